@@ -0,0 +1,314 @@
+#include <Engine/DynamicAABBTree.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace ToyEngine {
+	AABB AABB::transform(const glm::vec3& localMin, const glm::vec3& localMax, const glm::mat4& model)
+	{
+		glm::vec3 center = (localMin + localMax) * 0.5f;
+		glm::vec3 extent = (localMax - localMin) * 0.5f;
+
+		glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+		glm::vec3 worldExtent =
+			glm::abs(glm::vec3(model[0])) * extent.x +
+			glm::abs(glm::vec3(model[1])) * extent.y +
+			glm::abs(glm::vec3(model[2])) * extent.z;
+
+		return { worldCenter - worldExtent, worldCenter + worldExtent };
+	}
+
+	FrustumTestResult testFrustum(const Frustum& frustum, const AABB& box)
+	{
+		FrustumTestResult result = FrustumTestResult::Inside;
+		for (const auto& plane : frustum.planes) {
+			glm::vec3 normal = glm::vec3(plane);
+			// corner furthest along the normal, and the one furthest against it
+			glm::vec3 positive = glm::mix(box.min, box.max, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+			glm::vec3 negative = glm::mix(box.max, box.min, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+			if (glm::dot(normal, positive) + plane.w < 0.0f) {
+				return FrustumTestResult::Outside;
+			}
+			if (glm::dot(normal, negative) + plane.w < 0.0f) {
+				result = FrustumTestResult::Intersects;
+			}
+		}
+		return result;
+	}
+
+	float intersectRay(const AABB& box, const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance)
+	{
+		// slab test
+		glm::vec3 t1 = (box.min - origin) * invDirection;
+		glm::vec3 t2 = (box.max - origin) * invDirection;
+		glm::vec3 tNear = glm::min(t1, t2);
+		glm::vec3 tFar = glm::max(t1, t2);
+		float entry = std::max({ tNear.x, tNear.y, tNear.z, 0.0f });
+		float exit = std::min({ tFar.x, tFar.y, tFar.z, maxDistance });
+		return entry <= exit ? entry : -1.0f;
+	}
+
+	int32_t DynamicAABBTree::allocateNode()
+	{
+		if (mFreeList == NULL_NODE) {
+			mNodes.emplace_back();
+			return static_cast<int32_t>(mNodes.size() - 1);
+		}
+		int32_t nodeId = mFreeList;
+		mFreeList = mNodes[nodeId].parent;
+		mNodes[nodeId] = TreeNode();
+		return nodeId;
+	}
+
+	void DynamicAABBTree::freeNode(int32_t nodeId)
+	{
+		mNodes[nodeId].parent = mFreeList;
+		mNodes[nodeId].height = -1;
+		mFreeList = nodeId;
+	}
+
+	int32_t DynamicAABBTree::createProxy(const AABB& box, uint32_t userData)
+	{
+		int32_t proxyId = allocateNode();
+		TreeNode& node = mNodes[proxyId];
+		node.box = { box.min - glm::vec3(AABB_MARGIN), box.max + glm::vec3(AABB_MARGIN) };
+		node.userData = userData;
+		node.height = 0;
+
+		insertLeaf(proxyId);
+		mProxyCount++;
+		return proxyId;
+	}
+
+	void DynamicAABBTree::destroyProxy(int32_t proxyId)
+	{
+		assert(mNodes[proxyId].isLeaf());
+		removeLeaf(proxyId);
+		freeNode(proxyId);
+		mProxyCount--;
+	}
+
+	bool DynamicAABBTree::moveProxy(int32_t proxyId, const AABB& box)
+	{
+		TreeNode& node = mNodes[proxyId];
+		if (node.box.contains(box)) {
+			return false;
+		}
+
+		AABB fatBox = { box.min - glm::vec3(AABB_MARGIN), box.max + glm::vec3(AABB_MARGIN) };
+
+		// A teleport would stretch every ancestor across the scene. Reinsert instead of refitting.
+		if (!node.box.overlaps(box)) {
+			removeLeaf(proxyId);
+			mNodes[proxyId].box = fatBox;
+			insertLeaf(proxyId);
+			return true;
+		}
+
+		node.box = fatBox;
+		for (int32_t index = node.parent; index != NULL_NODE; index = mNodes[index].parent) {
+			TreeNode& parent = mNodes[index];
+			parent.box = AABB::merge(mNodes[parent.child1].box, mNodes[parent.child2].box);
+		}
+		return true;
+	}
+
+	int32_t DynamicAABBTree::findBestSibling(const AABB& box) const
+	{
+		// Branch and bound over the cost of the new parent plus the area growth of every ancestor.
+		const float boxArea = box.surfaceArea();
+
+		int32_t index = mRoot;
+		float area = mNodes[index].box.surfaceArea();
+		float directCost = AABB::merge(mNodes[index].box, box).surfaceArea();
+		float inheritedCost = 0.0f;
+
+		int32_t bestSibling = index;
+		float bestCost = directCost;
+
+		while (!mNodes[index].isLeaf()) {
+			const TreeNode& node = mNodes[index];
+
+			float cost = directCost + inheritedCost;
+			if (cost < bestCost) {
+				bestSibling = index;
+				bestCost = cost;
+			}
+			inheritedCost += directCost - area;
+
+			int32_t children[2] = { node.child1, node.child2 };
+			float lowerCost[2];
+			float childArea[2];
+			float childDirectCost[2];
+			for (int i = 0; i < 2; i++) {
+				const TreeNode& child = mNodes[children[i]];
+				childDirectCost[i] = AABB::merge(child.box, box).surfaceArea();
+				childArea[i] = child.box.surfaceArea();
+				if (child.isLeaf()) {
+					float childCost = childDirectCost[i] + inheritedCost;
+					if (childCost < bestCost) {
+						bestSibling = children[i];
+						bestCost = childCost;
+					}
+					lowerCost[i] = std::numeric_limits<float>::max();
+				}
+				else {
+					// lower bound of anything below this child
+					lowerCost[i] = inheritedCost + childDirectCost[i] + std::min(boxArea - childArea[i], 0.0f);
+				}
+			}
+
+			if (bestCost <= lowerCost[0] && bestCost <= lowerCost[1]) {
+				break;
+			}
+
+			int next = lowerCost[0] <= lowerCost[1] ? 0 : 1;
+			index = children[next];
+			area = childArea[next];
+			directCost = childDirectCost[next];
+		}
+		return bestSibling;
+	}
+
+	void DynamicAABBTree::insertLeaf(int32_t leaf)
+	{
+		if (mRoot == NULL_NODE) {
+			mRoot = leaf;
+			mNodes[leaf].parent = NULL_NODE;
+			return;
+		}
+
+		const AABB leafBox = mNodes[leaf].box;
+		int32_t sibling = findBestSibling(leafBox);
+
+		int32_t oldParent = mNodes[sibling].parent;
+		int32_t newParent = allocateNode();
+		mNodes[newParent].parent = oldParent;
+		mNodes[newParent].box = AABB::merge(leafBox, mNodes[sibling].box);
+		mNodes[newParent].height = mNodes[sibling].height + 1;
+		mNodes[newParent].child1 = sibling;
+		mNodes[newParent].child2 = leaf;
+		mNodes[sibling].parent = newParent;
+		mNodes[leaf].parent = newParent;
+
+		if (oldParent != NULL_NODE) {
+			if (mNodes[oldParent].child1 == sibling) {
+				mNodes[oldParent].child1 = newParent;
+			}
+			else {
+				mNodes[oldParent].child2 = newParent;
+			}
+		}
+		else {
+			mRoot = newParent;
+		}
+
+		refit(oldParent);
+	}
+
+	void DynamicAABBTree::removeLeaf(int32_t leaf)
+	{
+		if (leaf == mRoot) {
+			mRoot = NULL_NODE;
+			return;
+		}
+
+		int32_t parent = mNodes[leaf].parent;
+		int32_t grandParent = mNodes[parent].parent;
+		int32_t sibling = mNodes[parent].child1 == leaf ? mNodes[parent].child2 : mNodes[parent].child1;
+
+		if (grandParent != NULL_NODE) {
+			if (mNodes[grandParent].child1 == parent) {
+				mNodes[grandParent].child1 = sibling;
+			}
+			else {
+				mNodes[grandParent].child2 = sibling;
+			}
+			mNodes[sibling].parent = grandParent;
+			freeNode(parent);
+			refit(grandParent);
+		}
+		else {
+			mRoot = sibling;
+			mNodes[sibling].parent = NULL_NODE;
+			freeNode(parent);
+		}
+	}
+
+	void DynamicAABBTree::refit(int32_t nodeId)
+	{
+		int32_t index = nodeId;
+		while (index != NULL_NODE) {
+			index = balance(index);
+
+			TreeNode& node = mNodes[index];
+			node.height = 1 + std::max(mNodes[node.child1].height, mNodes[node.child2].height);
+			node.box = AABB::merge(mNodes[node.child1].box, mNodes[node.child2].box);
+
+			index = node.parent;
+		}
+	}
+
+	int32_t DynamicAABBTree::balance(int32_t iA)
+	{
+		if (mNodes[iA].isLeaf() || mNodes[iA].height < 2) {
+			return iA;
+		}
+
+		int32_t iB = mNodes[iA].child1;
+		int32_t iC = mNodes[iA].child2;
+		int32_t balanceFactor = mNodes[iC].height - mNodes[iB].height;
+
+		// Rotate the taller child up. Which of its children moves down to A depends on their heights.
+		auto rotateUp = [this, iA](int32_t iUp, int32_t iOther, bool upIsChild2) {
+			TreeNode& A = mNodes[iA];
+			TreeNode& up = mNodes[iUp];
+			int32_t iF = up.child1;
+			int32_t iG = up.child2;
+
+			up.child1 = iA;
+			up.parent = A.parent;
+			A.parent = iUp;
+
+			if (up.parent != NULL_NODE) {
+				if (mNodes[up.parent].child1 == iA) {
+					mNodes[up.parent].child1 = iUp;
+				}
+				else {
+					mNodes[up.parent].child2 = iUp;
+				}
+			}
+			else {
+				mRoot = iUp;
+			}
+
+			// the taller grandchild stays with the rotated node, the shorter one moves to A
+			int32_t iKeep = mNodes[iF].height > mNodes[iG].height ? iF : iG;
+			int32_t iMove = iKeep == iF ? iG : iF;
+			up.child2 = iKeep;
+			if (upIsChild2) {
+				A.child2 = iMove;
+			}
+			else {
+				A.child1 = iMove;
+			}
+			mNodes[iMove].parent = iA;
+
+			A.box = AABB::merge(mNodes[iOther].box, mNodes[iMove].box);
+			A.height = 1 + std::max(mNodes[iOther].height, mNodes[iMove].height);
+			up.box = AABB::merge(A.box, mNodes[iKeep].box);
+			up.height = 1 + std::max(A.height, mNodes[iKeep].height);
+		};
+
+		if (balanceFactor > 1) {
+			rotateUp(iC, iB, true);
+			return iC;
+		}
+		if (balanceFactor < -1) {
+			rotateUp(iB, iC, false);
+			return iB;
+		}
+		return iA;
+	}
+}
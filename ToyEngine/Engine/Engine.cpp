@@ -4,6 +4,10 @@
 #include <memory>
 #include <imgui_impl_opengl3.h>
 #include "Engine/Scene.h"
+#include "Utils/AssetPacker.h"
+#include "Utils/JobSystem.h"
+#include "Renderer/GpuTransferQueue.h"
+#include "Utils/VirtualFileSystem.h"
 
 extern std::shared_ptr<ToyEngine::MyEngine> engine_globalPtr;
 
@@ -35,13 +39,27 @@ namespace ToyEngine{
         processInput(delta_time);
 
 		//Logic Tick
-        
+        // Work from the loader and other jobs that has to touch the GL context.
+        JobSystem::getInstance().processMainThreadJobs();
+        GpuTransferQueue::getInstance().beginFrame();
+
 		//Render Tick
 
         mActiveScene->update();
 	}
 
-	void MyEngine::init() {
+	void MyEngine::init(bool looseFiles) {
+        // A packed build reads its assets from the archive with a single open, loose files are the fallback
+        // during development. Packing from the UI leaves the new archive next to the mounted one.
+        AssetPacker::installPending(VirtualFileSystem::DEFAULT_ARCHIVE);
+#ifndef NDEBUG
+        looseFiles = true;
+#endif
+        // A release build with an archive only reads what was packed.
+        if (VirtualFileSystem::getInstance().mount(VirtualFileSystem::DEFAULT_ARCHIVE) && !looseFiles) {
+            VirtualFileSystem::getInstance().setLooseFilesEnabled(false);
+        }
+
         // Must register callback first then init imgui.
         // See onenote for details
 
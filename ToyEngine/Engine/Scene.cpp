@@ -9,22 +9,40 @@
 namespace ToyEngine {
     void Scene::update()
     {
+        // Models finished on the workers go up first, so that their transforms get updated this frame.
+        RenderSystem::instance.getModelLoader().update(mRegistry);
+        mTransformSystem.update(mRegistry, [this](entt::entity entity) {
+            onWorldTransformChanged(entity);
+        });
         processRendering();
     }
 
     void Scene::processRendering()
     {
-        auto view = mRegistry.view<MeshComponent, TransformComponent, MaterialComponent>();
-
         RenderSystem::instance.preDraw();
 
         RenderSystem::instance.drawGridLine();
         RenderSystem::instance.drawCoordinateIndicator({ 0,0,0 });
 
-        for (auto entity : view) {
-            // reference?
-            auto [mesh, transform, texture] = mRegistry.get<MeshComponent, TransformComponent, MaterialComponent>(entity);
-            RenderSystem::instance.drawMesh(transform, mesh, texture);
+        if (RenderSystem::instance.isGpuCullingEnabled()) {
+            // The meshes are already on the GPU, nothing is walked on the CPU.
+            RenderSystem::instance.setBroadphaseCulledCount(0);
+            RenderSystem::instance.drawResidentMeshes();
+        }
+        else {
+            // Only meshes whose bounds reach into the frustum are submitted. Whole subtrees outside it are skipped.
+            size_t submitted = 0;
+            mSpatialIndex.query(RenderSystem::instance.getViewFrustum(), [&](uint32_t userData) {
+                entt::entity entity = static_cast<entt::entity>(userData);
+                if (!mRegistry.all_of<MeshComponent, TransformComponent, MaterialComponent>(entity)) {
+                    return;
+                }
+                auto [mesh, transform, material] = mRegistry.get<MeshComponent, TransformComponent, MaterialComponent>(entity);
+                RenderSystem::instance.submitMesh(transform, mesh, material, mRegistry.try_get<BoundsComponent>(entity));
+                submitted++;
+            });
+            RenderSystem::instance.setBroadphaseCulledCount(mSpatialMeshCount > submitted ? mSpatialMeshCount - submitted : 0);
+            RenderSystem::instance.drawRenderQueue();
         }
 
         RenderSystem::instance.drawPointLight();
@@ -38,8 +56,158 @@ namespace ToyEngine {
 
     void Scene::init()
     {
+        mTransformSystem.init(mRegistry);
+
         mRootEntity = mRegistry.create();
         auto transform = mRegistry.emplace<TransformComponent>(mRootEntity);
+
+        // Lights get their transform after the light component, so both have to be watched.
+        mRegistry.on_construct<MeshComponent>().connect<&Scene::onSpatialComponentConstruct>(*this);
+        mRegistry.on_construct<LightComponent>().connect<&Scene::onSpatialComponentConstruct>(*this);
+        mRegistry.on_construct<TransformComponent>().connect<&Scene::onSpatialComponentConstruct>(*this);
+        mRegistry.on_destroy<MeshComponent>().connect<&Scene::onSpatialComponentDestroy>(*this);
+        mRegistry.on_destroy<LightComponent>().connect<&Scene::onSpatialComponentDestroy>(*this);
+        mRegistry.on_destroy<TransformComponent>().connect<&Scene::onSpatialComponentDestroy>(*this);
+
+        // Materials are emplaced before the mesh at import, but any order works.
+        mRegistry.on_construct<MeshComponent>().connect<&Scene::onResidentMeshConstruct>(*this);
+        mRegistry.on_construct<MaterialComponent>().connect<&Scene::onResidentMeshConstruct>(*this);
+        mRegistry.on_construct<TransformComponent>().connect<&Scene::onResidentMeshConstruct>(*this);
+        mRegistry.on_destroy<MeshComponent>().connect<&Scene::onResidentMeshDestroy>(*this);
+        mRegistry.on_destroy<MaterialComponent>().connect<&Scene::onResidentMeshDestroy>(*this);
+        mRegistry.on_destroy<TransformComponent>().connect<&Scene::onResidentMeshDestroy>(*this);
+        mRegistry.on_update<MeshComponent>().connect<&Scene::onResidentMeshUpdate>(*this);
+        mRegistry.on_update<MaterialComponent>().connect<&Scene::onResidentMeshUpdate>(*this);
+    }
+
+    void Scene::onSpatialComponentConstruct(entt::registry& registry, entt::entity entity)
+    {
+        if (mSpatialProxies.count(entity) || !registry.all_of<TransformComponent>(entity)
+            || !registry.any_of<MeshComponent, LightComponent>(entity)) {
+            return;
+        }
+        // directional lights have no position
+        if (auto* light = registry.try_get<LightComponent>(entity); light && light->type == "directional") {
+            return;
+        }
+
+        mSpatialProxies[entity] = mSpatialIndex.createProxy(computeWorldBounds(entity), static_cast<uint32_t>(entity));
+        if (registry.all_of<MeshComponent>(entity)) {
+            mSpatialMeshCount++;
+        }
+    }
+
+    void Scene::onSpatialComponentDestroy(entt::registry& registry, entt::entity entity)
+    {
+        auto iter = mSpatialProxies.find(entity);
+        if (iter == mSpatialProxies.end()) {
+            return;
+        }
+        // The component being destroyed is still attached while the signal runs.
+        if (registry.all_of<MeshComponent>(entity)) {
+            mSpatialMeshCount--;
+        }
+        mSpatialIndex.destroyProxy(iter->second);
+        mSpatialProxies.erase(iter);
+    }
+
+    void Scene::onResidentMeshConstruct(entt::registry& registry, entt::entity entity)
+    {
+        if (mResidentMeshes.count(entity) || !registry.all_of<MeshComponent, TransformComponent, MaterialComponent>(entity)) {
+            return;
+        }
+        auto [mesh, transform, material] = registry.get<MeshComponent, TransformComponent, MaterialComponent>(entity);
+        mResidentMeshes[entity] = RenderSystem::instance.addResidentMesh(transform, mesh, material, getLocalBounds(entity));
+    }
+
+    void Scene::onResidentMeshDestroy(entt::registry& registry, entt::entity entity)
+    {
+        auto iter = mResidentMeshes.find(entity);
+        if (iter == mResidentMeshes.end()) {
+            return;
+        }
+        RenderSystem::instance.removeResidentMesh(iter->second);
+        mResidentMeshes.erase(iter);
+    }
+
+    void Scene::onResidentMeshUpdate(entt::registry& registry, entt::entity entity)
+    {
+        // A new shader, geometry or material can move the mesh to another batch, so it is added again.
+        onResidentMeshDestroy(registry, entity);
+        onResidentMeshConstruct(registry, entity);
+    }
+
+    void Scene::onWorldTransformChanged(entt::entity entity)
+    {
+        auto iter = mSpatialProxies.find(entity);
+        if (iter != mSpatialProxies.end()) {
+            mSpatialIndex.moveProxy(iter->second, computeWorldBounds(entity));
+        }
+
+        auto resident = mResidentMeshes.find(entity);
+        if (resident != mResidentMeshes.end()) {
+            RenderSystem::instance.updateResidentMesh(resident->second, mRegistry.get<TransformComponent>(entity));
+        }
+
+        // Also when only a parent moved.
+        if (mRegistry.all_of<LightComponent>(entity)) {
+            RenderSystem::instance.markLightsDirty();
+        }
+    }
+
+    AABB Scene::computeWorldBounds(entt::entity entity) const
+    {
+        const auto& transform = mRegistry.get<TransformComponent>(entity);
+
+        if (mRegistry.all_of<MeshComponent>(entity)) {
+            const BoundsComponent& localBounds = getLocalBounds(entity);
+            return AABB::transform(localBounds.min, localBounds.max, transform.getWorldMatrix());
+        }
+
+        // lights are drawn as a 0.2 cube around their position
+        glm::vec3 position = transform.getWorldPos();
+        return { position - glm::vec3(0.1f), position + glm::vec3(0.1f) };
+    }
+
+    const BoundsComponent& Scene::getLocalBounds(entt::entity entity) const
+    {
+        const auto* bounds = mRegistry.try_get<BoundsComponent>(entity);
+        return bounds ? *bounds : mRegistry.get<MeshComponent>(entity).geometry->bounds;
+    }
+
+    std::vector<entt::entity> Scene::queryRange(const AABB& box) const
+    {
+        std::vector<entt::entity> result;
+        mSpatialIndex.query(box, [&](uint32_t userData) {
+            entt::entity entity = static_cast<entt::entity>(userData);
+            // the tree stores enlarged boxes, so check the exact ones
+            if (computeWorldBounds(entity).overlaps(box)) {
+                result.push_back(entity);
+            }
+        });
+        return result;
+    }
+
+    entt::entity Scene::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* hitDistance) const
+    {
+        entt::entity closest = entt::null;
+        float closestDistance = maxDistance;
+        const glm::vec3 invDirection = 1.0f / direction;
+
+        mSpatialIndex.rayCast(origin, direction, maxDistance, [&](uint32_t userData, float) {
+            entt::entity entity = static_cast<entt::entity>(userData);
+            float distance = intersectRay(computeWorldBounds(entity), origin, invDirection, closestDistance);
+            if (distance >= 0.0f && (closest == entt::null || distance < closestDistance)) {
+                closest = entity;
+                closestDistance = distance;
+            }
+            return closestDistance;
+        });
+
+        if (hitDistance && closest != entt::null) {
+            *hitDistance = closestDistance;
+        }
+        return closest;
     }
 
     std::tuple<std::vector<entt::entity>, std::vector<entt::entity>, std::vector<entt::entity>> Scene::getLightEntities() {
@@ -81,7 +249,7 @@ namespace ToyEngine {
     void Scene::addPointLight(glm::vec3 pos, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, float constant, float linear, float quadratic) {
         auto entity = mRegistry.create();
         mRegistry.emplace<LightComponent>(entity, "point", ambient, diffuse, specular, constant, linear, quadratic);
-        mRegistry.emplace<TransformComponent>(entity, pos, glm::vec3{.0f,.0f,.0f}, glm::vec3{ .0f,.0f,.0f });
+        mRegistry.emplace<TransformComponent>(entity, pos, glm::vec3{.0f,.0f,.0f}, glm::vec3{ 1.0f,1.0f,1.0f });
         mRegistry.emplace<TagComponent>(entity, "pointLight");
         mRegistry.emplace<RelationComponent>(entity);
     }
@@ -90,8 +258,13 @@ namespace ToyEngine {
     {
         auto entity = mRegistry.create();
         mRegistry.emplace<LightComponent>(entity, "directional", ambient, diffuse, specular, constant, linear, quadratic);
-        // Use rotation to imply light direction.
-        mRegistry.emplace<TransformComponent>(entity, glm::vec3{.0f, .0f, .0f}, direction, glm::vec3{ .0f,.0f,.0f });
+        // Lights shine along their local z axis. Rotating it about y and then x turns it into the direction.
+        glm::vec3 rotation{ .0f, .0f, .0f };
+        if (glm::length(direction) > 0.0f) {
+            const glm::vec3 axis = glm::normalize(direction);
+            rotation = glm::vec3(glm::degrees(std::atan2(-axis.y, axis.z)), glm::degrees(std::asin(axis.x)), 0.0f);
+        }
+        mRegistry.emplace<TransformComponent>(entity, glm::vec3{.0f, .0f, .0f}, rotation, glm::vec3{ 1.0f,1.0f,1.0f });
         mRegistry.emplace<TagComponent>(entity, "directional light");
         mRegistry.emplace<RelationComponent>(entity);
     }
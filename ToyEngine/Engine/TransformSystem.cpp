@@ -0,0 +1,306 @@
+#include <Engine/TransformSystem.h>
+#include <Utils/CpuFeatures.h>
+#include <Utils/JobSystem.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <utility>
+
+namespace ToyEngine {
+	namespace {
+		// out = a * b, column major
+		void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#if TOY_X86_SIMD
+			const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+			const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+			const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+			const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+			for (int column = 0; column < 4; column++) {
+				__m128 result = _mm_mul_ps(a0, _mm_set1_ps(b[column][0]));
+				result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(b[column][1])));
+				result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(b[column][2])));
+				result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(b[column][3])));
+				_mm_storeu_ps(&out[column][0], result);
+			}
+#else
+			out = a * b;
+#endif
+		}
+
+		// mChanged values. Zero is unchanged.
+		constexpr uint8_t LOCAL_CHANGED = 1;
+		constexpr uint8_t WORLD_CHANGED = 2;
+
+		entt::entity getParent(const entt::registry& registry, entt::entity entity) {
+			const auto* relation = registry.try_get<RelationComponent>(entity);
+			// A parent without a transform does not move its children.
+			if (relation && relation->parent != entt::null && registry.valid(relation->parent)
+				&& registry.all_of<TransformComponent>(relation->parent)) {
+				return relation->parent;
+			}
+			return entt::null;
+		}
+	}
+
+	void TransformSystem::init(entt::registry& registry)
+	{
+		registry.on_construct<TransformComponent>().connect<&TransformSystem::onTopologyChanged>(*this);
+		registry.on_destroy<TransformComponent>().connect<&TransformSystem::onTopologyChanged>(*this);
+		registry.on_update<TransformComponent>().connect<&TransformSystem::onTransformChanged>(*this);
+		registry.on_construct<RelationComponent>().connect<&TransformSystem::onTopologyChanged>(*this);
+		registry.on_update<RelationComponent>().connect<&TransformSystem::onTopologyChanged>(*this);
+		registry.on_destroy<RelationComponent>().connect<&TransformSystem::onTopologyChanged>(*this);
+	}
+
+	void TransformSystem::onTransformChanged(entt::registry& registry, entt::entity entity)
+	{
+		// Patches that assign the members directly do not go through the setters.
+		registry.get<TransformComponent>(entity).markDirty();
+	}
+
+	void TransformSystem::onTopologyChanged(entt::registry& registry, entt::entity entity)
+	{
+		mTopologyDirty = true;
+	}
+
+	template<typename Function>
+	void TransformSystem::forEachSlotRange(size_t begin, size_t end, Function&& function)
+	{
+		if (end - begin <= SLOTS_PER_TASK) {
+			function(begin, end);
+			return;
+		}
+		JobSystem::getInstance().parallelFor("Transform slots", end - begin, SLOTS_PER_TASK, [&function, begin](size_t first, size_t last) {
+			function(begin + first, begin + last);
+		});
+	}
+
+	void TransformSystem::rebuild(entt::registry& registry)
+	{
+		auto view = registry.view<TransformComponent>();
+		std::vector<entt::entity> entities(view.begin(), view.end());
+		const size_t count = entities.size();
+
+		// Depths are memoized, so every parent chain is only walked once.
+		std::unordered_map<entt::entity, uint32_t> depths;
+		depths.reserve(count);
+		std::vector<entt::entity> chain;
+		uint32_t maxDepth = 0;
+		for (entt::entity entity : entities) {
+			entt::entity current = entity;
+			while (current != entt::null && depths.find(current) == depths.end()) {
+				chain.push_back(current);
+				current = getParent(registry, current);
+			}
+			uint32_t depth = current == entt::null ? 0 : depths[current] + 1;
+			for (auto iter = chain.rbegin(); iter != chain.rend(); ++iter) {
+				maxDepth = std::max(maxDepth, depth);
+				depths[*iter] = depth++;
+			}
+			chain.clear();
+		}
+
+		// Counting sort by depth.
+		mLevels.assign(count > 0 ? maxDepth + 2 : 1, 0);
+		for (entt::entity entity : entities) {
+			mLevels[depths[entity] + 1]++;
+		}
+		for (size_t level = 1; level < mLevels.size(); level++) {
+			mLevels[level] += mLevels[level - 1];
+		}
+		std::vector<size_t> cursors(mLevels.begin(), mLevels.end() - 1);
+		mEntities.resize(count);
+		for (entt::entity entity : entities) {
+			mEntities[cursors[depths[entity]]++] = entity;
+		}
+
+		// Within a level, order by parent so that siblings are next to each other. The parents are in
+		// the level before, so their slots are final by then.
+		mParents.assign(count, -1);
+		mComponents.resize(count);
+		mLocal.resize(count);
+		mWorld.resize(count);
+		mChildBegin.assign(count, 0);
+		mChildEnd.assign(count, 0);
+		std::vector<std::pair<int32_t, entt::entity>> levelEntries;
+		for (size_t level = 0; level + 1 < mLevels.size(); level++) {
+			levelEntries.clear();
+			for (size_t slot = mLevels[level]; slot < mLevels[level + 1]; slot++) {
+				entt::entity parent = getParent(registry, mEntities[slot]);
+				int32_t parentSlot = parent == entt::null ? -1 : static_cast<int32_t>(registry.get<TransformComponent>(parent).slot);
+				levelEntries.emplace_back(parentSlot, mEntities[slot]);
+			}
+			std::stable_sort(levelEntries.begin(), levelEntries.end(), [](const auto& a, const auto& b) {
+				return a.first < b.first;
+			});
+
+			uint32_t slot = static_cast<uint32_t>(mLevels[level]);
+			for (const auto& [parentSlot, entity] : levelEntries) {
+				mEntities[slot] = entity;
+				mParents[slot] = parentSlot;
+				if (parentSlot >= 0) {
+					if (mChildEnd[parentSlot] == 0) {
+						mChildBegin[parentSlot] = slot;
+					}
+					mChildEnd[parentSlot] = slot + 1;
+				}
+				TransformComponent& transform = registry.get<TransformComponent>(entity);
+				transform.slot = slot;
+				transform.dirty = true;
+				transform.queue = &mQueue;
+				transform.world = &mWorld[slot];
+				mComponents[slot] = &transform;
+				slot++;
+			}
+		}
+
+		mChanged.assign(count, 0);
+		forEachSlotRange(0, count, [this](size_t begin, size_t end) {
+			for (size_t slot = begin; slot < end; slot++) {
+				loadLocal(static_cast<uint32_t>(slot));
+			}
+		});
+		mTopologyDirty = false;
+	}
+
+	void TransformSystem::propagate(entt::registry& registry)
+	{
+		mChangedSlots.clear();
+		if (!mTopologyDirty && mQueue.empty()) {
+			mLastUpdateMilliseconds = 0.0f;
+			return;
+		}
+		auto start = std::chrono::steady_clock::now();
+
+		// The slots queued before a rebuild are stale, but it takes every transform anyway.
+		if (mTopologyDirty) {
+			rebuild(registry);
+			updateLevels();
+		}
+		else {
+			loadQueued();
+			if (mQueue.size() * SPARSE_UPDATE_RATIO >= mEntities.size() || !updateSubtrees()) {
+				mChangedSlots.clear();
+				updateLevels();
+			}
+			else {
+				for (uint32_t slot : mChangedSlots) {
+					mChanged[slot] = 0;
+				}
+			}
+		}
+		mQueue.clear();
+
+		mLastUpdateMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void TransformSystem::loadLocal(uint32_t slot)
+	{
+		TransformComponent& transform = *mComponents[slot];
+		mLocal[slot] = transform.getLocalMatrix();
+		transform.dirty = false;
+		mChanged[slot] = LOCAL_CHANGED;
+	}
+
+	void TransformSystem::loadQueued()
+	{
+		// A transform is only queued when it turns dirty, so every slot is in here once.
+		forEachSlotRange(0, mQueue.size(), [this](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				loadLocal(mQueue[i]);
+			}
+		});
+	}
+
+	void TransformSystem::computeWorld(uint32_t slot)
+	{
+		const int32_t parent = mParents[slot];
+		if (parent >= 0) {
+			multiply(mWorld[parent], mLocal[slot], mWorld[slot]);
+		}
+		else {
+			mWorld[slot] = mLocal[slot];
+		}
+	}
+
+	void TransformSystem::updateLevels()
+	{
+		// Loaded slots are marked changed, the levels pass that on to the children. Slots that updateSubtrees
+		// got to before it gave up are marked as well and just get computed again.
+		for (size_t level = 0; level + 1 < mLevels.size(); level++) {
+			forEachSlotRange(mLevels[level], mLevels[level + 1], [this](size_t begin, size_t end) {
+				for (size_t slot = begin; slot < end; slot++) {
+					const int32_t parent = mParents[slot];
+					if (mChanged[slot] || (parent >= 0 && mChanged[parent])) {
+						mChanged[slot] = WORLD_CHANGED;
+						computeWorld(static_cast<uint32_t>(slot));
+					}
+				}
+			});
+		}
+
+		// Count the changed slots per block, then every block writes its own part of the list and clears the
+		// marks it read.
+		const size_t count = mEntities.size();
+		const size_t blocks = (count + SLOTS_PER_TASK - 1) / SLOTS_PER_TASK;
+		auto forEachBlock = [count, blocks](auto&& function) {
+			JobSystem::getInstance().parallelFor("Transform changes", blocks, 1, [&function, count](size_t first, size_t last) {
+				for (size_t block = first; block < last; block++) {
+					function(block, block * SLOTS_PER_TASK, std::min(count, (block + 1) * SLOTS_PER_TASK));
+				}
+			});
+		};
+		mBlockOffsets.assign(blocks + 1, 0);
+		forEachBlock([this](size_t block, size_t begin, size_t end) {
+			size_t changed = 0;
+			for (size_t slot = begin; slot < end; slot++) {
+				changed += mChanged[slot] != 0;
+			}
+			mBlockOffsets[block + 1] = changed;
+		});
+		for (size_t block = 1; block <= blocks; block++) {
+			mBlockOffsets[block] += mBlockOffsets[block - 1];
+		}
+		mChangedSlots.resize(mBlockOffsets[blocks]);
+		forEachBlock([this](size_t block, size_t begin, size_t end) {
+			size_t next = mBlockOffsets[block];
+			for (size_t slot = begin; slot < end; slot++) {
+				if (mChanged[slot]) {
+					mChangedSlots[next++] = static_cast<uint32_t>(slot);
+					mChanged[slot] = 0;
+				}
+			}
+		});
+	}
+
+	bool TransformSystem::updateSubtrees()
+	{
+		mQueuedSlots.assign(mQueue.begin(), mQueue.end());
+		// Slots are in depth order, so ancestors come first and their subtrees cover queued descendants.
+		std::sort(mQueuedSlots.begin(), mQueuedSlots.end());
+
+		const size_t maxChanged = mEntities.size() / SPARSE_UPDATE_RATIO;
+		for (uint32_t root : mQueuedSlots) {
+			if (mChanged[root] == WORLD_CHANGED) {
+				continue;
+			}
+			mStack.push_back(root);
+			while (!mStack.empty()) {
+				uint32_t slot = mStack.back();
+				mStack.pop_back();
+
+				computeWorld(slot);
+				mChanged[slot] = WORLD_CHANGED;
+				mChangedSlots.push_back(slot);
+				for (uint32_t child = mChildBegin[slot]; child < mChildEnd[slot]; child++) {
+					mStack.push_back(child);
+				}
+				if (mChangedSlots.size() > maxChanged) {
+					mStack.clear();
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,139 @@
+#include <Renderer/FrustumCuller.h>
+#include <Utils/CpuFeatures.h>
+
+namespace ToyEngine {
+	Frustum Frustum::fromMatrix(const glm::mat4& m)
+	{
+		// glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+		auto row = [&m](int i) {
+			return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+		};
+
+		Frustum frustum;
+		frustum.planes[Left] = row(3) + row(0);
+		frustum.planes[Right] = row(3) - row(0);
+		frustum.planes[Bottom] = row(3) + row(1);
+		frustum.planes[Top] = row(3) - row(1);
+		frustum.planes[Near] = row(3) + row(2);
+		frustum.planes[Far] = row(3) - row(2);
+
+		// normalized so that the plane distance can be compared against a radius
+		for (auto& plane : frustum.planes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+		return frustum;
+	}
+
+	void FrustumCuller::clear()
+	{
+		mCenterX.clear();
+		mCenterY.clear();
+		mCenterZ.clear();
+		mRadius.clear();
+		mVisible.clear();
+	}
+
+	size_t FrustumCuller::add(const glm::vec3& center, float radius)
+	{
+		mCenterX.push_back(center.x);
+		mCenterY.push_back(center.y);
+		mCenterZ.push_back(center.z);
+		mRadius.push_back(radius);
+		return mCenterX.size() - 1;
+	}
+
+	void FrustumCuller::cull(const Frustum& frustum)
+	{
+		const size_t count = mCenterX.size();
+		mVisible.resize(count);
+
+		size_t done = 0;
+#if TOY_X86_SIMD
+		done = CpuFeatures::hasAVX2() ? cullAVX2(frustum) : cullSSE(frustum);
+#endif
+		cullScalar(frustum, done, count);
+
+		mCulledCount = 0;
+		for (uint8_t visible : mVisible) {
+			mCulledCount += visible ? 0 : 1;
+		}
+	}
+
+	void FrustumCuller::cullScalar(const Frustum& frustum, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++) {
+			bool inside = true;
+			for (const auto& plane : frustum.planes) {
+				float distance = plane.x * mCenterX[i] + plane.y * mCenterY[i] + plane.z * mCenterZ[i] + plane.w;
+				inside = inside && distance >= -mRadius[i];
+			}
+			mVisible[i] = inside ? 1 : 0;
+		}
+	}
+
+#if TOY_X86_SIMD
+	size_t FrustumCuller::cullSSE(const Frustum& frustum)
+	{
+		const size_t count = mCenterX.size() & ~size_t(3);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (size_t i = 0; i < count; i += 4) {
+			__m128 x = _mm_loadu_ps(&mCenterX[i]);
+			__m128 y = _mm_loadu_ps(&mCenterY[i]);
+			__m128 z = _mm_loadu_ps(&mCenterZ[i]);
+			__m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(&mRadius[i]));
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const auto& plane : frustum.planes) {
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z), _mm_set1_ps(plane.w)));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for (int lane = 0; lane < 4; lane++) {
+				mVisible[i + lane] = (mask >> lane) & 1;
+			}
+		}
+		return count;
+	}
+
+	TOY_TARGET_AVX2 size_t FrustumCuller::cullAVX2(const Frustum& frustum)
+	{
+		const size_t count = mCenterX.size() & ~size_t(7);
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (size_t i = 0; i < count; i += 8) {
+			__m256 x = _mm256_loadu_ps(&mCenterX[i]);
+			__m256 y = _mm256_loadu_ps(&mCenterY[i]);
+			__m256 z = _mm256_loadu_ps(&mCenterZ[i]);
+			__m256 negativeRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&mRadius[i]));
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const auto& plane : frustum.planes) {
+				__m256 distance = _mm256_fmadd_ps(_mm256_set1_ps(plane.x), x,
+					_mm256_fmadd_ps(_mm256_set1_ps(plane.y), y,
+						_mm256_fmadd_ps(_mm256_set1_ps(plane.z), z, _mm256_set1_ps(plane.w))));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+			}
+
+			int mask = _mm256_movemask_ps(inside);
+			for (int lane = 0; lane < 8; lane++) {
+				mVisible[i + lane] = (mask >> lane) & 1;
+			}
+		}
+		return count;
+	}
+#else
+	size_t FrustumCuller::cullSSE(const Frustum&)
+	{
+		return 0;
+	}
+
+	size_t FrustumCuller::cullAVX2(const Frustum&)
+	{
+		return 0;
+	}
+#endif
+}
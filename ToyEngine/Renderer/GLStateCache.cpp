@@ -0,0 +1,240 @@
+#include <Renderer/GLStateCache.h>
+
+namespace ToyEngine {
+	GLStateCache& GLStateCache::getInstance()
+	{
+		static GLStateCache instance;
+		return instance;
+	}
+
+	GLStateCache::GLStateCache()
+	{
+		invalidate();
+	}
+
+	GLStateCache::BufferSlot GLStateCache::getBufferSlot(GLenum target)
+	{
+		switch (target) {
+		case GL_ARRAY_BUFFER: return ARRAY_BUFFER_SLOT;
+		case GL_COPY_READ_BUFFER: return COPY_READ_BUFFER_SLOT;
+		case GL_COPY_WRITE_BUFFER: return COPY_WRITE_BUFFER_SLOT;
+		case GL_DRAW_INDIRECT_BUFFER: return DRAW_INDIRECT_BUFFER_SLOT;
+		case GL_UNIFORM_BUFFER: return UNIFORM_BUFFER_SLOT;
+		case GL_SHADER_STORAGE_BUFFER: return SHADER_STORAGE_BUFFER_SLOT;
+		case GL_PIXEL_PACK_BUFFER: return PIXEL_PACK_BUFFER_SLOT;
+		case GL_PIXEL_UNPACK_BUFFER: return PIXEL_UNPACK_BUFFER_SLOT;
+		case GL_TEXTURE_BUFFER: return TEXTURE_BUFFER_BUFFER_SLOT;
+		default: return UNTRACKED_BUFFER_SLOT;
+		}
+	}
+
+	GLStateCache::TextureSlot GLStateCache::getTextureSlot(GLenum target)
+	{
+		switch (target) {
+		case GL_TEXTURE_2D: return TEXTURE_2D_SLOT;
+		case GL_TEXTURE_2D_ARRAY: return TEXTURE_2D_ARRAY_SLOT;
+		case GL_TEXTURE_CUBE_MAP: return TEXTURE_CUBE_MAP_SLOT;
+		case GL_TEXTURE_BUFFER: return TEXTURE_BUFFER_SLOT;
+		default: return UNTRACKED_TEXTURE_SLOT;
+		}
+	}
+
+	bool GLStateCache::changes(GLuint& shadow, GLuint value)
+	{
+		if (shadow == value) {
+			mCounters.elided++;
+			return false;
+		}
+		shadow = value;
+		mCounters.issued++;
+		return true;
+	}
+
+	void GLStateCache::useProgram(GLuint program)
+	{
+		if (changes(mProgram, program)) {
+			glUseProgram(program);
+		}
+	}
+
+	bool GLStateCache::bindVertexArray(GLuint vertexArray)
+	{
+		if (changes(mVertexArray, vertexArray)) {
+			glBindVertexArray(vertexArray);
+			return true;
+		}
+		return false;
+	}
+
+	void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+	{
+		BufferSlot slot = getBufferSlot(target);
+		if (slot == UNTRACKED_BUFFER_SLOT) {
+			mCounters.issued++;
+			glBindBuffer(target, buffer);
+		}
+		else if (changes(mBuffers[slot], buffer)) {
+			glBindBuffer(target, buffer);
+		}
+	}
+
+	void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+	{
+		// Indexed bindings are not shadowed, the call is always needed.
+		mCounters.issued++;
+		glBindBufferBase(target, index, buffer);
+		BufferSlot slot = getBufferSlot(target);
+		if (slot != UNTRACKED_BUFFER_SLOT) {
+			mBuffers[slot] = buffer;
+		}
+	}
+
+	void GLStateCache::activateUnit(GLuint unit)
+	{
+		if (mActiveUnit != unit) {
+			mActiveUnit = unit;
+			mCounters.issued++;
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+	}
+
+	void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+	{
+		TextureSlot slot = getTextureSlot(target);
+		if (unit >= MAX_TEXTURE_UNITS || slot == UNTRACKED_TEXTURE_SLOT) {
+			activateUnit(unit);
+			mCounters.issued++;
+			glBindTexture(target, texture);
+		}
+		else if (mTextures[unit][slot] != texture) {
+			activateUnit(unit);
+			changes(mTextures[unit][slot], texture);
+			glBindTexture(target, texture);
+		}
+		else {
+			mCounters.elided++;
+		}
+	}
+
+	void GLStateCache::setCapability(GLenum capability, GLuint& shadow, bool enabled)
+	{
+		if (changes(shadow, enabled ? GL_TRUE : GL_FALSE)) {
+			if (enabled) {
+				glEnable(capability);
+			}
+			else {
+				glDisable(capability);
+			}
+		}
+	}
+
+	void GLStateCache::setDepthTest(bool enabled)
+	{
+		setCapability(GL_DEPTH_TEST, mDepthTest, enabled);
+	}
+
+	void GLStateCache::setDepthFunc(GLenum func)
+	{
+		if (changes(mDepthFunc, func)) {
+			glDepthFunc(func);
+		}
+	}
+
+	void GLStateCache::setDepthMask(bool enabled)
+	{
+		if (changes(mDepthMask, enabled ? GL_TRUE : GL_FALSE)) {
+			glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+		}
+	}
+
+	void GLStateCache::setBlend(bool enabled)
+	{
+		setCapability(GL_BLEND, mBlend, enabled);
+	}
+
+	void GLStateCache::setBlendFunc(GLenum source, GLenum destination)
+	{
+		if (mBlendSource == source && mBlendDestination == destination) {
+			mCounters.elided++;
+			return;
+		}
+		mBlendSource = source;
+		mBlendDestination = destination;
+		mCounters.issued++;
+		glBlendFunc(source, destination);
+	}
+
+	void GLStateCache::deleteBuffer(GLuint buffer)
+	{
+		if (buffer == 0) {
+			return;
+		}
+		glDeleteBuffers(1, &buffer);
+		for (GLuint& bound : mBuffers) {
+			if (bound == buffer) {
+				bound = 0;
+			}
+		}
+	}
+
+	void GLStateCache::deleteVertexArray(GLuint vertexArray)
+	{
+		if (vertexArray == 0) {
+			return;
+		}
+		glDeleteVertexArrays(1, &vertexArray);
+		if (mVertexArray == vertexArray) {
+			mVertexArray = 0;
+		}
+	}
+
+	void GLStateCache::deleteTexture(GLuint texture)
+	{
+		if (texture == 0) {
+			return;
+		}
+		glDeleteTextures(1, &texture);
+		for (auto& unit : mTextures) {
+			for (GLuint& bound : unit) {
+				if (bound == texture) {
+					bound = 0;
+				}
+			}
+		}
+	}
+
+	void GLStateCache::deleteProgram(GLuint program)
+	{
+		if (program == 0) {
+			return;
+		}
+		glDeleteProgram(program);
+		// A program in use is only flagged for deletion, force the next useProgram through.
+		if (mProgram == program) {
+			mProgram = UNKNOWN;
+		}
+	}
+
+	void GLStateCache::invalidate()
+	{
+		mProgram = UNKNOWN;
+		mVertexArray = UNKNOWN;
+		mBuffers.fill(UNKNOWN);
+		mActiveUnit = UNKNOWN;
+		for (auto& unit : mTextures) {
+			unit.fill(UNKNOWN);
+		}
+		mDepthTest = UNKNOWN;
+		mDepthFunc = UNKNOWN;
+		mDepthMask = UNKNOWN;
+		mBlend = UNKNOWN;
+		mBlendSource = UNKNOWN;
+		mBlendDestination = UNKNOWN;
+	}
+
+	void GLStateCache::beginFrame()
+	{
+		mLastFrameCounters = mCounters;
+		mCounters = Counters();
+	}
+}
@@ -0,0 +1,291 @@
+#include <Renderer/GeometryPool.h>
+#include <Renderer/GLStateCache.h>
+#include <Renderer/InstanceBuffer.h>
+#include <Utils/Logger.h>
+#include <algorithm>
+#include <cstddef>
+
+namespace ToyEngine {
+	namespace {
+		// 64K vertices is 1.3 MB in the quantized layouts. Both buffers double when they run out.
+		constexpr size_t INITIAL_VERTEX_CAPACITY = 64 * 1024;
+		constexpr size_t INITIAL_INDEX_CAPACITY = 256 * 1024;
+
+		// Shared by all pools, since draws from different pools end up in the same render queue.
+		uint32_t nextGeometryId = 1;
+	}
+
+	size_t RangeAllocator::allocate(size_t size)
+	{
+		for (auto iter = mFreeBlocks.begin(); iter != mFreeBlocks.end(); ++iter) {
+			if (iter->second < size) {
+				continue;
+			}
+			size_t offset = iter->first;
+			size_t remaining = iter->second - size;
+			mFreeBlocks.erase(iter);
+			if (remaining > 0) {
+				mFreeBlocks.emplace(offset + size, remaining);
+			}
+			return offset;
+		}
+		return INVALID_OFFSET;
+	}
+
+	void RangeAllocator::release(size_t offset, size_t size)
+	{
+		auto next = mFreeBlocks.lower_bound(offset);
+
+		// merge with the following block
+		if (next != mFreeBlocks.end() && offset + size == next->first) {
+			size += next->second;
+			next = mFreeBlocks.erase(next);
+		}
+
+		// merge with the preceding block
+		if (next != mFreeBlocks.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset) {
+				prev->second += size;
+				return;
+			}
+		}
+		mFreeBlocks.emplace(offset, size);
+	}
+
+	void RangeAllocator::grow(size_t newCapacity)
+	{
+		if (newCapacity <= mCapacity) {
+			return;
+		}
+		size_t oldCapacity = mCapacity;
+		mCapacity = newCapacity;
+		release(oldCapacity, newCapacity - oldCapacity);
+	}
+
+	GeometryPool::GeometryPool(const VertexLayout& layout, GLenum indexType) :
+		mLayout(layout), mIndexType(indexType)
+	{
+	}
+
+	std::map<std::pair<const VertexLayout*, GLenum>, std::unique_ptr<GeometryPool>>& GeometryPool::getPools()
+	{
+		static std::map<std::pair<const VertexLayout*, GLenum>, std::unique_ptr<GeometryPool>> pools;
+		return pools;
+	}
+
+	GeometryPool& GeometryPool::getInstance(const VertexLayout& layout, GLenum indexType)
+	{
+		auto& pool = getPools()[{ &layout, indexType }];
+		if (!pool) {
+			pool.reset(new GeometryPool(layout, indexType));
+		}
+		return *pool;
+	}
+
+	size_t GeometryPool::getTotalAllocatedBytes()
+	{
+		size_t bytes = 0;
+		for (const auto& [key, pool] : getPools()) {
+			bytes += pool->getAllocatedBytes();
+		}
+		return bytes;
+	}
+
+	void GeometryPool::init()
+	{
+		if (mVAOIndex != 0) {
+			return;
+		}
+
+		glGenVertexArrays(1, &mVAOIndex);
+		growBuffer(mVBOIndex, mVertexRanges, mLayout.getStride(), INITIAL_VERTEX_CAPACITY);
+		growBuffer(mEBOIndex, mIndexRanges, getIndexSize(mIndexType), INITIAL_INDEX_CAPACITY);
+		setupVertexAttributes();
+	}
+
+	GeometryRange GeometryPool::allocate(const std::vector<uint8_t>& vertexData, const std::vector<unsigned int>& indices)
+	{
+		GeometryRange range;
+		const size_t stride = mLayout.getStride();
+		const size_t vertexCount = vertexData.size() / stride;
+		if (vertexCount == 0 || indices.empty()) {
+			return range;
+		}
+
+		init();
+
+		const size_t vertexOffset = allocateVertexRange(vertexCount);
+		GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, mVBOIndex);
+		glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * stride, vertexCount * stride, vertexData.data());
+		GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, 0);
+
+		range.baseVertex = static_cast<GLint>(vertexOffset);
+		range.vertexCount = static_cast<GLsizei>(vertexCount);
+		range.firstIndex = static_cast<GLuint>(uploadIndices(indices));
+		range.indexCount = static_cast<GLsizei>(indices.size());
+		range.id = nextGeometryId++;
+		return range;
+	}
+
+	GeometryRange GeometryPool::allocateIndices(const GeometryRange& base, const std::vector<unsigned int>& indices)
+	{
+		GeometryRange range;
+		if (!base.isValid() || indices.empty()) {
+			return range;
+		}
+
+		range.baseVertex = base.baseVertex;
+		range.vertexCount = base.vertexCount;
+		range.firstIndex = static_cast<GLuint>(uploadIndices(indices));
+		range.indexCount = static_cast<GLsizei>(indices.size());
+		range.id = nextGeometryId++;
+		return range;
+	}
+
+	GeometryRange GeometryPool::allocateFrom(GLuint source, size_t vertexOffset, size_t vertexCount, size_t indexOffset, size_t indexCount)
+	{
+		GeometryRange range;
+		if (source == 0 || vertexCount == 0 || indexCount == 0) {
+			return range;
+		}
+
+		init();
+
+		const size_t stride = mLayout.getStride();
+		const size_t baseVertex = allocateVertexRange(vertexCount);
+		GLStateCache& state = GLStateCache::getInstance();
+		state.bindBuffer(GL_COPY_READ_BUFFER, source);
+		state.bindBuffer(GL_COPY_WRITE_BUFFER, mVBOIndex);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, vertexOffset, baseVertex * stride, vertexCount * stride);
+		state.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		state.bindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		range.baseVertex = static_cast<GLint>(baseVertex);
+		range.vertexCount = static_cast<GLsizei>(vertexCount);
+		range = allocateIndicesFrom(range, source, indexOffset, indexCount);
+		return range;
+	}
+
+	GeometryRange GeometryPool::allocateIndicesFrom(const GeometryRange& base, GLuint source, size_t indexOffset, size_t indexCount)
+	{
+		GeometryRange range;
+		if (source == 0 || base.vertexCount == 0 || indexCount == 0) {
+			return range;
+		}
+
+		const size_t indexSize = getIndexSize(mIndexType);
+		const size_t firstIndex = allocateIndexRange(indexCount);
+		// The generic copy targets leave the element buffer binding of the VAO alone.
+		GLStateCache& state = GLStateCache::getInstance();
+		state.bindBuffer(GL_COPY_READ_BUFFER, source);
+		state.bindBuffer(GL_COPY_WRITE_BUFFER, mEBOIndex);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, indexOffset, firstIndex * indexSize, indexCount * indexSize);
+		state.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		state.bindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		range.baseVertex = base.baseVertex;
+		range.vertexCount = base.vertexCount;
+		range.firstIndex = static_cast<GLuint>(firstIndex);
+		range.indexCount = static_cast<GLsizei>(indexCount);
+		range.id = nextGeometryId++;
+		return range;
+	}
+
+	size_t GeometryPool::allocateVertexRange(size_t vertexCount)
+	{
+		size_t vertexOffset = mVertexRanges.allocate(vertexCount);
+		if (vertexOffset == RangeAllocator::INVALID_OFFSET) {
+			growBuffer(mVBOIndex, mVertexRanges, mLayout.getStride(), mVertexRanges.getCapacity() + vertexCount);
+			setupVertexAttributes();
+			vertexOffset = mVertexRanges.allocate(vertexCount);
+		}
+		return vertexOffset;
+	}
+
+	size_t GeometryPool::allocateIndexRange(size_t indexCount)
+	{
+		size_t indexOffset = mIndexRanges.allocate(indexCount);
+		if (indexOffset == RangeAllocator::INVALID_OFFSET) {
+			growBuffer(mEBOIndex, mIndexRanges, getIndexSize(mIndexType), mIndexRanges.getCapacity() + indexCount);
+			setupVertexAttributes();
+			indexOffset = mIndexRanges.allocate(indexCount);
+		}
+		return indexOffset;
+	}
+
+	size_t GeometryPool::uploadIndices(const std::vector<unsigned int>& indices)
+	{
+		const size_t indexSize = getIndexSize(mIndexType);
+		const size_t indexOffset = allocateIndexRange(indices.size());
+
+		// The element buffer binding is VAO state, so go through the pool's VAO instead of unbinding it from another one.
+		GLStateCache::getInstance().bindVertexArray(mVAOIndex);
+		if (mIndexType == GL_UNSIGNED_SHORT) {
+			std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset * indexSize, shortIndices.size() * indexSize, shortIndices.data());
+		}
+		else {
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset * indexSize, indices.size() * indexSize, indices.data());
+		}
+		GLStateCache::getInstance().bindVertexArray(0);
+		return indexOffset;
+	}
+
+	void GeometryPool::release(const GeometryRange& range)
+	{
+		if (!range.isValid()) {
+			return;
+		}
+		mVertexRanges.release(range.baseVertex, range.vertexCount);
+		mIndexRanges.release(range.firstIndex, range.indexCount);
+	}
+
+	void GeometryPool::releaseIndices(const GeometryRange& range)
+	{
+		if (!range.isValid()) {
+			return;
+		}
+		mIndexRanges.release(range.firstIndex, range.indexCount);
+	}
+
+	void GeometryPool::growBuffer(GLuint& buffer, RangeAllocator& allocator, size_t elementSize, size_t minCapacity)
+	{
+		size_t oldCapacity = allocator.getCapacity();
+		size_t newCapacity = std::max(minCapacity, oldCapacity * 2);
+
+		GLuint newBuffer = 0;
+		glGenBuffers(1, &newBuffer);
+		GLStateCache::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * elementSize, nullptr, GL_STATIC_DRAW);
+
+		if (buffer != 0) {
+			Logger::DEBUG_INFO("Growing geometry pool buffer to " + std::to_string(newCapacity * elementSize) + " bytes.");
+			GLStateCache::getInstance().bindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity * elementSize);
+			GLStateCache::getInstance().bindBuffer(GL_COPY_READ_BUFFER, 0);
+			GLStateCache::getInstance().deleteBuffer(buffer);
+		}
+		GLStateCache::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		buffer = newBuffer;
+		allocator.grow(newCapacity);
+	}
+
+	void GeometryPool::setupVertexAttributes()
+	{
+		// Any subsequent vertex attribute calls from this on will be stored inside the VAO
+		GLStateCache::getInstance().bindVertexArray(mVAOIndex);
+
+		// The last EBO that gets bound while a VAO is bound is part of the VAO.
+		GLStateCache::getInstance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBOIndex);
+
+		mLayout.setupAttributes(mVBOIndex);
+
+		// per-instance model and normal matrices, pointed at the instance buffer when drawn
+		InstanceBuffer::enableAttributes();
+
+		GLStateCache::getInstance().bindVertexArray(0);
+		GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
@@ -0,0 +1,420 @@
+#include <Renderer/GpuCuller.h>
+#include <Renderer/GLStateCache.h>
+#include <Renderer/InstanceBuffer.h>
+#include <Renderer/Shader.h>
+#include <Renderer/ShaderLibrary.h>
+#include <Utils/Logger.h>
+#include <algorithm>
+
+namespace ToyEngine {
+	namespace {
+		// Storage buffer bindings of Shaders/gpuCull.comp.
+		enum CullBufferBinding : GLuint {
+			INSTANCES_BINDING = 0,
+			BATCH_INFOS_BINDING = 1,
+			COMMANDS_BINDING = 2,
+			VISIBLE_INSTANCES_BINDING = 3,
+			INSTANCE_SLOTS_BINDING = 4,
+		};
+
+		// Image units of Shaders/depthPyramid.comp.
+		enum DepthPyramidImageUnit : GLuint {
+			SOURCE_IMAGE_UNIT = 0,
+			DESTINATION_IMAGE_UNIT = 1,
+		};
+
+		constexpr GLuint DEPTH_PYRAMID_GROUP_SIZE = 8;
+
+		// INSTANCE_FLOATS of the write pass.
+		static_assert(sizeof(InstanceData) == 26 * sizeof(float), "InstanceData does not match the culling shader.");
+
+		GLuint getGroupCount(GLuint size, GLuint groupSize) {
+			return (size + groupSize - 1) / groupSize;
+		}
+
+		// Grow a storage buffer to hold at least size bytes. The content is not kept.
+		void reserveBuffer(GLenum target, GLuint buffer, size_t& capacity, size_t size, GLenum usage) {
+			if (size <= capacity && capacity > 0) {
+				return;
+			}
+			capacity = std::max({ size, capacity * 2, size_t(1) });
+			GLStateCache::getInstance().bindBuffer(target, buffer);
+			glBufferData(target, capacity, nullptr, usage);
+		}
+	}
+
+	bool GpuCuller::isSupported()
+	{
+		return GLAD_GL_ARB_compute_shader && GLAD_GL_ARB_shader_storage_buffer_object && GLAD_GL_ARB_shader_image_load_store
+			&& IndirectBuffer::isSupported();
+	}
+
+	void GpuCuller::init()
+	{
+		if (!isSupported()) {
+			Logger::DEBUG_WARNING("GPU culling needs compute shaders, storage buffers and multi draw indirect.");
+			return;
+		}
+
+		mCullShader = ShaderLibrary::getInstance().getCompute("Shaders/gpuCull.comp", { "CULL_PASS" });
+		mAllocateShader = ShaderLibrary::getInstance().getCompute("Shaders/gpuCull.comp", { "ALLOCATE_PASS" });
+		mWriteShader = ShaderLibrary::getInstance().getCompute("Shaders/gpuCull.comp", { "WRITE_PASS" });
+		mCopyDepthShader = ShaderLibrary::getInstance().getCompute("Shaders/depthPyramid.comp", { "FROM_DEPTH_TEXTURE" });
+		mReduceDepthShader = ShaderLibrary::getInstance().getCompute("Shaders/depthPyramid.comp");
+
+		glGenBuffers(1, &mInstanceBuffer);
+		glGenBuffers(1, &mBatchInfoBuffer);
+		glGenBuffers(1, &mCommandTemplateBuffer);
+		glGenBuffers(1, &mCommandBuffer);
+		glGenBuffers(1, &mVisibleBuffer);
+		glGenBuffers(1, &mInstanceSlotBuffer);
+		glGenFramebuffers(1, &mDepthFramebuffer);
+	}
+
+	uint32_t GpuCuller::findOrAddBatch(const DrawPacket& state, const std::vector<MeshLod>& lods)
+	{
+		const GeometryRange& finest = lods.front().range;
+		BatchKey key(state.shader, state.VAOIndex, finest.firstIndex, finest.baseVertex, finest.indexCount,
+			state.diffusePage, state.specularPage, state.materialIndex);
+		auto iter = mBatchIds.find(key);
+		if (iter != mBatchIds.end()) {
+			return iter->second;
+		}
+
+		// Batches are never removed. An empty one gets no command, and a later mesh with the same key reuses it.
+		uint32_t first = static_cast<uint32_t>(mBatches.size());
+		for (const auto& lod : lods) {
+			Batch newBatch;
+			newBatch.state = state;
+			newBatch.state.model = glm::mat4(1.0f);
+			newBatch.state.geometryId = lod.range.id;
+			newBatch.state.firstIndex = lod.range.firstIndex;
+			newBatch.state.indexCount = lod.range.indexCount;
+			newBatch.state.baseVertex = lod.range.baseVertex;
+			newBatch.lodError = lod.error;
+			mBatches.push_back(newBatch);
+		}
+		mBatches[first].lodCount = static_cast<uint32_t>(lods.size());
+		mBatchIds.emplace(key, first);
+		return first;
+	}
+
+	uint32_t GpuCuller::addInstance(const DrawPacket& state, const std::vector<MeshLod>& lods, const glm::mat4& model,
+		const glm::vec3& localMin, const glm::vec3& localMax)
+	{
+		uint32_t batch = findOrAddBatch(state, lods);
+		const uint32_t lodCount = mBatches[batch].lodCount;
+		for (uint32_t lod = 0; lod < lodCount; lod++) {
+			mBatches[batch + lod].instanceCount++;
+		}
+		mCommandsDirty = true;
+
+		uint32_t handle;
+		if (!mFreeHandles.empty()) {
+			handle = mFreeHandles.back();
+			mFreeHandles.pop_back();
+		}
+		else {
+			handle = static_cast<uint32_t>(mHandleRecord.size());
+			mHandleRecord.push_back(INVALID_INSTANCE);
+		}
+
+		size_t record = mRecords.size();
+		mRecords.push_back({ model, glm::vec4(localMin, glm::uintBitsToFloat(batch)), glm::vec4(localMax, glm::uintBitsToFloat(lodCount)) });
+		mRecordBatch.push_back(batch);
+		mRecordHandle.push_back(handle);
+		mHandleRecord[handle] = static_cast<uint32_t>(record);
+		markDirty(record);
+		return handle;
+	}
+
+	void GpuCuller::updateInstance(uint32_t instance, const glm::mat4& model)
+	{
+		size_t record = mHandleRecord[instance];
+		mRecords[record].model = model;
+		markDirty(record);
+	}
+
+	void GpuCuller::removeInstance(uint32_t instance)
+	{
+		size_t record = mHandleRecord[instance];
+		const uint32_t batch = mRecordBatch[record];
+		for (uint32_t lod = 0; lod < mBatches[batch].lodCount; lod++) {
+			mBatches[batch + lod].instanceCount--;
+		}
+		mCommandsDirty = true;
+
+		// Move the last record into the hole so that the records stay dense.
+		size_t last = mRecords.size() - 1;
+		if (record != last) {
+			mRecords[record] = mRecords[last];
+			mRecordBatch[record] = mRecordBatch[last];
+			mRecordHandle[record] = mRecordHandle[last];
+			mHandleRecord[mRecordHandle[record]] = static_cast<uint32_t>(record);
+			markDirty(record);
+		}
+		mRecords.pop_back();
+		mRecordBatch.pop_back();
+		mRecordHandle.pop_back();
+
+		mHandleRecord[instance] = INVALID_INSTANCE;
+		mFreeHandles.push_back(instance);
+	}
+
+	void GpuCuller::markDirty(size_t record)
+	{
+		mDirtyBegin = std::min(mDirtyBegin, record);
+		mDirtyEnd = std::max(mDirtyEnd, record + 1);
+	}
+
+	void GpuCuller::rebuildCommands()
+	{
+		// Sort by draw state so that batches which only differ in geometry end up in the same multi draw.
+		std::vector<uint32_t> order;
+		for (uint32_t batch = 0; batch < mBatches.size(); batch++) {
+			if (mBatches[batch].instanceCount > 0) {
+				order.push_back(batch);
+			}
+		}
+		std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+			const DrawPacket& first = mBatches[a].state;
+			const DrawPacket& second = mBatches[b].state;
+			return std::tie(first.shader, first.diffusePage, first.specularPage, first.VAOIndex, first.firstIndex, first.materialIndex)
+				< std::tie(second.shader, second.diffusePage, second.specularPage, second.VAOIndex, second.firstIndex, second.materialIndex);
+		});
+
+		// Instance counts and base instances are filled in on the GPU every frame.
+		mCommandTemplate.clear();
+		mDrawRuns.clear();
+		mBatchInfos.resize(mBatches.size());
+		for (uint32_t batch = 0; batch < mBatches.size(); batch++) {
+			mBatchInfos[batch] = { mBatches[batch].state.positionDequantization, 0, mBatches[batch].lodError, mBatches[batch].state.materialIndex, 0 };
+		}
+		for (uint32_t batch : order) {
+			const Batch& current = mBatches[batch];
+			mBatchInfos[batch].command = static_cast<uint32_t>(mCommandTemplate.size());
+
+			DrawElementsIndirectCommand command;
+			command.count = current.state.indexCount;
+			command.firstIndex = current.state.firstIndex;
+			command.baseVertex = current.state.baseVertex;
+
+			if (mDrawRuns.empty() || !mDrawRuns.back().state.sharesDrawState(current.state)) {
+				mDrawRuns.push_back({ current.state, mCommandTemplate.size(), 0 });
+			}
+			mDrawRuns.back().commandCount++;
+			mCommandTemplate.push_back(command);
+		}
+
+		size_t commandBytes = mCommandTemplate.size() * sizeof(DrawElementsIndirectCommand);
+		reserveBuffer(GL_COPY_WRITE_BUFFER, mCommandTemplateBuffer, mCommandTemplateCapacity, commandBytes, GL_STATIC_DRAW);
+		reserveBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer, mCommandCapacity, commandBytes, GL_DYNAMIC_DRAW);
+		if (commandBytes > 0) {
+			GLStateCache::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, mCommandTemplateBuffer);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, 0, commandBytes, mCommandTemplate.data());
+		}
+		GLStateCache::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		GLStateCache::getInstance().bindBuffer(GL_SHADER_STORAGE_BUFFER, mBatchInfoBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(mBatchInfos.size(), 1) * sizeof(BatchInfo), nullptr, GL_STATIC_DRAW);
+		if (!mBatchInfos.empty()) {
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mBatchInfos.size() * sizeof(BatchInfo), mBatchInfos.data());
+		}
+
+		// An instance is drawn with at most one level, so the output never holds more than every instance once.
+		reserveBuffer(GL_SHADER_STORAGE_BUFFER, mVisibleBuffer, mVisibleCapacity, mRecords.size() * sizeof(InstanceData), GL_DYNAMIC_COPY);
+		reserveBuffer(GL_SHADER_STORAGE_BUFFER, mInstanceSlotBuffer, mInstanceSlotCapacity, mRecords.size() * 2 * sizeof(uint32_t), GL_DYNAMIC_COPY);
+		GLStateCache::getInstance().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		mCommandsDirty = false;
+	}
+
+	void GpuCuller::uploadInstances()
+	{
+		GLStateCache::getInstance().bindBuffer(GL_SHADER_STORAGE_BUFFER, mInstanceBuffer);
+		size_t bytes = mRecords.size() * sizeof(InstanceRecord);
+		if (bytes > mInstanceCapacity) {
+			// Reallocating loses the content, so everything goes up again.
+			mInstanceCapacity = std::max(bytes, mInstanceCapacity * 2);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, mInstanceCapacity, nullptr, GL_DYNAMIC_DRAW);
+			mDirtyBegin = 0;
+			mDirtyEnd = mRecords.size();
+		}
+
+		mDirtyEnd = std::min(mDirtyEnd, mRecords.size());
+		if (mDirtyBegin < mDirtyEnd) {
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, mDirtyBegin * sizeof(InstanceRecord),
+				(mDirtyEnd - mDirtyBegin) * sizeof(InstanceRecord), mRecords.data() + mDirtyBegin);
+		}
+		mDirtyBegin = SIZE_MAX;
+		mDirtyEnd = 0;
+		GLStateCache::getInstance().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	void GpuCuller::cull(const glm::mat4& viewProjection, float lodErrorScale)
+	{
+		if (!mCullShader) {
+			return;
+		}
+
+		if (mCommandsDirty) {
+			rebuildCommands();
+		}
+		uploadInstances();
+
+		if (mCommandTemplate.empty()) {
+			return;
+		}
+
+		size_t commandBytes = mCommandTemplate.size() * sizeof(DrawElementsIndirectCommand);
+		GLStateCache::getInstance().bindBuffer(GL_COPY_READ_BUFFER, mCommandTemplateBuffer);
+		GLStateCache::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, mCommandBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandBytes);
+		GLStateCache::getInstance().bindBuffer(GL_COPY_READ_BUFFER, 0);
+		GLStateCache::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		GLStateCache::getInstance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES_BINDING, mInstanceBuffer);
+		GLStateCache::getInstance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_INFOS_BINDING, mBatchInfoBuffer);
+		GLStateCache::getInstance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, mCommandBuffer);
+		GLStateCache::getInstance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_INSTANCES_BINDING, mVisibleBuffer);
+		GLStateCache::getInstance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_SLOTS_BINDING, mInstanceSlotBuffer);
+
+		const GLuint instanceGroups = getGroupCount(static_cast<GLuint>(mRecords.size()), WORKGROUP_SIZE);
+
+		// Test every instance, pick its level and take a slot in that level's command.
+		mCullShader->use();
+		mCullShader->setUniform(mCullShader->getUniformHandle<glm::mat4>("viewProjection"_uniform), viewProjection);
+		mCullShader->setUniform(mCullShader->getUniformHandle<glm::mat4>("depthPyramidViewProjection"_uniform), mDepthPyramidViewProjection);
+		mCullShader->setUniform(mCullShader->getUniformHandle<int>("instanceCount"_uniform), static_cast<int>(mRecords.size()));
+		mCullShader->setUniform(mCullShader->getUniformHandle<bool>("useDepthPyramid"_uniform), mDepthPyramidValid);
+		mCullShader->setUniform(mCullShader->getUniformHandle<glm::ivec2>("depthPyramidScreenSize"_uniform), glm::ivec2(mDepthWidth, mDepthHeight));
+		mCullShader->setUniform(mCullShader->getUniformHandle<int>("depthPyramid"_uniform), 0);
+		mCullShader->setUniform(mCullShader->getUniformHandle<float>("lodErrorScale"_uniform), lodErrorScale);
+
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mDepthPyramidValid ? mDepthPyramid : 0);
+		glDispatchCompute(instanceGroups, 1, 1);
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, 0);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// Turn the instance counts into consecutive instance ranges.
+		mAllocateShader->use();
+		mAllocateShader->setUniform(mAllocateShader->getUniformHandle<int>("commandCount"_uniform), static_cast<int>(mCommandTemplate.size()));
+		glDispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// Write the visible instances into their ranges.
+		mWriteShader->use();
+		mWriteShader->setUniform(mWriteShader->getUniformHandle<int>("instanceCount"_uniform), static_cast<int>(mRecords.size()));
+		glDispatchCompute(instanceGroups, 1, 1);
+
+		// The commands are read by the draw, the compacted instances as vertex attributes.
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+		for (GLuint binding : { INSTANCES_BINDING, BATCH_INFOS_BINDING, COMMANDS_BINDING, VISIBLE_INSTANCES_BINDING, INSTANCE_SLOTS_BINDING }) {
+			GLStateCache::getInstance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+		}
+		GLStateCache::getInstance().useProgram(0);
+		GLStateCache::getInstance().bindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+	}
+
+	void GpuCuller::resizeDepthPyramid(int width, int height)
+	{
+		if (width == mDepthWidth && height == mDepthHeight) {
+			return;
+		}
+		mDepthWidth = width;
+		mDepthHeight = height;
+
+		if (mDepthTexture == 0) {
+			glGenTextures(1, &mDepthTexture);
+		}
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mDepthTexture);
+		// Blitting depth needs the same format on both sides, which is what GLFW creates by default.
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, mDepthFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, mDepthTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			Logger::DEBUG_ERROR("Depth pyramid framebuffer is incomplete.");
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		// Level 0 is half the screen, every level halves again down to 1x1. Image units cannot be
+		// bound to a texture whose storage may still change, so the pyramid is recreated on resize.
+		if (mDepthPyramid != 0) {
+			GLStateCache::getInstance().deleteTexture(mDepthPyramid);
+		}
+		glGenTextures(1, &mDepthPyramid);
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mDepthPyramid);
+		int levelWidth = std::max(width / 2, 1);
+		int levelHeight = std::max(height / 2, 1);
+		mDepthPyramidLevels = 0;
+		while (true) {
+			glTexImage2D(GL_TEXTURE_2D, mDepthPyramidLevels, GL_R32F, levelWidth, levelHeight, 0, GL_RED, GL_FLOAT, nullptr);
+			mDepthPyramidLevels++;
+			if (levelWidth == 1 && levelHeight == 1) {
+				break;
+			}
+			levelWidth = std::max(levelWidth / 2, 1);
+			levelHeight = std::max(levelHeight / 2, 1);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mDepthPyramidLevels - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, 0);
+
+		mDepthPyramidValid = false;
+	}
+
+	void GpuCuller::buildDepthPyramid(int width, int height, const glm::mat4& viewProjection)
+	{
+		if (!mCullShader || width <= 0 || height <= 0) {
+			return;
+		}
+		resizeDepthPyramid(width, height);
+
+		// The default framebuffer's depth cannot be sampled, so it is copied into a texture first.
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mDepthFramebuffer);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		// Every texel keeps the farthest depth it covers, so a box is hidden if it is behind all of them.
+		int levelWidth = std::max(width / 2, 1);
+		int levelHeight = std::max(height / 2, 1);
+		for (int level = 0; level < mDepthPyramidLevels; level++) {
+			if (level == 0) {
+				mCopyDepthShader->use();
+				mCopyDepthShader->setUniform(mCopyDepthShader->getUniformHandle<int>("source"_uniform), 0);
+				GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mDepthTexture);
+			}
+			else {
+				mReduceDepthShader->use();
+				glBindImageTexture(SOURCE_IMAGE_UNIT, mDepthPyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+			}
+			glBindImageTexture(DESTINATION_IMAGE_UNIT, mDepthPyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+			glDispatchCompute(getGroupCount(levelWidth, DEPTH_PYRAMID_GROUP_SIZE), getGroupCount(levelHeight, DEPTH_PYRAMID_GROUP_SIZE), 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+			levelWidth = std::max(levelWidth / 2, 1);
+			levelHeight = std::max(levelHeight / 2, 1);
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, 0);
+		glBindImageTexture(SOURCE_IMAGE_UNIT, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(DESTINATION_IMAGE_UNIT, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		GLStateCache::getInstance().useProgram(0);
+
+		mDepthPyramidViewProjection = viewProjection;
+		mDepthPyramidValid = true;
+	}
+}
@@ -0,0 +1,414 @@
+#include <Renderer/GpuTransferQueue.h>
+#include <GLFW/glfw3.h>
+#include <Renderer/GLStateCache.h>
+#include <Utils/JobSystem.h>
+#include <Utils/Logger.h>
+#include <Utils/RenderHelper.h>
+#include <algorithm>
+#include <cstring>
+
+namespace ToyEngine {
+	namespace {
+		// How long the transfer thread blocks on a fence at a time, in nanoseconds.
+		constexpr GLuint64 FENCE_WAIT_TIMEOUT = 1000000;
+	}
+
+	GpuTransfer::~GpuTransfer()
+	{
+		if (handle != 0) {
+			GpuTransferQueue::getInstance().release(handle, isTexture);
+		}
+	}
+
+	GpuTransferQueue& GpuTransferQueue::getInstance()
+	{
+		static GpuTransferQueue instance;
+		return instance;
+	}
+
+	bool GpuTransferQueue::init(GLFWwindow* mainWindow)
+	{
+		if (mRunning) {
+			return true;
+		}
+
+		// The hints of the main window are still set, so the context gets the same version.
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		mWindow = glfwCreateWindow(1, 1, "Transfer", nullptr, mainWindow);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+		if (!mWindow) {
+			Logger::DEBUG_WARNING("No shared GL context for the transfer queue, uploads stay on the main thread.");
+			return false;
+		}
+
+		mStop = false;
+		mRunning = true;
+		mThread = std::thread(&GpuTransferQueue::threadLoop, this);
+		return true;
+	}
+
+	void GpuTransferQueue::shutdown()
+	{
+		if (!mRunning) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+		mWake.notify_all();
+		mThread.join();
+		mRunning = false;
+		glfwDestroyWindow(mWindow);
+		mWindow = nullptr;
+	}
+
+	std::shared_ptr<GpuTransfer> GpuTransferQueue::uploadTexture(ImageData image)
+	{
+		Request request;
+		request.image = std::move(image);
+		return submit(std::move(request), true);
+	}
+
+	std::shared_ptr<GpuTransfer> GpuTransferQueue::uploadCompressedTexture(CompressedImage image)
+	{
+		Request request;
+		request.compressed = std::move(image);
+		return submit(std::move(request), true);
+	}
+
+	std::shared_ptr<GpuTransfer> GpuTransferQueue::uploadBuffer(std::vector<uint8_t> data)
+	{
+		Request request;
+		request.data = std::move(data);
+		return submit(std::move(request), false);
+	}
+
+	std::shared_ptr<GpuTransfer> GpuTransferQueue::uploadBuffer(const uint8_t* data, size_t size, std::shared_ptr<const void> owner)
+	{
+		Request request;
+		request.source = data;
+		request.sourceSize = size;
+		request.owner = std::move(owner);
+		return submit(std::move(request), false);
+	}
+
+	void GpuTransferQueue::wait(const GpuTransfer& transfer)
+	{
+		if (transfer.done.load(std::memory_order_acquire)) {
+			return;
+		}
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWaiters++;
+		// Wakes the thread up if it is waiting for the budget.
+		mWake.notify_all();
+		mDone.wait(lock, [&transfer] {
+			return transfer.done.load(std::memory_order_acquire);
+		});
+		mWaiters--;
+	}
+
+	void GpuTransferQueue::beginFrame()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mLastFrameBytes = mFrameBytes;
+			mFrameBytes = 0;
+		}
+		mWake.notify_all();
+	}
+
+	void GpuTransferQueue::release(GLuint handle, bool isTexture)
+	{
+		// The main context may have bound the object, which only its GLStateCache knows about. The contexts
+		// share their objects, so deleting it there frees it for both.
+		JobSystem::getInstance().runOnMainThread([handle, isTexture] {
+			GLStateCache& cache = GLStateCache::getInstance();
+			if (isTexture) {
+				cache.deleteTexture(handle);
+			}
+			else {
+				cache.deleteBuffer(handle);
+			}
+		});
+	}
+
+	std::shared_ptr<GpuTransfer> GpuTransferQueue::submit(Request request, bool isTexture)
+	{
+		if (!mRunning) {
+			return nullptr;
+		}
+		request.transfer = std::make_shared<GpuTransfer>();
+		request.transfer->isTexture = isTexture;
+		std::shared_ptr<GpuTransfer> transfer = request.transfer;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mRequests.push_back(std::move(request));
+			mPendingCount++;
+		}
+		mWake.notify_all();
+		return transfer;
+	}
+
+	void GpuTransferQueue::threadLoop()
+	{
+		glfwMakeContextCurrent(mWindow);
+
+		while (true) {
+			retire(false);
+
+			std::unique_lock<std::mutex> lock(mMutex);
+			if (mRequests.empty()) {
+				if (!mInFlight.empty()) {
+					lock.unlock();
+					retire(true);
+					continue;
+				}
+				if (mStop) {
+					break;
+				}
+				mWake.wait(lock, [this] {
+					return mStop || !mRequests.empty();
+				});
+				continue;
+			}
+			Request request = std::move(mRequests.front());
+			mRequests.pop_front();
+			lock.unlock();
+
+			process(request);
+		}
+
+		for (StagingSlot& slot : mSlots) {
+			if (slot.fence) {
+				glDeleteSync(slot.fence);
+			}
+			glDeleteBuffers(1, &slot.buffer);
+			slot = StagingSlot();
+		}
+		glfwMakeContextCurrent(nullptr);
+	}
+
+	void GpuTransferQueue::process(Request& request)
+	{
+		if (request.compressed.isValid()) {
+			stageCompressedTexture(request);
+		}
+		else if (request.transfer->isTexture) {
+			stageTexture(request);
+		}
+		else {
+			stageBuffer(request);
+		}
+
+		// Flushed, so that the main context waits for something that was submitted.
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+		mInFlight.push_back({ std::move(request.transfer), fence });
+	}
+
+	void GpuTransferQueue::stageTexture(Request& request)
+	{
+		const ImageData& image = request.image;
+		GpuTransfer& transfer = *request.transfer;
+		if (!image.isValid()) {
+			return;
+		}
+
+		// The same setup as Texture::upload.
+		const GLenum format = RenderHelper::convertChannelsToFormat(image.getChannels());
+		glGenTextures(1, &transfer.handle);
+		glBindTexture(GL_TEXTURE_2D, transfer.handle);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.getWidth(), image.getHeight(), 0, format, GL_UNSIGNED_BYTE, nullptr);
+
+		// Rows of RGB images are not 4 byte aligned.
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		const size_t rowBytes = static_cast<size_t>(image.getWidth()) * image.getChannels();
+		const int rowsPerSlot = static_cast<int>(std::max<size_t>(STAGING_SLOT_BYTES / rowBytes, 1));
+		for (int row = 0; row < image.getHeight(); row += rowsPerSlot) {
+			const int rows = std::min(rowsPerSlot, image.getHeight() - row);
+			const size_t bytes = rows * rowBytes;
+			consumeBudget(bytes);
+			if (void* staging = mapSlot(GL_PIXEL_UNPACK_BUFFER, bytes)) {
+				std::memcpy(staging, image.getPixels() + row * rowBytes, bytes);
+				unmapSlot(GL_PIXEL_UNPACK_BUFFER);
+				// With a pixel unpack buffer bound the pointer is an offset into it.
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row, image.getWidth(), rows, format, GL_UNSIGNED_BYTE, nullptr);
+			}
+			fenceSlot();
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		transfer.width = image.getWidth();
+		transfer.height = image.getHeight();
+		transfer.format = format;
+	}
+
+	void GpuTransferQueue::stageCompressedTexture(Request& request)
+	{
+		const CompressedImage& image = request.compressed;
+		GpuTransfer& transfer = *request.transfer;
+
+		const GLenum format = BcEncoder::getGLFormat(image.format);
+		const GLint levelCount = static_cast<GLint>(image.levels.size());
+		glGenTextures(1, &transfer.handle);
+		glBindTexture(GL_TEXTURE_2D, transfer.handle);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+		// Every level is allocated before staging starts, since a null pointer with a staging slot bound
+		// to GL_PIXEL_UNPACK_BUFFER would be read as an offset into the slot.
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		for (GLint level = 0; level < levelCount; level++) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, std::max(image.width >> level, 1), std::max(image.height >> level, 1), 0,
+				static_cast<GLsizei>(image.levels[level].size()), nullptr);
+		}
+
+		for (GLint level = 0; level < levelCount; level++) {
+			const std::vector<uint8_t>& data = image.levels[level];
+			const int width = std::max(image.width >> level, 1);
+			const int height = std::max(image.height >> level, 1);
+
+			// Staged in whole rows of blocks, the sub image has to start on a block.
+			const size_t rowBytes = BcEncoder::getLevelBytes(image.format, width, 1);
+			const int blockRows = (height + 3) / 4;
+			const int rowsPerSlot = static_cast<int>(std::max<size_t>(STAGING_SLOT_BYTES / rowBytes, 1));
+			for (int row = 0; row < blockRows; row += rowsPerSlot) {
+				const int rows = std::min(rowsPerSlot, blockRows - row);
+				const size_t bytes = rows * rowBytes;
+				consumeBudget(bytes);
+				if (void* staging = mapSlot(GL_PIXEL_UNPACK_BUFFER, bytes)) {
+					std::memcpy(staging, data.data() + row * rowBytes, bytes);
+					unmapSlot(GL_PIXEL_UNPACK_BUFFER);
+					glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, row * 4, width, std::min(rows * 4, height - row * 4), format,
+						static_cast<GLsizei>(bytes), nullptr);
+				}
+				fenceSlot();
+			}
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		transfer.width = image.width;
+		transfer.height = image.height;
+		transfer.format = format;
+	}
+
+	void GpuTransferQueue::stageBuffer(Request& request)
+	{
+		const uint8_t* data = request.source ? request.source : request.data.data();
+		const size_t size = request.source ? request.sourceSize : request.data.size();
+		GpuTransfer& transfer = *request.transfer;
+		if (size == 0) {
+			return;
+		}
+
+		glGenBuffers(1, &transfer.handle);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, transfer.handle);
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+		for (size_t offset = 0; offset < size; offset += STAGING_SLOT_BYTES) {
+			const size_t bytes = std::min(STAGING_SLOT_BYTES, size - offset);
+			consumeBudget(bytes);
+			// Reading a mapped file faults its pages in here, on this thread.
+			if (void* staging = mapSlot(GL_COPY_READ_BUFFER, bytes)) {
+				std::memcpy(staging, data + offset, bytes);
+				unmapSlot(GL_COPY_READ_BUFFER);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, bytes);
+			}
+			fenceSlot();
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		transfer.size = size;
+	}
+
+	void* GpuTransferQueue::mapSlot(GLenum target, size_t bytes)
+	{
+		StagingSlot& slot = mSlots[mNextSlot];
+		if (slot.fence) {
+			GLenum status;
+			do {
+				status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_TIMEOUT);
+			} while (status == GL_TIMEOUT_EXPIRED);
+			glDeleteSync(slot.fence);
+			slot.fence = nullptr;
+		}
+
+		if (slot.buffer == 0) {
+			glGenBuffers(1, &slot.buffer);
+		}
+		glBindBuffer(target, slot.buffer);
+		if (bytes > slot.capacity) {
+			slot.capacity = std::max(bytes, STAGING_SLOT_BYTES);
+			glBufferData(target, slot.capacity, nullptr, GL_STREAM_DRAW);
+		}
+
+		// The fence says the GPU is done reading the slot, so the driver does not have to synchronize.
+		void* staging = glMapBufferRange(target, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!staging) {
+			Logger::DEBUG_ERROR("Mapping a staging buffer of the transfer queue failed.");
+		}
+		return staging;
+	}
+
+	void GpuTransferQueue::unmapSlot(GLenum target)
+	{
+		if (!glUnmapBuffer(target)) {
+			Logger::DEBUG_WARNING("A staging buffer of the transfer queue got corrupted.");
+		}
+	}
+
+	void GpuTransferQueue::fenceSlot()
+	{
+		mSlots[mNextSlot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mNextSlot = (mNextSlot + 1) % STAGING_SLOT_COUNT;
+	}
+
+	void GpuTransferQueue::consumeBudget(size_t bytes)
+	{
+		// Whatever finished in the meantime does not have to wait for the next frame.
+		retire(false);
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		// A chunk larger than the whole budget still goes through on a frame of its own.
+		mWake.wait(lock, [this, bytes] {
+			return mStop || mWaiters > 0 || mFrameBytes == 0 || mFrameBytes + bytes <= mFrameBudget;
+		});
+		mFrameBytes += bytes;
+	}
+
+	void GpuTransferQueue::retire(bool block)
+	{
+		bool retired = false;
+		// Fences signal in submission order.
+		while (!mInFlight.empty()) {
+			InFlight& front = mInFlight.front();
+			GLenum status = glClientWaitSync(front.fence, GL_SYNC_FLUSH_COMMANDS_BIT, block ? FENCE_WAIT_TIMEOUT : 0);
+			if (status == GL_TIMEOUT_EXPIRED) {
+				break;
+			}
+			glDeleteSync(front.fence);
+			front.transfer->done.store(true, std::memory_order_release);
+			mInFlight.pop_front();
+			mPendingCount--;
+			block = false;
+			retired = true;
+		}
+
+		// Taking the lock orders the stores before a waiter's check, so it cannot go to sleep after missing them.
+		if (retired) {
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+			}
+			mDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#include <Renderer/IndirectBuffer.h>
+#include <Renderer/GLStateCache.h>
+#include <algorithm>
+
+namespace ToyEngine {
+	void IndirectBuffer::init()
+	{
+		if (isSupported()) {
+			glGenBuffers(1, &mBufferIndex);
+		}
+	}
+
+	void IndirectBuffer::upload(const std::vector<DrawElementsIndirectCommand>& commands)
+	{
+		GLStateCache::getInstance().bindBuffer(GL_DRAW_INDIRECT_BUFFER, mBufferIndex);
+		if (commands.size() > mCapacity) {
+			mCapacity = std::max(commands.size(), mCapacity * 2);
+		}
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, mCapacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+		if (!commands.empty()) {
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+		}
+	}
+}
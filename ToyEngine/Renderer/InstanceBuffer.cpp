@@ -0,0 +1,55 @@
+#include <Renderer/InstanceBuffer.h>
+#include <Renderer/GLStateCache.h>
+#include <algorithm>
+#include <cstddef>
+
+namespace ToyEngine {
+	void InstanceBuffer::enableAttributes()
+	{
+		for (GLuint i = 0; i < 4; i++) {
+			glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + i);
+			glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + i, 1);
+		}
+		for (GLuint i = 0; i < 3; i++) {
+			glEnableVertexAttribArray(INSTANCE_NORMAL_MATRIX_LOCATION + i);
+			glVertexAttribDivisor(INSTANCE_NORMAL_MATRIX_LOCATION + i, 1);
+		}
+		glEnableVertexAttribArray(INSTANCE_MATERIAL_LOCATION);
+		glVertexAttribDivisor(INSTANCE_MATERIAL_LOCATION, 1);
+	}
+
+	void InstanceBuffer::init()
+	{
+		glGenBuffers(1, &mBufferIndex);
+	}
+
+	void InstanceBuffer::upload(const std::vector<InstanceData>& instances)
+	{
+		GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, mBufferIndex);
+		// Grow geometrically, otherwise orphan the old storage so the driver doesn't wait on last frame's draws.
+		if (instances.size() > mCapacity) {
+			mCapacity = std::max(instances.size(), mCapacity * 2);
+		}
+		glBufferData(GL_ARRAY_BUFFER, mCapacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+		if (!instances.empty()) {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+		}
+	}
+
+	void InstanceBuffer::bindAttributes(GLuint buffer, size_t firstInstance)
+	{
+		const size_t base = firstInstance * sizeof(InstanceData);
+
+		GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, buffer);
+		for (GLuint i = 0; i < 4; i++) {
+			size_t offset = base + offsetof(InstanceData, model) + i * sizeof(glm::vec4);
+			glVertexAttribPointer(INSTANCE_MODEL_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+		}
+		for (GLuint i = 0; i < 3; i++) {
+			size_t offset = base + offsetof(InstanceData, normalMatrix) + i * sizeof(glm::vec3);
+			glVertexAttribPointer(INSTANCE_NORMAL_MATRIX_LOCATION + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+		}
+		glVertexAttribIPointer(INSTANCE_MATERIAL_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, materialIndex)));
+		// Left bound, so that the next batch pointing at the same buffer skips the bind.
+	}
+}
@@ -0,0 +1,103 @@
+#include <Renderer/LightBuffer.h>
+#include <Engine/Component.h>
+#include <Utils/Logger.h>
+
+namespace ToyEngine {
+	namespace {
+		// Lights shine along their local z axis. Without a scale the world matrix has no axes left, then it is
+		// the world z axis.
+		glm::vec3 getWorldDirection(const glm::mat4& world) {
+			const glm::vec3 axis(world[2]);
+			const float length = glm::length(axis);
+			return length > 0.0f ? axis / length : glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+	}
+
+	void LightBuffer::init(entt::registry& registry)
+	{
+		mBuffer.init(sizeof(LightBlock), LIGHTS_BLOCK_BINDING);
+
+		registry.on_construct<LightComponent>().connect<&LightBuffer::onLightChanged>(*this);
+		registry.on_update<LightComponent>().connect<&LightBuffer::onLightChanged>(*this);
+		registry.on_destroy<LightComponent>().connect<&LightBuffer::onLightChanged>(*this);
+
+		mIsDirty = true;
+	}
+
+	void LightBuffer::update(entt::registry& registry)
+	{
+		if (!mIsDirty) {
+			return;
+		}
+
+		pack(registry);
+		mBuffer.upload(&mBlock, sizeof(LightBlock));
+		mIsDirty = false;
+	}
+
+	void LightBuffer::onLightChanged(entt::registry& registry, entt::entity entity)
+	{
+		mIsDirty = true;
+	}
+
+	void LightBuffer::pack(entt::registry& registry)
+	{
+		int dirLightCount = 0;
+		int pointLightCount = 0;
+		int spotLightCount = 0;
+
+		auto view = registry.view<LightComponent, TransformComponent>();
+		for (auto entity : view) {
+			auto [light, transform] = view.get<LightComponent, TransformComponent>(entity);
+
+			if (light.type == "directional") {
+				if (dirLightCount == MAX_LIGHTS_PER_TYPE) {
+					continue;
+				}
+				GpuDirLight& gpuLight = mBlock.dirLights[dirLightCount++];
+				gpuLight.direction = getWorldDirection(transform.getWorldMatrix());
+				gpuLight.ambient = light.ambient;
+				gpuLight.diffuse = light.diffuse;
+				gpuLight.specular = light.specular;
+			}
+			else if (light.type == "point") {
+				if (pointLightCount == MAX_LIGHTS_PER_TYPE) {
+					continue;
+				}
+				GpuPointLight& gpuLight = mBlock.pointLights[pointLightCount++];
+				gpuLight.position = transform.getWorldPos();
+				gpuLight.ambient = light.ambient;
+				gpuLight.diffuse = light.diffuse;
+				gpuLight.specular = light.specular;
+				gpuLight.constant = light.constant;
+				gpuLight.linear = light.linear;
+				gpuLight.quadratic = light.quadratic;
+			}
+			else if (light.type == "spotlight") {
+				if (spotLightCount == MAX_LIGHTS_PER_TYPE) {
+					continue;
+				}
+				GpuSpotLight& gpuLight = mBlock.spotLights[spotLightCount++];
+				gpuLight.position = transform.getWorldPos();
+				// This used to be TransformComponent::front(), which reads rotation_eular as yaw about y and
+				// pitch about x and points along x without rotation. Spotlights now point along their z axis
+				// like the directional lights, so they have to be rotated the way Scene::addDirectionalLight
+				// does it. Nothing creates spotlights so far.
+				gpuLight.direction = getWorldDirection(transform.getWorldMatrix());
+				gpuLight.ambient = light.ambient;
+				gpuLight.diffuse = light.diffuse;
+				gpuLight.specular = light.specular;
+				gpuLight.constant = light.constant;
+				gpuLight.linear = light.linear;
+				gpuLight.quadratic = light.quadratic;
+				gpuLight.cutOff = glm::cos(glm::radians(light.cutOff));
+				gpuLight.outerCutOff = glm::cos(glm::radians(light.outerCutOff));
+			}
+			else {
+				Logger::DEBUG_ERROR("Invalid light type detected in Light component: " + light.type);
+			}
+		}
+
+		mBlock.lightCounts = glm::ivec4(dirLightCount, pointLightCount, spotLightCount, 0);
+	}
+}
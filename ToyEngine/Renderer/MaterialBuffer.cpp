@@ -0,0 +1,55 @@
+#include <Renderer/MaterialBuffer.h>
+#include <Renderer/GLStateCache.h>
+#include <algorithm>
+
+namespace ToyEngine {
+	namespace {
+		const size_t INITIAL_CAPACITY = 256;
+	}
+
+	void MaterialBuffer::init()
+	{
+		glGenBuffers(1, &mBuffer);
+		GLStateCache::getInstance().bindBuffer(GL_TEXTURE_BUFFER, mBuffer);
+		mCapacity = INITIAL_CAPACITY;
+		glBufferData(GL_TEXTURE_BUFFER, mCapacity * sizeof(GpuMaterial), nullptr, GL_STATIC_DRAW);
+
+		// The texture refers to the buffer object, so it stays attached when the storage is reallocated.
+		glGenTextures(1, &mTexture);
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_BUFFER, mTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, mBuffer);
+	}
+
+	uint32_t MaterialBuffer::add(const TextureLayer& diffuse, const TextureLayer& specular, float shininess)
+	{
+		MaterialKey key(diffuse.page, diffuse.layer, specular.page, specular.layer, shininess);
+		auto iter = mIndices.find(key);
+		if (iter != mIndices.end()) {
+			return iter->second;
+		}
+
+		uint32_t index = static_cast<uint32_t>(mMaterials.size());
+		mMaterials.push_back({ diffuse.layer, specular.layer, shininess, 0 });
+		mPages.push_back({ diffuse.page, specular.page });
+		mIndices.emplace(key, index);
+		return index;
+	}
+
+	void MaterialBuffer::bind(GLuint unit)
+	{
+		GLStateCache& state = GLStateCache::getInstance();
+		if (mUploadedCount < mMaterials.size()) {
+			state.bindBuffer(GL_TEXTURE_BUFFER, mBuffer);
+			if (mMaterials.size() > mCapacity) {
+				// Reallocating loses the content, so everything goes up again.
+				mCapacity = std::max(mMaterials.size(), mCapacity * 2);
+				glBufferData(GL_TEXTURE_BUFFER, mCapacity * sizeof(GpuMaterial), nullptr, GL_STATIC_DRAW);
+				mUploadedCount = 0;
+			}
+			glBufferSubData(GL_TEXTURE_BUFFER, mUploadedCount * sizeof(GpuMaterial), (mMaterials.size() - mUploadedCount) * sizeof(GpuMaterial),
+				mMaterials.data() + mUploadedCount);
+			mUploadedCount = mMaterials.size();
+		}
+		state.bindTexture(unit, GL_TEXTURE_BUFFER, mTexture);
+	}
+}
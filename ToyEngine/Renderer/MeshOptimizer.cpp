@@ -0,0 +1,376 @@
+#include <Renderer/MeshOptimizer.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+
+namespace ToyEngine {
+	namespace {
+		constexpr unsigned int NO_VERTEX = UINT32_MAX;
+
+		// FIFO post-transform cache. A vertex only gets a new timestamp when it misses, so it drops out
+		// cacheSize misses after it was loaded, no matter how often it was hit in between.
+		struct FifoCache {
+			std::vector<uint32_t> loadedAt;
+			uint32_t timestamp;
+			uint32_t size;
+
+			FifoCache(size_t vertexCount, size_t cacheSize)
+				: loadedAt(vertexCount, 0), timestamp(static_cast<uint32_t>(cacheSize) + 1), size(static_cast<uint32_t>(cacheSize)) {
+			}
+
+			bool contains(unsigned int vertex) const {
+				return timestamp - loadedAt[vertex] <= size;
+			}
+
+			// Returns whether the vertex had to be transformed.
+			bool touch(unsigned int vertex) {
+				if (contains(vertex)) {
+					return false;
+				}
+				loadedAt[vertex] = timestamp++;
+				return true;
+			}
+
+			void flush() {
+				timestamp += size + 1;
+			}
+		};
+
+		uint64_t hashVertex(const Vertex& vertex) {
+			// FNV-1a over the raw bytes
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); i++) {
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+			return hash;
+		}
+
+		// Triangles around every vertex, as offsets into one flat list.
+		struct Adjacency {
+			std::vector<uint32_t> offsets;
+			std::vector<uint32_t> triangles;
+
+			Adjacency(const std::vector<unsigned int>& indices, size_t vertexCount) : offsets(vertexCount + 1, 0), triangles(indices.size()) {
+				for (unsigned int index : indices) {
+					offsets[index + 1]++;
+				}
+				for (size_t v = 0; v < vertexCount; v++) {
+					offsets[v + 1] += offsets[v];
+				}
+				std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+				for (size_t i = 0; i < indices.size(); i++) {
+					triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+
+			uint32_t count(unsigned int vertex) const {
+				return offsets[vertex + 1] - offsets[vertex];
+			}
+		};
+
+		glm::vec3 triangleNormal(const std::vector<Vertex>& vertices, const unsigned int* triangle) {
+			// twice the area, pointing out of the front face
+			return glm::cross(vertices[triangle[1]].Position - vertices[triangle[0]].Position,
+				vertices[triangle[2]].Position - vertices[triangle[0]].Position);
+		}
+
+		glm::vec3 triangleCentroid(const std::vector<Vertex>& vertices, const unsigned int* triangle) {
+			return (vertices[triangle[0]].Position + vertices[triangle[1]].Position + vertices[triangle[2]].Position) / 3.0f;
+		}
+	}
+
+	VertexCacheStatistics MeshOptimizer::analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, size_t cacheSize)
+	{
+		VertexCacheStatistics statistics;
+		if (indices.empty() || vertexCount == 0) {
+			return statistics;
+		}
+
+		FifoCache cache(vertexCount, cacheSize);
+		size_t misses = 0;
+		for (unsigned int index : indices) {
+			misses += cache.touch(index) ? 1 : 0;
+		}
+		statistics.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+		statistics.atvr = static_cast<float>(misses) / static_cast<float>(vertexCount);
+		return statistics;
+	}
+
+	size_t MeshOptimizer::deduplicateVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+	{
+		std::vector<bool> referenced(vertices.size(), false);
+		for (unsigned int index : indices) {
+			referenced[index] = true;
+		}
+
+		// open addressing, at most half full
+		size_t tableSize = 1;
+		while (tableSize < vertices.size() * 2) {
+			tableSize *= 2;
+		}
+		std::vector<unsigned int> table(tableSize, NO_VERTEX);
+
+		std::vector<unsigned int> remap(vertices.size(), NO_VERTEX);
+		std::vector<Vertex> unique;
+		unique.reserve(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++) {
+			if (!referenced[v]) {
+				continue;
+			}
+			size_t slot = static_cast<size_t>(hashVertex(vertices[v])) & (tableSize - 1);
+			while (table[slot] != NO_VERTEX && std::memcmp(&unique[table[slot]], &vertices[v], sizeof(Vertex)) != 0) {
+				slot = (slot + 1) & (tableSize - 1);
+			}
+			if (table[slot] == NO_VERTEX) {
+				table[slot] = static_cast<unsigned int>(unique.size());
+				unique.push_back(vertices[v]);
+			}
+			remap[v] = table[slot];
+		}
+
+		for (unsigned int& index : indices) {
+			index = remap[index];
+		}
+		vertices.swap(unique);
+		return vertices.size();
+	}
+
+	void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, size_t cacheSize, std::vector<size_t>* clusters)
+	{
+		if (clusters) {
+			clusters->clear();
+		}
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0 || vertexCount == 0) {
+			return;
+		}
+
+		const Adjacency adjacency(indices, vertexCount);
+		std::vector<uint32_t> liveTriangles(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			liveTriangles[v] = adjacency.count(static_cast<unsigned int>(v));
+		}
+		std::vector<bool> emitted(triangleCount, false);
+		FifoCache cache(vertexCount, cacheSize);
+
+		// recently used vertices, to restart from when a fan runs out of candidates
+		std::vector<unsigned int> deadEnds;
+		size_t cursor = 0;
+		auto skipDeadEnd = [&]() {
+			while (!deadEnds.empty()) {
+				unsigned int vertex = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[vertex] > 0) {
+					return vertex;
+				}
+			}
+			for (; cursor < vertexCount; cursor++) {
+				if (liveTriangles[cursor] > 0) {
+					return static_cast<unsigned int>(cursor);
+				}
+			}
+			return NO_VERTEX;
+		};
+
+		std::vector<unsigned int> result;
+		result.reserve(triangleCount * 3);
+		std::vector<unsigned int> candidates;
+
+		unsigned int fan = skipDeadEnd();
+		if (clusters) {
+			clusters->push_back(0);
+		}
+		while (fan != NO_VERTEX) {
+			candidates.clear();
+			for (uint32_t i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; i++) {
+				uint32_t triangle = adjacency.triangles[i];
+				if (emitted[triangle]) {
+					continue;
+				}
+				emitted[triangle] = true;
+				for (size_t corner = 0; corner < 3; corner++) {
+					unsigned int vertex = indices[triangle * 3 + corner];
+					result.push_back(vertex);
+					deadEnds.push_back(vertex);
+					candidates.push_back(vertex);
+					liveTriangles[vertex]--;
+					cache.touch(vertex);
+				}
+			}
+
+			// Prefer the candidate that entered the cache earliest, as long as its remaining triangles
+			// can still be emitted before it drops out.
+			unsigned int next = NO_VERTEX;
+			int64_t bestPriority = -1;
+			for (unsigned int vertex : candidates) {
+				if (liveTriangles[vertex] == 0) {
+					continue;
+				}
+				int64_t priority = 0;
+				int64_t age = cache.timestamp - cache.loadedAt[vertex];
+				if (age + 2 * static_cast<int64_t>(liveTriangles[vertex]) <= static_cast<int64_t>(cacheSize)) {
+					priority = age;
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					next = vertex;
+				}
+			}
+
+			if (next == NO_VERTEX) {
+				next = skipDeadEnd();
+				if (clusters && next != NO_VERTEX && clusters->back() != result.size() / 3) {
+					clusters->push_back(result.size() / 3);
+				}
+			}
+			fan = next;
+		}
+
+		indices.swap(result);
+	}
+
+	void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+		const std::vector<size_t>& clusters, size_t cacheSize, float threshold)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0 || clusters.empty()) {
+			return;
+		}
+
+		// Split every hard cluster as soon as the triangles since the last split reach the cache efficiency
+		// of the whole hard cluster times threshold. The cache is treated as cold after every split, since
+		// the split point can end up after any other cluster.
+		FifoCache cache(vertices.size(), cacheSize);
+		std::vector<size_t> softClusters;
+		for (size_t c = 0; c < clusters.size(); c++) {
+			const size_t start = clusters[c];
+			const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+			cache.flush();
+			size_t clusterMisses = 0;
+			for (size_t i = start * 3; i < end * 3; i++) {
+				clusterMisses += cache.touch(indices[i]) ? 1 : 0;
+			}
+			const float clusterThreshold = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+			softClusters.push_back(start);
+			cache.flush();
+			size_t misses = 0;
+			size_t triangles = 0;
+			for (size_t t = start; t < end; t++) {
+				for (size_t corner = 0; corner < 3; corner++) {
+					misses += cache.touch(indices[t * 3 + corner]) ? 1 : 0;
+				}
+				triangles++;
+				if (t + 1 < end && static_cast<float>(misses) <= clusterThreshold * static_cast<float>(triangles)) {
+					softClusters.push_back(t + 1);
+					cache.flush();
+					misses = 0;
+					triangles = 0;
+				}
+			}
+		}
+
+		// Area weighted centroid of the whole mesh.
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+		for (size_t t = 0; t < triangleCount; t++) {
+			float area = glm::length(triangleNormal(vertices, &indices[t * 3]));
+			meshCentroid += triangleCentroid(vertices, &indices[t * 3]) * area;
+			meshArea += area;
+		}
+		meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+		// Clusters on the outside facing outwards get the highest key.
+		std::vector<std::pair<float, size_t>> order(softClusters.size());
+		for (size_t c = 0; c < softClusters.size(); c++) {
+			const size_t start = softClusters[c];
+			const size_t end = c + 1 < softClusters.size() ? softClusters[c + 1] : triangleCount;
+
+			glm::vec3 centroid(0.0f);
+			glm::vec3 normal(0.0f);
+			float area = 0.0f;
+			for (size_t t = start; t < end; t++) {
+				glm::vec3 triangle = triangleNormal(vertices, &indices[t * 3]);
+				float triangleArea = glm::length(triangle);
+				centroid += triangleCentroid(vertices, &indices[t * 3]) * triangleArea;
+				normal += triangle;
+				area += triangleArea;
+			}
+
+			float key = 0.0f;
+			float normalLength = glm::length(normal);
+			if (area > 0.0f && normalLength > 0.0f) {
+				key = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+			}
+			order[c] = { key, c };
+		}
+		std::stable_sort(order.begin(), order.end(), [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) {
+			return a.first > b.first;
+		});
+
+		std::vector<unsigned int> result;
+		result.reserve(indices.size());
+		for (const auto& cluster : order) {
+			const size_t start = softClusters[cluster.second];
+			const size_t end = cluster.second + 1 < softClusters.size() ? softClusters[cluster.second + 1] : triangleCount;
+			result.insert(result.end(), indices.begin() + start * 3, indices.begin() + end * 3);
+		}
+		indices.swap(result);
+	}
+
+	void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+	{
+		std::vector<unsigned int> remap(vertices.size(), NO_VERTEX);
+		std::vector<Vertex> ordered;
+		ordered.reserve(vertices.size());
+		for (unsigned int& index : indices) {
+			if (remap[index] == NO_VERTEX) {
+				remap[index] = static_cast<unsigned int>(ordered.size());
+				ordered.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+		vertices.swap(ordered);
+	}
+
+	std::vector<MeshOptimizationStep> MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, size_t cacheSize)
+	{
+		std::vector<MeshOptimizationStep> steps;
+		// point and line faces are left alone
+		if (vertices.empty() || indices.empty() || indices.size() % 3 != 0) {
+			return steps;
+		}
+
+		auto beginStep = [&](const char* name) {
+			MeshOptimizationStep step;
+			step.name = name;
+			step.before = analyzeVertexCache(indices, vertices.size(), cacheSize);
+			steps.push_back(step);
+		};
+		auto endStep = [&]() {
+			steps.back().after = analyzeVertexCache(indices, vertices.size(), cacheSize);
+		};
+
+		beginStep("vertex deduplication");
+		deduplicateVertices(vertices, indices);
+		endStep();
+
+		std::vector<size_t> clusters;
+		beginStep("vertex cache");
+		optimizeVertexCache(indices, vertices.size(), cacheSize, &clusters);
+		endStep();
+
+		beginStep("overdraw");
+		optimizeOverdraw(indices, vertices, clusters, cacheSize);
+		endStep();
+
+		beginStep("vertex fetch");
+		optimizeVertexFetch(vertices, indices);
+		endStep();
+
+		return steps;
+	}
+}
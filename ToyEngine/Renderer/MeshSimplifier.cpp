@@ -0,0 +1,496 @@
+#include <Renderer/MeshSimplifier.h>
+#include <Renderer/MeshOptimizer.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace ToyEngine {
+	namespace {
+		// Meshes smaller than this are cheap enough at full detail.
+		constexpr size_t MIN_LOD_TRIANGLES = 64;
+		// A level has to drop at least this share of the previous level's triangles to be kept.
+		constexpr float MIN_LOD_REDUCTION = 0.2f;
+		// Error allowed for any level, relative to the mesh's bounding box diagonal.
+		constexpr float MAX_LOD_RELATIVE_ERROR = 0.1f;
+		// How strongly open borders and attribute seams resist moving away from their edges.
+		constexpr double BORDER_WEIGHT = 10.0;
+
+		// Sum of weighted squared distances to a set of planes, as p^T A p + 2 b.p + c.
+		struct Quadric {
+			double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+			double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+			double c = 0.0;
+			double weight = 0.0;
+
+			void addPlane(const glm::dvec3& normal, double distance, double planeWeight) {
+				a00 += planeWeight * normal.x * normal.x;
+				a01 += planeWeight * normal.x * normal.y;
+				a02 += planeWeight * normal.x * normal.z;
+				a11 += planeWeight * normal.y * normal.y;
+				a12 += planeWeight * normal.y * normal.z;
+				a22 += planeWeight * normal.z * normal.z;
+				b0 += planeWeight * normal.x * distance;
+				b1 += planeWeight * normal.y * distance;
+				b2 += planeWeight * normal.z * distance;
+				c += planeWeight * distance * distance;
+				weight += planeWeight;
+			}
+
+			Quadric& operator+=(const Quadric& other) {
+				a00 += other.a00; a01 += other.a01; a02 += other.a02;
+				a11 += other.a11; a12 += other.a12; a22 += other.a22;
+				b0 += other.b0; b1 += other.b1; b2 += other.b2;
+				c += other.c;
+				weight += other.weight;
+				return *this;
+			}
+
+			// Mean squared distance of p to the planes.
+			double evaluate(const glm::dvec3& p) const {
+				double sum = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+					+ 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+					+ 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+				return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+			}
+		};
+
+		struct Collapse {
+			uint32_t from;
+			uint32_t to;
+			// bits of the float cost, which order like the cost since it is never negative
+			uint32_t costKey;
+		};
+
+		// LSD radix sort on the cost, 4 passes of 8 bits. Much cheaper than a comparison sort
+		// for the hundreds of thousands of candidates of a large mesh.
+		void sortCollapses(std::vector<Collapse>& collapses, std::vector<Collapse>& scratch) {
+			scratch.resize(collapses.size());
+			for (int shift = 0; shift < 32; shift += 8) {
+				size_t histogram[256] = {};
+				for (const Collapse& collapse : collapses) {
+					histogram[(collapse.costKey >> shift) & 0xFF]++;
+				}
+				size_t offset = 0;
+				for (size_t& bucket : histogram) {
+					size_t bucketSize = bucket;
+					bucket = offset;
+					offset += bucketSize;
+				}
+				for (const Collapse& collapse : collapses) {
+					scratch[histogram[(collapse.costKey >> shift) & 0xFF]++] = collapse;
+				}
+				collapses.swap(scratch);
+			}
+		}
+
+		uint32_t makeCostKey(double cost) {
+			float value = static_cast<float>(cost);
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+
+		double getCost(uint32_t costKey) {
+			float value;
+			std::memcpy(&value, &costKey, sizeof(value));
+			return value;
+		}
+
+		struct PositionHash {
+			size_t operator()(const glm::vec3& p) const {
+				uint32_t bits[3];
+				std::memcpy(bits, &p, sizeof(bits));
+				return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+			}
+		};
+
+		uint64_t edgeKey(uint32_t a, uint32_t b) {
+			return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+		}
+
+		// Moving from onto to must not turn any remaining triangle around from upside down.
+		bool flipsTriangle(const std::vector<glm::dvec3>& positions, const uint32_t* triangle, uint32_t from, uint32_t to) {
+			glm::dvec3 before[3];
+			glm::dvec3 after[3];
+			for (int i = 0; i < 3; i++) {
+				before[i] = positions[triangle[i]];
+				after[i] = triangle[i] == from ? positions[to] : before[i];
+			}
+			glm::dvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::dvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+			return glm::dot(normalBefore, normalAfter) <= 0.0;
+		}
+
+		// Distance from p to the triangle abc, from the closest point test in Ericson's Real-Time Collision Detection.
+		double pointTriangleDistance(const glm::dvec3& p, const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c) {
+			const glm::dvec3 ab = b - a;
+			const glm::dvec3 ac = c - a;
+			const glm::dvec3 ap = p - a;
+			const double d1 = glm::dot(ab, ap);
+			const double d2 = glm::dot(ac, ap);
+			if (d1 <= 0.0 && d2 <= 0.0) {
+				return glm::distance(p, a);
+			}
+			const glm::dvec3 bp = p - b;
+			const double d3 = glm::dot(ab, bp);
+			const double d4 = glm::dot(ac, bp);
+			if (d3 >= 0.0 && d4 <= d3) {
+				return glm::distance(p, b);
+			}
+			const double vc = d1 * d4 - d3 * d2;
+			if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+				return glm::distance(p, a + ab * (d1 / (d1 - d3)));
+			}
+			const glm::dvec3 cp = p - c;
+			const double d5 = glm::dot(ab, cp);
+			const double d6 = glm::dot(ac, cp);
+			if (d6 >= 0.0 && d5 <= d6) {
+				return glm::distance(p, c);
+			}
+			const double vb = d5 * d2 - d1 * d6;
+			if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+				return glm::distance(p, a + ac * (d2 / (d2 - d6)));
+			}
+			const double va = d3 * d6 - d5 * d4;
+			if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0) {
+				return glm::distance(p, b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+			}
+			// inside, unless the triangle has no area
+			const double area = va + vb + vc;
+			if (area <= 0.0) {
+				return std::min({ glm::distance(p, a), glm::distance(p, b), glm::distance(p, c) });
+			}
+			return glm::distance(p, a + ab * (vb / area) + ac * (vc / area));
+		}
+
+		// Largest distance of an original position to the triangles around the position it ended up collapsed
+		// onto. Those are a part of the simplified surface, so this is at least the distance to the surface.
+		// The quadric cost is a mean over the planes, which can be far below the deviation of a single vertex.
+		double measureDeviation(const std::vector<glm::dvec3>& positions, const std::vector<uint32_t>& triangles, std::vector<uint32_t>& mergedInto) {
+			const size_t positionCount = positions.size();
+			std::vector<uint32_t> offsets(positionCount + 1, 0);
+			for (uint32_t p : triangles) {
+				offsets[p + 1]++;
+			}
+			for (size_t p = 0; p < positionCount; p++) {
+				offsets[p + 1] += offsets[p];
+			}
+			std::vector<uint32_t> around(triangles.size());
+			{
+				std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+				for (size_t i = 0; i < triangles.size(); i++) {
+					around[fill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+
+			double deviation = 0.0;
+			for (uint32_t p = 0; p < positionCount; p++) {
+				uint32_t target = mergedInto[p];
+				while (mergedInto[target] != target) {
+					target = mergedInto[target];
+				}
+				// Later positions collapsed onto this one skip the rest of the chain.
+				mergedInto[p] = target;
+				if (target == p) {
+					continue;
+				}
+				double distance = glm::distance(positions[p], positions[target]);
+				for (uint32_t i = offsets[target]; i < offsets[target + 1]; i++) {
+					const uint32_t* triangle = &triangles[around[i] * 3];
+					distance = std::min(distance, pointTriangleDistance(positions[p], positions[triangle[0]], positions[triangle[1]], positions[triangle[2]]));
+				}
+				deviation = std::max(deviation, distance);
+			}
+			return deviation;
+		}
+
+		// Of the vertices at a position, the one whose attributes are closest to the corner's original vertex.
+		uint32_t closestWedge(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& wedges, uint32_t original) {
+			const Vertex& reference = vertices[original];
+			uint32_t best = wedges[0];
+			float bestScore = std::numeric_limits<float>::max();
+			for (uint32_t wedge : wedges) {
+				glm::vec2 uvOffset = vertices[wedge].TexCoords - reference.TexCoords;
+				float score = glm::dot(uvOffset, uvOffset) + (1.0f - glm::dot(vertices[wedge].Normal, reference.Normal));
+				if (score < bestScore) {
+					bestScore = score;
+					best = wedge;
+				}
+			}
+			return best;
+		}
+	}
+
+	std::vector<unsigned int> MeshSimplifier::simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+		size_t targetIndexCount, float maxError, float* error)
+	{
+		if (error) {
+			*error = 0.0f;
+		}
+
+		// Collapses work on positions. Vertices that only differ in normal or UV move together.
+		std::vector<uint32_t> positionOf(vertices.size());
+		std::vector<glm::dvec3> positions;
+		std::vector<std::vector<uint32_t>> wedges;
+		{
+			std::unordered_map<glm::vec3, uint32_t, PositionHash> unique;
+			unique.reserve(vertices.size());
+			for (uint32_t v = 0; v < vertices.size(); v++) {
+				auto [iter, inserted] = unique.emplace(vertices[v].Position, static_cast<uint32_t>(positions.size()));
+				if (inserted) {
+					positions.emplace_back(vertices[v].Position);
+					wedges.emplace_back();
+				}
+				positionOf[v] = iter->second;
+				wedges[iter->second].push_back(v);
+			}
+		}
+		const uint32_t positionCount = static_cast<uint32_t>(positions.size());
+
+		// corners keeps the original vertices for the output, triangles the positions they currently sit on
+		std::vector<uint32_t> corners;
+		std::vector<uint32_t> triangles;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			uint32_t a = positionOf[indices[i]], b = positionOf[indices[i + 1]], c = positionOf[indices[i + 2]];
+			if (a == b || b == c || a == c) {
+				continue;
+			}
+			corners.insert(corners.end(), { indices[i], indices[i + 1], indices[i + 2] });
+			triangles.insert(triangles.end(), { a, b, c });
+		}
+
+		std::vector<Quadric> quadrics(positionCount);
+		struct EdgeUse {
+			uint32_t count = 0;
+			// original vertices of the first triangle using the edge, in the order of the edge key
+			uint32_t wedgeLow = 0;
+			uint32_t wedgeHigh = 0;
+			bool seam = false;
+			glm::dvec3 faceNormal = glm::dvec3(0.0);
+		};
+		std::unordered_map<uint64_t, EdgeUse> edges;
+		edges.reserve(triangles.size());
+
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+			const glm::dvec3& p0 = positions[triangles[t]];
+			glm::dvec3 normal = glm::cross(positions[triangles[t + 1]] - p0, positions[triangles[t + 2]] - p0);
+			double length = glm::length(normal);
+			if (length > 0.0) {
+				normal /= length;
+				// weighted by area so that many small triangles do not outweigh a large one
+				Quadric plane;
+				plane.addPlane(normal, -glm::dot(normal, p0), length * 0.5);
+				for (int i = 0; i < 3; i++) {
+					quadrics[triangles[t + i]] += plane;
+				}
+			}
+
+			for (int i = 0; i < 3; i++) {
+				uint32_t a = triangles[t + i], b = triangles[t + (i + 1) % 3];
+				uint32_t wedgeA = corners[t + i], wedgeB = corners[t + (i + 1) % 3];
+				if (a > b) {
+					std::swap(a, b);
+					std::swap(wedgeA, wedgeB);
+				}
+				EdgeUse& use = edges[edgeKey(a, b)];
+				if (use.count == 0) {
+					use.wedgeLow = wedgeA;
+					use.wedgeHigh = wedgeB;
+					use.faceNormal = normal;
+				}
+				else if (use.wedgeLow != wedgeA || use.wedgeHigh != wedgeB) {
+					use.seam = true;
+				}
+				use.count++;
+			}
+		}
+
+		// Open borders and attribute seams get a plane through the edge, perpendicular to the surface,
+		// so that collapses along them are cheap and collapses away from them are not.
+		for (const auto& [key, use] : edges) {
+			if (use.count != 1 && !use.seam) {
+				continue;
+			}
+			uint32_t a = static_cast<uint32_t>(key >> 32), b = static_cast<uint32_t>(key & 0xFFFFFFFF);
+			glm::dvec3 edge = positions[b] - positions[a];
+			glm::dvec3 normal = glm::cross(edge, use.faceNormal);
+			double length = glm::length(normal);
+			if (length <= 0.0) {
+				continue;
+			}
+			normal /= length;
+			Quadric plane;
+			plane.addPlane(normal, -glm::dot(normal, positions[a]), glm::dot(edge, edge) * BORDER_WEIGHT);
+			quadrics[a] += plane;
+			quadrics[b] += plane;
+		}
+
+		const size_t targetTriangles = targetIndexCount / 3;
+		const double maxCost = double(maxError) * double(maxError);
+
+		// where every position went over all passes, for the error
+		std::vector<uint32_t> mergedInto(positionCount);
+		for (uint32_t p = 0; p < positionCount; p++) {
+			mergedInto[p] = p;
+		}
+		std::vector<uint32_t> collapsedTo(positionCount);
+		std::vector<uint8_t> touched(positionCount);
+		std::vector<uint32_t> adjacencyOffsets(positionCount + 1);
+		std::vector<uint32_t> adjacency;
+		std::vector<Collapse> collapses;
+		std::vector<Collapse> collapsesScratch;
+
+		// Every pass collapses a set of edges that do not share triangles, cheapest first, then rebuilds the triangles.
+		while (triangles.size() / 3 > targetTriangles) {
+			const size_t triangleCount = triangles.size() / 3;
+
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+			for (uint32_t p : triangles) {
+				adjacencyOffsets[p + 1]++;
+			}
+			for (uint32_t p = 0; p < positionCount; p++) {
+				adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+			}
+			adjacency.resize(triangles.size());
+			{
+				std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < triangles.size(); i++) {
+					adjacency[fill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+
+			collapses.clear();
+			for (size_t t = 0; t < triangles.size(); t += 3) {
+				for (int i = 0; i < 3; i++) {
+					// Interior edges come up twice, once from each triangle. The second copy is skipped as touched.
+					uint32_t a = triangles[t + i], b = triangles[t + (i + 1) % 3];
+					Quadric sum = quadrics[a];
+					sum += quadrics[b];
+					double costToB = sum.evaluate(positions[b]);
+					double costToA = sum.evaluate(positions[a]);
+					if (costToB <= costToA) {
+						collapses.push_back({ a, b, makeCostKey(costToB) });
+					}
+					else {
+						collapses.push_back({ b, a, makeCostKey(costToA) });
+					}
+				}
+			}
+			sortCollapses(collapses, collapsesScratch);
+
+			for (uint32_t p = 0; p < positionCount; p++) {
+				collapsedTo[p] = p;
+			}
+			std::fill(touched.begin(), touched.end(), 0);
+
+			// Each collapse removes about two triangles.
+			size_t remainingCollapses = (triangleCount - targetTriangles + 1) / 2;
+			size_t applied = 0;
+			for (const Collapse& collapse : collapses) {
+				double cost = getCost(collapse.costKey);
+				if (cost > maxCost || applied >= remainingCollapses) {
+					break;
+				}
+				if (touched[collapse.from] || touched[collapse.to]) {
+					continue;
+				}
+
+				bool flips = false;
+				for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1] && !flips; i++) {
+					const uint32_t* triangle = &triangles[adjacency[i] * 3];
+					if (triangle[0] != collapse.to && triangle[1] != collapse.to && triangle[2] != collapse.to) {
+						flips = flipsTriangle(positions, triangle, collapse.from, collapse.to);
+					}
+				}
+				if (flips) {
+					continue;
+				}
+
+				collapsedTo[collapse.from] = collapse.to;
+				mergedInto[collapse.from] = collapse.to;
+				quadrics[collapse.to] += quadrics[collapse.from];
+				applied++;
+
+				// The triangles around from change shape, so none of their vertices may move again in this pass.
+				for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1]; i++) {
+					const uint32_t* triangle = &triangles[adjacency[i] * 3];
+					touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+				}
+				touched[collapse.to] = 1;
+			}
+
+			if (applied == 0) {
+				break;
+			}
+
+			size_t kept = 0;
+			for (size_t t = 0; t < triangles.size(); t += 3) {
+				uint32_t a = collapsedTo[triangles[t]], b = collapsedTo[triangles[t + 1]], c = collapsedTo[triangles[t + 2]];
+				if (a == b || b == c || a == c) {
+					continue;
+				}
+				triangles[kept] = a;
+				triangles[kept + 1] = b;
+				triangles[kept + 2] = c;
+				corners[kept] = corners[t];
+				corners[kept + 1] = corners[t + 1];
+				corners[kept + 2] = corners[t + 2];
+				kept += 3;
+			}
+			triangles.resize(kept);
+			corners.resize(kept);
+		}
+
+		// A corner that moved takes the vertex at its new position that looks most like its old one.
+		std::vector<unsigned int> result(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i++) {
+			result[i] = positionOf[corners[i]] == triangles[i] ? corners[i] : closestWedge(vertices, wedges[triangles[i]], corners[i]);
+		}
+
+		if (error) {
+			*error = static_cast<float>(measureDeviation(positions, triangles, mergedInto));
+		}
+		return result;
+	}
+
+	std::vector<LodIndices> MeshSimplifier::buildLods(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, size_t maxLevels)
+	{
+		std::vector<LodIndices> lods;
+		if (vertices.empty() || indices.size() / 3 < MIN_LOD_TRIANGLES || maxLevels < 2) {
+			return lods;
+		}
+
+		glm::vec3 min = vertices[0].Position;
+		glm::vec3 max = vertices[0].Position;
+		for (const auto& vertex : vertices) {
+			min = glm::min(min, vertex.Position);
+			max = glm::max(max, vertex.Position);
+		}
+		const float maxError = glm::length(max - min) * MAX_LOD_RELATIVE_ERROR;
+
+		// Each level starts from the full mesh rather than the previous level, so errors do not stack up.
+		size_t previousCount = indices.size();
+		for (size_t level = 1; level < maxLevels; level++) {
+			float ratio = std::pow(0.1f, static_cast<float>(level) / static_cast<float>(maxLevels - 1));
+			size_t target = static_cast<size_t>(static_cast<float>(indices.size()) * ratio) / 3 * 3;
+
+			LodIndices lod;
+			lod.indices = simplify(vertices, indices, target, maxError, &lod.error);
+			if (lod.indices.empty() || static_cast<float>(lod.indices.size()) > static_cast<float>(previousCount) * (1.0f - MIN_LOD_REDUCTION)) {
+				break;
+			}
+			// A coarser level is never more accurate than a finer one.
+			if (!lods.empty()) {
+				lod.error = std::max(lod.error, lods.back().error);
+			}
+			// Collapses leave holes in the original triangle order, so reorder for the vertex cache again.
+			MeshOptimizer::optimizeVertexCache(lod.indices, vertices.size());
+			previousCount = lod.indices.size();
+			lods.push_back(std::move(lod));
+		}
+		return lods;
+	}
+}
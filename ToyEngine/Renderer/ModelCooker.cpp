@@ -0,0 +1,717 @@
+#include <Renderer/ModelCooker.h>
+#include <Renderer/OcclusionCuller.h>
+#include <Utils/VirtualFileSystem.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+
+namespace ToyEngine {
+	namespace {
+		const char* CACHE_DIRECTORY = "ModelCache";
+		const char* STAMPS_EXTENSION = ".stamps";
+		// "TMSH"
+		constexpr uint32_t MAGIC = 0x48534D54;
+		// "TSTP"
+		constexpr uint32_t STAMPS_MAGIC = 0x50545354;
+		// Every section and blob starts on a cache line, the packed geometry is copied from the mapping as it is.
+		constexpr size_t ALIGNMENT = 64;
+
+		// The file starts with the header, then the record sections, the pool, the string table and the
+		// blobs, all at offsets from the start of the file.
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t key;
+			uint32_t nodeCount;
+			uint32_t meshCount;
+			uint32_t lodCount;
+			uint32_t materialCount;
+			uint32_t textureCount;
+			// uint32_t entries
+			uint32_t poolCount;
+			uint32_t sourceCount;
+			uint32_t padding;
+			uint64_t sources;
+			uint64_t nodes;
+			uint64_t meshes;
+			uint64_t lods;
+			uint64_t materials;
+			uint64_t textures;
+			uint64_t pool;
+			uint64_t strings;
+			uint64_t stringsSize;
+		};
+
+		// In the string table.
+		struct StringRecord {
+			uint32_t offset;
+			uint32_t length;
+		};
+
+		// A file the model was imported from, see ImportedSource. Its size and time are in the stamps file.
+		struct SourceRecord {
+			StringRecord path;
+			uint32_t exists;
+			uint32_t padding;
+			uint64_t hash;
+		};
+
+		// Root first, mesh and child indices are ranges in the pool.
+		struct NodeRecord {
+			StringRecord name;
+			uint32_t firstMesh;
+			uint32_t meshCount;
+			uint32_t firstChild;
+			uint32_t childCount;
+		};
+
+		struct MeshRecord {
+			StringRecord name;
+			uint32_t material;
+			uint32_t hasNormals;
+			uint32_t hasTexCoords;
+			uint32_t positionFormat;
+			uint32_t skinned;
+			uint32_t indexType;
+			// levels 1 and up in the lod section
+			uint32_t firstLod;
+			uint32_t lodCount;
+			uint64_t vertexCount;
+			uint64_t indexCount;
+			// MeshGeometryData::pack()
+			uint64_t packedOffset;
+			uint64_t packedSize;
+			float boundsMin[3];
+			float boundsMax[3];
+			float boundsCenter[3];
+			float boundsRadius;
+			float dequantization[4];
+			// the positions as float triples followed by the indices, no occluder without triangles
+			uint64_t occluderOffset;
+			uint32_t occluderPositionCount;
+			uint32_t occluderIndexCount;
+			uint32_t occluderExact;
+			// of the layout, see VertexLayout::get
+			uint32_t halfTexCoords;
+		};
+
+		struct LodRecord {
+			uint64_t indexCount;
+			float error;
+			uint32_t padding;
+		};
+
+		// Diffuse textures are a range in the pool, texture indices are -1 without one.
+		struct MaterialRecord {
+			float ambientColor[4];
+			float diffuseColor[4];
+			float specularColor[4];
+			float shininess;
+			uint32_t isEmbedded;
+			uint32_t firstDiffuse;
+			uint32_t diffuseCount;
+			int32_t specularTexture;
+			int32_t heightTexture;
+			int32_t normalTexture;
+			int32_t ambientTexture;
+		};
+
+		struct TextureRecord {
+			StringRecord path;
+			uint32_t type;
+			uint32_t isEmbedded;
+			// the compressed image of an embedded texture
+			uint64_t dataOffset;
+			uint64_t dataSize;
+		};
+
+		// Next to the cooked file, the status of every source when its hash was last checked. It only saves
+		// reading the sources, without it they are hashed, and it is replaced when they turn out unchanged.
+		struct StampsHeader {
+			uint32_t magic;
+			uint32_t sourceCount;
+			uint64_t key;
+		};
+
+		struct StampRecord {
+			uint64_t size;
+			int64_t modifiedTime;
+
+			bool operator==(const StampRecord& other) const {
+				return size == other.size && modifiedTime == other.modifiedTime;
+			}
+		};
+
+		static_assert(std::is_trivially_copyable<MeshRecord>::value && sizeof(MeshRecord) % 8 == 0, "Records are read in place.");
+		static_assert(sizeof(Header) % 8 == 0 && sizeof(SourceRecord) % 8 == 0 && sizeof(NodeRecord) % 4 == 0 && sizeof(LodRecord) % 8 == 0
+			&& sizeof(MaterialRecord) % 4 == 0 && sizeof(TextureRecord) % 8 == 0, "Records are read in place.");
+
+		size_t alignUp(size_t value, size_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		// FNV-1a over 8 byte words, the source files of large scenes are hundreds of megabytes.
+		uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+			size_t i = 0;
+			for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+				uint64_t word;
+				std::memcpy(&word, data + i, sizeof(word));
+				hash ^= word;
+				hash *= 1099511628211ull;
+			}
+			for (; i < size; i++) {
+				hash ^= data[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		template<typename T>
+		uint64_t hashValue(T value, uint64_t hash) {
+			return hashBytes(reinterpret_cast<const uint8_t*>(&value), sizeof(value), hash);
+		}
+
+		// Plain data, stored as it is in memory.
+		template<typename T>
+		void append(std::vector<uint8_t>& bytes, const T* values, size_t count) {
+			const size_t offset = bytes.size();
+			bytes.resize(offset + count * sizeof(T));
+			if (count > 0) {
+				std::memcpy(&bytes[offset], values, count * sizeof(T));
+			}
+		}
+
+		template<typename T>
+		uint64_t appendSection(std::vector<uint8_t>& bytes, const std::vector<T>& records) {
+			bytes.resize(alignUp(bytes.size(), ALIGNMENT));
+			const uint64_t offset = bytes.size();
+			append(bytes, records.data(), records.size());
+			return offset;
+		}
+
+		std::string getStampsPath(const std::string& cookedPath) {
+			return cookedPath + STAMPS_EXTENSION;
+		}
+
+		// Empty when there is none for key.
+		std::vector<StampRecord> readStamps(const std::string& cookedPath, uint64_t key, uint32_t sourceCount) {
+			const FileData file = VirtualFileSystem::getInstance().read(getStampsPath(cookedPath));
+			StampsHeader header;
+			if (!file.isValid() || file.size != sizeof(header) + sourceCount * sizeof(StampRecord)) {
+				return {};
+			}
+			std::memcpy(&header, file.data, sizeof(header));
+			if (header.magic != STAMPS_MAGIC || header.key != key || header.sourceCount != sourceCount) {
+				return {};
+			}
+			std::vector<StampRecord> stamps(sourceCount);
+			if (sourceCount > 0) {
+				std::memcpy(stamps.data(), file.data + sizeof(header), stamps.size() * sizeof(StampRecord));
+			}
+			return stamps;
+		}
+
+		// Replaced as a whole, readers may have it mapped.
+		void writeStamps(const std::string& cookedPath, uint64_t key, const std::vector<StampRecord>& stamps) {
+			const StampsHeader header = { STAMPS_MAGIC, static_cast<uint32_t>(stamps.size()), key };
+			const std::string stampsPath = getStampsPath(cookedPath);
+			const std::string temporaryPath = stampsPath + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+			std::error_code error;
+			std::filesystem::create_directories(std::filesystem::path(stampsPath).parent_path(), error);
+			{
+				std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+				file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				file.write(reinterpret_cast<const char*>(stamps.data()), static_cast<std::streamsize>(stamps.size() * sizeof(StampRecord)));
+				if (!file) {
+					file.close();
+					std::filesystem::remove(temporaryPath, error);
+					return;
+				}
+			}
+			std::filesystem::rename(temporaryPath, stampsPath, error);
+			if (error) {
+				std::filesystem::remove(temporaryPath, error);
+			}
+		}
+
+		class StringTable
+		{
+		public:
+			StringRecord add(const std::string& text) {
+				StringRecord record = { static_cast<uint32_t>(mBytes.size()), static_cast<uint32_t>(text.size()) };
+				mBytes.insert(mBytes.end(), text.begin(), text.end());
+				return record;
+			}
+
+			const std::vector<uint8_t>& getBytes() const {
+				return mBytes;
+			}
+
+		private:
+			std::vector<uint8_t> mBytes;
+		};
+
+		// Bounds checked access to a cooked file.
+		class CookedReader
+		{
+		public:
+			CookedReader(const FileData& file, const Header& header) : mData(file.data), mSize(file.size), mHeader(header) {}
+
+			bool contains(uint64_t offset, uint64_t size) const {
+				return offset <= mSize && size <= mSize - offset;
+			}
+
+			// In place, files are read page or ALIGNMENT aligned and so is every section. Null when out of bounds.
+			template<typename T>
+			const T* getRecords(uint64_t offset, uint64_t count) const {
+				if (count == 0) {
+					return reinterpret_cast<const T*>(mData);
+				}
+				if (offset % alignof(T) != 0 || count > mSize / sizeof(T) || !contains(offset, count * sizeof(T))) {
+					return nullptr;
+				}
+				return reinterpret_cast<const T*>(mData + offset);
+			}
+
+			bool getString(const StringRecord& record, std::string& text) const {
+				if (static_cast<uint64_t>(record.offset) + record.length > mHeader.stringsSize) {
+					return false;
+				}
+				text.assign(reinterpret_cast<const char*>(mData + mHeader.strings + record.offset), record.length);
+				return true;
+			}
+
+			// A range of the pool.
+			const uint32_t* getPool(uint32_t first, uint32_t count) const {
+				if (static_cast<uint64_t>(first) + count > mHeader.poolCount) {
+					return nullptr;
+				}
+				return reinterpret_cast<const uint32_t*>(mData + mHeader.pool) + first;
+			}
+
+		private:
+			const uint8_t* mData;
+			size_t mSize;
+			const Header& mHeader;
+		};
+
+		// Whether every source is still what the model was cooked from. Only sources whose size or time
+		// changed since they were last checked are read and hashed.
+		bool isUpToDate(const std::string& cookedPath, uint64_t key, const CookedReader& reader, const Header& header) {
+			const SourceRecord* records = reader.getRecords<SourceRecord>(header.sources, header.sourceCount);
+			if (!records) {
+				return false;
+			}
+			const VirtualFileSystem& fileSystem = VirtualFileSystem::getInstance();
+			const std::vector<StampRecord> stamps = readStamps(cookedPath, key, header.sourceCount);
+			std::vector<StampRecord> currentStamps(header.sourceCount);
+			bool hashed = false;
+			for (uint32_t i = 0; i < header.sourceCount; i++) {
+				std::string path;
+				if (!reader.getString(records[i].path, path)) {
+					return false;
+				}
+				const FileStatus status = fileSystem.getStatus(path);
+				if (status.exists != (records[i].exists != 0)) {
+					return false;
+				}
+				if (!status.exists) {
+					continue;
+				}
+				currentStamps[i] = { status.size, status.modifiedTime };
+				if (!stamps.empty() && stamps[i] == currentStamps[i]) {
+					continue;
+				}
+				if (ModelCooker::hashSource(fileSystem.read(path)) != records[i].hash) {
+					return false;
+				}
+				hashed = true;
+			}
+			// Touched but unchanged, like after a checkout.
+			if (hashed) {
+				writeStamps(cookedPath, key, currentStamps);
+			}
+			return true;
+		}
+	}
+
+	uint64_t ModelCooker::computeKey(const std::string& sourcePath, unsigned int importFlags, PositionFormat positionFormat)
+	{
+		// External texture paths are resolved against the model's directory at import.
+		const std::string name = VirtualFileSystem::normalize(sourcePath);
+		uint64_t hash = hashBytes(reinterpret_cast<const uint8_t*>(name.data()), name.size());
+		hash = hashValue<uint32_t>(importFlags, hash);
+		hash = hashValue<uint32_t>(static_cast<uint32_t>(positionFormat), hash);
+		hash = hashValue<uint32_t>(VERSION, hash);
+		return hash == 0 ? 1 : hash;
+	}
+
+	uint64_t ModelCooker::hashSource(const FileData& file)
+	{
+		return hashValue<uint64_t>(file.size, hashBytes(file.data, file.size));
+	}
+
+	std::string ModelCooker::getCookedPath(uint64_t key)
+	{
+		std::stringstream fileName;
+		fileName << std::hex << std::setw(16) << std::setfill('0') << key << ".tmesh";
+		return (std::filesystem::path(CACHE_DIRECTORY) / fileName.str()).string();
+	}
+
+	bool ModelCooker::write(const std::string& cookedPath, uint64_t key, const ModelImport& import)
+	{
+		StringTable strings;
+		std::vector<uint32_t> pool;
+		std::vector<NodeRecord> nodes;
+		std::vector<MeshRecord> meshes;
+		std::vector<LodRecord> lods;
+		std::vector<MaterialRecord> materials;
+		std::vector<TextureRecord> textures;
+
+		for (const ImportedNode& node : import.nodes) {
+			NodeRecord record = { strings.add(node.name) };
+			record.firstMesh = static_cast<uint32_t>(pool.size());
+			record.meshCount = static_cast<uint32_t>(node.meshes.size());
+			pool.insert(pool.end(), node.meshes.begin(), node.meshes.end());
+			record.firstChild = static_cast<uint32_t>(pool.size());
+			record.childCount = static_cast<uint32_t>(node.children.size());
+			pool.insert(pool.end(), node.children.begin(), node.children.end());
+			nodes.push_back(record);
+		}
+
+		for (const ImportedMaterial& material : import.materials) {
+			MaterialRecord record = {};
+			std::memcpy(record.ambientColor, &material.ambientColor[0], sizeof(record.ambientColor));
+			std::memcpy(record.diffuseColor, &material.diffuseColor[0], sizeof(record.diffuseColor));
+			std::memcpy(record.specularColor, &material.specularColor[0], sizeof(record.specularColor));
+			record.shininess = material.shininess;
+			record.isEmbedded = material.isEmbedded;
+			record.firstDiffuse = static_cast<uint32_t>(pool.size());
+			record.diffuseCount = static_cast<uint32_t>(material.diffuseTextures.size());
+			for (int32_t texture : material.diffuseTextures) {
+				pool.push_back(static_cast<uint32_t>(texture));
+			}
+			record.specularTexture = material.specularTexture;
+			record.heightTexture = material.heightTexture;
+			record.normalTexture = material.normalTexture;
+			record.ambientTexture = material.ambientTexture;
+			materials.push_back(record);
+		}
+
+		// The blobs go after everything else, their offsets are set once the size of the rest is known.
+		std::vector<uint64_t> blobSizes;
+		for (const ImportedMesh& mesh : import.meshes) {
+			const MeshGeometryData* data = mesh.data.get();
+			if (!data) {
+				return false;
+			}
+			MeshRecord record = {};
+			record.name = strings.add(mesh.name);
+			record.material = mesh.material;
+			record.hasNormals = mesh.hasNormals;
+			record.hasTexCoords = mesh.hasTexCoords;
+			record.positionFormat = static_cast<uint32_t>(data->layout->getPositionFormat());
+			record.skinned = data->layout->isSkinned();
+			record.halfTexCoords = data->layout->hasHalfTexCoords();
+			record.indexType = data->indexType;
+			record.firstLod = static_cast<uint32_t>(lods.size());
+			record.lodCount = static_cast<uint32_t>(data->lods.size());
+			record.vertexCount = data->vertexCount;
+			record.indexCount = data->getIndexCount(0);
+			uint64_t indexCount = record.indexCount;
+			for (size_t level = 1; level <= data->lods.size(); level++) {
+				lods.push_back({ data->getIndexCount(level), data->lods[level - 1].error, 0 });
+				indexCount += data->getIndexCount(level);
+			}
+			record.packedSize = data->getVertexBytes() + indexCount * GeometryPool::getIndexSize(data->indexType);
+			std::memcpy(record.boundsMin, &data->bounds.min[0], sizeof(record.boundsMin));
+			std::memcpy(record.boundsMax, &data->bounds.max[0], sizeof(record.boundsMax));
+			std::memcpy(record.boundsCenter, &data->bounds.center[0], sizeof(record.boundsCenter));
+			record.boundsRadius = data->bounds.radius;
+			std::memcpy(record.dequantization, &data->dequantization[0], sizeof(record.dequantization));
+			if (data->occluder) {
+				record.occluderPositionCount = static_cast<uint32_t>(data->occluder->positions.size());
+				record.occluderIndexCount = static_cast<uint32_t>(data->occluder->indices.size());
+				record.occluderExact = data->occluder->exact ? 1 : 0;
+			}
+			blobSizes.push_back(record.packedSize);
+			blobSizes.push_back(record.occluderPositionCount * sizeof(float) * 3 + record.occluderIndexCount * sizeof(uint32_t));
+			meshes.push_back(record);
+		}
+
+		for (const ImportedTexture& texture : import.textures) {
+			TextureRecord record = { strings.add(texture.path) };
+			record.type = static_cast<uint32_t>(texture.type);
+			record.isEmbedded = texture.isEmbedded;
+			record.dataSize = texture.embeddedData.size();
+			blobSizes.push_back(record.dataSize);
+			textures.push_back(record);
+		}
+
+		std::vector<SourceRecord> sources;
+		std::vector<StampRecord> stamps;
+		for (const ImportedSource& source : import.sources) {
+			SourceRecord record = { strings.add(source.path) };
+			record.exists = source.status.exists;
+			record.hash = source.hash;
+			sources.push_back(record);
+			stamps.push_back({ source.status.size, source.status.modifiedTime });
+		}
+
+		Header header = {};
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.key = key;
+		header.sourceCount = static_cast<uint32_t>(sources.size());
+		header.nodeCount = static_cast<uint32_t>(nodes.size());
+		header.meshCount = static_cast<uint32_t>(meshes.size());
+		header.lodCount = static_cast<uint32_t>(lods.size());
+		header.materialCount = static_cast<uint32_t>(materials.size());
+		header.textureCount = static_cast<uint32_t>(textures.size());
+		header.poolCount = static_cast<uint32_t>(pool.size());
+
+		// Everything but the blobs, the sizes and offsets are the same on the second pass.
+		std::vector<uint8_t> bytes;
+		for (int pass = 0; pass < 2; pass++) {
+			bytes.clear();
+			append(bytes, &header, 1);
+			header.sources = appendSection(bytes, sources);
+			header.nodes = appendSection(bytes, nodes);
+			header.meshes = appendSection(bytes, meshes);
+			header.lods = appendSection(bytes, lods);
+			header.materials = appendSection(bytes, materials);
+			header.textures = appendSection(bytes, textures);
+			header.pool = appendSection(bytes, pool);
+			header.strings = appendSection(bytes, strings.getBytes());
+			header.stringsSize = strings.getBytes().size();
+
+			uint64_t offset = alignUp(bytes.size(), ALIGNMENT);
+			size_t blob = 0;
+			for (MeshRecord& record : meshes) {
+				record.packedOffset = offset;
+				offset = alignUp(offset + blobSizes[blob++], ALIGNMENT);
+				record.occluderOffset = offset;
+				offset = alignUp(offset + blobSizes[blob++], ALIGNMENT);
+			}
+			for (TextureRecord& record : textures) {
+				record.dataOffset = offset;
+				offset = alignUp(offset + blobSizes[blob++], ALIGNMENT);
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(cookedPath).parent_path(), error);
+		// Named after the thread, two imports of the same file may cook at the same time.
+		const std::string temporaryPath = cookedPath + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			auto writeBlob = [&file](uint64_t offset, const void* data, size_t size) {
+				static const char padding[ALIGNMENT] = {};
+				file.write(padding, static_cast<std::streamsize>(offset - static_cast<uint64_t>(file.tellp())));
+				file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			};
+			file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+			for (size_t i = 0; i < meshes.size() && file; i++) {
+				const MeshGeometryData& data = *import.meshes[i].data;
+				const std::vector<uint8_t> packed = data.pack();
+				writeBlob(meshes[i].packedOffset, packed.data(), packed.size());
+				if (data.occluder) {
+					writeBlob(meshes[i].occluderOffset, data.occluder->positions.data(), data.occluder->positions.size() * sizeof(float) * 3);
+					file.write(reinterpret_cast<const char*>(data.occluder->indices.data()), static_cast<std::streamsize>(data.occluder->indices.size() * sizeof(uint32_t)));
+				}
+			}
+			for (size_t i = 0; i < textures.size() && file; i++) {
+				const std::vector<unsigned char>& data = import.textures[i].embeddedData;
+				writeBlob(textures[i].dataOffset, data.data(), data.size());
+			}
+			if (!file) {
+				file.close();
+				std::filesystem::remove(temporaryPath, error);
+				return false;
+			}
+		}
+		std::filesystem::rename(temporaryPath, cookedPath, error);
+		if (error) {
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+		writeStamps(cookedPath, key, stamps);
+		return true;
+	}
+
+	bool ModelCooker::read(const std::string& cookedPath, uint64_t key, ModelImport& import)
+	{
+		FileData file = VirtualFileSystem::getInstance().read(cookedPath);
+		if (!file.isValid() || file.size < sizeof(Header)) {
+			return false;
+		}
+		Header header;
+		std::memcpy(&header, file.data, sizeof(header));
+		if (header.magic != MAGIC || header.version != VERSION || header.key != key) {
+			return false;
+		}
+		CookedReader reader(file, header);
+		const NodeRecord* nodeRecords = reader.getRecords<NodeRecord>(header.nodes, header.nodeCount);
+		const MeshRecord* meshRecords = reader.getRecords<MeshRecord>(header.meshes, header.meshCount);
+		const LodRecord* lodRecords = reader.getRecords<LodRecord>(header.lods, header.lodCount);
+		const MaterialRecord* materialRecords = reader.getRecords<MaterialRecord>(header.materials, header.materialCount);
+		const TextureRecord* textureRecords = reader.getRecords<TextureRecord>(header.textures, header.textureCount);
+		if (header.nodeCount == 0 || !nodeRecords || !meshRecords || !lodRecords || !materialRecords || !textureRecords
+			|| !reader.getRecords<uint32_t>(header.pool, header.poolCount) || !reader.contains(header.strings, header.stringsSize)) {
+			return false;
+		}
+		if (!isUpToDate(cookedPath, key, reader, header)) {
+			return false;
+		}
+		auto isTexture = [&header](int32_t texture) {
+			return texture >= -1 && texture < static_cast<int64_t>(header.textureCount);
+		};
+
+		// Filled aside, import stays untouched unless the whole file is valid.
+		std::vector<ImportedNode> nodes(header.nodeCount);
+		for (uint32_t i = 0; i < header.nodeCount; i++) {
+			const NodeRecord& record = nodeRecords[i];
+			const uint32_t* meshes = reader.getPool(record.firstMesh, record.meshCount);
+			const uint32_t* children = reader.getPool(record.firstChild, record.childCount);
+			if (!meshes || !children || !reader.getString(record.name, nodes[i].name)) {
+				return false;
+			}
+			nodes[i].meshes.assign(meshes, meshes + record.meshCount);
+			nodes[i].children.assign(children, children + record.childCount);
+			for (uint32_t mesh : nodes[i].meshes) {
+				if (mesh >= header.meshCount) {
+					return false;
+				}
+			}
+			// Children come after their parent, so that a damaged file cannot make a cycle.
+			for (uint32_t child : nodes[i].children) {
+				if (child <= i || child >= header.nodeCount) {
+					return false;
+				}
+			}
+		}
+
+		std::vector<ImportedMaterial> materials(header.materialCount);
+		for (uint32_t i = 0; i < header.materialCount; i++) {
+			const MaterialRecord& record = materialRecords[i];
+			ImportedMaterial& material = materials[i];
+			const uint32_t* diffuseTextures = reader.getPool(record.firstDiffuse, record.diffuseCount);
+			if (!diffuseTextures) {
+				return false;
+			}
+			material.isEmbedded = record.isEmbedded != 0;
+			material.shininess = record.shininess;
+			std::memcpy(&material.ambientColor[0], record.ambientColor, sizeof(record.ambientColor));
+			std::memcpy(&material.diffuseColor[0], record.diffuseColor, sizeof(record.diffuseColor));
+			std::memcpy(&material.specularColor[0], record.specularColor, sizeof(record.specularColor));
+			for (uint32_t j = 0; j < record.diffuseCount; j++) {
+				material.diffuseTextures.push_back(static_cast<int32_t>(diffuseTextures[j]));
+			}
+			material.specularTexture = record.specularTexture;
+			material.heightTexture = record.heightTexture;
+			material.normalTexture = record.normalTexture;
+			material.ambientTexture = record.ambientTexture;
+			if (!isTexture(material.specularTexture) || !isTexture(material.heightTexture) || !isTexture(material.normalTexture)
+				|| !isTexture(material.ambientTexture) || std::any_of(material.diffuseTextures.begin(), material.diffuseTextures.end(),
+					[&isTexture](int32_t texture) { return texture < 0 || !isTexture(texture); })) {
+				return false;
+			}
+		}
+
+		std::vector<ImportedTexture> textures(header.textureCount);
+		for (uint32_t i = 0; i < header.textureCount; i++) {
+			const TextureRecord& record = textureRecords[i];
+			if (record.type > static_cast<uint32_t>(TextureType::UNKNOWN) || !reader.contains(record.dataOffset, record.dataSize)
+				|| !reader.getString(record.path, textures[i].path)) {
+				return false;
+			}
+			textures[i].type = static_cast<TextureType>(record.type);
+			textures[i].isEmbedded = record.isEmbedded != 0;
+			const uint8_t* data = file.data + record.dataOffset;
+			textures[i].embeddedData.assign(data, data + record.dataSize);
+		}
+
+		std::vector<ImportedMesh> meshes(header.meshCount);
+		for (uint32_t i = 0; i < header.meshCount; i++) {
+			const MeshRecord& record = meshRecords[i];
+			ImportedMesh& mesh = meshes[i];
+			if (!reader.getString(record.name, mesh.name)) {
+				return false;
+			}
+			mesh.material = record.material;
+			mesh.hasNormals = record.hasNormals != 0;
+			mesh.hasTexCoords = record.hasTexCoords != 0;
+			if (import.cachedGeometry.count(i)) {
+				continue;
+			}
+
+			if (record.positionFormat > static_cast<uint32_t>(PositionFormat::Snorm16)
+				|| (record.indexType != GL_UNSIGNED_SHORT && record.indexType != GL_UNSIGNED_INT)
+				|| static_cast<uint64_t>(record.firstLod) + record.lodCount > header.lodCount) {
+				return false;
+			}
+			auto data = std::make_unique<MeshGeometryData>();
+			data->layout = &VertexLayout::get(static_cast<PositionFormat>(record.positionFormat), record.skinned != 0, record.halfTexCoords != 0);
+			data->indexType = record.indexType;
+			data->vertexCount = static_cast<size_t>(record.vertexCount);
+			data->packedIndexCounts.push_back(static_cast<size_t>(record.indexCount));
+			uint64_t indexCount = record.indexCount;
+			for (uint32_t level = 0; level < record.lodCount; level++) {
+				const LodRecord& lod = lodRecords[record.firstLod + level];
+				data->lods.push_back({ {}, lod.error });
+				data->packedIndexCounts.push_back(static_cast<size_t>(lod.indexCount));
+				indexCount += lod.indexCount;
+			}
+			// Counts this large would have overflowed the sum, and do not fit into the file anyway.
+			if (record.vertexCount > file.size || indexCount > file.size
+				|| record.packedSize != data->getVertexBytes() + indexCount * GeometryPool::getIndexSize(data->indexType)
+				|| !reader.contains(record.packedOffset, record.packedSize)) {
+				return false;
+			}
+			std::memcpy(&data->bounds.min[0], record.boundsMin, sizeof(record.boundsMin));
+			std::memcpy(&data->bounds.max[0], record.boundsMax, sizeof(record.boundsMax));
+			std::memcpy(&data->bounds.center[0], record.boundsCenter, sizeof(record.boundsCenter));
+			data->bounds.radius = record.boundsRadius;
+			std::memcpy(&data->dequantization[0], record.dequantization, sizeof(record.dequantization));
+
+			const uint64_t positionBytes = static_cast<uint64_t>(record.occluderPositionCount) * sizeof(float) * 3;
+			if (!reader.contains(record.occluderOffset, positionBytes + static_cast<uint64_t>(record.occluderIndexCount) * sizeof(uint32_t))) {
+				return false;
+			}
+			if (record.occluderIndexCount > 0) {
+				auto occluder = std::make_shared<OccluderMesh>();
+				occluder->exact = record.occluderExact != 0;
+				const uint8_t* positions = file.data + record.occluderOffset;
+				occluder->positions.resize(record.occluderPositionCount);
+				for (uint32_t j = 0; j < record.occluderPositionCount; j++) {
+					std::memcpy(&occluder->positions[j][0], positions + j * sizeof(float) * 3, sizeof(float) * 3);
+				}
+				occluder->indices.resize(record.occluderIndexCount);
+				std::memcpy(occluder->indices.data(), positions + positionBytes, occluder->indices.size() * sizeof(uint32_t));
+				for (uint32_t index : occluder->indices) {
+					if (index >= record.occluderPositionCount) {
+						return false;
+					}
+				}
+				data->occluder = std::move(occluder);
+			}
+
+			mesh.data = std::move(data);
+			mesh.packed = file.data + record.packedOffset;
+			mesh.packedSize = static_cast<size_t>(record.packedSize);
+		}
+
+		import.nodes = std::move(nodes);
+		import.meshes = std::move(meshes);
+		import.materials = std::move(materials);
+		import.textures = std::move(textures);
+		import.cookedFile = std::move(file);
+		return true;
+	}
+}
@@ -0,0 +1,773 @@
+#include <Renderer/ModelLoader.h>
+#include <Renderer/ModelCooker.h>
+#include <Renderer/MeshOptimizer.h>
+#include <Renderer/MeshSimplifier.h>
+#include <Renderer/OcclusionCuller.h>
+#include <Renderer/RenderSystem.h>
+#include <Renderer/ShaderLibrary.h>
+#include <Utils/JobSystem.h>
+#include <Utils/Logger.h>
+#include <Utils/RenderHelper.h>
+#include <Utils/VirtualFileSystem.h>
+#include <assimp/Importer.hpp>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/ProgressHandler.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+namespace ToyEngine {
+	namespace {
+		const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_FlipUVs;
+
+		// Share of the progress bar for reading the file and for converting the meshes. The upload takes the rest.
+		constexpr float READ_PROGRESS = 0.4f;
+		constexpr float CONVERT_PROGRESS = 0.4f;
+
+		// In the order the materials were always set up.
+		const aiTextureType MATERIAL_TEXTURE_TYPES[] = {
+			aiTextureType_AMBIENT, aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_NORMALS
+		};
+
+		// Reports how far ReadFile got and aborts it when the import was cancelled.
+		class ImportProgressHandler : public Assimp::ProgressHandler
+		{
+		public:
+			explicit ImportProgressHandler(ModelImport& import) : mImport(import) {}
+
+			bool Update(float percentage) override {
+				if (percentage >= 0.0f) {
+					mImport.progress = std::min(percentage, 1.0f) * READ_PROGRESS;
+				}
+				return !mImport.cancelled;
+			}
+
+		private:
+			ModelImport& mImport;
+		};
+
+		// A file from the VirtualFileSystem, read in place.
+		class VfsIOStream : public Assimp::IOStream
+		{
+		public:
+			explicit VfsIOStream(FileData file) : mFile(std::move(file)) {}
+
+			size_t Read(void* buffer, size_t size, size_t count) override {
+				if (size == 0) {
+					return 0;
+				}
+				count = std::min(count, (mFile.size - mPosition) / size);
+				if (count > 0) {
+					std::memcpy(buffer, mFile.data + mPosition, size * count);
+				}
+				mPosition += size * count;
+				return count;
+			}
+
+			size_t Write(const void* buffer, size_t size, size_t count) override {
+				return 0;
+			}
+
+			// Offsets from the end count backwards, like Assimp's own memory stream.
+			aiReturn Seek(size_t offset, aiOrigin origin) override {
+				const size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? mPosition : mFile.size;
+				const bool backwards = origin == aiOrigin_END;
+				if (backwards ? offset > base : offset > mFile.size - base) {
+					return aiReturn_FAILURE;
+				}
+				mPosition = backwards ? base - offset : base + offset;
+				return aiReturn_SUCCESS;
+			}
+
+			size_t Tell() const override {
+				return mPosition;
+			}
+
+			size_t FileSize() const override {
+				return mFile.size;
+			}
+
+			void Flush() override {}
+
+		private:
+			FileData mFile;
+			size_t mPosition = 0;
+		};
+
+		// So that the model and the files it refers to, like the .mtl of an OBJ, can come from an archive. Every
+		// file it is asked for becomes a source of the cooked model.
+		class VfsIOSystem : public Assimp::IOSystem
+		{
+		public:
+			explicit VfsIOSystem(std::vector<ImportedSource>& sources) : mSources(sources) {}
+
+			bool Exists(const char* path) const override {
+				const bool exists = VirtualFileSystem::getInstance().exists(path);
+				// Adding it later changes the model as well.
+				if (!exists) {
+					addSource(path, FileStatus(), FileData());
+				}
+				return exists;
+			}
+
+			char getOsSeparator() const override {
+				return '/';
+			}
+
+			Assimp::IOStream* Open(const char* path, const char* mode) override {
+				if (std::strchr(mode, 'w') || std::strchr(mode, 'a')) {
+					return nullptr;
+				}
+				// Taken first, a file written meanwhile then looks changed.
+				const FileStatus status = VirtualFileSystem::getInstance().getStatus(path);
+				FileData file = VirtualFileSystem::getInstance().read(path);
+				addSource(path, file.isValid() ? status : FileStatus(), file);
+				return file.isValid() ? new VfsIOStream(std::move(file)) : nullptr;
+			}
+
+			void Close(Assimp::IOStream* stream) override {
+				delete stream;
+			}
+
+		private:
+			void addSource(const char* path, const FileStatus& status, const FileData& file) const {
+				const std::string name = VirtualFileSystem::normalize(path);
+				const bool known = std::any_of(mSources.begin(), mSources.end(), [&name](const ImportedSource& source) {
+					return source.path == name;
+				});
+				if (!known) {
+					mSources.push_back({ name, status, status.exists ? ModelCooker::hashSource(file) : 0 });
+				}
+			}
+
+			std::vector<ImportedSource>& mSources;
+		};
+
+		// Get ambient/diffuse/specular color from material
+		glm::vec4 getMaterialColor(aiTextureType type, const aiMaterial* material) {
+			aiColor4D color(1.0f, 1.0f, 1.0f, 1.0f);
+			if (type == aiTextureType_DIFFUSE) {
+				if (material->Get(AI_MATKEY_COLOR_DIFFUSE, color) != aiReturn_SUCCESS) {
+					color = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+					Logger::DEBUG_ERROR("Error getting color for material of type " + std::to_string(type));
+				}
+			}
+			else if (type == aiTextureType_SPECULAR) {
+				if (material->Get(AI_MATKEY_COLOR_SPECULAR, color) != aiReturn_SUCCESS) {
+					color = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+					Logger::DEBUG_ERROR("Error getting color for material of type " + std::to_string(type));
+				}
+			}
+			else if (type == aiTextureType_AMBIENT) {
+				if (material->Get(AI_MATKEY_COLOR_AMBIENT, color) != aiReturn_SUCCESS) {
+					color = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+					Logger::DEBUG_ERROR("Error getting color for material of type " + std::to_string(type));
+				}
+			}
+			return { color.r, color.g, color.b, color.a };
+		}
+
+		// One line per model, the meshes are optimized on the workers and per mesh lines would flood the log.
+		// Invocations and vertices add up over the meshes, so the ratios are taken of their sums.
+		void logOptimization(const std::string& path, const aiScene* scene, const std::vector<std::vector<MeshOptimizationStep>>& meshSteps)
+		{
+			double triangles = 0.0, invocationsBefore = 0.0, invocationsAfter = 0.0, verticesBefore = 0.0, verticesAfter = 0.0;
+			size_t optimizedCount = 0;
+			for (size_t i = 0; i < meshSteps.size(); i++) {
+				const std::vector<MeshOptimizationStep>& steps = meshSteps[i];
+				if (steps.empty()) {
+					continue;
+				}
+				const VertexCacheStatistics& before = steps.front().before;
+				const VertexCacheStatistics& after = steps.back().after;
+				const double meshTriangles = scene->mMeshes[i]->mNumFaces;
+				triangles += meshTriangles;
+				invocationsBefore += before.acmr * meshTriangles;
+				invocationsAfter += after.acmr * meshTriangles;
+				verticesBefore += before.atvr > 0.0f ? before.acmr * meshTriangles / before.atvr : 0.0;
+				verticesAfter += after.atvr > 0.0f ? after.acmr * meshTriangles / after.atvr : 0.0;
+				optimizedCount++;
+			}
+			if (optimizedCount == 0) {
+				return;
+			}
+			Logger::DEBUG_INFO("Optimized " + std::to_string(optimizedCount) + " meshes of " + path
+				+ ": ACMR " + std::to_string(invocationsBefore / triangles) + " -> " + std::to_string(invocationsAfter / triangles)
+				+ ", ATVR " + std::to_string(verticesBefore > 0.0 ? invocationsBefore / verticesBefore : 0.0)
+				+ " -> " + std::to_string(verticesAfter > 0.0 ? invocationsAfter / verticesAfter : 0.0)
+				+ ", " + std::to_string(static_cast<size_t>(verticesAfter + 0.5)) + " vertices");
+		}
+
+		// Make a built entity a child of its parent, after the ones built before it.
+		void attach(entt::registry& registry, entt::entity parent, entt::entity entity)
+		{
+			registry.patch<RelationComponent>(parent, [entity](RelationComponent& relation) {
+				relation.children.push_back(entity);
+			});
+		}
+
+		void destroyTree(entt::registry& registry, entt::entity entity)
+		{
+			if (const auto* relation = registry.try_get<RelationComponent>(entity)) {
+				for (entt::entity child : relation->children) {
+					if (registry.valid(child)) {
+						destroyTree(registry, child);
+					}
+				}
+			}
+			registry.destroy(entity);
+		}
+	}
+
+	entt::entity ModelLoader::load(const std::string& path, const std::string& name, entt::registry& registry, entt::entity parent, PositionFormat positionFormat)
+	{
+		auto import = std::make_shared<ModelImport>();
+		import->path = path;
+		import->name = name.empty() ? "default model" : name;
+		import->positionFormat = positionFormat;
+
+		// The placeholder is a complete node already, so that it can be selected and moved while loading.
+		import->placeholder = registry.create();
+		registry.emplace<TransformComponent>(import->placeholder);
+		registry.emplace<RelationComponent>(import->placeholder, parent, std::list<entt::entity>());
+		registry.emplace<TagComponent>(import->placeholder, import->name + " (loading)");
+		// The transform system walks children, so moving the parent has to reach the model.
+		if (auto* parentRelation = registry.try_get<RelationComponent>(parent)) {
+			parentRelation->children.push_back(import->placeholder);
+		}
+
+		// Keys are "path#mesh#format", see getGeometryKey.
+		const std::string keyPrefix = path + "#";
+		const std::string keySuffix = "#" + std::to_string(static_cast<int>(positionFormat));
+		for (const auto& [key, geometry] : mGeometryCache) {
+			if (key.size() <= keyPrefix.size() + keySuffix.size() || key.compare(0, keyPrefix.size(), keyPrefix) != 0
+				|| key.compare(key.size() - keySuffix.size(), keySuffix.size(), keySuffix) != 0) {
+				continue;
+			}
+			if (auto cached = geometry.lock()) {
+				const std::string meshIndex = key.substr(keyPrefix.size(), key.size() - keyPrefix.size() - keySuffix.size());
+				import->cachedGeometry.emplace(static_cast<uint32_t>(std::stoul(meshIndex)), cached);
+			}
+		}
+
+		mImports.push_back(import);
+		return import->placeholder;
+	}
+
+	void ModelLoader::cancel(entt::entity placeholder)
+	{
+		for (auto& import : mImports) {
+			if (import->placeholder == placeholder) {
+				import->cancelled = true;
+			}
+		}
+	}
+
+	void ModelLoader::update(entt::registry& registry)
+	{
+		size_t inFlight = 0;
+		for (auto& import : mImports) {
+			ImportState state = import->state;
+			// Deleting the placeholder is as good as cancelling.
+			if (!registry.valid(import->placeholder)) {
+				import->cancelled = true;
+			}
+			// A running job notices by itself, anything else stops right here.
+			if (import->cancelled && state != ImportState::Importing) {
+				import->state = state = ImportState::Cancelled;
+			}
+
+			if (state == ImportState::Importing || state == ImportState::Uploading) {
+				inFlight++;
+			}
+			else if (state == ImportState::Queued && inFlight < MAX_IMPORTS_IN_FLIGHT) {
+				import->state = ImportState::Importing;
+				inFlight++;
+				JobSystem::getInstance().spawn("Model import", [import] {
+					ModelLoader::import(*import);
+				});
+			}
+		}
+
+		// Always one step, so that a slow step cannot stall the upload.
+		auto start = std::chrono::steady_clock::now();
+		bool withinBudget = true;
+		for (auto& import : mImports) {
+			while (withinBudget && import->state == ImportState::Uploading) {
+				UploadStep step = uploadStep(*import, registry);
+				if (step == UploadStep::Waiting) {
+					break;
+				}
+				if (step == UploadStep::Finished) {
+					import->state = ImportState::Done;
+				}
+				withinBudget = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() < mUploadBudget;
+			}
+		}
+
+		mImports.erase(std::remove_if(mImports.begin(), mImports.end(), [&registry](const std::shared_ptr<ModelImport>& import) {
+			switch (import->state.load()) {
+			case ImportState::Done:
+				Logger::DEBUG_INFO("Loaded model " + import->path);
+				return true;
+			case ImportState::Failed:
+				Logger::DEBUG_ERROR("ERROR::ASSIMP::" + import->error);
+				removePlaceholder(*import, registry);
+				return true;
+			case ImportState::Cancelled:
+				Logger::DEBUG_INFO("Cancelled loading model " + import->path);
+				removePlaceholder(*import, registry);
+				return true;
+			default:
+				return false;
+			}
+		}), mImports.end());
+	}
+
+	void ModelLoader::import(ModelImport& import)
+	{
+		// A model loaded before comes from its cooked file, its geometry goes to the GPU straight from the mapping.
+		const uint64_t cookKey = ModelCooker::computeKey(import.path, IMPORT_FLAGS, import.positionFormat);
+		const std::string cookedPath = ModelCooker::getCookedPath(cookKey);
+		if (ModelCooker::read(cookedPath, cookKey, import)) {
+			for (ImportedMesh& mesh : import.meshes) {
+				if (mesh.data) {
+					mesh.transfer = GpuTransferQueue::getInstance().uploadBuffer(mesh.packed, mesh.packedSize, import.cookedFile.owner);
+				}
+			}
+			import.progress = READ_PROGRESS + CONVERT_PROGRESS;
+			import.state = import.cancelled ? ImportState::Cancelled : ImportState::Uploading;
+			return;
+		}
+
+		Assimp::Importer importer;
+		// The importer deletes them.
+		importer.SetProgressHandler(new ImportProgressHandler(import));
+		importer.SetIOHandler(new VfsIOSystem(import.sources));
+		const aiScene* scene = importer.ReadFile(import.path, IMPORT_FLAGS);
+		if (import.cancelled) {
+			import.state = ImportState::Cancelled;
+			return;
+		}
+		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+			import.error = importer.GetErrorString();
+			import.state = ImportState::Failed;
+			return;
+		}
+
+		std::unordered_map<std::string, int32_t> textureIndices;
+		import.materials.resize(scene->mNumMaterials);
+		for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
+			importMaterial(import, scene, i, textureIndices);
+		}
+
+		// Optimizing and simplifying is most of the work, and every mesh is independent.
+		import.meshes.resize(scene->mNumMeshes);
+		std::vector<std::vector<MeshOptimizationStep>> optimization(scene->mNumMeshes);
+		std::atomic<size_t> convertedCount{ 0 };
+		JobSystem::getInstance().parallelFor("Mesh conversion", scene->mNumMeshes, 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end && !import.cancelled; i++) {
+				const aiMesh* source = scene->mMeshes[i];
+				ImportedMesh& mesh = import.meshes[i];
+				mesh.name = source->mName.C_Str();
+				mesh.material = source->mMaterialIndex;
+				mesh.hasNormals = source->HasNormals();
+				mesh.hasTexCoords = source->HasTextureCoords(0);
+				if (!import.cachedGeometry.count(static_cast<uint32_t>(i))) {
+					mesh.data = convertMesh(source, import.positionFormat, optimization[i]);
+					mesh.transfer = GpuTransferQueue::getInstance().uploadBuffer(mesh.data->pack());
+				}
+				import.progress = READ_PROGRESS + CONVERT_PROGRESS * (convertedCount.fetch_add(1) + 1) / scene->mNumMeshes;
+			}
+		});
+		if (import.cancelled) {
+			import.state = ImportState::Cancelled;
+			return;
+		}
+
+		logOptimization(import.path, scene, optimization);
+
+		importNode(import, scene->mRootNode);
+		// Meshes already on the GPU have no data, the import that uploaded them has cooked the file already.
+		if (import.cachedGeometry.empty() && !ModelCooker::write(cookedPath, cookKey, import)) {
+			Logger::DEBUG_WARNING("Could not cook " + import.path + " into " + cookedPath);
+		}
+		import.progress = READ_PROGRESS + CONVERT_PROGRESS;
+		import.state = ImportState::Uploading;
+	}
+
+	void ModelLoader::importMaterial(ModelImport& import, const aiScene* scene, uint32_t materialIndex, std::unordered_map<std::string, int32_t>& textureIndices)
+	{
+		const aiMaterial* source = scene->mMaterials[materialIndex];
+		ImportedMaterial& material = import.materials[materialIndex];
+
+		float shininess = 20.f;
+		if (AI_SUCCESS != aiGetMaterialFloat(source, AI_MATKEY_SHININESS, &shininess)) {
+			shininess = 20.f;
+		}
+
+		for (aiTextureType type : MATERIAL_TEXTURE_TYPES) {
+			for (unsigned int i = 0; i < source->GetTextureCount(type); i++) {
+				aiString path;
+				if (source->GetTexture(type, i, &path, NULL, NULL, NULL, NULL, NULL) != aiReturn_SUCCESS) {
+					continue;
+				}
+
+				const aiTexture* embedded = scene->GetEmbeddedTexture(path.C_Str());
+				// External textures are relative to the model file.
+				std::string texturePath = embedded ? std::string(path.C_Str())
+					: std::filesystem::path(import.path).parent_path().append(path.C_Str()).string();
+
+				auto [iter, inserted] = textureIndices.try_emplace(texturePath, static_cast<int32_t>(import.textures.size()));
+				if (inserted) {
+					ImportedTexture texture;
+					texture.path = texturePath;
+					texture.type = RenderHelper::ConvertTextureType(type);
+					texture.isEmbedded = embedded != nullptr;
+					if (embedded) {
+						// mHeight is 0 for compressed images, mWidth is then their size in bytes.
+						size_t size = embedded->mHeight == 0 ? embedded->mWidth : static_cast<size_t>(embedded->mWidth) * embedded->mHeight;
+						const unsigned char* data = reinterpret_cast<const unsigned char*>(embedded->pcData);
+						texture.embeddedData.assign(data, data + size);
+					}
+					import.textures.push_back(std::move(texture));
+				}
+				const int32_t textureIndex = iter->second;
+
+				material.isEmbedded = embedded != nullptr;
+				material.shininess = shininess;
+				switch (type) {
+				case aiTextureType_DIFFUSE:
+					material.diffuseTextures.push_back(textureIndex);
+					break;
+				case aiTextureType_SPECULAR:
+					material.specularTexture = textureIndex;
+					break;
+				case aiTextureType_HEIGHT:
+					material.heightTexture = textureIndex;
+					break;
+				case aiTextureType_NORMALS:
+					material.normalTexture = textureIndex;
+					break;
+				default:
+					material.ambientTexture = textureIndex;
+					break;
+				}
+			}
+		}
+
+		material.ambientColor = getMaterialColor(aiTextureType_AMBIENT, source);
+		material.diffuseColor = getMaterialColor(aiTextureType_DIFFUSE, source);
+		material.specularColor = getMaterialColor(aiTextureType_SPECULAR, source);
+	}
+
+	uint32_t ModelLoader::importNode(ModelImport& import, const aiNode* node)
+	{
+		const uint32_t index = static_cast<uint32_t>(import.nodes.size());
+		import.nodes.emplace_back();
+		import.nodes[index].name = node->mName.C_Str();
+		import.nodes[index].meshes.assign(node->mMeshes, node->mMeshes + node->mNumMeshes);
+
+		for (unsigned int i = 0; i < node->mNumChildren; i++) {
+			// The recursion grows the vector, so no reference into it is held across it.
+			uint32_t child = importNode(import, node->mChildren[i]);
+			import.nodes[index].children.push_back(child);
+		}
+		return index;
+	}
+
+	std::unique_ptr<MeshGeometryData> ModelLoader::convertMesh(const aiMesh* mesh, PositionFormat positionFormat, std::vector<MeshOptimizationStep>& steps)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+
+		// walk through each of the mesh's vertices
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+		{
+			// zeroed, the optimizer compares vertices bytewise
+			Vertex vertex{};
+			// positions
+			vertex.Position.x = mesh->mVertices[i].x;
+			vertex.Position.y = mesh->mVertices[i].y;
+			vertex.Position.z = mesh->mVertices[i].z;
+			// normals
+			if (mesh->HasNormals())
+			{
+				vertex.Normal.x = mesh->mNormals[i].x;
+				vertex.Normal.y = mesh->mNormals[i].y;
+				vertex.Normal.z = mesh->mNormals[i].z;
+			}
+			// texture coordinates
+			if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+			{
+				// a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+				// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+				vertex.TexCoords.x = mesh->mTextureCoords[0][i].x;
+				vertex.TexCoords.y = mesh->mTextureCoords[0][i].y;
+				// tangent
+				vertex.Tangent.x = mesh->mTangents[i].x;
+				vertex.Tangent.y = mesh->mTangents[i].y;
+				vertex.Tangent.z = mesh->mTangents[i].z;
+				// bitangent
+				vertex.Bitangent.x = mesh->mBitangents[i].x;
+				vertex.Bitangent.y = mesh->mBitangents[i].y;
+				vertex.Bitangent.z = mesh->mBitangents[i].z;
+			}
+			else
+				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+
+			vertices.push_back(vertex);
+		}
+
+		// now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+		{
+			const aiFace& face = mesh->mFaces[i];
+			// retrieve all indices of the face and store them in the indices vector
+			for (unsigned int j = 0; j < face.mNumIndices; j++)
+				indices.push_back(face.mIndices[j]);
+		}
+
+		// Up to MAX_BONE_INFLUENCE bones per vertex, the strongest ones when there are more.
+		for (unsigned int b = 0; b < mesh->mNumBones; b++)
+		{
+			const aiBone* bone = mesh->mBones[b];
+			for (unsigned int w = 0; w < bone->mNumWeights; w++)
+			{
+				Vertex& vertex = vertices[bone->mWeights[w].mVertexId];
+				int weakest = 0;
+				for (int i = 1; i < MAX_BONE_INFLUENCE; i++) {
+					if (vertex.mWeights[i] < vertex.mWeights[weakest]) {
+						weakest = i;
+					}
+				}
+				if (bone->mWeights[w].mWeight > vertex.mWeights[weakest]) {
+					vertex.mBoneIDs[weakest] = static_cast<int>(b);
+					vertex.mWeights[weakest] = bone->mWeights[w].mWeight;
+				}
+			}
+		}
+		// The dropped weights would leave the kept ones summing to less than 1, which shrinks the vertex.
+		if (mesh->HasBones()) {
+			for (Vertex& vertex : vertices) {
+				float sum = 0.0f;
+				for (int i = 0; i < MAX_BONE_INFLUENCE; i++) {
+					sum += vertex.mWeights[i];
+				}
+				if (sum > 0.0f) {
+					for (int i = 0; i < MAX_BONE_INFLUENCE; i++) {
+						vertex.mWeights[i] /= sum;
+					}
+				}
+			}
+		}
+
+		steps = MeshOptimizer::optimize(vertices, indices);
+
+		auto data = std::make_unique<MeshGeometryData>(vertices, indices, positionFormat, mesh->HasBones());
+		// Most of the conversion time goes into these two.
+		data->lods = MeshSimplifier::buildLods(vertices, indices);
+		data->occluder = OccluderMesh::build(vertices, indices);
+		return data;
+	}
+
+	ModelLoader::UploadStep ModelLoader::uploadStep(ModelImport& import, entt::registry& registry)
+	{
+		const size_t stepCount = import.textures.size() + import.meshes.size() + import.nodes.size() + 1;
+		requestTextures(import);
+		// Whichever is ready goes first, the meshes go up while the images decode.
+		const bool texturesLeft = import.uploadedTextures < import.textures.size();
+		const bool meshesLeft = import.uploadedMeshes < import.meshes.size();
+		const TextureRequest* request = texturesLeft ? &import.textures[import.uploadedTextures].request : nullptr;
+		const GpuTransfer* transfer = meshesLeft ? import.meshes[import.uploadedMeshes].transfer.get() : nullptr;
+		if (texturesLeft && (!request->isRequested() || request->isReady())) {
+			uploadTexture(import.textures[import.uploadedTextures++]);
+		}
+		else if (meshesLeft && (!transfer || transfer->done)) {
+			uploadMesh(import, static_cast<uint32_t>(import.uploadedMeshes++));
+		}
+		else if (texturesLeft || meshesLeft) {
+			return UploadStep::Waiting;
+		}
+		else if (import.builtNodes < import.nodes.size()) {
+			buildStep(import, registry);
+		}
+		else {
+			registry.patch<TagComponent>(import.placeholder, [&import](TagComponent& tag) {
+				tag.name = import.name;
+			});
+			import.progress = 1.0f;
+			return UploadStep::Finished;
+		}
+
+		const size_t doneCount = import.uploadedTextures + import.uploadedMeshes + import.builtNodes;
+		import.progress = READ_PROGRESS + CONVERT_PROGRESS + (1.0f - READ_PROGRESS - CONVERT_PROGRESS) * doneCount / stepCount;
+		return UploadStep::Progressed;
+	}
+
+	void ModelLoader::buildStep(ModelImport& import, entt::registry& registry)
+	{
+		if (import.nodeEntities.empty()) {
+			import.nodeEntities.assign(import.nodes.size(), entt::null);
+			import.nodeParents.assign(import.nodes.size(), entt::null);
+			import.nodeParents[0] = import.placeholder;
+		}
+
+		const uint32_t nodeIndex = static_cast<uint32_t>(import.builtNodes);
+		const ImportedNode& node = import.nodes[nodeIndex];
+		entt::entity& entity = import.nodeEntities[nodeIndex];
+		if (entity == entt::null && registry.valid(import.nodeParents[nodeIndex])) {
+			entity = buildNode(import, nodeIndex, registry, import.nodeParents[nodeIndex]);
+			// Children come after their parent, see importNode.
+			for (uint32_t child : node.children) {
+				import.nodeParents[child] = entity;
+			}
+		}
+		else if (registry.valid(entity)) {
+			buildMesh(import, node.meshes[import.builtNodeMeshes++], registry, entity);
+		}
+
+		// Also when the node was dropped, its children then find no parent and are dropped as well.
+		if (!registry.valid(entity) || import.builtNodeMeshes == node.meshes.size()) {
+			import.builtNodes++;
+			import.builtNodeMeshes = 0;
+		}
+	}
+
+	void ModelLoader::requestTextures(ModelImport& import)
+	{
+		const size_t end = std::min(import.textures.size(), import.uploadedTextures + MAX_TEXTURES_DECODED_AHEAD);
+		for (; import.requestedTextures < end; import.requestedTextures++) {
+			ImportedTexture& texture = import.textures[import.requestedTextures];
+			if (texture.isEmbedded) {
+				texture.request = TextureRequest(texture.path, texture.type, std::move(texture.embeddedData), false);
+			}
+			else if (!mTextures.getTexture(texture.path).isValid()) {
+				texture.request = TextureRequest(texture.path, texture.type, false);
+			}
+		}
+	}
+
+	void ModelLoader::uploadTexture(ImportedTexture& texture)
+	{
+		if (texture.isEmbedded) {
+			texture.texture = texture.request.upload();
+		}
+		// Another import may have loaded the same file in the meantime.
+		else if (mTextures.getTexture(texture.path).isValid()) {
+			texture.texture = mTextures.getTexture(texture.path);
+		}
+		else {
+			texture.texture = texture.request.upload();
+			mTextures.addTexture(texture.path, texture.texture);
+		}
+		texture.request = TextureRequest();
+
+		if (!texture.texture.isValid()) {
+			Logger::DEBUG_WARNING("Texture with path: " + texture.path + " is not loaded properly.");
+		}
+	}
+
+	void ModelLoader::uploadMesh(ModelImport& import, uint32_t meshIndex)
+	{
+		ImportedMesh& mesh = import.meshes[meshIndex];
+		auto cached = import.cachedGeometry.find(meshIndex);
+		if (cached != import.cachedGeometry.end()) {
+			mesh.geometry = cached->second;
+			return;
+		}
+
+		// Another import of the same file may have finished in the meantime.
+		std::weak_ptr<MeshGeometry>& entry = mGeometryCache[getGeometryKey(import.path, meshIndex, import.positionFormat)];
+		mesh.geometry = entry.lock();
+		if (!mesh.geometry) {
+			// Without a transferred buffer the pool uploads from the CPU copy, cooked meshes only have the mapped one.
+			GLuint packed = mesh.transfer ? mesh.transfer->take() : 0;
+			if (packed == 0 && mesh.packed) {
+				glGenBuffers(1, &packed);
+				GLStateCache::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, packed);
+				glBufferData(GL_COPY_WRITE_BUFFER, mesh.packedSize, mesh.packed, GL_STATIC_DRAW);
+			}
+			mesh.geometry = std::make_shared<MeshGeometry>(*mesh.data, packed);
+			entry = mesh.geometry;
+			if (packed != 0) {
+				GLStateCache::getInstance().deleteBuffer(packed);
+			}
+		}
+		mesh.data.reset();
+		mesh.transfer.reset();
+	}
+
+	entt::entity ModelLoader::buildNode(const ModelImport& import, uint32_t nodeIndex, entt::registry& registry, entt::entity parent)
+	{
+		entt::entity entity = registry.create();
+		registry.emplace<RelationComponent>(entity, parent, std::list<entt::entity>());
+		registry.emplace<TagComponent>(entity, import.nodes[nodeIndex].name);
+		registry.emplace<TransformComponent>(entity);
+		attach(registry, parent, entity);
+		return entity;
+	}
+
+	entt::entity ModelLoader::buildMesh(ModelImport& import, uint32_t meshIndex, entt::registry& registry, entt::entity parent)
+	{
+		const ImportedMesh& mesh = import.meshes[meshIndex];
+		entt::entity entity = registry.create();
+
+		if (mesh.material < import.materials.size()) {
+			const ImportedMaterial& source = import.materials[mesh.material];
+			auto getTexture = [&import](int32_t texture) {
+				return texture >= 0 ? import.textures[texture].texture : Texture();
+			};
+
+			MaterialComponent material;
+			material.isEmbedded = source.isEmbedded;
+			material.shininess = source.shininess;
+			for (int32_t texture : source.diffuseTextures) {
+				material.diffuseTextures.push_back(getTexture(texture));
+			}
+			material.diffuseColor = source.diffuseColor;
+			material.specularTexture = getTexture(source.specularTexture);
+			material.specularColor = source.specularColor;
+			material.heightTexture = getTexture(source.heightTexture);
+			material.normalTexture = getTexture(source.normalTexture);
+			material.ambientTexture = getTexture(source.ambientTexture);
+			material.ambientColor = source.ambientColor;
+			material.materialIndex = RenderSystem::instance.registerMaterial(material);
+			registry.emplace<MaterialComponent>(entity, std::move(material));
+		}
+
+		// TODO USE ACTIVE SHADER
+		std::shared_ptr<Shader> simpleMeshShader = ShaderLibrary::getInstance().get("Shaders/simpleMeshShader.vert", "Shaders/simpleMeshShader.frag");
+
+		registry.emplace<TransformComponent>(entity);
+		registry.emplace<MeshComponent>(entity, mesh.geometry, simpleMeshShader, mesh.hasNormals, mesh.hasTexCoords);
+		registry.emplace<RelationComponent>(entity, parent, std::list<entt::entity>());
+		registry.emplace<BoundsComponent>(entity, mesh.geometry->bounds);
+		registry.emplace<TagComponent>(entity, mesh.name.empty() ? std::string("unnamed mesh") : mesh.name);
+		attach(registry, parent, entity);
+		return entity;
+	}
+
+	void ModelLoader::removePlaceholder(const ModelImport& import, entt::registry& registry)
+	{
+		if (!registry.valid(import.placeholder)) {
+			return;
+		}
+		const entt::entity parent = registry.get<RelationComponent>(import.placeholder).parent;
+		if (registry.valid(parent) && registry.all_of<RelationComponent>(parent)) {
+			registry.patch<RelationComponent>(parent, [&import](RelationComponent& relation) {
+				relation.children.remove(import.placeholder);
+			});
+		}
+		destroyTree(registry, import.placeholder);
+	}
+
+	std::string ModelLoader::getGeometryKey(const std::string& path, uint32_t meshIndex, PositionFormat positionFormat)
+	{
+		return path + "#" + std::to_string(meshIndex) + "#" + std::to_string(static_cast<int>(positionFormat));
+	}
+}
@@ -0,0 +1,656 @@
+#include <Renderer/OcclusionCuller.h>
+#include <Utils/CpuFeatures.h>
+#include <Utils/JobSystem.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ToyEngine {
+	namespace {
+		constexpr int TILES_X = OcclusionCuller::WIDTH / OcclusionCuller::TILE_SIZE;
+		constexpr int TILES_Y = OcclusionCuller::HEIGHT / OcclusionCuller::TILE_SIZE;
+		constexpr int TILES_PER_BLOCK = OcclusionCuller::BLOCK_SIZE / OcclusionCuller::TILE_SIZE;
+		constexpr int BLOCKS_X = OcclusionCuller::WIDTH / OcclusionCuller::BLOCK_SIZE;
+		constexpr int BLOCKS_Y = OcclusionCuller::HEIGHT / OcclusionCuller::BLOCK_SIZE;
+
+		static_assert(OcclusionCuller::WIDTH % OcclusionCuller::BLOCK_SIZE == 0 && OcclusionCuller::HEIGHT % OcclusionCuller::BLOCK_SIZE == 0,
+			"The depth buffer must be made of whole blocks.");
+		static_assert(OcclusionCuller::BLOCK_SIZE % OcclusionCuller::TILE_SIZE == 0, "A block must be made of whole tiles.");
+		static_assert(OcclusionCuller::WIDTH % 8 == 0, "Rows are rasterized 8 pixels at a time.");
+
+		constexpr size_t OCCLUDERS_PER_TASK = 8;
+		constexpr size_t OCCLUDEES_PER_TASK = 256;
+		constexpr float DEPTH_BIAS = 2e-6f;
+
+		// Screen space x, y in pixels and depth in [0, 1]. False when the triangle faces away or lies outside
+		// the depth buffer.
+		bool setupTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, OccluderTriangle& setup)
+		{
+			// Counter clockwise is front facing, as in GL. Back faces of a closed mesh are always behind its
+			// front faces, and skipping them on an open mesh only makes the culling more conservative.
+			float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+			if (area < 1e-8f) {
+				return false;
+			}
+
+			const glm::vec3 vertices[3] = { v0, v1, v2 };
+			for (int i = 0; i < 3; i++) {
+				const glm::vec3& from = vertices[i];
+				const glm::vec3& to = vertices[(i + 1) % 3];
+				setup.edgeA[i] = from.y - to.y;
+				setup.edgeB[i] = to.x - from.x;
+				setup.edgeC[i] = -(setup.edgeA[i] * from.x + setup.edgeB[i] * from.y);
+			}
+
+			// Edge i is opposite to vertex (i + 2) % 3, so its function is that vertex's barycentric weight times the area.
+			const float invArea = 1.0f / area;
+			setup.depthA = (setup.edgeA[1] * v0.z + setup.edgeA[2] * v1.z + setup.edgeA[0] * v2.z) * invArea;
+			setup.depthB = (setup.edgeB[1] * v0.z + setup.edgeB[2] * v1.z + setup.edgeB[0] * v2.z) * invArea;
+			setup.depthC = (setup.edgeC[1] * v0.z + setup.edgeC[2] * v1.z + setup.edgeC[0] * v2.z) * invArea;
+
+			// clamped as floats, vertices close to the camera plane project far outside the int range
+			setup.xMin = static_cast<int>(std::floor(std::max(std::min({ v0.x, v1.x, v2.x }), 0.0f)));
+			setup.xMax = static_cast<int>(std::floor(std::min(std::max({ v0.x, v1.x, v2.x }), OcclusionCuller::WIDTH - 1.0f)));
+			setup.yMin = static_cast<int>(std::floor(std::max(std::min({ v0.y, v1.y, v2.y }), 0.0f)));
+			setup.yMax = static_cast<int>(std::floor(std::min(std::max({ v0.y, v1.y, v2.y }), OcclusionCuller::HEIGHT - 1.0f)));
+			return setup.xMin <= setup.xMax && setup.yMin <= setup.yMax;
+		}
+
+		// Pixels are sampled at their centers and keep the nearest depth.
+		void rasterizeScalar(const OccluderTriangle& setup, float* depth, int yBegin, int yEnd)
+		{
+			for (int y = std::max(yBegin, setup.yMin); y <= std::min(yEnd - 1, setup.yMax); y++) {
+				const float py = y + 0.5f;
+				float* row = depth + y * OcclusionCuller::WIDTH;
+				for (int x = setup.xMin; x <= setup.xMax; x++) {
+					const float px = x + 0.5f;
+					bool inside = true;
+					for (int i = 0; i < 3; i++) {
+						inside = inside && setup.edgeA[i] * px + setup.edgeB[i] * py + setup.edgeC[i] >= 0.0f;
+					}
+					if (inside) {
+						row[x] = std::min(row[x], setup.depthA * px + setup.depthB * py + setup.depthC);
+					}
+				}
+			}
+		}
+
+#if TOY_X86_SIMD
+		// Same as the scalar version, 8 pixels of a row at a time. Pixels outside the bounding box
+		// are also outside the triangle, so starting at an 8 pixel boundary needs no extra mask.
+		TOY_TARGET_AVX2 void rasterizeAVX2(const OccluderTriangle& setup, float* depth, int yBegin, int yEnd)
+		{
+			const __m256 pixelOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 edgeA0 = _mm256_set1_ps(setup.edgeA[0]);
+			const __m256 edgeA1 = _mm256_set1_ps(setup.edgeA[1]);
+			const __m256 edgeA2 = _mm256_set1_ps(setup.edgeA[2]);
+			const __m256 depthA = _mm256_set1_ps(setup.depthA);
+
+			for (int y = std::max(yBegin, setup.yMin); y <= std::min(yEnd - 1, setup.yMax); y++) {
+				const float py = y + 0.5f;
+				const __m256 row0 = _mm256_set1_ps(setup.edgeB[0] * py + setup.edgeC[0]);
+				const __m256 row1 = _mm256_set1_ps(setup.edgeB[1] * py + setup.edgeC[1]);
+				const __m256 row2 = _mm256_set1_ps(setup.edgeB[2] * py + setup.edgeC[2]);
+				const __m256 rowDepth = _mm256_set1_ps(setup.depthB * py + setup.depthC);
+				float* row = depth + y * OcclusionCuller::WIDTH;
+
+				for (int x = setup.xMin & ~7; x <= setup.xMax; x += 8) {
+					const __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), pixelOffsets);
+					__m256 inside = _mm256_cmp_ps(_mm256_fmadd_ps(edgeA0, px, row0), zero, _CMP_GE_OQ);
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(edgeA1, px, row1), zero, _CMP_GE_OQ));
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(edgeA2, px, row2), zero, _CMP_GE_OQ));
+					if (_mm256_movemask_ps(inside) == 0) {
+						continue;
+					}
+
+					const __m256 pixelDepth = _mm256_fmadd_ps(depthA, px, rowDepth);
+					const __m256 current = _mm256_loadu_ps(row + x);
+					_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, _mm256_min_ps(current, pixelDepth), inside));
+				}
+			}
+		}
+#endif
+
+		// Any pixel of the row span [xBegin, xEnd] at or behind depth. The span lies within one tile.
+		bool isAnyPixelBehind(const float* row, int xBegin, int xEnd, float depth)
+		{
+			for (int x = xBegin; x <= xEnd; x++) {
+				if (row[x] >= depth) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+#if TOY_X86_SIMD
+		TOY_TARGET_AVX2 bool isAnyPixelBehindAVX2(const float* row, int xBegin, int xEnd, float depth)
+		{
+			static_assert(OcclusionCuller::TILE_SIZE == 8, "A tile row is loaded as one AVX2 register.");
+			const int tileStart = xBegin & ~7;
+			const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+			const __m256i inSpan = _mm256_and_si256(
+				_mm256_cmpgt_epi32(lanes, _mm256_set1_epi32(xBegin - tileStart - 1)),
+				_mm256_cmpgt_epi32(_mm256_set1_epi32(xEnd - tileStart + 1), lanes));
+			const __m256 behind = _mm256_cmp_ps(_mm256_loadu_ps(row + tileStart), _mm256_set1_ps(depth), _CMP_GE_OQ);
+			return _mm256_movemask_ps(_mm256_and_ps(behind, _mm256_castsi256_ps(inSpan))) != 0;
+		}
+#endif
+
+		// Entirely outside one of the clip planes, except near which is clipped.
+		bool isOutsideClipVolume(const glm::vec4 (&clip)[3])
+		{
+			auto allOutside = [&clip](auto predicate) {
+				return predicate(clip[0]) && predicate(clip[1]) && predicate(clip[2]);
+			};
+			return allOutside([](const glm::vec4& c) { return c.x < -c.w; })
+				|| allOutside([](const glm::vec4& c) { return c.x > c.w; })
+				|| allOutside([](const glm::vec4& c) { return c.y < -c.w; })
+				|| allOutside([](const glm::vec4& c) { return c.y > c.w; })
+				|| allOutside([](const glm::vec4& c) { return c.z > c.w; })
+				|| allOutside([](const glm::vec4& c) { return c.z < -c.w; });
+		}
+
+		// Sutherland-Hodgman against z >= -w. A triangle becomes at most a quad.
+		int clipNear(const glm::vec4 (&input)[3], glm::vec4 (&output)[4])
+		{
+			int count = 0;
+			for (int i = 0; i < 3; i++) {
+				const glm::vec4& a = input[i];
+				const glm::vec4& b = input[(i + 1) % 3];
+				const float distanceA = a.z + a.w;
+				const float distanceB = b.z + b.w;
+				if (distanceA >= 0.0f) {
+					output[count++] = a;
+				}
+				if ((distanceA >= 0.0f) != (distanceB >= 0.0f)) {
+					output[count++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+				}
+			}
+			return count;
+		}
+
+		glm::vec3 toScreen(const glm::vec4& clip)
+		{
+			const float invW = 1.0f / clip.w;
+			return glm::vec3(
+				(clip.x * invW * 0.5f + 0.5f) * OcclusionCuller::WIDTH,
+				(clip.y * invW * 0.5f + 0.5f) * OcclusionCuller::HEIGHT,
+				clip.z * invW * 0.5f + 0.5f);
+		}
+
+		// Screen rectangle in pixels and nearest depth of a box.
+		struct ScreenBounds {
+			float minX;
+			float minY;
+			float maxX;
+			float maxY;
+			float nearestDepth;
+		};
+
+		// The corners of a box in clip space are the projected min corner plus the projected edges, which
+		// saves most of the matrix products.
+		struct ClipBox {
+			glm::vec4 base;
+			glm::vec4 edgeX;
+			glm::vec4 edgeY;
+			glm::vec4 edgeZ;
+		};
+
+		ClipBox toClipBox(const glm::mat4& viewProjection, const glm::vec3& min, const glm::vec3& max)
+		{
+			return { viewProjection * glm::vec4(min, 1.0f), viewProjection[0] * (max.x - min.x),
+				viewProjection[1] * (max.y - min.y), viewProjection[2] * (max.z - min.z) };
+		}
+
+		// False when a corner reaches behind the camera, then the box can't be projected.
+		bool projectBox(const ClipBox& box, ScreenBounds& bounds)
+		{
+			bounds = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+				std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), 1.0f };
+			for (int corner = 0; corner < 8; corner++) {
+				glm::vec4 clip = box.base;
+				if (corner & 1) {
+					clip += box.edgeX;
+				}
+				if (corner & 2) {
+					clip += box.edgeY;
+				}
+				if (corner & 4) {
+					clip += box.edgeZ;
+				}
+				if (clip.w <= 1e-5f) {
+					return false;
+				}
+				const glm::vec3 screen = toScreen(clip);
+				bounds.minX = std::min(bounds.minX, screen.x);
+				bounds.minY = std::min(bounds.minY, screen.y);
+				bounds.maxX = std::max(bounds.maxX, screen.x);
+				bounds.maxY = std::max(bounds.maxY, screen.y);
+				bounds.nearestDepth = std::min(bounds.nearestDepth, screen.z);
+			}
+			return true;
+		}
+
+#if TOY_X86_SIMD
+		TOY_TARGET_AVX2 float reduceMin(__m256 values)
+		{
+			__m128 half = _mm_min_ps(_mm256_castps256_ps128(values), _mm256_extractf128_ps(values, 1));
+			half = _mm_min_ps(half, _mm_movehl_ps(half, half));
+			return _mm_cvtss_f32(_mm_min_ss(half, _mm_shuffle_ps(half, half, 1)));
+		}
+
+		TOY_TARGET_AVX2 float reduceMax(__m256 values)
+		{
+			__m128 half = _mm_max_ps(_mm256_castps256_ps128(values), _mm256_extractf128_ps(values, 1));
+			half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+			return _mm_cvtss_f32(_mm_max_ss(half, _mm_shuffle_ps(half, half, 1)));
+		}
+
+		// One component of the 8 box corners, corner i adds the edges selected by its bits 0, 1 and 2.
+		TOY_TARGET_AVX2 __m256 getCornerComponent(float base, float edgeX, float edgeY, float edgeZ)
+		{
+			__m256 result = _mm256_fmadd_ps(_mm256_setr_ps(0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f), _mm256_set1_ps(edgeX), _mm256_set1_ps(base));
+			result = _mm256_fmadd_ps(_mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f), _mm256_set1_ps(edgeY), result);
+			return _mm256_fmadd_ps(_mm256_setr_ps(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f), _mm256_set1_ps(edgeZ), result);
+		}
+
+		// Same as the scalar version, with one corner per lane. The box is set up by the caller, glm is not
+		// compiled for AVX2 and switching back and forth is slow.
+		TOY_TARGET_AVX2 bool projectBoxAVX2(const ClipBox& box, ScreenBounds& bounds)
+		{
+			const __m256 w = getCornerComponent(box.base.w, box.edgeX.w, box.edgeY.w, box.edgeZ.w);
+			if (_mm256_movemask_ps(_mm256_cmp_ps(w, _mm256_set1_ps(1e-5f), _CMP_LE_OQ)) != 0) {
+				return false;
+			}
+			const __m256 invW = _mm256_div_ps(_mm256_set1_ps(1.0f), w);
+			const __m256 halfWidth = _mm256_set1_ps(OcclusionCuller::WIDTH * 0.5f);
+			const __m256 halfHeight = _mm256_set1_ps(OcclusionCuller::HEIGHT * 0.5f);
+			const __m256 half = _mm256_set1_ps(0.5f);
+			const __m256 x = _mm256_fmadd_ps(_mm256_mul_ps(getCornerComponent(box.base.x, box.edgeX.x, box.edgeY.x, box.edgeZ.x), invW), halfWidth, halfWidth);
+			const __m256 y = _mm256_fmadd_ps(_mm256_mul_ps(getCornerComponent(box.base.y, box.edgeX.y, box.edgeY.y, box.edgeZ.y), invW), halfHeight, halfHeight);
+			const __m256 z = _mm256_fmadd_ps(_mm256_mul_ps(getCornerComponent(box.base.z, box.edgeX.z, box.edgeY.z, box.edgeZ.z), invW), half, half);
+			bounds = { reduceMin(x), reduceMin(y), reduceMax(x), reduceMax(y), std::min(reduceMin(z), 1.0f) };
+			return true;
+		}
+#endif
+	}
+
+	std::shared_ptr<const OccluderMesh> OccluderMesh::build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, size_t maxTriangles)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (vertices.empty() || triangleCount == 0) {
+			return nullptr;
+		}
+
+		auto mesh = std::make_shared<OccluderMesh>();
+		if (triangleCount <= maxTriangles) {
+			mesh->positions.reserve(vertices.size());
+			for (const auto& vertex : vertices) {
+				mesh->positions.push_back(vertex.Position);
+			}
+			mesh->indices.assign(indices.begin(), indices.begin() + triangleCount * 3);
+			return mesh;
+		}
+
+		glm::vec3 min = vertices[0].Position;
+		glm::vec3 max = vertices[0].Position;
+		for (const auto& vertex : vertices) {
+			min = glm::min(min, vertex.Position);
+			max = glm::max(max, vertex.Position);
+		}
+		const glm::vec3 extent = glm::max(max - min, glm::vec3(1e-6f));
+
+		std::vector<uint32_t> vertexCluster(vertices.size());
+		for (int resolution : { 32, 24, 16, 12, 8, 6, 4, 3, 2 }) {
+			std::unordered_map<uint32_t, uint32_t> cellClusters;
+			std::vector<glm::vec3> clusterSums;
+			std::vector<glm::vec3> clusterNormals;
+			std::vector<uint32_t> clusterCounts;
+
+			for (size_t i = 0; i < vertices.size(); i++) {
+				glm::ivec3 cell = glm::min(glm::ivec3((vertices[i].Position - min) / extent * static_cast<float>(resolution)), glm::ivec3(resolution - 1));
+				uint32_t cellKey = static_cast<uint32_t>((cell.x * resolution + cell.y) * resolution + cell.z);
+
+				auto [iter, inserted] = cellClusters.emplace(cellKey, static_cast<uint32_t>(clusterSums.size()));
+				if (inserted) {
+					clusterSums.emplace_back(0.0f);
+					clusterNormals.emplace_back(0.0f);
+					clusterCounts.push_back(0);
+				}
+				vertexCluster[i] = iter->second;
+				clusterSums[iter->second] += vertices[i].Position;
+				clusterNormals[iter->second] += vertices[i].Normal;
+				clusterCounts[iter->second]++;
+			}
+
+			// Triangles collapsed into a line or a point cover nothing, and duplicates cover the same pixels.
+			std::vector<uint32_t> clusteredIndices;
+			std::unordered_set<uint64_t> emitted;
+			for (size_t t = 0; t < triangleCount; t++) {
+				uint32_t corners[3] = { vertexCluster[indices[t * 3]], vertexCluster[indices[t * 3 + 1]], vertexCluster[indices[t * 3 + 2]] };
+				if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2]) {
+					continue;
+				}
+				uint32_t sorted[3] = { corners[0], corners[1], corners[2] };
+				std::sort(sorted, sorted + 3);
+				uint64_t triangleKey = uint64_t(sorted[0]) | (uint64_t(sorted[1]) << 21) | (uint64_t(sorted[2]) << 42);
+				if (emitted.insert(triangleKey).second) {
+					clusteredIndices.insert(clusteredIndices.end(), corners, corners + 3);
+				}
+			}
+
+			if (clusteredIndices.size() / 3 <= maxTriangles || resolution == 2) {
+				// A clustered vertex stays within its cell, so the simplified surface is at most a cell
+				// diagonal away from the mesh. Where the normals of a cluster cancel out, like on both sides
+				// of a thin wall, the vertex stays in the middle.
+				const float shrink = glm::length(extent / static_cast<float>(resolution));
+				mesh->positions.resize(clusterSums.size());
+				for (size_t c = 0; c < clusterSums.size(); c++) {
+					const glm::vec3 normal = clusterNormals[c] / static_cast<float>(clusterCounts[c]);
+					const float normalLength = glm::length(normal);
+					mesh->positions[c] = clusterSums[c] / static_cast<float>(clusterCounts[c]);
+					if (normalLength > 0.5f) {
+						mesh->positions[c] -= normal / normalLength * shrink;
+					}
+				}
+				mesh->exact = false;
+				mesh->indices = std::move(clusteredIndices);
+				break;
+			}
+		}
+		return mesh;
+	}
+
+	OcclusionCuller::OcclusionCuller() :
+		mTileRowBins(TILES_Y),
+		mDepth(WIDTH * HEIGHT, 1.0f),
+		mTileMaxDepth(TILES_X * TILES_Y, 1.0f),
+		mBlockMaxDepth(BLOCKS_X * BLOCKS_Y, 1.0f)
+	{
+	}
+
+	OcclusionCuller::~OcclusionCuller() = default;
+
+	void OcclusionCuller::clear()
+	{
+		mOccludeeMin.clear();
+		mOccludeeMax.clear();
+		mOccluders.clear();
+		mSelectedOccluders.clear();
+		mVisible.clear();
+	}
+
+	size_t OcclusionCuller::addOccludee(const glm::vec3& worldMin, const glm::vec3& worldMax)
+	{
+		mOccludeeMin.push_back(worldMin);
+		mOccludeeMax.push_back(worldMax);
+		return mOccludeeMin.size() - 1;
+	}
+
+	void OcclusionCuller::addOccluder(size_t occludee, const OccluderMesh& mesh, const glm::mat4& model, float priority)
+	{
+		mOccluders.push_back({ occludee, &mesh, model, priority });
+	}
+
+	void OcclusionCuller::cull(const glm::mat4& viewProjection, const std::vector<uint8_t>& frustumVisibility)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const size_t count = size();
+		mViewProjection = viewProjection;
+
+		mVisible.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			mVisible[i] = i < frustumVisibility.size() ? frustumVisibility[i] : 1;
+		}
+
+		// The largest occluders on screen hide the most, so they get the triangle budget first.
+		mSelectedOccluders.clear();
+		for (const auto& occluder : mOccluders) {
+			if (mVisible[occluder.occludee]) {
+				mSelectedOccluders.push_back(&occluder);
+			}
+		}
+		std::stable_sort(mSelectedOccluders.begin(), mSelectedOccluders.end(), [](const Occluder* a, const Occluder* b) {
+			return a->priority > b->priority;
+		});
+		mRasterizedTriangleCount = 0;
+		size_t selected = 0;
+		while (selected < mSelectedOccluders.size()
+			&& mRasterizedTriangleCount + mSelectedOccluders[selected]->mesh->getTriangleCount() <= mTriangleBudget) {
+			mRasterizedTriangleCount += mSelectedOccluders[selected]->mesh->getTriangleCount();
+			selected++;
+		}
+		mSelectedOccluders.resize(selected);
+
+		mCulledCount = 0;
+		if (mSelectedOccluders.empty()) {
+			std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+			mLastCullMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			return;
+		}
+
+		JobSystem& jobs = JobSystem::getInstance();
+		mTriangleChunks.resize((mSelectedOccluders.size() + OCCLUDERS_PER_TASK - 1) / OCCLUDERS_PER_TASK);
+		jobs.parallelFor("Occluder setup", mTriangleChunks.size(), 1, [this](size_t first, size_t last) {
+			for (size_t chunk = first; chunk < last; chunk++) {
+				size_t begin = chunk * OCCLUDERS_PER_TASK;
+				setupOccluders(begin, std::min(begin + OCCLUDERS_PER_TASK, mSelectedOccluders.size()), mTriangleChunks[chunk]);
+			}
+		});
+
+		// Every tile row is owned by one task, so rasterization needs no synchronization.
+		binTriangles();
+		jobs.parallelFor("Occluder rasterization", TILES_Y, 1, [this](size_t first, size_t last) {
+			for (size_t tileRow = first; tileRow < last; tileRow++) {
+				rasterizeTileRow(static_cast<int>(tileRow));
+			}
+		});
+		buildBlocks();
+
+		jobs.parallelFor("Occludee tests", count, OCCLUDEES_PER_TASK, [this](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				if (mVisible[i] && !isOccludeeVisible(i)) {
+					mVisible[i] = 0;
+				}
+			}
+		});
+
+		for (size_t i = 0; i < count; i++) {
+			if (i < frustumVisibility.size() && frustumVisibility[i] && !mVisible[i]) {
+				mCulledCount++;
+			}
+		}
+		mLastCullMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void OcclusionCuller::setupOccluders(size_t begin, size_t end, std::vector<OccluderTriangle>& triangles) const
+	{
+		triangles.clear();
+		std::vector<glm::vec4> clipPositions;
+		std::vector<glm::vec3> screenPositions;
+
+		for (size_t i = begin; i < end; i++) {
+			const Occluder& occluder = *mSelectedOccluders[i];
+			const glm::mat4 modelViewProjection = mViewProjection * occluder.model;
+
+			// Vertices in front of the near plane are shared by several triangles, so they are projected once.
+			const auto& positions = occluder.mesh->positions;
+			clipPositions.resize(positions.size());
+			screenPositions.resize(positions.size());
+			for (size_t v = 0; v < positions.size(); v++) {
+				clipPositions[v] = modelViewProjection * glm::vec4(positions[v], 1.0f);
+				if (clipPositions[v].z + clipPositions[v].w >= 0.0f) {
+					screenPositions[v] = toScreen(clipPositions[v]);
+				}
+			}
+
+			const auto& indices = occluder.mesh->indices;
+			for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+				const glm::vec4 clip[3] = { clipPositions[indices[t]], clipPositions[indices[t + 1]], clipPositions[indices[t + 2]] };
+				if (isOutsideClipVolume(clip)) {
+					continue;
+				}
+
+				OccluderTriangle triangle;
+				if (clip[0].z + clip[0].w >= 0.0f && clip[1].z + clip[1].w >= 0.0f && clip[2].z + clip[2].w >= 0.0f) {
+					if (setupTriangle(screenPositions[indices[t]], screenPositions[indices[t + 1]], screenPositions[indices[t + 2]], triangle)) {
+						triangles.push_back(triangle);
+					}
+					continue;
+				}
+
+				glm::vec4 polygon[4];
+				int polygonSize = clipNear(clip, polygon);
+				glm::vec3 screen[4];
+				for (int corner = 0; corner < polygonSize; corner++) {
+					screen[corner] = toScreen(polygon[corner]);
+				}
+				for (int fan = 1; fan + 1 < polygonSize; fan++) {
+					if (setupTriangle(screen[0], screen[fan], screen[fan + 1], triangle)) {
+						triangles.push_back(triangle);
+					}
+				}
+			}
+		}
+	}
+
+	void OcclusionCuller::binTriangles()
+	{
+		for (auto& bin : mTileRowBins) {
+			bin.clear();
+		}
+
+		for (uint32_t chunk = 0; chunk < mTriangleChunks.size(); chunk++) {
+			const auto& triangles = mTriangleChunks[chunk];
+			for (uint32_t t = 0; t < triangles.size(); t++) {
+				const int lastRow = triangles[t].yMax / TILE_SIZE;
+				for (int row = triangles[t].yMin / TILE_SIZE; row <= lastRow; row++) {
+					mTileRowBins[row].emplace_back(chunk, t);
+				}
+			}
+		}
+	}
+
+	void OcclusionCuller::rasterizeTileRow(int tileRow)
+	{
+		const int yBegin = tileRow * TILE_SIZE;
+		const int yEnd = yBegin + TILE_SIZE;
+		float* depth = mDepth.data();
+		std::fill(depth + yBegin * WIDTH, depth + yEnd * WIDTH, 1.0f);
+
+#if TOY_X86_SIMD
+		const bool useAVX2 = CpuFeatures::hasAVX2();
+#endif
+		for (const auto& [chunk, index] : mTileRowBins[tileRow]) {
+			const OccluderTriangle& setup = mTriangleChunks[chunk][index];
+#if TOY_X86_SIMD
+			if (useAVX2) {
+				rasterizeAVX2(setup, depth, yBegin, yEnd);
+				continue;
+			}
+#endif
+			rasterizeScalar(setup, depth, yBegin, yEnd);
+		}
+
+		for (int tileX = 0; tileX < TILES_X; tileX++) {
+			float maxDepth = 0.0f;
+			for (int y = yBegin; y < yEnd; y++) {
+				const float* row = depth + y * WIDTH + tileX * TILE_SIZE;
+				maxDepth = std::max(maxDepth, *std::max_element(row, row + TILE_SIZE));
+			}
+			mTileMaxDepth[tileRow * TILES_X + tileX] = maxDepth;
+		}
+	}
+
+	void OcclusionCuller::buildBlocks()
+	{
+		for (int blockY = 0; blockY < BLOCKS_Y; blockY++) {
+			for (int blockX = 0; blockX < BLOCKS_X; blockX++) {
+				float maxDepth = 0.0f;
+				for (int tileY = blockY * TILES_PER_BLOCK; tileY < (blockY + 1) * TILES_PER_BLOCK; tileY++) {
+					for (int tileX = blockX * TILES_PER_BLOCK; tileX < (blockX + 1) * TILES_PER_BLOCK; tileX++) {
+						maxDepth = std::max(maxDepth, mTileMaxDepth[tileY * TILES_X + tileX]);
+					}
+				}
+				mBlockMaxDepth[blockY * BLOCKS_X + blockX] = maxDepth;
+			}
+		}
+	}
+
+	bool OcclusionCuller::isOccludeeVisible(size_t occludee) const
+	{
+		const glm::vec3& min = mOccludeeMin[occludee];
+		const glm::vec3& max = mOccludeeMax[occludee];
+		if (!std::isfinite(min.x + min.y + min.z + max.x + max.y + max.z)) {
+			return true;
+		}
+
+		// Screen rectangle and nearest depth of the box.
+		const ClipBox box = toClipBox(mViewProjection, min, max);
+		ScreenBounds bounds;
+#if TOY_X86_SIMD
+		const bool useAVX2 = CpuFeatures::hasAVX2();
+		const bool projected = useAVX2 ? projectBoxAVX2(box, bounds) : projectBox(box, bounds);
+#else
+		const bool projected = projectBox(box, bounds);
+#endif
+		if (!projected || bounds.nearestDepth <= 0.0f) {
+			return true;
+		}
+		// An occluder's own surface can touch its box, and the two depths are rounded differently.
+		const float nearestDepth = bounds.nearestDepth - DEPTH_BIAS;
+
+		// clamped as floats, corners close to the camera plane project far outside the int range
+		const int x0 = static_cast<int>(std::floor(std::max(bounds.minX, 0.0f)));
+		const int y0 = static_cast<int>(std::floor(std::max(bounds.minY, 0.0f)));
+		const int x1 = static_cast<int>(std::floor(std::min(bounds.maxX, WIDTH - 1.0f)));
+		const int y1 = static_cast<int>(std::floor(std::min(bounds.maxY, HEIGHT - 1.0f)));
+		if (x0 > x1 || y0 > y1) {
+			return false;
+		}
+
+		// Descend only where the farthest occluder depth is behind the box.
+		for (int blockY = y0 / BLOCK_SIZE; blockY <= y1 / BLOCK_SIZE; blockY++) {
+			for (int blockX = x0 / BLOCK_SIZE; blockX <= x1 / BLOCK_SIZE; blockX++) {
+				if (nearestDepth > mBlockMaxDepth[blockY * BLOCKS_X + blockX]) {
+					continue;
+				}
+
+				const int tileY0 = std::max(y0 / TILE_SIZE, blockY * TILES_PER_BLOCK);
+				const int tileY1 = std::min(y1 / TILE_SIZE, (blockY + 1) * TILES_PER_BLOCK - 1);
+				const int tileX0 = std::max(x0 / TILE_SIZE, blockX * TILES_PER_BLOCK);
+				const int tileX1 = std::min(x1 / TILE_SIZE, (blockX + 1) * TILES_PER_BLOCK - 1);
+				for (int tileY = tileY0; tileY <= tileY1; tileY++) {
+					for (int tileX = tileX0; tileX <= tileX1; tileX++) {
+						if (nearestDepth > mTileMaxDepth[tileY * TILES_X + tileX]) {
+							continue;
+						}
+
+						const int pixelX0 = std::max(x0, tileX * TILE_SIZE);
+						const int pixelX1 = std::min(x1, (tileX + 1) * TILE_SIZE - 1);
+						const int pixelY1 = std::min(y1, (tileY + 1) * TILE_SIZE - 1);
+						for (int y = std::max(y0, tileY * TILE_SIZE); y <= pixelY1; y++) {
+							const float* row = mDepth.data() + y * WIDTH;
+#if TOY_X86_SIMD
+							if (useAVX2) {
+								if (isAnyPixelBehindAVX2(row, pixelX0, pixelX1, nearestDepth)) {
+									return true;
+								}
+								continue;
+							}
+#endif
+							if (isAnyPixelBehind(row, pixelX0, pixelX1, nearestDepth)) {
+								return true;
+							}
+						}
+					}
+				}
+			}
+		}
+		return false;
+	}
+}
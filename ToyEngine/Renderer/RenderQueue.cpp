@@ -0,0 +1,113 @@
+#include <Renderer/RenderQueue.h>
+#include <algorithm>
+#include <array>
+
+namespace ToyEngine {
+	namespace {
+		constexpr int PASS_BITS = 2;
+		constexpr int SHADER_BITS = 10;
+		constexpr int MATERIAL_BITS = 16;
+		constexpr int GEOMETRY_BITS = 16;
+		constexpr int DEPTH_BITS = 20;
+
+		constexpr int DEPTH_SHIFT = 0;
+		constexpr int GEOMETRY_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+		constexpr int MATERIAL_SHIFT = GEOMETRY_SHIFT + GEOMETRY_BITS;
+		constexpr int SHADER_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+		constexpr int PASS_SHIFT = SHADER_SHIFT + SHADER_BITS;
+
+		static_assert(PASS_SHIFT + PASS_BITS == 64, "Sort key must use exactly 64 bits.");
+
+		constexpr uint64_t mask(int bits) {
+			return (uint64_t(1) << bits) - 1;
+		}
+	}
+
+	uint64_t RenderQueue::makeSortKey(RenderPass pass, GLuint program, uint32_t materialId, uint32_t geometryId, float viewDepth, float farPlane)
+	{
+		float normalizedDepth = farPlane > 0.0f ? std::clamp(viewDepth / farPlane, 0.0f, 1.0f) : 0.0f;
+		uint64_t depth = static_cast<uint64_t>(normalizedDepth * static_cast<float>(mask(DEPTH_BITS)));
+
+		// Opaque geometry goes front to back for early z, blended geometry back to front.
+		if (pass == RenderPass::Transparent) {
+			depth = mask(DEPTH_BITS) - depth;
+		}
+
+		return ((static_cast<uint64_t>(pass) & mask(PASS_BITS)) << PASS_SHIFT)
+			| ((static_cast<uint64_t>(program) & mask(SHADER_BITS)) << SHADER_SHIFT)
+			| ((static_cast<uint64_t>(materialId) & mask(MATERIAL_BITS)) << MATERIAL_SHIFT)
+			| ((static_cast<uint64_t>(geometryId) & mask(GEOMETRY_BITS)) << GEOMETRY_SHIFT)
+			| ((depth & mask(DEPTH_BITS)) << DEPTH_SHIFT);
+	}
+
+	uint32_t RenderQueue::getMaterialId(uint32_t diffusePage, uint32_t specularPage)
+	{
+		uint64_t pages = (static_cast<uint64_t>(diffusePage) << 32) | specularPage;
+		auto iter = mMaterialIds.find(pages);
+		if (iter != mMaterialIds.end()) {
+			return iter->second;
+		}
+		uint32_t id = static_cast<uint32_t>(mMaterialIds.size());
+		mMaterialIds.emplace(pages, id);
+		return id;
+	}
+
+	void RenderQueue::sort()
+	{
+		const size_t count = mPackets.size();
+		mKeys.resize(count);
+		mKeysScratch.resize(count);
+		mOrder.resize(count);
+		mOrderScratch.resize(count);
+
+		for (size_t i = 0; i < count; i++) {
+			mKeys[i] = mPackets[i].sortKey;
+			mOrder[i] = static_cast<uint32_t>(i);
+		}
+
+		// 8 passes of 8 bits. A pass where every key has the same digit is skipped,
+		// which is the common case for the pass and shader bytes.
+		for (int shift = 0; shift < 64; shift += 8) {
+			std::array<size_t, 256> histogram{};
+			for (size_t i = 0; i < count; i++) {
+				histogram[(mKeys[i] >> shift) & 0xFF]++;
+			}
+
+			if (count == 0 || histogram[(mKeys[0] >> shift) & 0xFF] == count) {
+				continue;
+			}
+
+			size_t offset = 0;
+			for (auto& bucket : histogram) {
+				size_t bucketSize = bucket;
+				bucket = offset;
+				offset += bucketSize;
+			}
+
+			for (size_t i = 0; i < count; i++) {
+				size_t destination = histogram[(mKeys[i] >> shift) & 0xFF]++;
+				mKeysScratch[destination] = mKeys[i];
+				mOrderScratch[destination] = mOrder[i];
+			}
+			mKeys.swap(mKeysScratch);
+			mOrder.swap(mOrderScratch);
+		}
+	}
+
+	void RenderQueue::filter(const std::vector<uint8_t>& keep)
+	{
+		size_t kept = 0;
+		for (size_t i = 0; i < mPackets.size(); i++) {
+			if (keep[i]) {
+				mPackets[kept++] = mPackets[i];
+			}
+		}
+		mPackets.resize(kept);
+	}
+
+	void RenderQueue::clear()
+	{
+		mPackets.clear();
+		mOrder.clear();
+	}
+}
@@ -8,14 +8,13 @@
 #include <Renderer/RenderSystem.h>
 #include <Resource/StbImageLoader.h>
 #include <Resource/Texture.h>
+#include <Resource/TextureCooker.h>
 #include <Resource/stb_image.h>
 #include <glm/gtc/type_ptr.hpp>
 #include <Engine/Component.h>
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-#include <filesystem>
+#include <algorithm>
+#include <limits>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -25,18 +24,31 @@
 #include "imgui_impl_opengl3.h"
 #include "UI/View/ImGuiManager.h"
 #include <Renderer/Line.h>
+#include <Renderer/GLStateCache.h>
+#include <Renderer/GpuTransferQueue.h>
 #include <UI/Controller/InspectorPanelController.h>
 #include <Utils/Logger.h>
 #include <Utils/RenderHelper.h>
 
 #define SELF_ROTATION 0
-#define NUM_OF_TEXTURE_TYPE 3
 
 namespace ToyEngine {
 	RenderSystem RenderSystem::instance = RenderSystem();
 
 	const glm::vec3 LIGHT_BULB_POSITION(5.0f, 5.0f, 5.0f);
 
+	const float CAMERA_NEAR_PLANE = 0.1f;
+	const float CAMERA_FAR_PLANE = 100.0f;
+
+	// Bounding radius over view depth. Meshes at least this large on screen occlude without being flagged,
+	// if their occluder is exact.
+	const float AUTO_OCCLUDER_SCREEN_SIZE = 0.2f;
+
+	// Texture units of Shaders/simpleMeshShader.*.
+	const GLint DIFFUSE_TEXTURE_UNIT = 0;
+	const GLint SPECULAR_TEXTURE_UNIT = 1;
+	const GLint MATERIALS_TEXTURE_UNIT = 2;
+
 	const glm::vec3 PHONG_TESTING_POSITION(0.f, 0.f, 2.f);
 	const glm::vec3 PHONG_AMBIENT_COLOR(0.2f, 0.2f, 0.2f);
 	const glm::vec3 PHONG_DIFFUSE_COLOR(1.0f, 0.0f, 0.0f);
@@ -69,127 +81,315 @@ namespace ToyEngine {
 
 	void RenderSystem::preDraw()
 	{
+		GLStateCache::getInstance().beginFrame();
+		// glClear respects the depth mask.
+		GLStateCache::getInstance().setDepthMask(true);
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		updateFrameConstants();
+		mLightBuffer.update(mScene->getRegistry());
 	}
 
-	void RenderSystem::drawGridLine()
+	void RenderSystem::updateFrameConstants()
 	{
-		glm::mat4 projection = glm::perspective(glm::radians(mCamera->mZoom), 1920.0f / 1080.0f, 0.1f, 100.0f);
+		float currentTime = static_cast<float>(glfwGetTime());
+		float deltaTime = currentTime - lastFrameTime;
+		lastFrameTime = currentTime;
+
+		mFrameConstants.view = mCamera->GetViewMatrix();
+		mFrameConstants.projection = glm::perspective(glm::radians(mCamera->mZoom), (float)mViewportWidth / (float)mViewportHeight, CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
+		mFrameConstants.viewProjection = mFrameConstants.projection * mFrameConstants.view;
+		mFrameConstants.cameraPosition = glm::vec4(mCamera->Position, 1.0f);
+		mFrameConstants.time = glm::vec4(currentTime, deltaTime, 0.0f, 0.0f);
 
-		glUseProgram(mGridShader->ID);
-		glm::highp_mat4 mvp = projection * mCamera->GetViewMatrix();
-		glUniformMatrix4fv(glGetUniformLocation(mGridShader->ID, "MVP"), 1, GL_FALSE, &mvp[0][0]);
-		glUniform3fv(glGetUniformLocation(mGridShader->ID, "color"), 1, &mGridLineColor[0]);
-		glBindVertexArray(mGridVAOIndex);
+		mFrameConstantsBuffer.upload(&mFrameConstants, sizeof(FrameConstants));
+	}
+
+	void RenderSystem::onFramebufferResize(int width, int height)
+	{
+		// A minimized window reports 0x0. Keep the last aspect ratio instead of dividing by zero.
+		if (width <= 0 || height <= 0) {
+			return;
+		}
+		mViewportWidth = width;
+		mViewportHeight = height;
+		glViewport(0, 0, width, height);
+	}
+
+	void RenderSystem::drawGridLine()
+	{
+		mGridShader->use();
+		mGridShader->setUniform(mGridShader->getUniformHandle<glm::vec3>("color"_uniform), mGridLineColor);
+		GLStateCache::getInstance().bindVertexArray(mGridVAOIndex);
 		glDrawArrays(GL_LINES, 0, mGridPoints.size());
 
 	}
 
 	void RenderSystem::drawCoordinateIndicator(glm::vec3 position)
 	{
-		glm::mat4 projection = glm::perspective(glm::radians(mCamera->mZoom), 1920.0f / 1080.0f, 0.1f, 100.0f);
-
 		Line lineX = Line(position, position + glm::vec3(1, 0, 0));
-		lineX.setMVP(projection * mCamera->GetViewMatrix());
+		lineX.setMVP(mFrameConstants.viewProjection);
 		lineX.setColor(vec3(255, 0, 0));
 		lineX.draw();
 		Line lineY = Line(position, position + glm::vec3(0, 1, 0));
-		lineY.setMVP(projection * mCamera->GetViewMatrix());
+		lineY.setMVP(mFrameConstants.viewProjection);
 		lineY.setColor(vec3(0, 0, 255));
 		lineY.draw();
 		Line lineZ = Line(position, position + glm::vec3(0, 0, 1));
-		lineZ.setMVP(projection * mCamera->GetViewMatrix());
+		lineZ.setMVP(mFrameConstants.viewProjection);
 		lineZ.setColor(vec3(0, 255, 0));
 		lineZ.draw();
 	}
 
-	void RenderSystem::drawMesh(const TransformComponent& transform, const MeshComponent& mesh, MaterialComponent material)
-	{	
-		try {
-			mesh.shader->use();
+	DrawPacket RenderSystem::makeDrawPacket(const MeshComponent& mesh, const MaterialComponent& material, size_t lod) const
+	{
+		const GeometryRange& range = mesh.geometry->lods[lod].range;
+		DrawPacket packet;
+		packet.shader = mesh.shader.get();
+		packet.VAOIndex = mesh.geometry->VAOIndex;
+		packet.geometryId = range.id;
+		packet.indexCount = range.indexCount;
+		packet.firstIndex = range.firstIndex;
+		packet.baseVertex = range.baseVertex;
+		packet.indexType = mesh.geometry->indexType;
+		packet.positionDequantization = mesh.geometry->dequantization;
+
+		const MaterialPages& pages = mMaterialBuffer.getPages(material.materialIndex);
+		packet.materialIndex = material.materialIndex;
+		packet.diffusePage = pages.diffusePage;
+		packet.specularPage = pages.specularPage;
+		return packet;
+	}
 
-			glActiveTexture(GL_TEXTURE0);
+	uint32_t RenderSystem::registerMaterial(const MaterialComponent& material)
+	{
+		//TODO: Use multiple textures
+		const Texture& diffuse = !material.diffuseTextures.empty() && material.diffuseTextures[0].getArrayLayer().isValid()
+			? material.diffuseTextures[0] : mMissingTextureDiffuse;
+		const Texture& specular = material.specularTexture.getArrayLayer().isValid() ? material.specularTexture : mMissingTextureSpecular;
+		return mMaterialBuffer.add(diffuse.getArrayLayer(), specular.getArrayLayer(), material.shininess);
+	}
 
-			if (!material.diffuseTextures.empty()) {
-				// bind diffuse map
-				//TODO: Use multiple textures
-				glBindTexture(GL_TEXTURE_2D, material.diffuseTextures[0].getTextureIndex());
+	void RenderSystem::submitMesh(const TransformComponent& transform, const MeshComponent& mesh, const MaterialComponent& material, const BoundsComponent* bounds)
+	{
+		glm::mat4 model = computeModelMatrix(transform);
+
+		// The coarsest level whose error stays below a pixel or so at the mesh's nearest point.
+		size_t lod = 0;
+		if (bounds && mesh.geometry->lods.size() > 1) {
+			float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+			glm::vec3 center = glm::vec3(model * glm::vec4(bounds->center, 1.0f));
+			float depth = glm::dot(center - mCamera->Position, mCamera->Front) - bounds->radius * scale;
+			if (depth > 0.0f) {
+				lod = mesh.geometry->selectLod(depth / (scale * getLodErrorScale()));
 			}
-			else {
-				glBindTexture(GL_TEXTURE_2D, mMissingTextureDiffuse.getTextureIndex());
-				//throw(std::overflow_error("Attempting to access the first diffuse map but there is no diffuse texture."));
+		}
+
+		DrawPacket packet = makeDrawPacket(mesh, material, lod);
+		packet.model = model;
+		packet.normalMatrix = SELF_ROTATION ? glm::transpose(glm::inverse(glm::mat3(model))) : transform.getNormalMatrix();
+
+		float viewDepth = glm::dot(glm::vec3(packet.model[3]) - mCamera->Position, mCamera->Front);
+		uint32_t materialId = mRenderQueue.getMaterialId(packet.diffusePage, packet.specularPage);
+		packet.sortKey = RenderQueue::makeSortKey(RenderPass::Opaque, packet.shader->ID, materialId, packet.geometryId, viewDepth, CAMERA_FAR_PLANE);
+
+		mRenderQueue.push(packet);
+
+		// World space bounding sphere. The largest axis scale keeps the sphere conservative under non-uniform scaling.
+		if (bounds) {
+			glm::vec3 center = glm::vec3(packet.model * glm::vec4(bounds->center, 1.0f));
+			float scale = std::max({ glm::length(glm::vec3(packet.model[0])), glm::length(glm::vec3(packet.model[1])), glm::length(glm::vec3(packet.model[2])) });
+			float radius = bounds->radius * scale;
+			mFrustumCuller.add(center, radius);
+
+			AABB worldBounds = AABB::transform(bounds->min, bounds->max, packet.model);
+			size_t occludee = mOcclusionCuller.addOccludee(worldBounds.min, worldBounds.max);
+
+			float screenSize = radius / std::max(glm::dot(center - mCamera->Position, mCamera->Front), CAMERA_NEAR_PLANE);
+			const auto& occluder = mesh.geometry->occluder;
+			if (occluder && (mesh.occluder || (occluder->exact && screenSize >= AUTO_OCCLUDER_SCREEN_SIZE))) {
+				float priority = mesh.occluder ? std::numeric_limits<float>::max() : screenSize;
+				mOcclusionCuller.addOccluder(occludee, *occluder, packet.model, priority);
 			}
+		}
+		else {
+			mFrustumCuller.add(glm::vec3(packet.model[3]), std::numeric_limits<float>::infinity());
+			mOcclusionCuller.addOccludee(glm::vec3(-std::numeric_limits<float>::infinity()), glm::vec3(std::numeric_limits<float>::infinity()));
+		}
+	}
 
-			glActiveTexture(GL_TEXTURE1);
-			if (material.specularTexture.isValid()) {
-				// bind specular map
-				glBindTexture(GL_TEXTURE_2D, material.specularTexture.getTextureIndex());
+	void RenderSystem::drawRenderQueue()
+	{
+		mFrustumCuller.cull(getViewFrustum());
+		if (mOcclusionCullingEnabled) {
+			mOcclusionCuller.cull(mFrameConstants.viewProjection, mFrustumCuller.getVisibility());
+			mRenderQueue.filter(mOcclusionCuller.getVisibility());
+		}
+		else {
+			mRenderQueue.filter(mFrustumCuller.getVisibility());
+		}
+		mFrustumCuller.clear();
+		mOcclusionCuller.clear();
+
+		mRenderQueue.sort();
+
+		// Consecutive packets with the same program, geometry and texture pages become one instanced draw, the material
+		// is per instance. The sort key already puts them next to each other, so batching is a single linear pass.
+		mInstances.clear();
+		mInstanceBatches.clear();
+		for (size_t i = 0; i < mRenderQueue.size(); i++) {
+			const DrawPacket& packet = mRenderQueue.getSorted(i);
+			// The normal matrix comes from the mesh space model, normals are not quantized with the positions.
+			mInstances.push_back({ packet.model * VertexLayout::getDequantizationMatrix(packet.positionDequantization),
+				packet.normalMatrix, packet.materialIndex });
+
+			if (!mInstanceBatches.empty()) {
+				const DrawPacket& first = mRenderQueue.getSorted(mInstanceBatches.back().first);
+				if (first.sharesDrawState(packet) && first.firstIndex == packet.firstIndex
+					&& first.baseVertex == packet.baseVertex && first.indexCount == packet.indexCount) {
+					mInstanceBatches.back().second++;
+					continue;
+				}
 			}
-			else {
-				glBindTexture(GL_TEXTURE_2D, mMissingTextureSpecular.getTextureIndex());
-				//throw(std::overflow_error("Attempting to bind invalid specular map."));
+			mInstanceBatches.emplace_back(i, 1);
+		}
+		mInstanceBuffer.upload(mInstances);
+
+		// With multi draw indirect every batch is a command, and the instance attributes stay at offset 0:
+		// the command's base instance selects its range of the instance buffer.
+		const bool useIndirect = IndirectBuffer::isSupported();
+		if (useIndirect) {
+			mIndirectCommands.clear();
+			for (const auto& [firstInstance, instanceCount] : mInstanceBatches) {
+				const DrawPacket& packet = mRenderQueue.getSorted(firstInstance);
+				DrawElementsIndirectCommand command;
+				command.count = packet.indexCount;
+				command.instanceCount = static_cast<GLuint>(instanceCount);
+				command.firstIndex = packet.firstIndex;
+				command.baseVertex = packet.baseVertex;
+				command.baseInstance = static_cast<GLuint>(firstInstance);
+				mIndirectCommands.push_back(command);
 			}
+			mIndirectBuffer.upload(mIndirectCommands);
+		}
 
+		mMaterialBuffer.bind(MATERIALS_TEXTURE_UNIT);
+		BoundDrawState bound;
+		mDrawCallCount = 0;
+		size_t batch = 0;
+		while (batch < mInstanceBatches.size()) {
+			const auto& [firstInstance, instanceCount] = mInstanceBatches[batch];
+			const DrawPacket& packet = mRenderQueue.getSorted(firstInstance);
 
-			// bind texture maps
-			mesh.shader->setUniform("material.diffuse", 0);
-			mesh.shader->setUniform("material.specular", 1);
-			mesh.shader->setUniform("material.shininess", material.shininess);
+			if (applyDrawState(packet, bound) && useIndirect) {
+				mInstanceBuffer.bindAttributes(0);
+			}
 
-			glActiveTexture(GL_TEXTURE0);
+			if (useIndirect) {
+				// Following batches that only differ in geometry go into the same call.
+				size_t end = batch + 1;
+				while (end < mInstanceBatches.size() && packet.sharesDrawState(mRenderQueue.getSorted(mInstanceBatches[end].first))) {
+					end++;
+				}
+				glMultiDrawElementsIndirect(GL_TRIANGLES, packet.indexType, (void*)(batch * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(end - batch), 0);
+				batch = end;
+			}
+			else {
+				mInstanceBuffer.bindAttributes(firstInstance);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.indexCount, packet.indexType, (void*)(packet.firstIndex * GeometryPool::getIndexSize(packet.indexType)),
+					static_cast<GLsizei>(instanceCount), packet.baseVertex);
+				batch++;
+			}
+			mDrawCallCount++;
+		}
 
-			applyLighting(mesh.shader.get());
+		mRenderQueue.clear();
+	}
 
-			auto model = glm::mat4(1.0f);
+	uint32_t RenderSystem::addResidentMesh(const TransformComponent& transform, const MeshComponent& mesh, const MaterialComponent& material, const BoundsComponent& bounds)
+	{
+		return mGpuCuller.addInstance(makeDrawPacket(mesh, material), mesh.geometry->lods, computeModelMatrix(transform), bounds.min, bounds.max);
+	}
 
-			glm::vec3 worldPos = transform.getWorldPos();
-			glm::vec3 worldRot = transform.getWorldRotation();
-			glm::vec3 worldScale = transform.getWorldScale();
+	void RenderSystem::updateResidentMesh(uint32_t instance, const TransformComponent& transform)
+	{
+		mGpuCuller.updateInstance(instance, computeModelMatrix(transform));
+	}
 
-			if (SELF_ROTATION) {
-				// rotation need to be improved
-				auto model_rotate = glm::rotate(model, (float)glfwGetTime() * glm::radians(40.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-				auto model_translate = glm::translate(model, worldPos);
-				model = model_translate * model_rotate;
-			}
-			else {
-				auto model_translate = glm::translate(model, worldPos);
-				auto model_rotate = glm::rotate(glm::mat4(1.0f), glm::radians(worldRot.x), glm::vec3(1.0f, 0.0f, 0.0f));
-				model_rotate = glm::rotate(model_rotate, glm::radians(worldRot.y), glm::vec3(0.0f, 1.0f, 0.0f));
-				model_rotate = glm::rotate(model_rotate, glm::radians(worldRot.z), glm::vec3(0.0f, 0.0f, 1.0f));
+	void RenderSystem::removeResidentMesh(uint32_t instance)
+	{
+		mGpuCuller.removeInstance(instance);
+	}
 
-				model = glm::scale(model_translate * model_rotate, worldScale);
-			}
-			mesh.shader->setUniform("model", model);
-
-			auto view = glm::mat4(1.0f);
-			// note that we're translating the scene in the reverse direction of where we want to move
-			view = mCamera->GetViewMatrix();
-			//view = glm::translate(view, glm::vec3(0.0f, 0.0f, -10.0f));
-			mesh.shader->setUniform("view", view);
-			mesh.shader->setUniform("viewPos", mCamera->Position);
-
-			mesh.shader->setUniform("normalMat", glm::transpose(glm::inverse(view * model)));
-
-			auto projection = glm::mat4(1);
-			projection = glm::perspective(glm::radians(mCamera->mZoom), 1920.0f / 1080.0f, 0.1f, 100.0f);
-			mesh.shader->setUniform("projection", projection);
-
-			glBindVertexArray(mesh.VAOIndex);
-			glDrawElements(GL_TRIANGLES, mesh.vertexSize, GL_UNSIGNED_INT, 0);
-			glBindVertexArray(0);
-
-			// Clear texture binding so that current binding will not affect other meshes.
-			for (int i = 0; i < 5; i++)
-			{
-				glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
-				glBindTexture(GL_TEXTURE_2D, 0);
+	void RenderSystem::drawResidentMeshes()
+	{
+		mGpuCuller.cull(mFrameConstants.viewProjection, getLodErrorScale());
+
+		// The culling pass already wrote the instance counts, so this loop only depends on the number of
+		// distinct draw states. Every VAO reads its instances from the compacted buffer at offset 0.
+		mMaterialBuffer.bind(MATERIALS_TEXTURE_UNIT);
+		BoundDrawState bound;
+		mDrawCallCount = 0;
+		for (const auto& run : mGpuCuller.getDrawRuns()) {
+			if (applyDrawState(run.state, bound)) {
+				InstanceBuffer::bindAttributes(mGpuCuller.getVisibleInstanceBuffer(), 0);
 			}
+			glMultiDrawElementsIndirect(GL_TRIANGLES, run.state.indexType, (void*)(run.firstCommand * sizeof(DrawElementsIndirectCommand)),
+				static_cast<GLsizei>(run.commandCount), 0);
+			mDrawCallCount++;
 		}
-		catch (std::overflow_error err) {
-			Logger::DEBUG_ERROR(err.what());
+
+		mGpuCuller.buildDepthPyramid(mViewportWidth, mViewportHeight, mFrameConstants.viewProjection);
+	}
+
+	bool RenderSystem::applyDrawState(const DrawPacket& packet, BoundDrawState& bound)
+	{
+		GLStateCache& state = GLStateCache::getInstance();
+		if (packet.shader != bound.shader) {
+			bound.shader = packet.shader;
+			state.useProgram(bound.shader->ID);
+
+			// Uniforms are program state, so the sampler units only need to be set once per program.
+			// Camera and lights come from the shared uniform blocks, materials from the material buffer.
+			bound.shader->setUniform(bound.shader->getUniformHandle<int>("material.diffuse"_uniform), DIFFUSE_TEXTURE_UNIT);
+			bound.shader->setUniform(bound.shader->getUniformHandle<int>("material.specular"_uniform), SPECULAR_TEXTURE_UNIT);
+			bound.shader->setUniform(bound.shader->getUniformHandle<int>("materials"_uniform), MATERIALS_TEXTURE_UNIT);
 		}
+
+		const TextureArrayPool& textures = TextureArrayPool::getInstance();
+		state.bindTexture(DIFFUSE_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, textures.getTexture(packet.diffusePage));
+		state.bindTexture(SPECULAR_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, textures.getTexture(packet.specularPage));
+
+		// The VAO may already be bound from an earlier pass, but its instance attributes may point elsewhere.
+		state.bindVertexArray(packet.VAOIndex);
+		if (packet.VAOIndex != bound.VAOIndex) {
+			bound.VAOIndex = packet.VAOIndex;
+			return true;
+		}
+		return false;
+	}
+
+	float RenderSystem::getLodErrorScale() const
+	{
+		float pixelsPerUnit = static_cast<float>(mViewportHeight) / (2.0f * std::tan(glm::radians(mCamera->mZoom) * 0.5f));
+		return pixelsPerUnit / mLodPixelError;
+	}
+
+	glm::mat4 RenderSystem::computeModelMatrix(const TransformComponent& transform) const
+	{
+		auto model = glm::mat4(1.0f);
+
+		if (SELF_ROTATION) {
+			// rotation need to be improved
+			auto model_rotate = glm::rotate(model, (float)glfwGetTime() * glm::radians(40.0f), glm::vec3(0.5f, 1.0f, 0.0f));
+			auto model_translate = glm::translate(model, transform.getWorldPos());
+			model = model_translate * model_rotate;
+		}
+		else {
+			model = transform.getWorldMatrix();
+		}
+		return model;
 	}
 
 	void RenderSystem::drawImGuiManager()
@@ -201,20 +401,11 @@ namespace ToyEngine {
 	{
 		mLightCubeShader->use();
 
-		auto view = mCamera->GetViewMatrix();
-		//view = glm::translate(view, glm::vec3(0.0f, 0.0f, -10.0f));
-		mLightCubeShader->setUniform("view", view);
-
-		auto projection = glm::mat4(1);
-		projection = glm::perspective(glm::radians(mCamera->mZoom), 1920.0f / 1080.0f, 0.1f, 100.0f);
-		
-		mLightCubeShader->setUniform("projection", projection);
-		mLightCubeShader->setUniform("view", view);
 		auto lightEntities = mScene->getLightEntities();
 		std::vector<entt::entity> pointLights = std::get<1>(lightEntities);
 		for (entt::entity entity : pointLights) {
 			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::translate(model, mScene->getRegistry().get<TransformComponent>(entity).localPos);
+			model = glm::translate(model, mScene->getRegistry().get<TransformComponent>(entity).getWorldPos());
 			model = glm::scale(model, glm::vec3(0.2f)); // smaller cube
 			mLightCubeShader->setUniform("model", model);
 			mScene->getRegistry().get<LightComponent>(entity).draw();
@@ -223,7 +414,7 @@ namespace ToyEngine {
 
 	void RenderSystem::initGrid()
 	{
-		mGridShader = std::make_shared<Shader>("Shaders/GridVertex.glsl", "Shaders/GridFragment.glsl");
+		mGridShader = ShaderLibrary::getInstance().get("Shaders/GridVertex.glsl", "Shaders/GridFragment.glsl");
 
 		const int gridWidth = 500;
 		const int gridHeight = 500;
@@ -248,12 +439,12 @@ namespace ToyEngine {
 
 		glGenVertexArrays(1, &mGridVAOIndex);
 		glGenBuffers(1, &mGridVBOIndex);
-		glBindVertexArray(mGridVAOIndex);
-		glBindBuffer(GL_ARRAY_BUFFER, mGridVBOIndex);
+		GLStateCache::getInstance().bindVertexArray(mGridVAOIndex);
+		GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, mGridVBOIndex);
 		glBufferData(GL_ARRAY_BUFFER, mGridPoints.size() * sizeof(float), mGridPoints.data(), GL_STATIC_DRAW);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(0);
-		glBindVertexArray(0);
+		GLStateCache::getInstance().bindVertexArray(0);
 	}
 
 	// Setup active shader, camera, window.
@@ -261,7 +452,21 @@ namespace ToyEngine {
 		mWindow = window;
 		mCamera = camera;
 		mScene = scene;
-		glEnable(GL_DEPTH_TEST);
+		GLStateCache::getInstance().setDepthTest(true);
+		// Before anything loads textures or meshes, so that they can go through it.
+		GpuTransferQueue::getInstance().init(mWindow.get());
+		TextureCooker::getInstance().init();
+
+		glfwGetFramebufferSize(mWindow.get(), &mViewportWidth, &mViewportHeight);
+		onFramebufferResize(mViewportWidth, mViewportHeight);
+
+		mFrameConstantsBuffer.init(sizeof(FrameConstants), FRAME_CONSTANTS_BLOCK_BINDING);
+		mLightBuffer.init(scene->getRegistry());
+		mMaterialBuffer.init();
+		mInstanceBuffer.init();
+		mIndirectBuffer.init();
+		mGpuCuller.init();
+		mGpuCullingEnabled = GpuCuller::isSupported();
 
 		initGrid();
 
@@ -269,10 +474,12 @@ namespace ToyEngine {
 		setupImGUI();
 		ui::ImGuiManager::getInstance().setupControllers(scene);
 
-		mLightCubeShader = std::make_shared<Shader>("Shaders/lightingShader.vert", "Shaders/lightingShader.frag");
+		mLightCubeShader = ShaderLibrary::getInstance().get("Shaders/lightingShader.vert", "Shaders/lightingShader.frag");
 
 		mMissingTextureDiffuse = Texture("Resources\\Images\\missing_texture_diffuse.png", ToyEngine::TextureType::Diffuse, false);
 		mMissingTextureSpecular = Texture("Resources\\Images\\missing_texture_specular.png", ToyEngine::TextureType::Specular, false);
+		// MaterialBuffer::DEFAULT_MATERIAL
+		registerMaterial(MaterialComponent());
 
 		mSkyBox = SkyBox({
 				   "Resources/Images/skybox/right.jpg",
@@ -281,7 +488,7 @@ namespace ToyEngine {
 				   "Resources/Images/skybox/bottom.jpg",
 				   "Resources/Images/skybox/front.jpg",
 				   "Resources/Images/skybox/back.jpg"
-			}, camera);
+			});
 	}
 
 	void RenderSystem::setupImGUI()
@@ -301,184 +508,7 @@ namespace ToyEngine {
 
 	entt::entity RenderSystem::loadModel(std::string path, std::string modelName, entt::registry& registry, entt::entity parent)
 	{
-		Assimp::Importer import;
-		const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_FlipUVs);
-
-		// TODO: What if the model has already been loaded before?
-
-		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
-		{
-			std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
-			return entt::null;
-		}
-
-		std::vector<Texture> textures(scene->mNumMaterials * NUM_OF_TEXTURE_TYPE);
-
-		//TODO: change to path
-		std::string directory = path;
-
-		entt::entity entity = registry.create();
-
-		auto& parentTransform = registry.get<TransformComponent>(parent);
-		auto& newTrasnform = registry.emplace<TransformComponent>(entity);
-		newTrasnform.addParentTransform(parentTransform);
-
-		auto child = processNode(scene->mRootNode, scene, registry, entity, textures, directory);
-		//TODO: PRE, NEXT
-		auto& relation = registry.emplace<RelationComponent>(entity, parent, std::list<entt::entity>());
-		if (modelName.size() == 0) {
-			registry.emplace<TagComponent>(entity, "default model");
-		}
-		else {
-			registry.emplace<TagComponent>(entity, modelName);
-		}
-		relation.children.push_back(child);
-		return entity;
-	}
-
-	// Get ambient/diffuse/specualr color from material
-	aiColor4D RenderSystem::getColorFromMaterialOfType(const aiTextureType type, const aiMaterial* const pMaterial)
-	{
-		aiColor4D aiColor = aiColor4D(1.0, 1.0, 1.0, 1.0);
-
-		if (type == aiTextureType_DIFFUSE) {
-			if (pMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, aiColor) != aiReturn_SUCCESS) {
-				aiColor = aiColor4D(1.0, 1.0, 1.0, 1.0);
-				Logger::DEBUG_ERROR("Error getting color for material of type " + std::to_string(type));
-			}
-		}
-		else if (type == aiTextureType_SPECULAR) {
-			if (pMaterial->Get(AI_MATKEY_COLOR_SPECULAR, aiColor) != aiReturn_SUCCESS) {
-				aiColor = aiColor4D(1.0, 1.0, 1.0, 1.0);
-				Logger::DEBUG_ERROR("Error getting color for material of type " + std::to_string(type));
-
-			}
-		}
-		else if (type == aiTextureType_AMBIENT) {
-			if (pMaterial->Get(AI_MATKEY_COLOR_AMBIENT, aiColor) != aiReturn_SUCCESS) {
-				aiColor = aiColor4D(1.0, 1.0, 1.0, 1.0);
-				Logger::DEBUG_ERROR("Error getting color for material of type " + std::to_string(type));
-			}
-		}
-		else if (type == aiTextureType_HEIGHT) {
-			aiColor = aiColor4D(0.0, 0.0, 0.0, 0.0);
-		}
-		else if (type == aiTextureType_NORMALS) {
-			aiColor = aiColor4D(0.0, 0.0, 0.0, 0.0);
-		}
-		else {
-			Logger::DEBUG_ERROR("Unable to extract color from texture type" + std::to_string(type));
-		}
-		return aiColor;
-	}
-
-
-	void RenderSystem::setupTextureOfType(entt::entity entity, aiTextureType type, aiMaterial* const& pMaterial, const std::string& directory, const aiScene* scene)
-	{
-		Logger::DEBUG_INFO("Start setup textures of type: " + RenderHelper::getTextureTypeString(type));
-		float shininess = 20.f;
-		if (AI_SUCCESS != aiGetMaterialFloat(pMaterial, AI_MATKEY_SHININESS, &shininess)) {
-			shininess = 20.f;
-		}
-		
-		const aiTexture* assimpTexture = nullptr;
-
-		aiColor4D aiColor = getColorFromMaterialOfType(type, pMaterial);
-		glm::vec4 color = { aiColor.r, aiColor.g, aiColor.b, aiColor.a };
-
-		Logger::DEBUG_INFO("Have " + std::to_string(pMaterial->GetTextureCount(type))+ " " + RenderHelper::getTextureTypeString(type) + " textures in total");
-		for (int i = 0; i < pMaterial->GetTextureCount(type); i++) {
-			aiString path;
-			if (pMaterial->GetTexture(type, i, &path, NULL, NULL, NULL, NULL, NULL) == aiReturn_SUCCESS) {
-				std::string p(path.data);
-				Texture texture;
-				bool isEmbedded = false;
-				if (auto assimpTexture = scene->GetEmbeddedTexture(path.C_Str())) {
-					// embedded texture
-					Logger::DEBUG_INFO("The" + RenderHelper::getTextureTypeString(type) + " texture " + std::to_string(i) + " is an embedded texture.");
-
-					isEmbedded = true;
-
-					// add texture embedded into model file
-					auto buffer = reinterpret_cast<unsigned char*>(assimpTexture->pcData);
-					int len = assimpTexture->mHeight == 0 ? static_cast<int>(assimpTexture->mWidth) 
-														  : static_cast<int>(assimpTexture->mWidth * assimpTexture->mHeight);
-						
-					texture = Texture(p, RenderHelper::ConvertTextureType(type), buffer, len, false);
-
-					if (!texture.isValid()) {
-						Logger::DEBUG_WARNING("Texture with path: " + std::string(path.C_Str()) + " is not loaded properly.");
-					}
-				}
-				else {
-					// regular texture file
-					isEmbedded = false;
-
-					std::string texturePath = std::filesystem::path(directory).parent_path().append(path.C_Str()).string();
-					
-					Logger::DEBUG_INFO("The " + RenderHelper::getTextureTypeString(type) + " texture " + std::to_string(i) + " is a regular texture.");
-					Logger::DEBUG_INFO("Texture Path: " + texturePath);
-
-					// add texture stored in an external image file
-					if (!rm.getTexture(texturePath).isValid()) {
-						Logger::DEBUG_INFO("Texture path not found in resource manager.");
-						texture = Texture(texturePath, RenderHelper::ConvertTextureType(type), false);
-						rm.addTexture(texturePath, texture);
-					}
-					else {
-						Logger::DEBUG_INFO("Texture path found in resource manager. Use the texture from resource manager");
-
-						texture = rm.getTexture(texturePath);
-						if (!texture.isValid()) {
-							Logger::DEBUG_WARNING("Texture with path: " + std::string(path.C_Str()) + " is not loaded properly.");
-						}
-					}
-				}
-
-				if (!mScene->getRegistry().try_get<MaterialComponent>(entity)) {
-					mScene->getRegistry().emplace<MaterialComponent>(entity);
-				}
-
-				MaterialComponent& materialComp = mScene->getRegistry().get<MaterialComponent>(entity);
-				
-				// Construct material component
-				materialComp.isEmbedded = isEmbedded;
-				materialComp.shininess = shininess;
-				if (type == aiTextureType_DIFFUSE) {
-					materialComp.diffuseTextures.push_back(texture);
-				}
-				else if (type == aiTextureType_SPECULAR) {
-					materialComp.specularTexture = texture;
-				}
-				else if (type == aiTextureType_HEIGHT) {
-					materialComp.heightTexture = texture;
-				}
-				else if (type == aiTextureType_NORMALS) {
-					materialComp.normalTexture = texture;
-				}
-				else if (type == aiTextureType_AMBIENT) {
-					materialComp.ambientTexture = texture;
-				}
-				else {
-					Logger::DEBUG_ERROR("Unable to attach texture to Material component from the Assimp material.");
-				}
-			}
-		}
-
-		// Set colors
-		if (!mScene->getRegistry().try_get<MaterialComponent>(entity)) {
-			mScene->getRegistry().emplace<MaterialComponent>(entity);
-		}
-
-		if (type == aiTextureType_DIFFUSE) {
-			mScene->getRegistry().get<MaterialComponent>(entity).diffuseColor = color;
-		}
-		else if (type == aiTextureType_SPECULAR) {
-			mScene->getRegistry().get<MaterialComponent>(entity).specularColor = color;
-		}
-		else if (type == aiTextureType_AMBIENT) {
-			mScene->getRegistry().get<MaterialComponent>(entity).ambientColor = color;
-		}
+		return mModelLoader.load(path, modelName, registry, parent, mPositionFormat);
 	}
 
 	void RenderSystem::bindSiblings(entt::registry& registry, entt::entity curr, entt::entity& prev)
@@ -492,191 +522,4 @@ namespace ToyEngine {
 		}
 		prev = curr;
 	}
-
-	entt::entity RenderSystem::processNode(aiNode* node, const aiScene* scene, entt::registry& registry, entt::entity parent, std::vector<Texture>& textures, const string& directory)
-	{
-		auto& parentTransform = registry.get<TransformComponent>(parent);
-
-		entt::entity entity = registry.create();
-		
-		std::shared_ptr<std::vector<Vertex>> verticesPtr;
-		std::shared_ptr<std::vector<unsigned int>> indicesPtr;
-		auto& relation = registry.emplace<RelationComponent>(entity, parent, std::list<entt::entity>());
-		auto& tag = registry.emplace<TagComponent>(entity, std::string(node->mName.C_Str()));
-		auto& transform = registry.emplace<TransformComponent>(entity);
-		transform.addParentTransform(parentTransform);
-		
-
-		entt::entity prev = entt::null;
-
-		// process all the node's meshes (if any)
-		for (unsigned int i = 0; i < node->mNumMeshes; i++)
-		{
-			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-
-			auto child = processMesh(mesh, scene, registry, entity, textures, directory);
-
-			//bindSiblings(registry, child, prev);
-
-			//prev = child;
-			relation.children.push_back(child);
-		}
-
-		// then do the same for each of its children
-		for (unsigned int i = 0; i < node->mNumChildren; i++)
-		{
-			auto child = processNode(node->mChildren[i], scene, registry, entity, textures, directory);
-
-			//bindSiblings(registry, child, prev);
-
-			//prev = child;
-			relation.children.push_back(child);
-		}
-		return entity;
-	}
-
-	entt::entity RenderSystem::processMesh(aiMesh* mesh, const aiScene* scene, entt::registry& registry, entt::entity parent, std::vector<Texture>& textures, const string& directory)
-	{
-		auto& parenTransform = registry.get<TransformComponent>(parent);
-
-		entt::entity entity =  registry.create();
-
-		std::vector<Vertex> vertices;
-		vector<unsigned int> indices;
-
-		bool hasNormal = false;
-		bool hasTexture = false;
-
-		// walk through each of the mesh's vertices
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-		{
-			Vertex vertex;
-			// positions
-			vertex.Position.x = mesh->mVertices[i].x;
-			vertex.Position.y = mesh->mVertices[i].y;
-			vertex.Position.z = mesh->mVertices[i].z;
-			// normals
-			if (mesh->HasNormals())
-			{
-				vertex.Normal.x = mesh->mNormals[i].x;
-				vertex.Normal.y = mesh->mNormals[i].y;
-				vertex.Normal.z = mesh->mNormals[i].z;
-			}
-			// texture coordinates
-			if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-			{
-				glm::vec2 vec;
-				// a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
-				// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-				vertex.TexCoords.x = mesh->mTextureCoords[0][i].x;
-				vertex.TexCoords.y = mesh->mTextureCoords[0][i].y;
-				// tangent
-				vertex.Tangent.x = mesh->mTangents[i].x;
-				vertex.Tangent.y = mesh->mTangents[i].y;
-				vertex.Tangent.z = mesh->mTangents[i].z;
-				// bitangent
-				vertex.Bitangent.x = mesh->mBitangents[i].x;
-				vertex.Bitangent.y = mesh->mBitangents[i].y;
-				vertex.Bitangent.z = mesh->mBitangents[i].z;
-			}
-			else
-				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-			vertices.push_back(vertex);
-		}
-
-		// now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
-		{
-			aiFace face = mesh->mFaces[i];
-			// retrieve all indices of the face and store them in the indices vector
-			for (unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
-		}
-		
-		// process material
-		if (mesh->mMaterialIndex >= 0)
-		{
-			aiMaterial* mat = scene->mMaterials[mesh->mMaterialIndex];
-			// RN we only want to get ambient diffuse and specualr texture
-			setupTextureOfType(entity, aiTextureType_AMBIENT, mat, directory, scene);
-			setupTextureOfType(entity, aiTextureType_DIFFUSE, mat, directory, scene);
-			setupTextureOfType(entity, aiTextureType_SPECULAR, mat, directory, scene);
-			setupTextureOfType(entity, aiTextureType_HEIGHT, mat, directory, scene);
-			setupTextureOfType(entity, aiTextureType_NORMALS, mat, directory, scene);
-
-		}
-
-		// TODO USE ACTIVE SHADER
-		std::shared_ptr<Shader> simpleMeshShader = std::make_shared<Shader>("Shaders/simpleMeshShader.vert", "Shaders/simpleMeshShader.frag");
-
-		auto& transformComp = registry.emplace<TransformComponent>(entity);
-		transformComp.addParentTransform(parenTransform);
-		auto& meshComp = registry.emplace<MeshComponent>(entity, vertices, indices , simpleMeshShader, hasNormal, hasTexture);
-		auto& relationComp = registry.emplace<RelationComponent>(entity, parent, std::list<entt::entity>());
-
-		if (std::string(mesh->mName.C_Str()).size()) {
-			registry.emplace<TagComponent>(entity, std::string(mesh->mName.C_Str()));
-		}
-		else {
-			registry.emplace<TagComponent>(entity, "unnamed mesh");
-		}
-
-		return entity;
-	}
-
-	void RenderSystem::applyLighting(Shader* shader) {
-		entt::registry& registry = mScene->getRegistry();
-		
-		auto lightEntities = mScene->getLightEntities();
-		std::vector<entt::entity> directionalLights = std::get<0>(lightEntities);
-		std::vector<entt::entity> pointLights = std::get<1>(lightEntities);
-		std::vector<entt::entity> spotLights = std::get<2>(lightEntities);
-
-		// define current number of point lights
-		shader->setUniform("numberOfDirLights", (int)directionalLights.size());
-		shader->setUniform("numberOfPointLights", (int)pointLights.size());
-		shader->setUniform("numberOfSpotLights", (int)spotLights.size());
-
-		for (int i = 0; i < directionalLights.size(); i++) {
-			entt::entity lightEntity = directionalLights.at(i);
-			LightComponent lightComponent = registry.get<LightComponent>(lightEntity);
-			std::string prefix = "dirLights[" + std::to_string(i) + "]";
-
-			// This line maybe buggy!!
-			shader->setUniform(prefix + ".direction", registry.get<TransformComponent>(lightEntity).rotation_eular);   // TODO: instead of direction, use entity rotation
-			shader->setUniform(prefix + ".ambient", lightComponent.ambient);
-			shader->setUniform(prefix + ".diffuse", lightComponent.diffuse);
-			shader->setUniform(prefix + ".specular", lightComponent.specular);
-		}
-
-		for (int i = 0; i < pointLights.size(); i++) {
-			entt::entity lightEntity = pointLights.at(i);
-			LightComponent lightComponent = registry.get<LightComponent>(lightEntity);
-			std::string prefix = "pointLights[" + std::to_string(i) + "]";
-			shader->setUniform(prefix + ".position", registry.get<TransformComponent>(lightEntity).localPos);
-			shader->setUniform(prefix + ".ambient", lightComponent.ambient);
-			shader->setUniform(prefix + ".diffuse", lightComponent.diffuse);
-			shader->setUniform(prefix + ".specular", lightComponent.specular);
-			shader->setUniform(prefix + ".constant", lightComponent.constant);
-			shader->setUniform(prefix + ".linear", lightComponent.linear);
-			shader->setUniform(prefix + ".quadratic", lightComponent.quadratic);
-		}
-
-		for (int i = 0; i < spotLights.size(); i++) {
-			entt::entity lightEntity = spotLights.at(i);
-			LightComponent lightComponent = registry.get<LightComponent>(lightEntity);
-			std::string prefix = "spotLights[" + std::to_string(i) + "]";
-			shader->setUniform(prefix + ".position", registry.get<TransformComponent>(lightEntity).localPos);
-			shader->setUniform(prefix + ".direction", registry.get<TransformComponent>(lightEntity).front());  // TODO: consider changing this to .rotation
-			shader->setUniform(prefix + ".ambient", lightComponent.ambient);
-			shader->setUniform(prefix + ".diffuse", lightComponent.diffuse);
-			shader->setUniform(prefix + ".specular", lightComponent.specular);
-			shader->setUniform(prefix + ".constant", lightComponent.constant);
-			shader->setUniform(prefix + ".linear", lightComponent.linear);
-			shader->setUniform(prefix + ".quadratic", lightComponent.quadratic);
-			shader->setUniform(prefix + ".cutOff", glm::cos(glm::radians(lightComponent.cutOff)));
-			shader->setUniform(prefix + ".outerCutOff", glm::cos(glm::radians(lightComponent.outerCutOff)));
-		}
-	}
 }
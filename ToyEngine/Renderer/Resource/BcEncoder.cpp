@@ -0,0 +1,757 @@
+#include <Resource/BcEncoder.h>
+#include <Utils/CpuFeatures.h>
+#include <Utils/JobSystem.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace ToyEngine {
+	namespace {
+		constexpr int BLOCK_TEXELS = 16;
+		constexpr int POWER_ITERATIONS = 8;
+
+		// One row of 16 floats per channel, so that four texels load at once.
+		using ChannelRow = float[BLOCK_TEXELS];
+
+		struct BlockTexels {
+			alignas(16) ChannelRow channels[4];
+		};
+
+		// Decoded entries of a block, indexed by the code stored in the block.
+		struct Palette {
+			float entries[16][4] = {};
+			int size = 0;
+		};
+
+		const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		// How much of endpoint 0 each code of a 4 color BC1 block is.
+		const float COLOR_WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+		int getRefitCount(BcQuality quality) {
+			switch (quality) {
+			case BcQuality::Fast: return 0;
+			case BcQuality::Normal: return 1;
+			default: return 4;
+			}
+		}
+
+		float clampChannel(float value) {
+			return std::min(std::max(value, 0.0f), 255.0f);
+		}
+
+		// Bits of a block, least significant first.
+		class BitWriter {
+		public:
+			explicit BitWriter(uint8_t* data) : mData(data) {}
+
+			void write(uint32_t value, int bits) {
+				for (int bit = 0; bit < bits; bit++, mPosition++) {
+					mData[mPosition >> 3] |= static_cast<uint8_t>(((value >> bit) & 1) << (mPosition & 7));
+				}
+			}
+
+		private:
+			uint8_t* mData;
+			int mPosition = 0;
+		};
+
+		class BitReader {
+		public:
+			explicit BitReader(const uint8_t* data) : mData(data) {}
+
+			uint32_t read(int bits) {
+				uint32_t value = 0;
+				for (int bit = 0; bit < bits; bit++, mPosition++) {
+					value |= static_cast<uint32_t>((mData[mPosition >> 3] >> (mPosition & 7)) & 1) << bit;
+				}
+				return value;
+			}
+
+		private:
+			const uint8_t* mData;
+			int mPosition = 0;
+		};
+
+		// The nearest palette entry of every texel, returns the squared error of the block.
+		float selectIndices(const ChannelRow* rows, int channels, const Palette& palette, uint8_t* indices) {
+			float error = 0.0f;
+#if TOY_X86_SIMD
+			for (int group = 0; group < BLOCK_TEXELS; group += 4) {
+				__m128 best = _mm_set1_ps(FLT_MAX);
+				__m128i bestIndex = _mm_setzero_si128();
+				for (int entry = 0; entry < palette.size; entry++) {
+					__m128 distance = _mm_setzero_ps();
+					for (int channel = 0; channel < channels; channel++) {
+						__m128 delta = _mm_sub_ps(_mm_load_ps(rows[channel] + group), _mm_set1_ps(palette.entries[entry][channel]));
+						distance = _mm_add_ps(distance, _mm_mul_ps(delta, delta));
+					}
+					__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+					bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(entry)));
+					best = _mm_min_ps(distance, best);
+				}
+				alignas(16) int32_t groupIndices[4];
+				alignas(16) float groupErrors[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(groupIndices), bestIndex);
+				_mm_store_ps(groupErrors, best);
+				for (int i = 0; i < 4; i++) {
+					indices[group + i] = static_cast<uint8_t>(groupIndices[i]);
+					error += groupErrors[i];
+				}
+			}
+#else
+			for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+				float best = FLT_MAX;
+				for (int entry = 0; entry < palette.size; entry++) {
+					float distance = 0.0f;
+					for (int channel = 0; channel < channels; channel++) {
+						const float delta = rows[channel][texel] - palette.entries[entry][channel];
+						distance += delta * delta;
+					}
+					if (distance < best) {
+						best = distance;
+						indices[texel] = static_cast<uint8_t>(entry);
+					}
+				}
+				error += best;
+			}
+#endif
+			return error;
+		}
+
+		// Endpoints at the corners of the bounding box. Channels that fall while the widest one rises get their
+		// corners swapped, so that the diagonal follows the colors.
+		void fitBoundingBox(const ChannelRow* rows, int channels, float* e0, float* e1) {
+			float mean[4] = {};
+			int widest = 0;
+			for (int channel = 0; channel < channels; channel++) {
+				const float* row = rows[channel];
+				e0[channel] = *std::max_element(row, row + BLOCK_TEXELS);
+				e1[channel] = *std::min_element(row, row + BLOCK_TEXELS);
+				for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+					mean[channel] += row[texel] / BLOCK_TEXELS;
+				}
+				if (e0[channel] - e1[channel] > e0[widest] - e1[widest]) {
+					widest = channel;
+				}
+			}
+			for (int channel = 0; channel < channels; channel++) {
+				float covariance = 0.0f;
+				for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+					covariance += (rows[channel][texel] - mean[channel]) * (rows[widest][texel] - mean[widest]);
+				}
+				if (covariance < 0.0f) {
+					std::swap(e0[channel], e1[channel]);
+				}
+			}
+		}
+
+		// Endpoints at the extremes of the texels along the principal axis, found by power iteration starting
+		// from the bounding box diagonal.
+		void fitPrincipalAxis(const ChannelRow* rows, int channels, float* e0, float* e1) {
+			fitBoundingBox(rows, channels, e0, e1);
+
+			float mean[4] = {};
+			float covariance[4][4] = {};
+			for (int channel = 0; channel < channels; channel++) {
+				for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+					mean[channel] += rows[channel][texel] / BLOCK_TEXELS;
+				}
+			}
+			for (int a = 0; a < channels; a++) {
+				for (int b = a; b < channels; b++) {
+					for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+						covariance[a][b] += (rows[a][texel] - mean[a]) * (rows[b][texel] - mean[b]);
+					}
+					covariance[b][a] = covariance[a][b];
+				}
+			}
+
+			float axis[4] = {};
+			for (int channel = 0; channel < channels; channel++) {
+				axis[channel] = e0[channel] - e1[channel];
+			}
+			for (int iteration = 0; iteration < POWER_ITERATIONS; iteration++) {
+				float next[4] = {};
+				float largest = 0.0f;
+				for (int a = 0; a < channels; a++) {
+					for (int b = 0; b < channels; b++) {
+						next[a] += covariance[a][b] * axis[b];
+					}
+					largest = std::max(largest, std::abs(next[a]));
+				}
+				// A flat block, the bounding box is as good as it gets.
+				if (largest == 0.0f) {
+					return;
+				}
+				for (int channel = 0; channel < channels; channel++) {
+					axis[channel] = next[channel] / largest;
+				}
+			}
+
+			float length = 0.0f;
+			for (int channel = 0; channel < channels; channel++) {
+				length += axis[channel] * axis[channel];
+			}
+			length = std::sqrt(length);
+			float lowest = FLT_MAX;
+			float highest = -FLT_MAX;
+			for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+				float projection = 0.0f;
+				for (int channel = 0; channel < channels; channel++) {
+					projection += (rows[channel][texel] - mean[channel]) * axis[channel] / length;
+				}
+				lowest = std::min(lowest, projection);
+				highest = std::max(highest, projection);
+			}
+			for (int channel = 0; channel < channels; channel++) {
+				e0[channel] = clampChannel(mean[channel] + axis[channel] / length * highest);
+				e1[channel] = clampChannel(mean[channel] + axis[channel] / length * lowest);
+			}
+		}
+
+		// Least squares endpoints for the chosen codes, weights holds how much of endpoint 0 each texel gets.
+		// Fails when every texel uses the same mix of the two.
+		bool refitEndpoints(const ChannelRow* rows, int channels, const float* weights, float* e0, float* e1) {
+			float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+			float ax[4] = {}, bx[4] = {};
+			for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+				const float a = weights[texel];
+				const float b = 1.0f - a;
+				aa += a * a;
+				bb += b * b;
+				ab += a * b;
+				for (int channel = 0; channel < channels; channel++) {
+					ax[channel] += a * rows[channel][texel];
+					bx[channel] += b * rows[channel][texel];
+				}
+			}
+			const float determinant = aa * bb - ab * ab;
+			if (std::abs(determinant) < 1e-6f) {
+				return false;
+			}
+			for (int channel = 0; channel < channels; channel++) {
+				e0[channel] = clampChannel((ax[channel] * bb - bx[channel] * ab) / determinant);
+				e1[channel] = clampChannel((bx[channel] * aa - ax[channel] * ab) / determinant);
+			}
+			return true;
+		}
+
+		void fitEndpoints(const ChannelRow* rows, int channels, BcQuality quality, float* e0, float* e1) {
+			if (quality == BcQuality::Fast) {
+				fitBoundingBox(rows, channels, e0, e1);
+			}
+			else {
+				fitPrincipalAxis(rows, channels, e0, e1);
+			}
+		}
+
+		uint16_t packColor565(const float* color) {
+			const int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+			const int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+			const int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+			return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+		}
+
+		void unpackColor565(uint16_t packed, float* color) {
+			const int r = (packed >> 11) & 31;
+			const int g = (packed >> 5) & 63;
+			const int b = packed & 31;
+			color[0] = static_cast<float>((r << 3) | (r >> 2));
+			color[1] = static_cast<float>((g << 2) | (g >> 4));
+			color[2] = static_cast<float>((b << 3) | (b >> 2));
+		}
+
+		// BC1 is in its 3 color mode with black when c0 <= c1, the color block of BC3 never is.
+		void makeColorPalette(uint16_t c0, uint16_t c1, bool threeColorMode, Palette& palette) {
+			unpackColor565(c0, palette.entries[0]);
+			unpackColor565(c1, palette.entries[1]);
+			for (int channel = 0; channel < 3; channel++) {
+				const float e0 = palette.entries[0][channel];
+				const float e1 = palette.entries[1][channel];
+				if (threeColorMode) {
+					palette.entries[2][channel] = (e0 + e1) / 2.0f;
+					palette.entries[3][channel] = 0.0f;
+				}
+				else {
+					palette.entries[2][channel] = (2.0f * e0 + e1) / 3.0f;
+					palette.entries[3][channel] = (e0 + 2.0f * e1) / 3.0f;
+				}
+			}
+			palette.size = 4;
+		}
+
+		// 6 values and the two extremes when a0 <= a1.
+		void makeAlphaPalette(uint8_t a0, uint8_t a1, Palette& palette) {
+			palette.entries[0][0] = a0;
+			palette.entries[1][0] = a1;
+			if (a0 > a1) {
+				for (int code = 2; code < 8; code++) {
+					palette.entries[code][0] = ((8 - code) * a0 + (code - 1) * a1) / 7.0f;
+				}
+			}
+			else {
+				for (int code = 2; code < 6; code++) {
+					palette.entries[code][0] = ((6 - code) * a0 + (code - 1) * a1) / 5.0f;
+				}
+				palette.entries[6][0] = 0.0f;
+				palette.entries[7][0] = 255.0f;
+			}
+			palette.size = 8;
+		}
+
+		void makeBc7Palette(const int* e0, const int* e1, Palette& palette) {
+			for (int code = 0; code < 16; code++) {
+				for (int channel = 0; channel < 4; channel++) {
+					palette.entries[code][channel] = static_cast<float>(((64 - BC7_WEIGHTS[code]) * e0[channel] + BC7_WEIGHTS[code] * e1[channel] + 32) >> 6);
+				}
+			}
+			palette.size = 16;
+		}
+
+		// RGB of a BC1 block, also the second half of BC3.
+		void encodeColorBlock(const BlockTexels& texels, BcQuality quality, uint8_t* block) {
+			float e0[4], e1[4];
+			fitEndpoints(texels.channels, 3, quality, e0, e1);
+
+			float bestError = FLT_MAX;
+			uint16_t best0 = 0, best1 = 0;
+			uint8_t bestIndices[BLOCK_TEXELS] = {};
+			for (int refits = getRefitCount(quality); ; refits--) {
+				uint16_t c0 = packColor565(e0);
+				uint16_t c1 = packColor565(e1);
+				// The 4 color mode needs c0 > c1. Equal endpoints only encode one color.
+				if (c0 < c1) {
+					std::swap(c0, c1);
+				}
+				Palette palette;
+				makeColorPalette(c0, c1, false, palette);
+				if (c0 == c1) {
+					palette.size = 1;
+				}
+
+				uint8_t indices[BLOCK_TEXELS];
+				const float error = selectIndices(texels.channels, 3, palette, indices);
+				if (error >= bestError) {
+					break;
+				}
+				bestError = error;
+				best0 = c0;
+				best1 = c1;
+				std::memcpy(bestIndices, indices, BLOCK_TEXELS);
+
+				float weights[BLOCK_TEXELS];
+				for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+					weights[texel] = COLOR_WEIGHTS[indices[texel]];
+				}
+				if (refits == 0 || error == 0.0f || !refitEndpoints(texels.channels, 3, weights, e0, e1)) {
+					break;
+				}
+			}
+
+			BitWriter writer(block);
+			writer.write(best0, 16);
+			writer.write(best1, 16);
+			for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+				writer.write(bestIndices[texel], 2);
+			}
+		}
+
+		// One channel in 8 bytes, the alpha of BC3 and each channel of BC5.
+		void encodeChannelBlock(const ChannelRow& row, BcQuality quality, uint8_t* block) {
+			float e0, e1;
+			fitBoundingBox(&row, 1, &e0, &e1);
+
+			float bestError = FLT_MAX;
+			uint8_t best0 = 0, best1 = 0;
+			uint8_t bestIndices[BLOCK_TEXELS] = {};
+			for (int refits = getRefitCount(quality); ; refits--) {
+				uint8_t a0 = static_cast<uint8_t>(e0 + 0.5f);
+				uint8_t a1 = static_cast<uint8_t>(e1 + 0.5f);
+				if (a0 < a1) {
+					std::swap(a0, a1);
+				}
+				Palette palette;
+				makeAlphaPalette(a0, a1, palette);
+
+				uint8_t indices[BLOCK_TEXELS];
+				const float error = selectIndices(&row, 1, palette, indices);
+				if (error >= bestError) {
+					break;
+				}
+				bestError = error;
+				best0 = a0;
+				best1 = a1;
+				std::memcpy(bestIndices, indices, BLOCK_TEXELS);
+
+				// Only the 8 value mode interpolates all of its codes.
+				if (refits == 0 || error == 0.0f || a0 == a1) {
+					break;
+				}
+				float weights[BLOCK_TEXELS];
+				for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+					const int code = indices[texel];
+					weights[texel] = code == 0 ? 1.0f : code == 1 ? 0.0f : (8 - code) / 7.0f;
+				}
+				if (!refitEndpoints(&row, 1, weights, &e0, &e1)) {
+					break;
+				}
+			}
+
+			BitWriter writer(block);
+			writer.write(best0, 8);
+			writer.write(best1, 8);
+			for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+				writer.write(bestIndices[texel], 3);
+			}
+		}
+
+		// The 7 bit value closest to value once the p-bit is appended, as 8 bits.
+		int quantizeBc7(float value, int pBit) {
+			const int quantized = std::min(std::max(static_cast<int>((value - pBit) / 2.0f + 0.5f), 0), 127);
+			return (quantized << 1) | pBit;
+		}
+
+		// The p-bit that loses least of the endpoint.
+		int choosePBit(const float* endpoint) {
+			float errors[2] = {};
+			for (int pBit = 0; pBit < 2; pBit++) {
+				for (int channel = 0; channel < 4; channel++) {
+					const float delta = endpoint[channel] - quantizeBc7(endpoint[channel], pBit);
+					errors[pBit] += delta * delta;
+				}
+			}
+			return errors[1] < errors[0] ? 1 : 0;
+		}
+
+		// Mode 6, one subset of RGBA endpoints with 7 bits and a p-bit each and 4 bit indices.
+		void encodeBc7Block(const BlockTexels& texels, BcQuality quality, uint8_t* block) {
+			float e0[4], e1[4];
+			fitEndpoints(texels.channels, 4, quality, e0, e1);
+
+			float bestError = FLT_MAX;
+			int best0[4] = {}, best1[4] = {};
+			uint8_t bestIndices[BLOCK_TEXELS] = {};
+			for (int refits = getRefitCount(quality); ; refits--) {
+				float iterationError = FLT_MAX;
+				int iteration0[4], iteration1[4];
+				uint8_t iterationIndices[BLOCK_TEXELS];
+				for (int pBits = 0; pBits < 4; pBits++) {
+					const int p0 = pBits & 1;
+					const int p1 = pBits >> 1;
+					if (quality != BcQuality::High && (p0 != choosePBit(e0) || p1 != choosePBit(e1))) {
+						continue;
+					}
+					int q0[4], q1[4];
+					for (int channel = 0; channel < 4; channel++) {
+						q0[channel] = quantizeBc7(e0[channel], p0);
+						q1[channel] = quantizeBc7(e1[channel], p1);
+					}
+					Palette palette;
+					makeBc7Palette(q0, q1, palette);
+					uint8_t indices[BLOCK_TEXELS];
+					const float error = selectIndices(texels.channels, 4, palette, indices);
+					if (error < iterationError) {
+						iterationError = error;
+						std::memcpy(iteration0, q0, sizeof(q0));
+						std::memcpy(iteration1, q1, sizeof(q1));
+						std::memcpy(iterationIndices, indices, BLOCK_TEXELS);
+					}
+				}
+				if (iterationError >= bestError) {
+					break;
+				}
+				bestError = iterationError;
+				std::memcpy(best0, iteration0, sizeof(best0));
+				std::memcpy(best1, iteration1, sizeof(best1));
+				std::memcpy(bestIndices, iterationIndices, BLOCK_TEXELS);
+
+				float weights[BLOCK_TEXELS];
+				for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+					weights[texel] = (64 - BC7_WEIGHTS[iterationIndices[texel]]) / 64.0f;
+				}
+				if (refits == 0 || iterationError == 0.0f || !refitEndpoints(texels.channels, 4, weights, e0, e1)) {
+					break;
+				}
+			}
+
+			// The index of the first texel drops its top bit, which has to be 0.
+			if (bestIndices[0] >= 8) {
+				std::swap(best0, best1);
+				for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+					bestIndices[texel] = static_cast<uint8_t>(15 - bestIndices[texel]);
+				}
+			}
+
+			BitWriter writer(block);
+			writer.write(1 << 6, 7);
+			for (int channel = 0; channel < 4; channel++) {
+				writer.write(best0[channel] >> 1, 7);
+				writer.write(best1[channel] >> 1, 7);
+			}
+			writer.write(best0[0] & 1, 1);
+			writer.write(best1[0] & 1, 1);
+			writer.write(bestIndices[0], 3);
+			for (int texel = 1; texel < BLOCK_TEXELS; texel++) {
+				writer.write(bestIndices[texel], 4);
+			}
+		}
+
+		void decodeColorBlock(const uint8_t* block, bool allowThreeColorMode, uint8_t* texels) {
+			BitReader reader(block);
+			const uint16_t c0 = static_cast<uint16_t>(reader.read(16));
+			const uint16_t c1 = static_cast<uint16_t>(reader.read(16));
+			Palette palette;
+			makeColorPalette(c0, c1, allowThreeColorMode && c0 <= c1, palette);
+			for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+				const float* color = palette.entries[reader.read(2)];
+				for (int channel = 0; channel < 3; channel++) {
+					texels[texel * 4 + channel] = static_cast<uint8_t>(color[channel] + 0.5f);
+				}
+			}
+		}
+
+		void decodeChannelBlock(const uint8_t* block, uint8_t* texels, int channel) {
+			BitReader reader(block);
+			const uint8_t a0 = static_cast<uint8_t>(reader.read(8));
+			const uint8_t a1 = static_cast<uint8_t>(reader.read(8));
+			Palette palette;
+			makeAlphaPalette(a0, a1, palette);
+			for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+				texels[texel * 4 + channel] = static_cast<uint8_t>(palette.entries[reader.read(3)][0] + 0.5f);
+			}
+		}
+
+		bool decodeBc7Block(const uint8_t* block, uint8_t* texels) {
+			if ((block[0] & 0x7F) != 0x40) {
+				return false;
+			}
+			BitReader reader(block);
+			reader.read(7);
+			int e0[4], e1[4];
+			for (int channel = 0; channel < 4; channel++) {
+				e0[channel] = static_cast<int>(reader.read(7)) << 1;
+				e1[channel] = static_cast<int>(reader.read(7)) << 1;
+			}
+			const int p0 = static_cast<int>(reader.read(1));
+			const int p1 = static_cast<int>(reader.read(1));
+			for (int channel = 0; channel < 4; channel++) {
+				e0[channel] |= p0;
+				e1[channel] |= p1;
+			}
+			Palette palette;
+			makeBc7Palette(e0, e1, palette);
+			for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+				const float* color = palette.entries[reader.read(texel == 0 ? 3 : 4)];
+				for (int channel = 0; channel < 4; channel++) {
+					texels[texel * 4 + channel] = static_cast<uint8_t>(color[channel]);
+				}
+			}
+			return true;
+		}
+
+		// RGBA8 of any stb_image channel count, grey and grey alpha included.
+		std::vector<uint8_t> expandToRgba(const ImageData& image) {
+			const size_t texelCount = static_cast<size_t>(image.getWidth()) * image.getHeight();
+			const int channels = image.getChannels();
+			const stbi_uc* pixels = image.getPixels();
+			std::vector<uint8_t> rgba(texelCount * 4);
+			for (size_t texel = 0; texel < texelCount; texel++) {
+				const stbi_uc* source = pixels + texel * channels;
+				uint8_t* destination = &rgba[texel * 4];
+				if (channels < 3) {
+					destination[0] = destination[1] = destination[2] = source[0];
+				}
+				else {
+					destination[0] = source[0];
+					destination[1] = source[1];
+					destination[2] = source[2];
+				}
+				destination[3] = channels == 2 ? source[1] : channels == 4 ? source[3] : 255;
+			}
+			return rgba;
+		}
+
+		// Box filter down to half the size, the last row or column of odd sizes is reused.
+		std::vector<uint8_t> downsample(const std::vector<uint8_t>& rgba, int width, int height) {
+			const int halfWidth = std::max(width / 2, 1);
+			const int halfHeight = std::max(height / 2, 1);
+			std::vector<uint8_t> half(static_cast<size_t>(halfWidth) * halfHeight * 4);
+			for (int y = 0; y < halfHeight; y++) {
+				const size_t row0 = static_cast<size_t>(std::min(y * 2, height - 1)) * width;
+				const size_t row1 = static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width;
+				for (int x = 0; x < halfWidth; x++) {
+					const size_t column0 = std::min(x * 2, width - 1);
+					const size_t column1 = std::min(x * 2 + 1, width - 1);
+					for (int channel = 0; channel < 4; channel++) {
+						const int sum = rgba[(row0 + column0) * 4 + channel] + rgba[(row0 + column1) * 4 + channel]
+							+ rgba[(row1 + column0) * 4 + channel] + rgba[(row1 + column1) * 4 + channel];
+						half[(static_cast<size_t>(y) * halfWidth + x) * 4 + channel] = static_cast<uint8_t>((sum + 2) / 4);
+					}
+				}
+			}
+			return half;
+		}
+	}
+
+	GLenum BcEncoder::getGLFormat(BcFormat format)
+	{
+		switch (format) {
+		case BcFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BcFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case BcFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+		default: return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+		}
+	}
+
+	std::vector<uint8_t> BcEncoder::encode(const uint8_t* rgba, int width, int height, BcFormat format, BcQuality quality)
+	{
+		return encode(rgba, width, height, format, quality, JobSystem::getInstance());
+	}
+
+	std::vector<uint8_t> BcEncoder::encode(const uint8_t* rgba, int width, int height, BcFormat format, BcQuality quality, JobSystem& jobs)
+	{
+		const int blocksX = (width + 3) / 4;
+		const int blocksY = (height + 3) / 4;
+		const size_t blockBytes = getBlockBytes(format);
+		std::vector<uint8_t> blocks(getLevelBytes(format, width, height));
+		jobs.parallelFor("Texture compression", blocksY, 1, [&](size_t begin, size_t end) {
+			uint8_t texels[BLOCK_TEXELS * 4];
+			for (size_t blockY = begin; blockY < end; blockY++) {
+				for (int blockX = 0; blockX < blocksX; blockX++) {
+					// Blocks over the edge repeat the last row and column.
+					for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+						const int x = std::min(blockX * 4 + texel % 4, width - 1);
+						const int y = std::min(static_cast<int>(blockY) * 4 + texel / 4, height - 1);
+						std::memcpy(texels + texel * 4, rgba + (static_cast<size_t>(y) * width + x) * 4, 4);
+					}
+					encodeBlock(texels, format, quality, &blocks[(blockY * blocksX + blockX) * blockBytes]);
+				}
+			}
+		});
+		return blocks;
+	}
+
+	CompressedImage BcEncoder::compress(const ImageData& image, BcFormat format, BcQuality quality)
+	{
+		CompressedImage compressed;
+		compressed.format = format;
+		if (!image.isValid()) {
+			compressed.error = image.getError();
+			return compressed;
+		}
+
+		int width = image.getWidth();
+		int height = image.getHeight();
+		compressed.width = width;
+		compressed.height = height;
+		std::vector<uint8_t> level = expandToRgba(image);
+		while (true) {
+			compressed.levels.push_back(encode(level.data(), width, height, format, quality));
+			if (width == 1 && height == 1) {
+				break;
+			}
+			level = downsample(level, width, height);
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		return compressed;
+	}
+
+	bool BcEncoder::decode(const uint8_t* blocks, int width, int height, BcFormat format, std::vector<uint8_t>& rgba)
+	{
+		const int blocksX = (width + 3) / 4;
+		const int blocksY = (height + 3) / 4;
+		const size_t blockBytes = getBlockBytes(format);
+		rgba.assign(static_cast<size_t>(width) * height * 4, 0);
+		bool supported = true;
+		uint8_t texels[BLOCK_TEXELS * 4];
+		for (int blockY = 0; blockY < blocksY; blockY++) {
+			for (int blockX = 0; blockX < blocksX; blockX++) {
+				decodeBlock(blocks + (static_cast<size_t>(blockY) * blocksX + blockX) * blockBytes, format, texels, supported);
+				for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+					const int x = blockX * 4 + texel % 4;
+					const int y = blockY * 4 + texel / 4;
+					if (x < width && y < height) {
+						std::memcpy(&rgba[(static_cast<size_t>(y) * width + x) * 4], texels + texel * 4, 4);
+					}
+				}
+			}
+		}
+		return supported;
+	}
+
+	ImageData BcEncoder::decompress(const CompressedImage& image)
+	{
+		if (!image.isValid()) {
+			return ImageData(image.error);
+		}
+		std::vector<uint8_t> rgba;
+		if (!decode(image.levels.front().data(), image.width, image.height, image.format, rgba)) {
+			return ImageData("Only mode 6 of BC7 can be decoded.");
+		}
+		// Freed by stb_image, which uses malloc.
+		stbi_uc* pixels = static_cast<stbi_uc*>(std::malloc(rgba.size()));
+		std::memcpy(pixels, rgba.data(), rgba.size());
+		return ImageData(pixels, image.width, image.height, 4);
+	}
+
+	void BcEncoder::encodeBlock(const uint8_t* texels, BcFormat format, BcQuality quality, uint8_t* block)
+	{
+		BlockTexels rows;
+		for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+			for (int channel = 0; channel < 4; channel++) {
+				rows.channels[channel][texel] = texels[texel * 4 + channel];
+			}
+		}
+
+		std::memset(block, 0, getBlockBytes(format));
+		switch (format) {
+		case BcFormat::BC1:
+			encodeColorBlock(rows, quality, block);
+			break;
+		case BcFormat::BC3:
+			encodeChannelBlock(rows.channels[3], quality, block);
+			encodeColorBlock(rows, quality, block + 8);
+			break;
+		case BcFormat::BC5:
+			encodeChannelBlock(rows.channels[0], quality, block);
+			encodeChannelBlock(rows.channels[1], quality, block + 8);
+			break;
+		case BcFormat::BC7:
+			encodeBc7Block(rows, quality, block);
+			break;
+		}
+	}
+
+	void BcEncoder::decodeBlock(const uint8_t* block, BcFormat format, uint8_t* texels, bool& supported)
+	{
+		std::memset(texels, 255, BLOCK_TEXELS * 4);
+		switch (format) {
+		case BcFormat::BC1:
+			decodeColorBlock(block, true, texels);
+			break;
+		case BcFormat::BC3:
+			decodeChannelBlock(block, texels, 3);
+			decodeColorBlock(block + 8, false, texels);
+			break;
+		case BcFormat::BC5:
+			decodeChannelBlock(block, texels, 0);
+			decodeChannelBlock(block + 8, texels, 1);
+			// z of the unit normal
+			for (int texel = 0; texel < BLOCK_TEXELS; texel++) {
+				const float x = texels[texel * 4] / 127.5f - 1.0f;
+				const float y = texels[texel * 4 + 1] / 127.5f - 1.0f;
+				const float z = std::sqrt(std::max(1.0f - x * x - y * y, 0.0f));
+				texels[texel * 4 + 2] = static_cast<uint8_t>((z + 1.0f) * 127.5f + 0.5f);
+			}
+			break;
+		case BcFormat::BC7:
+			if (!decodeBc7Block(block, texels)) {
+				supported = false;
+			}
+			break;
+		}
+	}
+}
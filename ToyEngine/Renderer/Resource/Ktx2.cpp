@@ -0,0 +1,254 @@
+#include <Resource/Ktx2.h>
+#include <Utils/VirtualFileSystem.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace ToyEngine {
+	namespace {
+		const uint8_t IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+		// identifier, header and index
+		constexpr size_t LEVEL_INDEX_OFFSET = 80;
+		constexpr size_t LEVEL_INDEX_ENTRY_BYTES = 24;
+
+		// VkFormat values
+		constexpr uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+		constexpr uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+		constexpr uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+		constexpr uint32_t VK_FORMAT_BC7_UNORM_BLOCK = 145;
+
+		// Khronos data format descriptor values
+		constexpr uint32_t KHR_DF_MODEL_BC1A = 128;
+		constexpr uint32_t KHR_DF_MODEL_BC3 = 130;
+		constexpr uint32_t KHR_DF_MODEL_BC5 = 132;
+		constexpr uint32_t KHR_DF_MODEL_BC7 = 134;
+		constexpr uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+		constexpr uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+		constexpr uint32_t KHR_DF_CHANNEL_ALPHA = 15;
+
+		uint32_t getVkFormat(BcFormat format) {
+			switch (format) {
+			case BcFormat::BC1: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+			case BcFormat::BC3: return VK_FORMAT_BC3_UNORM_BLOCK;
+			case BcFormat::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+			default: return VK_FORMAT_BC7_UNORM_BLOCK;
+			}
+		}
+
+		bool getBcFormat(uint32_t vkFormat, BcFormat& format) {
+			switch (vkFormat) {
+			case VK_FORMAT_BC1_RGB_UNORM_BLOCK: format = BcFormat::BC1; return true;
+			case VK_FORMAT_BC3_UNORM_BLOCK: format = BcFormat::BC3; return true;
+			case VK_FORMAT_BC5_UNORM_BLOCK: format = BcFormat::BC5; return true;
+			case VK_FORMAT_BC7_UNORM_BLOCK: format = BcFormat::BC7; return true;
+			default: return false;
+			}
+		}
+
+		template<typename T>
+		void append(std::vector<uint8_t>& bytes, T value) {
+			const size_t offset = bytes.size();
+			bytes.resize(offset + sizeof(T));
+			std::memcpy(&bytes[offset], &value, sizeof(T));
+		}
+
+		template<typename T>
+		void store(std::vector<uint8_t>& bytes, size_t offset, T value) {
+			std::memcpy(&bytes[offset], &value, sizeof(T));
+		}
+
+		template<typename T>
+		T load(const uint8_t* data, size_t offset) {
+			T value;
+			std::memcpy(&value, data + offset, sizeof(T));
+			return value;
+		}
+
+		// One sample per 64 bit half of the block, the alpha half of BC3 comes first.
+		void appendSample(std::vector<uint8_t>& bytes, uint32_t bitOffset, uint32_t bitLength, uint32_t channel) {
+			append<uint32_t>(bytes, bitOffset | ((bitLength - 1) << 16) | (channel << 24));
+			append<uint32_t>(bytes, 0);
+			append<uint32_t>(bytes, 0);
+			append<uint32_t>(bytes, UINT32_MAX);
+		}
+
+		// A basic data format descriptor block, prefixed with the total size.
+		std::vector<uint8_t> makeDataFormatDescriptor(BcFormat format) {
+			std::vector<uint8_t> samples;
+			uint32_t model = KHR_DF_MODEL_BC1A;
+			switch (format) {
+			case BcFormat::BC1:
+				appendSample(samples, 0, 64, 0);
+				break;
+			case BcFormat::BC3:
+				model = KHR_DF_MODEL_BC3;
+				appendSample(samples, 0, 64, KHR_DF_CHANNEL_ALPHA);
+				appendSample(samples, 64, 64, 0);
+				break;
+			case BcFormat::BC5:
+				model = KHR_DF_MODEL_BC5;
+				appendSample(samples, 0, 64, 0);
+				appendSample(samples, 64, 64, 1);
+				break;
+			case BcFormat::BC7:
+				model = KHR_DF_MODEL_BC7;
+				appendSample(samples, 0, 128, 0);
+				break;
+			}
+
+			const uint32_t blockSize = 24 + static_cast<uint32_t>(samples.size());
+			std::vector<uint8_t> descriptor;
+			append<uint32_t>(descriptor, 4 + blockSize);
+			// Khronos vendor, basic descriptor type
+			append<uint32_t>(descriptor, 0);
+			append<uint32_t>(descriptor, 2 | (blockSize << 16));
+			append<uint32_t>(descriptor, model | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+			// 4x4x1x1 texels per block, stored as size - 1
+			append<uint32_t>(descriptor, 3 | (3 << 8));
+			append<uint32_t>(descriptor, static_cast<uint32_t>(BcEncoder::getBlockBytes(format)));
+			append<uint32_t>(descriptor, 0);
+			descriptor.insert(descriptor.end(), samples.begin(), samples.end());
+			return descriptor;
+		}
+
+		size_t alignUp(size_t value, size_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	bool Ktx2::write(const std::string& path, const CompressedImage& image)
+	{
+		if (!image.isValid()) {
+			return false;
+		}
+		const uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+		const std::vector<uint8_t> descriptor = makeDataFormatDescriptor(image.format);
+
+		std::vector<uint8_t> bytes(std::begin(IDENTIFIER), std::end(IDENTIFIER));
+		append<uint32_t>(bytes, getVkFormat(image.format));
+		// type size, 1 for block compressed formats
+		append<uint32_t>(bytes, 1);
+		append<uint32_t>(bytes, image.width);
+		append<uint32_t>(bytes, image.height);
+		// depth, layer count, face count, level count and no supercompression
+		append<uint32_t>(bytes, 0);
+		append<uint32_t>(bytes, 0);
+		append<uint32_t>(bytes, 1);
+		append<uint32_t>(bytes, levelCount);
+		append<uint32_t>(bytes, 0);
+
+		const size_t descriptorOffset = LEVEL_INDEX_OFFSET + levelCount * LEVEL_INDEX_ENTRY_BYTES;
+		append<uint32_t>(bytes, static_cast<uint32_t>(descriptorOffset));
+		append<uint32_t>(bytes, static_cast<uint32_t>(descriptor.size()));
+		// no key/value data and no supercompression global data
+		append<uint32_t>(bytes, 0);
+		append<uint32_t>(bytes, 0);
+		append<uint64_t>(bytes, 0);
+		append<uint64_t>(bytes, 0);
+
+		bytes.resize(descriptorOffset);
+		bytes.insert(bytes.end(), descriptor.begin(), descriptor.end());
+
+		// The smallest level goes first, so that a partial read has the low resolution levels.
+		const size_t alignment = BcEncoder::getBlockBytes(image.format);
+		for (uint32_t level = levelCount; level-- > 0;) {
+			const std::vector<uint8_t>& data = image.levels[level];
+			bytes.resize(alignUp(bytes.size(), alignment));
+			const size_t entry = LEVEL_INDEX_OFFSET + level * LEVEL_INDEX_ENTRY_BYTES;
+			store<uint64_t>(bytes, entry, bytes.size());
+			store<uint64_t>(bytes, entry + 8, data.size());
+			store<uint64_t>(bytes, entry + 16, data.size());
+			bytes.insert(bytes.end(), data.begin(), data.end());
+		}
+
+		// Readers map the file, so it is replaced as a whole rather than truncated under them.
+		const std::string temporaryPath = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+		std::error_code error;
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+			if (!file) {
+				file.close();
+				std::filesystem::remove(temporaryPath, error);
+				return false;
+			}
+		}
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error) {
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+		return true;
+	}
+
+	CompressedImage Ktx2::read(const std::string& path)
+	{
+		FileData file = VirtualFileSystem::getInstance().read(path);
+		if (!file.isValid()) {
+			CompressedImage image;
+			image.error = "Cannot open " + path;
+			return image;
+		}
+		CompressedImage image = read(file.data, file.size);
+		if (!image.error.empty()) {
+			image.error = path + ": " + image.error;
+		}
+		return image;
+	}
+
+	CompressedImage Ktx2::read(const uint8_t* data, size_t size)
+	{
+		CompressedImage image;
+		if (size < LEVEL_INDEX_OFFSET || std::memcmp(data, IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+			image.error = "Not a KTX 2.0 file.";
+			return image;
+		}
+		const uint32_t vkFormat = load<uint32_t>(data, 12);
+		const uint32_t width = load<uint32_t>(data, 20);
+		const uint32_t height = load<uint32_t>(data, 24);
+		const uint32_t depth = load<uint32_t>(data, 28);
+		const uint32_t layerCount = load<uint32_t>(data, 32);
+		const uint32_t faceCount = load<uint32_t>(data, 36);
+		const uint32_t levelCount = load<uint32_t>(data, 40);
+		const uint32_t supercompression = load<uint32_t>(data, 44);
+		if (!getBcFormat(vkFormat, image.format)) {
+			image.error = "Unsupported format " + std::to_string(vkFormat) + ".";
+			return image;
+		}
+		if (width == 0 || height == 0 || depth != 0 || layerCount > 1 || faceCount != 1 || supercompression != 0) {
+			image.error = "Only plain 2D textures are supported.";
+			return image;
+		}
+		// The texture array pool only takes complete mip chains.
+		uint32_t fullLevelCount = 1;
+		while ((std::max(width, height) >> fullLevelCount) > 0) {
+			fullLevelCount++;
+		}
+		if (levelCount != fullLevelCount || size < LEVEL_INDEX_OFFSET + levelCount * LEVEL_INDEX_ENTRY_BYTES) {
+			image.error = "The mip chain is incomplete.";
+			return image;
+		}
+
+		image.width = static_cast<int>(width);
+		image.height = static_cast<int>(height);
+		for (uint32_t level = 0; level < levelCount; level++) {
+			const size_t entry = LEVEL_INDEX_OFFSET + level * LEVEL_INDEX_ENTRY_BYTES;
+			const uint64_t offset = load<uint64_t>(data, entry);
+			const uint64_t length = load<uint64_t>(data, entry + 8);
+			const size_t expected = BcEncoder::getLevelBytes(image.format, std::max(image.width >> level, 1), std::max(image.height >> level, 1));
+			if (length != expected || offset > size || size - offset < length) {
+				image.error = "Level " + std::to_string(level) + " is truncated.";
+				image.levels.clear();
+				return image;
+			}
+			image.levels.emplace_back(data + offset, data + offset + length);
+		}
+		return image;
+	}
+}
@@ -1,48 +1,47 @@
 #include <Renderer/SkyBox.h>
+#include <Renderer/GLStateCache.h>
+#include <Renderer/ShaderLibrary.h>
+#include <Utils/Logger.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <Renderer/Camera.h>
 
-ToyEngine::SkyBox::SkyBox(const std::vector<std::string>& facePaths, std::shared_ptr<Camera> camera): mCamera(camera)
+ToyEngine::SkyBox::SkyBox(const std::vector<std::string>& facePaths)
 {
-    mShader = Shader("Shaders/skybox.vert", "Shaders/skybox.frag");
+    mShader = ShaderLibrary::getInstance().get("Shaders/skybox.vert", "Shaders/skybox.frag");
     initCube();
 	loadCubemap(facePaths);
 }
 
 void ToyEngine::SkyBox::render()
 {
-    auto view = glm::mat4(glm::mat3(mCamera->GetViewMatrix()));
-    auto projection = glm::mat4(1);
-    // hard coded. remove it in the future
-    projection = glm::perspective(glm::radians(mCamera->mZoom), 1920.0f / 1080.0f, 0.1f, 100.0f);
-    mShader.use();
-    mShader.setUniform("view", view);
-    mShader.setUniform("projection", projection);
+    // view and projection come from the FrameConstants block
+    mShader->use();
 
     // skybox cube
-    glDepthFunc(GL_LEQUAL);
-    glBindVertexArray(mCubeVAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, mTextureId);
+    GLStateCache& state = GLStateCache::getInstance();
+    state.setDepthFunc(GL_LEQUAL);
+    state.bindVertexArray(mCubeVAO);
+    state.bindTexture(0, GL_TEXTURE_CUBE_MAP, mTextureId);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-    glDepthFunc(GL_LESS);
+    state.setDepthFunc(GL_LESS);
 }
 
 void ToyEngine::SkyBox::loadCubemap(const std::vector<std::string>& faces)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
 
-    int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char* data = StbImageLoader::getImageFrom(faces[i].c_str(), &width, &height, &nrChannels, false);
+        ImageData image = StbImageLoader::getImageFrom(faces[i], false);
+        if (!image.isValid()) {
+            Logger::DEBUG_WARNING(image.getError());
+            continue;
+        }
 
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-            0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
+            0, GL_RGB, image.getWidth(), image.getHeight(), 0, GL_RGB, GL_UNSIGNED_BYTE, image.getPixels()
         );
     }
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -59,15 +58,15 @@ void ToyEngine::SkyBox::initCube()
     glGenBuffers(1, &mCubeVBO);
     glGenVertexArrays(1, &mCubeVAO);
     
-    glBindVertexArray(mCubeVAO);
+    GLStateCache::getInstance().bindVertexArray(mCubeVAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, mCubeVBO);
+    GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, mCubeVBO);
     glBufferData(GL_ARRAY_BUFFER, 108 * sizeof(float), skyboxVertices, GL_STATIC_DRAW);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
     
-    glBindVertexArray(0);
+    GLStateCache::getInstance().bindVertexArray(0);
 
     glDisableVertexAttribArray(0);
 
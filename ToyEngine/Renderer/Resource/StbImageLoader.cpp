@@ -1,36 +1,40 @@
+#include "Resource/ImageLoader.h"
 #include "Resource/StbImageLoader.h"
 #include "Resource/stb_image.h"
-#include<iostream>
+#include "Utils/VirtualFileSystem.h"
 
-// Guarunteed to produce a non-null pointer to the image.
-// Otherwise it throws an exception.
-unsigned char* ToyEngine::StbImageLoader::getImageFrom(std::string path, int* width, int* height, int* channelNum, bool shouldFlip)
+ToyEngine::ImageData ToyEngine::StbImageLoader::getImageFrom(const std::string& path, bool shouldFlip)
 {
     const std::string DEFAULT_PATH_PREFIX = "";
 
     // We probably don't need to flip the image here because the texture coordinate will be flipped when setting up the assimp.
     // But for those images that is not a texture, we still need to flip it.
-    stbi_set_flip_vertically_on_load(shouldFlip);
-    unsigned char* data = stbi_load((DEFAULT_PATH_PREFIX + path).c_str(), width, height, channelNum, 0);
+    // The flag is thread local, decodes on other threads keep their own.
+    stbi_set_flip_vertically_on_load_thread(shouldFlip);
+    // Decoded straight from the archive or the mapped file.
+    FileData file = VirtualFileSystem::getInstance().read(DEFAULT_PATH_PREFIX + path);
+    if (!file.isValid()) {
+        return ImageData("Image data is not properly loaded from path " + path + ": file not found");
+    }
+    int width = 0, height = 0, channels = 0;
+    stbi_uc* data = stbi_load_from_memory(file.data, static_cast<int>(file.size), &width, &height, &channels, 0);
 
     if (!data) {
-        throw std::exception("Image data is not properly loaded from path.");
+        // The failure reason is thread local as well.
+        return ImageData("Image data is not properly loaded from path " + path + ": " + stbi_failure_reason());
     }
 
-    return data;
+    return ImageData(data, width, height, channels);
 }
 
-// Guarunteed to produce a non-null pointer to the image.
-// Otherwise it throws an exception.
-unsigned char* ToyEngine::StbImageLoader::getImageFrom(stbi_uc const* buffer, int len, bool shouldFlip, int& width, int& height, int& channels)
+ToyEngine::ImageData ToyEngine::StbImageLoader::getImageFrom(stbi_uc const* buffer, int len, bool shouldFlip)
 {
-    stbi_set_flip_vertically_on_load(shouldFlip);
-    unsigned char* data = stbi_load_from_memory(buffer, len, &width, &height, &channels, 0);
+    stbi_set_flip_vertically_on_load_thread(shouldFlip);
+    int width = 0, height = 0, channels = 0;
+    stbi_uc* data = stbi_load_from_memory(buffer, len, &width, &height, &channels, 0);
     if (!data) {
-        throw std::exception("Image data is not properly loaded from buffer.");
+        return ImageData(std::string("Image data is not properly loaded from buffer: ") + stbi_failure_reason());
     }
 
-    return data;
+    return ImageData(data, width, height, channels);
 }
-
-
@@ -1,12 +1,38 @@
 #include <iostream>
+#include <algorithm>
 #include "Resource/Texture.h"
+#include <Renderer/GLStateCache.h>
+#include <Renderer/GpuTransferQueue.h>
 #include "glad/glad.h"
 #include <Resource/StbImageLoader.h>
+#include <Resource/TextureCooker.h>
+#include <Utils/JobSystem.h>
 #include <Utils/Logger.h>
 #include <Utils/RenderHelper.h>
 
 namespace ToyEngine {
-	Texture::Texture(const Texture& other): mPath(other.mPath), mWidth(other.mWidth),mHeight(other.mHeight),mInternalFormat(other.mInternalFormat), mSourceFormat(other.mSourceFormat), mMipmapLevel(other.mMipmapLevel), mTextureIndex(other.mTextureIndex), mTextureType(other.mTextureType)
+	namespace {
+		// The cooked texture if the driver samples its format, the decoded image file otherwise.
+		void loadImage(const std::string& path, TextureType type, bool flip, CompressedImage& compressed, ImageData& image) {
+			TextureCooker& cooker = TextureCooker::getInstance();
+			// Cooked textures are stored the way they are sampled.
+			if (!flip) {
+				compressed = cooker.load(path, type);
+			}
+			if (compressed.isValid() && cooker.isSupported(compressed.format)) {
+				return;
+			}
+			if (TextureCooker::isCooked(path)) {
+				image = BcEncoder::decompress(compressed);
+			}
+			else {
+				image = StbImageLoader::getImageFrom(path, flip);
+			}
+			compressed = CompressedImage();
+		}
+	}
+
+	Texture::Texture(const Texture& other): mWidth(other.mWidth), mHeight(other.mHeight), mInternalFormat(other.mInternalFormat), mMipmapLevel(other.mMipmapLevel), mSourceFormat(other.mSourceFormat), mTextureIndex(other.mTextureIndex), mArrayLayer(other.mArrayLayer), mKeepTexture2D(other.mKeepTexture2D), mTextureType(other.mTextureType), mPath(other.mPath)
 	{
 	}
 	Texture& Texture::operator=(Texture other)
@@ -18,96 +44,185 @@ namespace ToyEngine {
 		std::swap(mSourceFormat, other.mSourceFormat);
 		std::swap(mMipmapLevel, other.mMipmapLevel);
 		std::swap(mTextureIndex, other.mTextureIndex);
+		std::swap(mArrayLayer, other.mArrayLayer);
+		std::swap(mKeepTexture2D, other.mKeepTexture2D);
 		std::swap(mTextureType, other.mTextureType);
 		return *this;
 	}
 
 	void Texture::loadFromPath(bool flip){
-		try {
-			if (mPath == "") {
-				throw("Invalid texture path: " + mPath);
-			}
-			int channels = 0;
-			auto textureData = StbImageLoader::getImageFrom(mPath, &mWidth, &mHeight, &channels, flip);
-
-			mSourceFormat = RenderHelper::convertChannelsToFormat(channels);
-			mInternalFormat = RenderHelper::convertChannelsToFormat(channels);
-
-			glGenTextures(1, &mTextureIndex);
-			glBindTexture(GL_TEXTURE_2D, mTextureIndex);
-			// Add more texture here.
-
-
-			//Configuration
-			//=================================================================================
-			// what if the texture coordinate is over 1.0?
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-			// For GL_CLAMP_TO_BORDER
-			//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-			//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-			//float borderColor[] = { 1.0f, 1.0f, 0.0f, 1.0f };
-			//glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-			//=================================================================================
-			// filter
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			//=================================================================================
-
-			glTexImage2D(GL_TEXTURE_2D, 0, mInternalFormat, mWidth, mHeight, 0, mSourceFormat, GL_UNSIGNED_BYTE, textureData);
-			glGenerateMipmap(GL_TEXTURE_2D);
+		if (mPath == "") {
+			Logger::DEBUG_WARNING("Invalid texture path: " + mPath);
+			return;
+		}
+		CompressedImage compressed;
+		ImageData image;
+		loadImage(mPath, mTextureType, flip, compressed, image);
+		if (compressed.isValid()) {
+			upload(compressed);
+		}
+		else {
+			upload(image);
 		}
-		catch (const std::string& err) {
-			std::cerr << err << std::endl;
-		}	
 	}
 
 	void Texture::loadFromBuf(stbi_uc const* buffer, int len, bool shouldFlip)
 	{
-		try {
-			int channels = 0;
+		upload(StbImageLoader::getImageFrom(buffer, len, shouldFlip));
+	}
+
+	void Texture::upload(const ImageData& image)
+	{
+		if (!image.isValid()) {
+			Logger::DEBUG_WARNING(image.getError());
+			return;
+		}
+		mWidth = image.getWidth();
+		mHeight = image.getHeight();
+		mSourceFormat = RenderHelper::convertChannelsToFormat(image.getChannels());
+		mInternalFormat = RenderHelper::convertChannelsToFormat(image.getChannels());
+
+		glGenTextures(1, &mTextureIndex);
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mTextureIndex);
+		// Add more texture here.
+
+
+		//Configuration
+		//=================================================================================
+		// what if the texture coordinate is over 1.0?
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+		// For GL_CLAMP_TO_BORDER
+		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		//float borderColor[] = { 1.0f, 1.0f, 0.0f, 1.0f };
+		//glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+		//=================================================================================
+		// filter
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		//=================================================================================
+
+		glTexImage2D(GL_TEXTURE_2D, 0, mInternalFormat, mWidth, mHeight, 0, mSourceFormat, GL_UNSIGNED_BYTE, image.getPixels());
+		glGenerateMipmap(GL_TEXTURE_2D);
+		addToArrayPool(TextureArrayPool::DEFAULT_FORMAT);
+	}
 
-			auto textureData = StbImageLoader::getImageFrom(buffer, len, shouldFlip, mWidth, mHeight, channels);
-			
-			mSourceFormat = RenderHelper::convertChannelsToFormat(channels);
-			mInternalFormat = RenderHelper::convertChannelsToFormat(channels);
+	void Texture::upload(const CompressedImage& image)
+	{
+		mWidth = image.width;
+		mHeight = image.height;
+		mSourceFormat = BcEncoder::getGLFormat(image.format);
+		mInternalFormat = mSourceFormat;
+
+		glGenTextures(1, &mTextureIndex);
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D, mTextureIndex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// The mips come with the texture.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size()) - 1);
+		for (size_t level = 0; level < image.levels.size(); level++) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), mInternalFormat, std::max(mWidth >> level, 1),
+				std::max(mHeight >> level, 1), 0, static_cast<GLsizei>(image.levels[level].size()), image.levels[level].data());
+		}
+		addToArrayPool(mInternalFormat);
+	}
 
-			glGenTextures(1, &mTextureIndex);
-			glBindTexture(GL_TEXTURE_2D, mTextureIndex);
-			// Add more texture here.
+	void Texture::adopt(GLuint texture, int width, int height, GLenum format)
+	{
+		mTextureIndex = texture;
+		mWidth = width;
+		mHeight = height;
+		mSourceFormat = format;
+		mInternalFormat = format;
+		addToArrayPool(TextureArrayPool::isCompressed(format) ? format : TextureArrayPool::DEFAULT_FORMAT);
+	}
 
+	void Texture::addToArrayPool(GLenum format)
+	{
+		mArrayLayer = TextureArrayPool::getInstance().add(mTextureIndex, mWidth, mHeight, format);
+		// The meshes sample the copy. The copy commands are already queued, GL frees the texture after them.
+		if (mArrayLayer.isValid() && !mKeepTexture2D) {
+			GLStateCache::getInstance().deleteTexture(mTextureIndex);
+			mTextureIndex = 0;
+		}
+	}
 
-			//Configuration
-			//=================================================================================
-			// what if the texture coordinate is over 1.0?
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	struct TextureRequest::Decode {
+		JobCounter counter;
+		ImageData image;
+		// instead of the image when there is a cooked texture
+		CompressedImage compressed;
+		// null when the queue is not running or the decode failed
+		std::shared_ptr<GpuTransfer> transfer;
+
+		// Hand the pixels on to the transfer queue right away, so that the upload does not wait for the GL thread.
+		void submit() {
+			GpuTransferQueue& queue = GpuTransferQueue::getInstance();
+			if (!queue.isRunning()) {
+				return;
+			}
+			if (compressed.isValid()) {
+				transfer = queue.uploadCompressedTexture(std::move(compressed));
+			}
+			else if (image.isValid()) {
+				transfer = queue.uploadTexture(std::move(image));
+			}
+		}
+	};
 
-			// For GL_CLAMP_TO_BORDER
-			//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-			//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-			//float borderColor[] = { 1.0f, 1.0f, 0.0f, 1.0f };
-			//glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+	TextureRequest::TextureRequest(std::string path, TextureType type, bool flip)
+		: mDecode(std::make_shared<Decode>()), mPath(path), mTextureType(type)
+	{
+		// The job holds on to the decode, so that dropping the request before it finished is fine.
+		JobSystem::getInstance().spawn("Image decode", [decode = mDecode, path, type, flip] {
+			loadImage(path, type, flip, decode->compressed, decode->image);
+			decode->submit();
+		}, &mDecode->counter);
+	}
 
-			//=================================================================================
-			// filter
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			//=================================================================================
+	TextureRequest::TextureRequest(std::string path, TextureType type, std::vector<unsigned char> encoded, bool flip)
+		: mDecode(std::make_shared<Decode>()), mPath(path), mTextureType(type)
+	{
+		JobSystem::getInstance().spawn("Image decode", [decode = mDecode, encoded = std::move(encoded), flip] {
+			decode->image = StbImageLoader::getImageFrom(encoded.data(), static_cast<int>(encoded.size()), flip);
+			decode->submit();
+		}, &mDecode->counter);
+	}
 
-			glTexImage2D(GL_TEXTURE_2D, 0, mInternalFormat, mWidth, mHeight, 0, mSourceFormat, GL_UNSIGNED_BYTE, textureData);
-			glGenerateMipmap(GL_TEXTURE_2D);
+	bool TextureRequest::isReady() const
+	{
+		return mDecode && mDecode->counter.isDone() && (!mDecode->transfer || mDecode->transfer->done);
+	}
 
-			stbi_image_free(textureData);
+	Texture TextureRequest::upload()
+	{
+		if (!mDecode) {
+			return Texture();
+		}
+		JobSystem::getInstance().wait(mDecode->counter);
+		Texture texture;
+		if (GpuTransfer* transfer = mDecode->transfer.get()) {
+			GpuTransferQueue::getInstance().wait(*transfer);
+			if (transfer->handle != 0) {
+				texture = Texture(mPath, mTextureType, transfer->take(), transfer->width, transfer->height, transfer->format);
+			}
+			else {
+				Logger::DEBUG_WARNING("Uploading texture " + mPath + " failed.");
+			}
 		}
-		catch (const std::string& err) {
-			std::cerr << err << std::endl;
+		else if (mDecode->compressed.isValid()) {
+			texture = Texture(mPath, mTextureType, mDecode->compressed);
 		}
-		catch (const std::exception& e) {
-			Logger::DEBUG_WARNING(e.what());
+		else {
+			texture = Texture(mPath, mTextureType, mDecode->image);
 		}
+		mDecode.reset();
+		return texture;
 	}
 
 	// TODO: Move it to render helper.
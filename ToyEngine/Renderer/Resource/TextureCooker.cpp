@@ -0,0 +1,211 @@
+#include <Resource/TextureCooker.h>
+#include <Resource/Ktx2.h>
+#include <Resource/StbImageLoader.h>
+#include <Utils/Logger.h>
+#include <Utils/VirtualFileSystem.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+namespace ToyEngine {
+	namespace {
+		// Appended rather than replacing the extension, so that a.png and a.jpg do not share a cooked file.
+		const std::string COOKED_EXTENSION = ".ktx2";
+		const char* IMAGE_EXTENSIONS[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+
+		// In the core profile the extensions are only listed one at a time.
+		bool hasExtension(const char* name) {
+			GLint count = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+			for (GLint i = 0; i < count; i++) {
+				const GLubyte* extension = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+				if (extension && std::strcmp(reinterpret_cast<const char*>(extension), name) == 0) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		std::string toLower(std::string text) {
+			std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			return text;
+		}
+
+		bool endsWith(const std::string& text, const std::string& suffix) {
+			return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+		}
+
+		bool hasAlpha(const ImageData& image) {
+			const int channels = image.getChannels();
+			if (channels != 2 && channels != 4) {
+				return false;
+			}
+			const size_t texelCount = static_cast<size_t>(image.getWidth()) * image.getHeight();
+			for (size_t texel = 0; texel < texelCount; texel++) {
+				if (image.getPixels()[texel * channels + channels - 1] != 255) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Cooking a directory has no material to tell, normal maps usually say so in their name.
+		TextureType guessTextureType(const std::filesystem::path& path) {
+			const std::string stem = toLower(path.stem().string());
+			if (stem.find("normal") != std::string::npos || endsWith(stem, "_n") || endsWith(stem, "_nrm")) {
+				return TextureType::Normal;
+			}
+			return TextureType::Diffuse;
+		}
+
+		// Packed files keep the time they had on disk, so either may come from an archive.
+		bool isUpToDate(const std::string& cookedPath, const std::string& sourcePath) {
+			const VirtualFileSystem& fileSystem = VirtualFileSystem::getInstance();
+			const FileStatus cooked = fileSystem.getStatus(cookedPath);
+			if (!cooked.exists) {
+				return false;
+			}
+			// Archives are packed from cooked files, their sources may not even be in there.
+			const FileStatus source = fileSystem.getStatus(sourcePath);
+			return !source.exists || cooked.modifiedTime >= source.modifiedTime;
+		}
+	}
+
+	TextureCooker& TextureCooker::getInstance()
+	{
+		static TextureCooker instance;
+		return instance;
+	}
+
+	void TextureCooker::init()
+	{
+		const bool s3tc = hasExtension("GL_EXT_texture_compression_s3tc");
+		mSupported[static_cast<int>(BcFormat::BC1)] = s3tc;
+		mSupported[static_cast<int>(BcFormat::BC3)] = s3tc;
+		// RGTC is core since GL 3.0.
+		mSupported[static_cast<int>(BcFormat::BC5)] = true;
+		mSupported[static_cast<int>(BcFormat::BC7)] = hasExtension("GL_ARB_texture_compression_bptc")
+			|| GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2);
+		if (!s3tc) {
+			Logger::DEBUG_WARNING("No S3TC support, BC1 and BC3 textures are loaded uncompressed.");
+		}
+	}
+
+	BcFormat TextureCooker::selectFormat(TextureType type, bool hasAlpha, BcQuality quality) const
+	{
+		if (type == TextureType::Normal) {
+			return BcFormat::BC5;
+		}
+		const BcFormat format = hasAlpha ? BcFormat::BC3 : BcFormat::BC1;
+		if (isSupported(BcFormat::BC7) && (quality == BcQuality::High || !isSupported(format))) {
+			return BcFormat::BC7;
+		}
+		return format;
+	}
+
+	bool TextureCooker::isCooked(const std::string& path)
+	{
+		return endsWith(toLower(path), COOKED_EXTENSION);
+	}
+
+	std::string TextureCooker::getCookedPath(const std::string& path)
+	{
+		return path + COOKED_EXTENSION;
+	}
+
+	bool TextureCooker::cook(const std::string& path, TextureType type)
+	{
+		return compress(path, type).isValid();
+	}
+
+	size_t TextureCooker::cookDirectory(const std::string& directory)
+	{
+		size_t count = 0;
+		std::error_code error;
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+			const std::string extension = toLower(entry.path().extension().string());
+			const bool isImage = std::any_of(std::begin(IMAGE_EXTENSIONS), std::end(IMAGE_EXTENSIONS), [&extension](const char* imageExtension) {
+				return extension == imageExtension;
+			});
+			const std::string path = entry.path().string();
+			if (!entry.is_regular_file() || !isImage || isUpToDate(getCookedPath(path), path)) {
+				continue;
+			}
+			if (cook(path, guessTextureType(entry.path()))) {
+				count++;
+			}
+		}
+		if (error) {
+			Logger::DEBUG_WARNING("Cannot cook the textures in " + directory + ": " + error.message());
+		}
+		Logger::DEBUG_INFO("Cooked " + std::to_string(count) + " textures in " + directory + ".");
+		return count;
+	}
+
+	CompressedImage TextureCooker::load(const std::string& path, TextureType type)
+	{
+		if (isCooked(path)) {
+			CompressedImage image = Ktx2::read(path);
+			if (!image.isValid()) {
+				Logger::DEBUG_WARNING(image.error);
+			}
+			return image;
+		}
+
+		const std::string cookedPath = getCookedPath(path);
+		if (isUpToDate(cookedPath, path)) {
+			CompressedImage image = Ktx2::read(cookedPath);
+			if (image.isValid()) {
+				return image;
+			}
+			Logger::DEBUG_WARNING(image.error);
+		}
+		if (mCookingOnDemand) {
+			return compress(path, type);
+		}
+		return CompressedImage();
+	}
+
+	CompressedImage TextureCooker::compress(const std::string& path, TextureType type)
+	{
+		std::shared_ptr<PendingCook> pending;
+		{
+			std::unique_lock<std::mutex> lock(mPendingMutex);
+			auto found = mPendingCooks.find(path);
+			if (found != mPendingCooks.end()) {
+				pending = found->second;
+				mCookFinished.wait(lock, [&pending] { return pending->done; });
+				return pending->image;
+			}
+			pending = std::make_shared<PendingCook>();
+			mPendingCooks.emplace(path, pending);
+		}
+
+		CompressedImage compressed = cookImage(path, type);
+		{
+			std::lock_guard<std::mutex> lock(mPendingMutex);
+			pending->image = compressed;
+			pending->done = true;
+			mPendingCooks.erase(path);
+		}
+		mCookFinished.notify_all();
+		return compressed;
+	}
+
+	CompressedImage TextureCooker::cookImage(const std::string& path, TextureType type)
+	{
+		ImageData image = StbImageLoader::getImageFrom(path, false);
+		if (!image.isValid()) {
+			Logger::DEBUG_WARNING(image.getError());
+			return CompressedImage();
+		}
+		const BcQuality quality = mQuality;
+		CompressedImage compressed = BcEncoder::compress(image, selectFormat(type, hasAlpha(image), quality), quality);
+		if (!Ktx2::write(getCookedPath(path), compressed)) {
+			Logger::DEBUG_WARNING("Cannot write the cooked texture " + getCookedPath(path));
+		}
+		return compressed;
+	}
+}
@@ -1,39 +1,36 @@
 #include "Renderer/Shader.h"
+#include <Renderer/UniformBuffer.h>
+#include <Utils/VirtualFileSystem.h>
 
 namespace ToyEngine {
     Shader::Shader(const char* vertexPath, const char* fragmentPath)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
+        ID = compileProgram(readSource(vertexPath), readSource(fragmentPath), false);
+        reflect();
+    }
+
+    Shader::Shader(GLuint linkedProgram) : ID(linkedProgram)
+    {
+        reflect();
+    }
+
+    std::string Shader::readSource(const char* path)
+    {
+        // From the archive when there is one.
+        FileData file = VirtualFileSystem::getInstance().read(path);
+        if (!file.isValid())
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return std::string();
         }
+        return file.toString();
+    }
+
+    GLuint Shader::compileProgram(const std::string& vertexCode, const std::string& fragmentCode, bool retrievable)
+    {
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 1. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -46,14 +43,111 @@ namespace ToyEngine {
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        // the hint has to be set before linking for glGetProgramBinary to be allowed afterwards
+        if (retrievable && GLAD_GL_ARB_get_program_binary) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(program);
+        checkCompileErrors(program, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessary
+        glDetachShader(program, vertex);
+        glDetachShader(program, fragment);
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        return program;
+    }
+
+    GLuint Shader::compileComputeProgram(const std::string& computeCode, bool retrievable)
+    {
+        const char* cShaderCode = computeCode.c_str();
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+
+        GLuint program = glCreateProgram();
+        glAttachShader(program, compute);
+        if (retrievable && GLAD_GL_ARB_get_program_binary) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(program);
+        checkCompileErrors(program, "PROGRAM");
+        glDetachShader(program, compute);
+        glDeleteShader(compute);
+        return program;
+    }
+
+    void Shader::reflect()
+    {
+        mUniforms.clear();
+        mUniformBlocks.clear();
+
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+        std::string name(maxNameLength, '\0');
+        for (GLint i = 0; i < uniformCount; i++) {
+            GLsizei length = 0;
+            UniformInfo info;
+            glGetActiveUniform(ID, i, maxNameLength, &length, &info.arraySize, &info.type, name.data());
+            std::string uniformName = name.substr(0, length);
+
+            // Members of uniform blocks have no location; they are written through the block's buffer.
+            info.location = glGetUniformLocation(ID, uniformName.c_str());
+            if (info.location < 0) {
+                continue;
+            }
+            addUniform(uniformName, info);
+
+            // Arrays of basic types are reported once as "name[0]". Register "name" and every element.
+            auto bracket = uniformName.rfind("[0]");
+            if (bracket != std::string::npos && bracket + 3 == uniformName.size()) {
+                std::string baseName = uniformName.substr(0, bracket);
+                addUniform(baseName, info);
+                for (GLint element = 1; element < info.arraySize; element++) {
+                    std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                    UniformInfo elementInfo = info;
+                    elementInfo.location = glGetUniformLocation(ID, elementName.c_str());
+                    elementInfo.arraySize = 1;
+                    addUniform(elementName, elementInfo);
+                }
+            }
+        }
+
+        GLint blockCount = 0;
+        GLint maxBlockNameLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockNameLength);
+
+        std::string blockName(maxBlockNameLength, '\0');
+        for (GLint i = 0; i < blockCount; i++) {
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(ID, i, maxBlockNameLength, &length, blockName.data());
+
+            UniformBlockInfo info;
+            info.index = i;
+            glGetActiveUniformBlockiv(ID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &info.dataSize);
+            mUniformBlocks[hashUniformName(std::string_view(blockName.data(), length))] = info;
+
+            // Engine-wide blocks always live at the same binding point.
+            GLuint bindingPoint = getUniformBlockBinding(std::string_view(blockName.data(), length));
+            if (bindingPoint != GL_INVALID_INDEX) {
+                glUniformBlockBinding(ID, info.index, bindingPoint);
+            }
+        }
+    }
+
+    void Shader::addUniform(const std::string& name, const UniformInfo& info)
+    {
+        auto result = mUniforms.emplace(hashUniformName(name), info);
+        if (!result.second && result.first->second.location != info.location) {
+            std::cout << "ERROR::SHADER::UNIFORM_NAME_HASH_COLLISION: " << name << std::endl;
+        }
     }
 
     void Shader::checkCompileErrors(unsigned int shader, std::string type)
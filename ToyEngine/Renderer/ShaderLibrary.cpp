@@ -0,0 +1,226 @@
+#include <Renderer/ShaderLibrary.h>
+#include <Renderer/GLStateCache.h>
+#include <Utils/Logger.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+namespace ToyEngine {
+	namespace {
+		constexpr uint32_t PROGRAM_BINARY_MAGIC = 0x42505354; // "TSPB"
+		constexpr uint32_t PROGRAM_BINARY_VERSION = 1;
+
+		struct ProgramBinaryHeader {
+			uint32_t magic = PROGRAM_BINARY_MAGIC;
+			uint32_t version = PROGRAM_BINARY_VERSION;
+			uint32_t format = 0;
+			uint32_t length = 0;
+		};
+
+		// 64-bit FNV-1a, chained so that several strings can go into one hash.
+		uint64_t hashContent(const std::string& content, uint64_t hash = 14695981039346656037ull)
+		{
+			for (char c : content) {
+				hash ^= static_cast<uint8_t>(c);
+				hash *= 1099511628211ull;
+			}
+			// separator, so that ("ab", "c") and ("a", "bc") differ
+			hash ^= 0xFF;
+			hash *= 1099511628211ull;
+			return hash;
+		}
+
+		std::string getGLString(GLenum name)
+		{
+			const GLubyte* value = glGetString(name);
+			return value ? reinterpret_cast<const char*>(value) : "";
+		}
+	}
+
+	ShaderLibrary& ShaderLibrary::getInstance()
+	{
+		static ShaderLibrary instance;
+		return instance;
+	}
+
+	std::shared_ptr<Shader> ShaderLibrary::get(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& defines)
+	{
+		std::string key = vertexPath + "|" + fragmentPath;
+		for (const auto& define : defines) {
+			key += "|" + define;
+		}
+
+		auto iter = mPrograms.find(key);
+		if (iter != mPrograms.end()) {
+			return iter->second;
+		}
+
+		std::string vertexCode = injectDefines(Shader::readSource(vertexPath.c_str()), defines);
+		std::string fragmentCode = injectDefines(Shader::readSource(fragmentPath.c_str()), defines);
+
+		GLuint program = compileCached({ vertexCode, fragmentCode }, [&](bool retrievable) {
+			return Shader::compileProgram(vertexCode, fragmentCode, retrievable);
+		});
+		auto shader = std::make_shared<Shader>(program);
+		mPrograms.emplace(key, shader);
+		return shader;
+	}
+
+	std::shared_ptr<Shader> ShaderLibrary::getCompute(const std::string& computePath, const std::vector<std::string>& defines)
+	{
+		std::string key = computePath;
+		for (const auto& define : defines) {
+			key += "|" + define;
+		}
+
+		auto iter = mPrograms.find(key);
+		if (iter != mPrograms.end()) {
+			return iter->second;
+		}
+
+		std::string computeCode = injectDefines(Shader::readSource(computePath.c_str()), defines);
+		GLuint program = compileCached({ computeCode }, [&](bool retrievable) {
+			return Shader::compileComputeProgram(computeCode, retrievable);
+		});
+		auto shader = std::make_shared<Shader>(program);
+		mPrograms.emplace(key, shader);
+		return shader;
+	}
+
+	std::string ShaderLibrary::injectDefines(const std::string& source, const std::vector<std::string>& defines)
+	{
+		if (defines.empty()) {
+			return source;
+		}
+
+		std::string defineBlock;
+		for (const auto& define : defines) {
+			defineBlock += "#define " + define + "\n";
+		}
+
+		// #version has to stay the first statement of the source.
+		size_t insertAt = 0;
+		size_t versionPos = source.find("#version");
+		if (versionPos != std::string::npos) {
+			size_t lineEnd = source.find('\n', versionPos);
+			insertAt = lineEnd != std::string::npos ? lineEnd + 1 : source.size();
+		}
+
+		std::string result = source;
+		result.insert(insertAt, defineBlock);
+		return result;
+	}
+
+	GLuint ShaderLibrary::compileCached(const std::vector<std::string>& sources, const std::function<GLuint(bool)>& compile)
+	{
+		if (!isBinaryCacheSupported()) {
+			return compile(false);
+		}
+
+		// Keyed by content rather than path, so editing a shader never picks up a stale binary.
+		uint64_t hash = hashContent(mDriverId);
+		for (const auto& source : sources) {
+			hash = hashContent(source, hash);
+		}
+
+		std::stringstream fileName;
+		fileName << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+		std::filesystem::path cachePath = mCacheDirectory / fileName.str();
+
+		GLuint program = loadBinary(cachePath);
+		if (program != 0) {
+			return program;
+		}
+
+		program = compile(true);
+		saveBinary(cachePath, program);
+		return program;
+	}
+
+	GLuint ShaderLibrary::loadBinary(const std::filesystem::path& cachePath)
+	{
+		std::ifstream file(cachePath, std::ios::binary);
+		if (!file) {
+			return 0;
+		}
+
+		ProgramBinaryHeader header;
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		std::vector<char> binary;
+		if (file && header.magic == PROGRAM_BINARY_MAGIC && header.version == PROGRAM_BINARY_VERSION) {
+			binary.resize(header.length);
+			file.read(binary.data(), header.length);
+		}
+		file.close();
+
+		GLuint program = 0;
+		if (!binary.empty() && file) {
+			program = glCreateProgram();
+			glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+			GLint success = GL_FALSE;
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+			if (success) {
+				return program;
+			}
+			GLStateCache::getInstance().deleteProgram(program);
+		}
+
+		// Truncated file, or the driver no longer accepts the format. Recompile and overwrite it.
+		Logger::DEBUG_WARNING("Program binary " + cachePath.string() + " was rejected, compiling from source.");
+		std::error_code error;
+		std::filesystem::remove(cachePath, error);
+		return 0;
+	}
+
+	void ShaderLibrary::saveBinary(const std::filesystem::path& cachePath, GLuint program)
+	{
+		GLint success = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success) {
+			return;
+		}
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) {
+			return;
+		}
+
+		ProgramBinaryHeader header;
+		std::vector<char> binary(length);
+		GLsizei written = 0;
+		GLenum format = GL_NONE;
+		glGetProgramBinary(program, length, &written, &format, binary.data());
+		header.format = format;
+		header.length = static_cast<uint32_t>(written);
+
+		std::error_code error;
+		std::filesystem::create_directories(mCacheDirectory, error);
+		std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			Logger::DEBUG_WARNING("Unable to write program binary " + cachePath.string());
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), written);
+	}
+
+	bool ShaderLibrary::isBinaryCacheSupported()
+	{
+		if (mBinaryCacheSupported < 0) {
+			// Some drivers expose the extension but report no formats, which means binaries can't be stored.
+			GLint formatCount = 0;
+			if (GLAD_GL_ARB_get_program_binary) {
+				glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+			}
+			mBinaryCacheSupported = formatCount > 0 ? 1 : 0;
+			mDriverId = getGLString(GL_VENDOR) + "|" + getGLString(GL_RENDERER) + "|" + getGLString(GL_VERSION);
+
+			if (!mBinaryCacheSupported) {
+				Logger::DEBUG_INFO("Program binaries are not supported by the driver, shaders are always compiled from source.");
+			}
+		}
+		return mBinaryCacheSupported == 1;
+	}
+}
@@ -0,0 +1,221 @@
+#include <Renderer/TextureArrayPool.h>
+#include <Renderer/GLStateCache.h>
+#include <Resource/BcEncoder.h>
+#include <Utils/Logger.h>
+#include <algorithm>
+#include <string>
+
+namespace ToyEngine {
+	namespace {
+		const uint32_t INITIAL_PAGE_CAPACITY = 1;
+
+		size_t getTexelBytes(GLenum format) {
+			switch (format) {
+			case GL_R8: return 1;
+			case GL_RG8: return 2;
+			default: return 4;
+			}
+		}
+
+		size_t getLevelBytes(GLenum format, int width, int height) {
+			if (!TextureArrayPool::isCompressed(format)) {
+				return static_cast<size_t>(width) * height * getTexelBytes(format);
+			}
+			const size_t blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+			return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+		}
+	}
+
+	TextureArrayPool& TextureArrayPool::getInstance()
+	{
+		static TextureArrayPool instance;
+		return instance;
+	}
+
+	bool TextureArrayPool::isCompressed(GLenum format)
+	{
+		switch (format) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RG_RGTC2:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM_ARB:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	int TextureArrayPool::getLevelCount(int width, int height)
+	{
+		int levels = 1;
+		while ((std::max(width, height) >> levels) > 0) {
+			levels++;
+		}
+		return levels;
+	}
+
+	size_t TextureArrayPool::getPageBytes(const Page& page)
+	{
+		size_t bytes = 0;
+		for (int level = 0; level < page.levels; level++) {
+			bytes += getLevelBytes(page.format, std::max(page.width >> level, 1), std::max(page.height >> level, 1));
+		}
+		return bytes * page.capacity;
+	}
+
+	TextureLayer TextureArrayPool::add(GLuint texture, int width, int height, GLenum format)
+	{
+		if (texture == 0 || width <= 0 || height <= 0) {
+			return TextureLayer();
+		}
+		if (mReadFramebuffer == 0) {
+			glGenFramebuffers(1, &mReadFramebuffer);
+			glGenFramebuffers(1, &mDrawFramebuffer);
+			glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &mMaxLayers);
+		}
+
+		PageKey key(width, height, format);
+		auto iter = mOpenPages.find(key);
+		if (iter == mOpenPages.end() || mPages[iter->second].layerCount == static_cast<uint32_t>(mMaxLayers)) {
+			Page page;
+			page.width = width;
+			page.height = height;
+			page.format = format;
+			page.levels = getLevelCount(width, height);
+			mPages.push_back(page);
+			iter = mOpenPages.insert_or_assign(key, static_cast<uint32_t>(mPages.size() - 1)).first;
+		}
+
+		const uint32_t pageId = iter->second;
+		Page& page = mPages[pageId];
+		if (page.layerCount == page.capacity) {
+			grow(page, page.capacity == 0 ? INITIAL_PAGE_CAPACITY : std::min(page.capacity * 2, static_cast<uint32_t>(mMaxLayers)));
+		}
+
+		TextureLayer layer;
+		layer.page = pageId;
+		layer.layer = page.layerCount++;
+		if (isCompressed(format)) {
+			copyCompressed(GL_TEXTURE_2D, texture, page.texture, static_cast<GLint>(layer.layer), page, 1);
+		}
+		else {
+			copyLayer(texture, -1, page.texture, static_cast<GLint>(layer.layer), width, height, page.levels);
+		}
+		return layer;
+	}
+
+	size_t TextureArrayPool::getLayerCount() const
+	{
+		size_t count = 0;
+		for (const auto& page : mPages) {
+			count += page.layerCount;
+		}
+		return count;
+	}
+
+	size_t TextureArrayPool::getTotalAllocatedBytes() const
+	{
+		size_t bytes = 0;
+		for (const auto& page : mPages) {
+			bytes += getPageBytes(page);
+		}
+		return bytes;
+	}
+
+	void TextureArrayPool::grow(Page& page, uint32_t capacity)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		GLStateCache::getInstance().bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, page.levels - 1);
+		for (int level = 0; level < page.levels; level++) {
+			const int levelWidth = std::max(page.width >> level, 1);
+			const int levelHeight = std::max(page.height >> level, 1);
+			if (isCompressed(page.format)) {
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, page.format, levelWidth, levelHeight, static_cast<GLsizei>(capacity), 0,
+					static_cast<GLsizei>(getLevelBytes(page.format, levelWidth, levelHeight) * capacity), nullptr);
+			}
+			else {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, page.format, levelWidth, levelHeight, static_cast<GLsizei>(capacity), 0, GL_RGBA,
+					GL_UNSIGNED_BYTE, nullptr);
+			}
+		}
+
+		// There is no glCopyImageSubData in GL 3.3, so the layers move with framebuffer blits, or through a pixel
+		// buffer when they are compressed.
+		if (isCompressed(page.format)) {
+			if (page.capacity > 0) {
+				copyCompressed(GL_TEXTURE_2D_ARRAY, page.texture, texture, 0, page, static_cast<GLsizei>(page.capacity));
+			}
+		}
+		else {
+			for (uint32_t layer = 0; layer < page.layerCount; layer++) {
+				copyLayer(page.texture, static_cast<GLint>(layer), texture, static_cast<GLint>(layer), page.width, page.height, page.levels);
+			}
+		}
+		GLStateCache::getInstance().deleteTexture(page.texture);
+
+		Logger::DEBUG_INFO("Texture array page " + std::to_string(page.width) + "x" + std::to_string(page.height)
+			+ " grew to " + std::to_string(capacity) + " layers.");
+		page.texture = texture;
+		page.capacity = capacity;
+	}
+
+	void TextureArrayPool::copyLayer(GLuint source, GLint sourceLayer, GLuint destination, GLint destinationLayer, int width, int height, int levels)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, mReadFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mDrawFramebuffer);
+		for (int level = 0; level < levels; level++) {
+			if (sourceLayer < 0) {
+				glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, level);
+			}
+			else {
+				glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, source, level, sourceLayer);
+			}
+			glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, destination, level, destinationLayer);
+
+			const GLint levelWidth = std::max(width >> level, 1);
+			const GLint levelHeight = std::max(height >> level, 1);
+			glBlitFramebuffer(0, 0, levelWidth, levelHeight, 0, 0, levelWidth, levelHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}
+		// Detach, so that the pooled textures are never attached while they are sampled.
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void TextureArrayPool::copyCompressed(GLenum sourceTarget, GLuint source, GLuint destination, GLint destinationLayer, const Page& page,
+		GLsizei layerCount)
+	{
+		GLStateCache& cache = GLStateCache::getInstance();
+		const size_t bytes = getLevelBytes(page.format, page.width, page.height) * layerCount;
+		if (mCopyBuffer == 0) {
+			glGenBuffers(1, &mCopyBuffer);
+		}
+		cache.bindBuffer(GL_PIXEL_PACK_BUFFER, mCopyBuffer);
+		if (bytes > mCopyBufferBytes) {
+			mCopyBufferBytes = bytes;
+			glBufferData(GL_PIXEL_PACK_BUFFER, mCopyBufferBytes, nullptr, GL_STREAM_COPY);
+		}
+
+		for (int level = 0; level < page.levels; level++) {
+			const int levelWidth = std::max(page.width >> level, 1);
+			const int levelHeight = std::max(page.height >> level, 1);
+			// Reads every layer of an array at once, so a grown page copies each level in one go.
+			cache.bindTexture(0, sourceTarget, source);
+			cache.bindBuffer(GL_PIXEL_PACK_BUFFER, mCopyBuffer);
+			glGetCompressedTexImage(sourceTarget, level, nullptr);
+
+			cache.bindTexture(0, GL_TEXTURE_2D_ARRAY, destination);
+			cache.bindBuffer(GL_PIXEL_UNPACK_BUFFER, mCopyBuffer);
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, destinationLayer, levelWidth, levelHeight, layerCount, page.format,
+				static_cast<GLsizei>(getLevelBytes(page.format, levelWidth, levelHeight) * layerCount), nullptr);
+		}
+		cache.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		cache.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+}
@@ -0,0 +1,41 @@
+#include <Renderer/UniformBuffer.h>
+#include <Renderer/GLStateCache.h>
+#include <Utils/Logger.h>
+
+namespace ToyEngine {
+	GLuint getUniformBlockBinding(std::string_view blockName)
+	{
+		if (blockName == "Lights") {
+			return LIGHTS_BLOCK_BINDING;
+		}
+		if (blockName == "FrameConstants") {
+			return FRAME_CONSTANTS_BLOCK_BINDING;
+		}
+		return GL_INVALID_INDEX;
+	}
+
+	void UniformBuffer::init(GLsizeiptr size, GLuint bindingPoint)
+	{
+		mSize = size;
+		mBindingPoint = bindingPoint;
+
+		glGenBuffers(1, &mBufferIndex);
+		GLStateCache::getInstance().bindBuffer(GL_UNIFORM_BUFFER, mBufferIndex);
+		glBufferData(GL_UNIFORM_BUFFER, mSize, nullptr, GL_DYNAMIC_DRAW);
+		GLStateCache::getInstance().bindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		GLStateCache::getInstance().bindBufferBase(GL_UNIFORM_BUFFER, mBindingPoint, mBufferIndex);
+	}
+
+	void UniformBuffer::upload(const void* data, GLsizeiptr size)
+	{
+		if (size > mSize) {
+			Logger::DEBUG_ERROR("Uniform buffer upload of " + std::to_string(size) + " bytes exceeds its size of " + std::to_string(mSize) + " bytes.");
+			return;
+		}
+
+		GLStateCache::getInstance().bindBuffer(GL_UNIFORM_BUFFER, mBufferIndex);
+		glBufferData(GL_UNIFORM_BUFFER, mSize, nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+	}
+}
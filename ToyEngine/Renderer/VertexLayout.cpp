@@ -0,0 +1,212 @@
+#include <Renderer/VertexLayout.h>
+#include <Renderer/GLStateCache.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace ToyEngine {
+	namespace {
+		enum VertexAttributeLocation : GLuint {
+			POSITION_LOCATION = 0,
+			NORMAL_LOCATION = 1,
+			TEXCOORDS_LOCATION = 2,
+			TANGENT_LOCATION = 3,
+			BONE_IDS_LOCATION = 5,
+			BONE_WEIGHTS_LOCATION = 6,
+		};
+
+		float signNotZero(float value) {
+			return value >= 0.0f ? 1.0f : -1.0f;
+		}
+
+		// Unit vector onto the octahedron, unfolded into [-1, 1]^2. A zero vector stays at the origin.
+		glm::vec2 encodeOctahedral(const glm::vec3& direction) {
+			float length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+			if (length == 0.0f) {
+				return glm::vec2(0.0f);
+			}
+			glm::vec3 n = direction / length;
+			if (n.z >= 0.0f) {
+				return glm::vec2(n.x, n.y);
+			}
+			return glm::vec2((1.0f - std::abs(n.y)) * signNotZero(n.x), (1.0f - std::abs(n.x)) * signNotZero(n.y));
+		}
+
+		template<typename T>
+		void store(uint8_t* destination, const T& value) {
+			std::memcpy(destination, &value, sizeof(T));
+		}
+
+		void storeSnorm16(uint8_t* destination, const float* values, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				store(destination + i * sizeof(uint16_t), glm::packSnorm1x16(values[i]));
+			}
+		}
+
+		void storeHalf(uint8_t* destination, const float* values, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				store(destination + i * sizeof(uint16_t), glm::packHalf1x16(values[i]));
+			}
+		}
+	}
+
+	VertexLayout::VertexLayout(PositionFormat position, bool skinned, bool halfTexCoords) :
+		mPositionFormat(position), mSkinned(skinned), mHalfTexCoords(halfTexCoords && position != PositionFormat::Float32)
+	{
+		auto add = [this](GLuint location, GLint components, GLenum type, GLboolean normalized, bool integer, size_t size) {
+			mAttributes.push_back({ location, components, type, normalized, integer, mStride });
+			mStride += size;
+		};
+
+		switch (position) {
+		case PositionFormat::Float32:
+			add(POSITION_LOCATION, 4, GL_FLOAT, GL_FALSE, false, 4 * sizeof(float));
+			break;
+		case PositionFormat::Half:
+			add(POSITION_LOCATION, 4, GL_HALF_FLOAT, GL_FALSE, false, 4 * sizeof(uint16_t));
+			break;
+		case PositionFormat::Snorm16:
+			add(POSITION_LOCATION, 4, GL_SHORT, GL_TRUE, false, 4 * sizeof(uint16_t));
+			break;
+		}
+		add(NORMAL_LOCATION, 2, GL_SHORT, GL_TRUE, false, 2 * sizeof(uint16_t));
+		add(TANGENT_LOCATION, 2, GL_SHORT, GL_TRUE, false, 2 * sizeof(uint16_t));
+		if (mHalfTexCoords) {
+			add(TEXCOORDS_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE, false, 2 * sizeof(uint16_t));
+		}
+		else {
+			add(TEXCOORDS_LOCATION, 2, GL_FLOAT, GL_FALSE, false, 2 * sizeof(float));
+		}
+		if (skinned) {
+			add(BONE_IDS_LOCATION, 4, GL_UNSIGNED_SHORT, GL_FALSE, true, 4 * sizeof(uint16_t));
+			add(BONE_WEIGHTS_LOCATION, 4, GL_UNSIGNED_BYTE, GL_TRUE, false, 4 * sizeof(uint8_t));
+		}
+	}
+
+	const VertexLayout& VertexLayout::get(PositionFormat position, bool skinned, bool halfTexCoords)
+	{
+		// By position, then skinned, then half texture coordinates. The Float32 ones with half texture
+		// coordinates never get any, so every Float32 layout is returned for both.
+		static const VertexLayout layouts[] = {
+			VertexLayout(PositionFormat::Float32, false, false), VertexLayout(PositionFormat::Float32, true, false),
+			VertexLayout(PositionFormat::Half, false, false), VertexLayout(PositionFormat::Half, false, true),
+			VertexLayout(PositionFormat::Half, true, false), VertexLayout(PositionFormat::Half, true, true),
+			VertexLayout(PositionFormat::Snorm16, false, false), VertexLayout(PositionFormat::Snorm16, false, true),
+			VertexLayout(PositionFormat::Snorm16, true, false), VertexLayout(PositionFormat::Snorm16, true, true),
+		};
+		if (position == PositionFormat::Float32) {
+			return layouts[skinned ? 1 : 0];
+		}
+		return layouts[2 + (static_cast<size_t>(position) - 1) * 4 + (skinned ? 2 : 0) + (halfTexCoords ? 1 : 0)];
+	}
+
+	const VertexLayout& VertexLayout::select(PositionFormat position, bool skinned, const std::vector<Vertex>& vertices)
+	{
+		// Also false for NaN.
+		const bool halfTexCoords = std::all_of(vertices.begin(), vertices.end(), [](const Vertex& vertex) {
+			return std::abs(vertex.TexCoords.x) <= MAX_HALF_TEXCOORD && std::abs(vertex.TexCoords.y) <= MAX_HALF_TEXCOORD;
+		});
+		return get(position, skinned, halfTexCoords);
+	}
+
+	glm::vec4 VertexLayout::computeDequantization(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+	{
+		if (mPositionFormat == PositionFormat::Float32) {
+			return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+		// One scale for all axes keeps the dequantization a similarity transform, so normal matrices stay valid.
+		glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+		float scale = std::max({ extent.x, extent.y, extent.z });
+		return glm::vec4((boundsMin + boundsMax) * 0.5f, scale > 0.0f ? scale : 1.0f);
+	}
+
+	glm::mat4 VertexLayout::getDequantizationMatrix(const glm::vec4& dequantization)
+	{
+		glm::mat4 matrix = glm::scale(glm::mat4(1.0f), glm::vec3(dequantization.w));
+		matrix[3] = glm::vec4(glm::vec3(dequantization), 1.0f);
+		return matrix;
+	}
+
+	std::vector<uint8_t> VertexLayout::encode(const std::vector<Vertex>& vertices, const glm::vec4& dequantization) const
+	{
+		std::vector<uint8_t> data(vertices.size() * mStride, 0);
+		const glm::vec3 offset(dequantization);
+		const float inverseScale = 1.0f / dequantization.w;
+
+		for (size_t v = 0; v < vertices.size(); v++) {
+			const Vertex& vertex = vertices[v];
+			uint8_t* destination = data.data() + v * mStride;
+
+			glm::vec3 normal = vertex.Normal;
+			glm::vec3 tangent = vertex.Tangent;
+			float bitangentSign = signNotZero(glm::dot(glm::cross(normal, tangent), vertex.Bitangent));
+			glm::vec4 position(glm::clamp((vertex.Position - offset) * inverseScale, -1.0f, 1.0f), bitangentSign);
+			if (mPositionFormat == PositionFormat::Float32) {
+				position = glm::vec4(vertex.Position, bitangentSign);
+			}
+			glm::vec2 encodedNormal = encodeOctahedral(normal);
+			glm::vec2 encodedTangent = encodeOctahedral(tangent);
+
+			for (const auto& attribute : mAttributes) {
+				uint8_t* target = destination + attribute.offset;
+				switch (attribute.location) {
+				case POSITION_LOCATION:
+					if (mPositionFormat == PositionFormat::Float32) {
+						store(target, position);
+					}
+					else if (mPositionFormat == PositionFormat::Half) {
+						storeHalf(target, &position.x, 4);
+					}
+					else {
+						storeSnorm16(target, &position.x, 4);
+					}
+					break;
+				case NORMAL_LOCATION:
+					storeSnorm16(target, &encodedNormal.x, 2);
+					break;
+				case TANGENT_LOCATION:
+					storeSnorm16(target, &encodedTangent.x, 2);
+					break;
+				case TEXCOORDS_LOCATION:
+					if (mHalfTexCoords) {
+						storeHalf(target, &vertex.TexCoords.x, 2);
+					}
+					else {
+						store(target, vertex.TexCoords);
+					}
+					break;
+				case BONE_IDS_LOCATION:
+					for (size_t i = 0; i < MAX_BONE_INFLUENCE; i++) {
+						store(target + i * sizeof(uint16_t), static_cast<uint16_t>(std::clamp(vertex.mBoneIDs[i], 0, 0xFFFF)));
+					}
+					break;
+				case BONE_WEIGHTS_LOCATION:
+					for (size_t i = 0; i < MAX_BONE_INFLUENCE; i++) {
+						target[i] = glm::packUnorm1x8(vertex.mWeights[i]);
+					}
+					break;
+				}
+			}
+		}
+		return data;
+	}
+
+	void VertexLayout::setupAttributes(GLuint buffer) const
+	{
+		GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, buffer);
+		for (GLuint location = 0; location < MAX_VERTEX_ATTRIBUTES; location++) {
+			glDisableVertexAttribArray(location);
+		}
+		for (const auto& attribute : mAttributes) {
+			glEnableVertexAttribArray(attribute.location);
+			if (attribute.integer) {
+				glVertexAttribIPointer(attribute.location, attribute.components, attribute.type, static_cast<GLsizei>(mStride), (void*)attribute.offset);
+			}
+			else {
+				glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized, static_cast<GLsizei>(mStride), (void*)attribute.offset);
+			}
+		}
+	}
+}
@@ -1,7 +1,14 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-uniform mat4 MVP;
+layout (std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    // x: seconds since start, y: seconds since the last frame
+    vec4 time;
+};
 void main()
 {
-    gl_Position = MVP * vec4(aPos.x, aPos.y, aPos.z, 1.0);
+    gl_Position = viewProjection * vec4(aPos.x, aPos.y, aPos.z, 1.0);
 }
\ No newline at end of file
@@ -1,15 +1,71 @@
 #version 330 core
 // The uniform variable is set up in the javascript code and the same for all vertices
-uniform vec3 spherePosition;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 normalMat;
 
+// Light structs mirror the std140 layout packed by LightBuffer. Every vec3 is followed by a float.
+struct DirLight {
+    vec3 direction;
+    float padding0;
+    vec3 ambient;
+    float padding1;
+    vec3 diffuse;
+    float padding2;
+    vec3 specular;
+    float padding3;
+};
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal;
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    float padding0;
+};
+
+struct SpotLight {
+    vec3 position;
+    float constant;
+    vec3 direction;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float cutOff;
+    vec3 specular;
+    float outerCutOff;
+};
+
+#define MAX_NR_DIR_LIGHTS 32
+#define MAX_NR_POINT_LIGHTS 32
+#define MAX_NR_SPOT_LIGHTS 32
+
+layout (std140) uniform Lights {
+    // x: directional, y: point, z: spot
+    ivec4 lightCounts;
+    DirLight dirLights[MAX_NR_DIR_LIGHTS];
+    PointLight pointLights[MAX_NR_POINT_LIGHTS];
+    SpotLight spotLights[MAX_NR_SPOT_LIGHTS];
+};
+
+layout (std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    // x: seconds since start, y: seconds since the last frame
+    vec4 time;
+};
+
+// see VertexLayout.h: position with the bitangent sign in w, octahedral normal
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec2 normal;
 layout(location = 2) in vec2 textureCoordinate;
+// per instance, see InstanceBuffer.h. The model matrix includes the dequantization of the positions,
+// the normal matrix is the world space one.
+layout(location = 7) in mat4 instanceModel;
+layout(location = 11) in mat3 instanceNormalMatrix;
 
 // The shared variable is initialized in the vertex shader and attached to the current vertex being processed,
 // such that each vertex is given a shared variable and when passed to the fragment shader,
@@ -20,20 +76,34 @@ out vec3 lightDirection;
 out vec3 viewPosition;
 out vec2 aTextureCoordinate;
 
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (direction.z < 0.0) {
+        direction.xy = (1.0 - abs(direction.yx)) * vec2(direction.x >= 0.0 ? 1.0 : -1.0, direction.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(direction);
+}
+
 void main() {
+    // These shaders only model a single light, the first point light of the scene.
+    vec3 lightPosition = lightCounts.y > 0 ? pointLights[0].position : vec3(0.0);
+
+    vec4 worldPosition = instanceModel * vec4(position.xyz, 1.0);
+
     // HINT: Compute the vertex position in VCS
-    viewPosition = (view * model * vec4(position, 1.0)).xyz;
+    viewPosition = (view * worldPosition).xyz;
 
     // HINT: Compute the light direction in VCS
-    lightDirection = normalize(view * vec4(spherePosition, 1.0) - view * model * vec4(position, 1.0)).xyz;
+    lightDirection = normalize(view * vec4(lightPosition, 1.0) - view * worldPosition).xyz;
     
-    // HINT: Interpolate the normal
-    interpolatedNormal = normalize((normalMat * vec4(normal,0.0f)).xyz);
+    // HINT: Interpolate the normal. The view matrix is a rotation and translation, so it is its own normal matrix.
+    interpolatedNormal = normalize(mat3(view) * instanceNormalMatrix * decodeOctahedral(normal));
 
     aTextureCoordinate = textureCoordinate;
 
     // Multiply each vertex by the model matrix to get the world position of each vertex, 
     // then the view matrix to get the position in the camera coordinate system, 
     // and finally the projection matrix to get final vertex position
-    gl_Position = projection * view * model * vec4(position, 1.0);
+    gl_Position = viewProjection * worldPosition;
 }
\ No newline at end of file
@@ -3,66 +3,80 @@
 precision highp float;
 out vec4 FragColor;
 
+// Texture array pages, the layers and the shininess come per instance from the materials buffer.
 struct Material {
-    sampler2D diffuse;
-    sampler2D specular;
-    float shininess;
+    sampler2DArray diffuse;
+    sampler2DArray specular;
 };
 
+// Light structs mirror the std140 layout packed by LightBuffer. Every vec3 is followed by a float.
 struct DirLight {
     vec3 direction;
-
+    float padding0;
     vec3 ambient;
+    float padding1;
     vec3 diffuse;
+    float padding2;
     vec3 specular;
+    float padding3;
 };
 
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
+    float padding0;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
     float constant;
+    vec3 direction;
     float linear;
-    float quadratic;
-
     vec3 ambient;
+    float quadratic;
     vec3 diffuse;
+    float cutOff;
     vec3 specular;
+    float outerCutOff;
 };
 
 #define MAX_NR_DIR_LIGHTS 32
 #define MAX_NR_POINT_LIGHTS 32
 #define MAX_NR_SPOT_LIGHTS 32
 
+layout (std140) uniform Lights {
+    // x: directional, y: point, z: spot
+    ivec4 lightCounts;
+    DirLight dirLights[MAX_NR_DIR_LIGHTS];
+    PointLight pointLights[MAX_NR_POINT_LIGHTS];
+    SpotLight spotLights[MAX_NR_SPOT_LIGHTS];
+};
+
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+flat in vec2 MaterialLayers;
+flat in float Shininess;
 
-uniform vec3 viewPos;
-uniform DirLight dirLights[MAX_NR_DIR_LIGHTS];
-uniform PointLight pointLights[MAX_NR_POINT_LIGHTS];
-uniform SpotLight spotLights[MAX_NR_SPOT_LIGHTS];
 uniform Material material;
 
-uniform int numberOfDirLights;
-uniform int numberOfPointLights;
-uniform int numberOfSpotLights;
+layout (std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    // x: seconds since start, y: seconds since the last frame
+    vec4 time;
+};
 
 // function prototypes
+vec3 sampleDiffuse();
+vec3 sampleSpecular();
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
@@ -71,7 +85,7 @@ void main()
 {
     // properties
     vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(cameraPosition.xyz - FragPos);
 
     // == =====================================================
     // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
@@ -81,13 +95,13 @@ void main()
     // == =====================================================
     vec3 result = vec3(0.0,0.0,0.0);
     // phase 1: directional lighting
-    for(int i = 0; i < numberOfDirLights; i++)
+    for(int i = 0; i < lightCounts.x; i++)
     result += CalcDirLight(dirLights[i], norm, viewDir);
     // phase 2: point lights
-    for(int i = 0; i < numberOfPointLights; i++)
+    for(int i = 0; i < lightCounts.y; i++)
     result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
     // phase 3: spot light
-    for(int i = 0; i < numberOfSpotLights; i++)
+    for(int i = 0; i < lightCounts.z; i++)
     result += CalcSpotLight(spotLights[i], norm, FragPos, viewDir);
 
     FragColor = vec4(result, 1.0);
@@ -98,6 +112,16 @@ void main()
     //FragColor = vec4(TexCoords, 0.0, 1.0);
 }
 
+vec3 sampleDiffuse()
+{
+    return texture(material.diffuse, vec3(TexCoords, MaterialLayers.x)).rgb;
+}
+
+vec3 sampleSpecular()
+{
+    return texture(material.specular, vec3(TexCoords, MaterialLayers.y)).rgb;
+}
+
 // calculates the color when using a directional light.
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
@@ -106,11 +130,11 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), Shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * sampleDiffuse();
+    vec3 diffuse = light.diffuse * diff * sampleDiffuse();
+    vec3 specular = light.specular * spec * sampleSpecular();
     return (ambient + diffuse + specular);
 }
 
@@ -122,15 +146,15 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), Shininess);
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
     // combine results
     // should be material.ambient
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * sampleDiffuse();
+    vec3 diffuse = light.diffuse * diff * sampleDiffuse();
+    vec3 specular = light.specular * spec * sampleSpecular();
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -145,7 +169,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), Shininess);
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
@@ -154,9 +178,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * sampleDiffuse();
+    vec3 diffuse = light.diffuse * diff * sampleDiffuse();
+    vec3 specular = light.specular * spec * sampleSpecular();
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
@@ -1,21 +1,51 @@
 #version 330 core
-layout (location = 0) in vec3 pos;
-layout (location = 1) in vec3 norm;
+// see VertexLayout.h: position with the bitangent sign in w, octahedral normal
+layout (location = 0) in vec4 pos;
+layout (location = 1) in vec2 norm;
 layout (location = 2) in vec2 tex;
+// per instance, see InstanceBuffer.h
+layout (location = 7) in mat4 instanceModel;
+layout (location = 11) in mat3 instanceNormalMatrix;
+layout (location = 14) in uint instanceMaterial;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+// layers of the diffuse and specular texture arrays
+flat out vec2 MaterialLayers;
+flat out float Shininess;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// see MaterialBuffer.h: diffuse layer, specular layer, shininess as float bits
+uniform usamplerBuffer materials;
+
+layout (std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    // x: seconds since start, y: seconds since the last frame
+    vec4 time;
+};
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (direction.z < 0.0) {
+        direction.xy = (1.0 - abs(direction.yx)) * vec2(direction.x >= 0.0 ? 1.0 : -1.0, direction.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(direction);
+}
 
 void main()
 {
-    FragPos = vec3(model * vec4(pos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * norm;
+    // the instance model includes the dequantization of the positions
+    FragPos = vec3(instanceModel * vec4(pos.xyz, 1.0));
+    Normal = instanceNormalMatrix * decodeOctahedral(norm);
     TexCoords = tex;
 
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    uvec4 material = texelFetch(materials, int(instanceMaterial));
+    MaterialLayers = vec2(material.xy);
+    Shininess = uintBitsToFloat(material.z);
+
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -12,8 +12,8 @@ namespace ui {
 		int width = 0;
 		int height = 0;
 		int channel = 0;
-		mFileThumbnailTexture = std::make_shared<ToyEngine::Texture>(FILE_ICON_PATH, ToyEngine::TextureType::Diffuse, true);
-		mFolderThumbnailTexture = std::make_shared<ToyEngine::Texture>(FOLDER_ICON_PATH , ToyEngine::TextureType::Diffuse, true);
+		mFileThumbnailTexture = std::make_shared<ToyEngine::Texture>(FILE_ICON_PATH, ToyEngine::TextureType::Diffuse, true, true);
+		mFolderThumbnailTexture = std::make_shared<ToyEngine::Texture>(FOLDER_ICON_PATH , ToyEngine::TextureType::Diffuse, true, true);
 	}
 
 	void FileExplorer::render() {
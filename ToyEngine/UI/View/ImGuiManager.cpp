@@ -1,5 +1,19 @@
 #include "UI/View/ImGuiManager.h"
 #include <glm/gtx/string_cast.hpp>
+#include <Renderer/RenderSystem.h>
+#include <Renderer/GLStateCache.h>
+#include <Renderer/GpuTransferQueue.h>
+#include <Renderer/TextureArrayPool.h>
+#include <Resource/TextureCooker.h>
+#include <Utils/AssetPacker.h>
+#include <Utils/JobBenchmark.h>
+#include <Utils/JobSystem.h>
+#include <Utils/OcclusionBenchmark.h>
+#include <Utils/TextureCompressionBenchmark.h>
+#include <Utils/TransformBenchmark.h>
+#include <Utils/VirtualFileSystem.h>
+#include <map>
+#include <string>
 
 namespace ui{
 	void ImGuiManager::tick()
@@ -63,10 +77,167 @@ namespace ui{
 	void ImGuiManager::renderLoggingMenu()
 	{
 		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+		ImGui::Text("Mesh draw calls: %zu", ToyEngine::RenderSystem::instance.getDrawCallCount());
+		const auto& stateCalls = ToyEngine::GLStateCache::getInstance().getLastFrameCounters();
+		ImGui::Text("GL state calls: %zu issued, %zu elided", stateCalls.issued, stateCalls.elided);
+		if (mScene) {
+			const auto& transforms = mScene->getTransformSystem();
+			ImGui::Text("Transforms updated: %zu in %zu levels (%.3f ms)", transforms.getLastUpdateCount(), transforms.getLevelCount(),
+				transforms.getLastUpdateMilliseconds());
+		}
+		if (renderTaskButton(mTransformBenchmark, "Run transform benchmark")) {
+			startTask(mTransformBenchmark, "Transform benchmark", ToyEngine::TransformBenchmark::run);
+		}
+
+		ToyEngine::JobSystem& jobs = ToyEngine::JobSystem::getInstance();
+		bool jobTracing = jobs.isTracing();
+		if (ImGui::Checkbox("Job tracing", &jobTracing)) {
+			jobs.setTracing(jobTracing);
+		}
+		ImGui::SameLine();
+		ImGui::Text("%zu workers", jobs.getThreadCount());
+		if (jobTracing) {
+			// The jobs that finished since the last frame, by name.
+			std::map<std::string, std::pair<size_t, float>> jobTotals;
+			for (const auto& trace : jobs.collectTraces()) {
+				auto& total = jobTotals[trace.name];
+				total.first++;
+				total.second += trace.end - trace.start;
+			}
+			for (const auto& [name, total] : jobTotals) {
+				ImGui::Text("  %s: %zu jobs, %.3f ms", name.c_str(), total.first, total.second);
+			}
+		}
+		if (renderTaskButton(mJobBenchmark, "Run job benchmark")) {
+			startTask(mJobBenchmark, "Job benchmark", ToyEngine::JobBenchmark::run);
+		}
+
+		ToyEngine::ModelLoader& modelLoader = ToyEngine::RenderSystem::instance.getModelLoader();
+		float uploadBudget = modelLoader.getUploadBudget();
+		if (ImGui::SliderFloat("Model upload budget (ms)", &uploadBudget, 0.5f, 16.0f)) {
+			modelLoader.setUploadBudget(uploadBudget);
+		}
+		for (const auto& import : modelLoader.getImports()) {
+			static const char* STATE_NAMES[] = { "queued", "importing", "uploading", "done", "failed", "cancelled" };
+			std::string label = import->name + " (" + STATE_NAMES[static_cast<int>(import->state.load())] + ")";
+			ImGui::ProgressBar(import->progress.load(), ImVec2(-80.0f, 0.0f), label.c_str());
+			ImGui::SameLine();
+			ImGui::PushID(import.get());
+			if (ImGui::Button("Cancel")) {
+				modelLoader.cancel(import->placeholder);
+			}
+			ImGui::PopID();
+		}
+
+		ToyEngine::GpuTransferQueue& transferQueue = ToyEngine::GpuTransferQueue::getInstance();
+		if (transferQueue.isRunning()) {
+			int transferBudget = static_cast<int>(transferQueue.getFrameBudget() / (1024 * 1024));
+			if (ImGui::SliderInt("GPU transfer budget (MB/frame)", &transferBudget, 1, 256)) {
+				transferQueue.setFrameBudget(static_cast<size_t>(transferBudget) * 1024 * 1024);
+			}
+			ImGui::Text("GPU transfers: %zu pending, %.1f MB last frame", transferQueue.getPendingCount(),
+				transferQueue.getLastFrameBytes() / (1024.0 * 1024.0));
+		}
+
+		float lodPixelError = ToyEngine::RenderSystem::instance.getLodPixelError();
+		if (ImGui::SliderFloat("LOD pixel error", &lodPixelError, 0.1f, 8.0f)) {
+			ToyEngine::RenderSystem::instance.setLodPixelError(lodPixelError);
+		}
+
+		// Only affects meshes imported afterwards.
+		int positionFormat = static_cast<int>(ToyEngine::RenderSystem::instance.getPositionFormat());
+		if (ImGui::Combo("Vertex positions", &positionFormat, "Float32\0Half\0Snorm16\0")) {
+			ToyEngine::RenderSystem::instance.setPositionFormat(static_cast<ToyEngine::PositionFormat>(positionFormat));
+		}
+		ImGui::Text("Geometry memory: %.1f MB", ToyEngine::GeometryPool::getTotalAllocatedBytes() / (1024.0 * 1024.0));
+		const ToyEngine::TextureArrayPool& texturePool = ToyEngine::TextureArrayPool::getInstance();
+		ImGui::Text("Texture arrays: %zu layers in %zu pages, %.1f MB", texturePool.getLayerCount(), texturePool.getPageCount(),
+			texturePool.getTotalAllocatedBytes() / (1024.0 * 1024.0));
+
+		// Only affects textures loaded afterwards.
+		ToyEngine::TextureCooker& textureCooker = ToyEngine::TextureCooker::getInstance();
+		bool cookingOnDemand = textureCooker.isCookingOnDemand();
+		if (ImGui::Checkbox("Compress textures on load", &cookingOnDemand)) {
+			textureCooker.setCookingOnDemand(cookingOnDemand);
+		}
+		int compressionQuality = static_cast<int>(textureCooker.getQuality());
+		if (ImGui::Combo("Compression quality", &compressionQuality, "Fast\0Normal\0High\0")) {
+			textureCooker.setQuality(static_cast<ToyEngine::BcQuality>(compressionQuality));
+		}
+		if (renderTaskButton(mTextureCooking, "Compress textures in Resources")) {
+			startTask(mTextureCooking, "Texture cooking", [&textureCooker] {
+				return "Cooked " + std::to_string(textureCooker.cookDirectory("Resources")) + " textures.";
+			});
+		}
+		if (renderTaskButton(mCompressionBenchmark, "Run compression benchmark")) {
+			startTask(mCompressionBenchmark, "Compression benchmark", ToyEngine::TextureCompressionBenchmark::run);
+		}
+		// The archive may be mounted, so it is replaced at the next start.
+		if (renderTaskButton(mAssetPacking, "Pack assets")) {
+			startTask(mAssetPacking, "Asset packing", [] {
+				const std::string archivePath = ToyEngine::AssetPacker::getPendingPath(ToyEngine::VirtualFileSystem::DEFAULT_ARCHIVE);
+				return ToyEngine::AssetPacker::pack(ToyEngine::AssetPacker::getDefaultDirectories(), archivePath)
+					? "Packed " + archivePath + ", used from the next start on." : "Packing failed.";
+			});
+		}
+
+		// Culling on the GPU never reports back, so only the CPU path has culling statistics.
+		bool gpuCulling = ToyEngine::RenderSystem::instance.isGpuCullingEnabled();
+		if (ToyEngine::GpuCuller::isSupported() && ImGui::Checkbox("GPU culling", &gpuCulling)) {
+			ToyEngine::RenderSystem::instance.setGpuCullingEnabled(gpuCulling);
+		}
+		if (gpuCulling) {
+			ImGui::Text("GPU resident meshes: %zu", ToyEngine::RenderSystem::instance.getGpuCuller().getInstanceCount());
+		}
+		else {
+			ImGui::Text("Meshes frustum culled: %zu", ToyEngine::RenderSystem::instance.getCulledCount());
+
+			bool occlusionCulling = ToyEngine::RenderSystem::instance.isOcclusionCullingEnabled();
+			if (ImGui::Checkbox("Occlusion culling", &occlusionCulling)) {
+				ToyEngine::RenderSystem::instance.setOcclusionCullingEnabled(occlusionCulling);
+			}
+			if (occlusionCulling) {
+				const auto& occlusionCuller = ToyEngine::RenderSystem::instance.getOcclusionCuller();
+				ImGui::Text("Meshes occlusion culled: %zu (%zu occluder triangles, %.3f ms)", occlusionCuller.getCulledCount(),
+					occlusionCuller.getRasterizedTriangleCount(), occlusionCuller.getLastCullMilliseconds());
+			}
+			if (renderTaskButton(mOcclusionBenchmark, "Run occlusion benchmark")) {
+				startTask(mOcclusionBenchmark, "Occlusion benchmark", ToyEngine::OcclusionBenchmark::run);
+			}
+		}
 
 		mFileExplorer.render();
 	}
 
+	bool ImGuiManager::renderTaskButton(const BackgroundTask& task, const char* label)
+	{
+		bool pressed = false;
+		if (task.running) {
+			ImGui::TextDisabled("%s (running)", label);
+		}
+		else {
+			pressed = ImGui::Button(label);
+		}
+		if (!task.result.empty()) {
+			ImGui::TextUnformatted(task.result.c_str());
+		}
+		return pressed;
+	}
+
+	void ImGuiManager::startTask(BackgroundTask& task, const char* name, std::function<std::string()> function)
+	{
+		task.running = true;
+		task.result.clear();
+		ToyEngine::JobSystem::getInstance().spawn(name, [&task, function = std::move(function)] {
+			std::string result = function();
+			// The task is only touched on the main thread.
+			ToyEngine::JobSystem::getInstance().runOnMainThread([&task, result = std::move(result)] {
+				task.running = false;
+				task.result = result;
+			});
+		});
+	}
+
 	ImGuiManager& ImGuiManager::getInstance()
 	{
 		static ImGuiManager instance; // Guaranteed to be destroyed.
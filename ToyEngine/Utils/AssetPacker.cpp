@@ -0,0 +1,89 @@
+#include <Utils/AssetPacker.h>
+#include <Utils/Logger.h>
+#include <Utils/PackArchive.h>
+#include <Utils/VirtualFileSystem.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <system_error>
+
+namespace ToyEngine {
+	namespace {
+		// Mapped and uploaded as they are, decompressing them would only add a copy.
+		const char* IN_PLACE_EXTENSIONS[] = { ".tmesh", ".ktx2" };
+		// Left behind by an interrupted write.
+		const char* TEMPORARY_EXTENSION = ".tmp";
+		const char* PENDING_EXTENSION = ".new";
+	}
+
+	const std::vector<std::string>& AssetPacker::getDefaultDirectories()
+	{
+		static const std::vector<std::string> directories = { "Shaders", "Resources", "ModelCache" };
+		return directories;
+	}
+
+	bool AssetPacker::pack(const std::vector<std::string>& directories, const std::string& archivePath, bool compress)
+	{
+		auto start = std::chrono::steady_clock::now();
+		const std::string archiveName = VirtualFileSystem::normalize(archivePath);
+		std::vector<PackArchive::Source> sources;
+		for (const std::string& directory : directories) {
+			std::vector<PackArchive::Source> directorySources;
+			std::error_code error;
+			for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+				const std::string extension = entry.path().extension().string();
+				if (!entry.is_regular_file() || extension == TEMPORARY_EXTENSION) {
+					continue;
+				}
+				PackArchive::Source source;
+				source.diskPath = entry.path().string();
+				source.path = VirtualFileSystem::normalize(source.diskPath);
+				source.compress = compress && std::none_of(std::begin(IN_PLACE_EXTENSIONS), std::end(IN_PLACE_EXTENSIONS), [&extension](const char* inPlace) {
+					return extension == inPlace;
+				});
+				if (source.path != archiveName) {
+					directorySources.push_back(std::move(source));
+				}
+			}
+			if (error) {
+				Logger::DEBUG_WARNING("Cannot pack " + directory + ": " + error.message());
+			}
+			std::sort(directorySources.begin(), directorySources.end(), [](const PackArchive::Source& a, const PackArchive::Source& b) {
+				return a.path < b.path;
+			});
+			sources.insert(sources.end(), std::make_move_iterator(directorySources.begin()), std::make_move_iterator(directorySources.end()));
+		}
+
+		PackArchive::Statistics statistics;
+		if (!PackArchive::write(archivePath, sources, &statistics)) {
+			Logger::DEBUG_ERROR("Packing " + archivePath + " failed.");
+			return false;
+		}
+		const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		Logger::DEBUG_INFO("Packed " + std::to_string(statistics.entryCount) + " files, " + std::to_string(statistics.compressedCount)
+			+ " of them compressed, from " + std::to_string(statistics.fileBytes / 1024) + " KB into " + std::to_string(statistics.archiveBytes / 1024)
+			+ " KB in " + archivePath + " in " + std::to_string(seconds) + " s.");
+		return true;
+	}
+
+	std::string AssetPacker::getPendingPath(const std::string& archivePath)
+	{
+		return archivePath + PENDING_EXTENSION;
+	}
+
+	void AssetPacker::installPending(const std::string& archivePath)
+	{
+		const std::string pendingPath = getPendingPath(archivePath);
+		std::error_code error;
+		if (!std::filesystem::exists(pendingPath, error)) {
+			return;
+		}
+		std::filesystem::rename(pendingPath, archivePath, error);
+		if (error) {
+			Logger::DEBUG_WARNING("Cannot replace " + archivePath + " with " + pendingPath + ": " + error.message());
+		}
+		else {
+			Logger::DEBUG_INFO("Replaced " + archivePath + " with the archive packed last time.");
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#include <Utils/CpuFeatures.h>
+
+#if TOY_X86_SIMD && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace ToyEngine {
+	namespace {
+		bool detectAVX2()
+		{
+#if !TOY_X86_SIMD
+			return false;
+#elif defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) {
+				return false;
+			}
+			__cpuid(info, 1);
+			const bool fma = (info[2] & (1 << 12)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+			if (!fma || !osxsave || !avx) {
+				return false;
+			}
+			// the OS has to save the YMM registers on context switches
+			if ((_xgetbv(0) & 0x6) != 0x6) {
+				return false;
+			}
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+		}
+	}
+
+	bool CpuFeatures::hasAVX2()
+	{
+		static const bool supported = detectAVX2();
+		return supported;
+	}
+}
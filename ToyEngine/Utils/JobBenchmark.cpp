@@ -0,0 +1,105 @@
+#include <Utils/JobBenchmark.h>
+#include <Utils/JobSystem.h>
+#include <Utils/Logger.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace ToyEngine {
+	namespace {
+		const size_t THREAD_COUNTS[] = { 1, 2, 4, 8, 16, 32, 64 };
+		constexpr size_t SPAWNED_JOBS = 100000;
+		constexpr size_t FOR_ELEMENTS = 1 << 22;
+		constexpr size_t FOR_GRAIN = 4096;
+		constexpr size_t SORT_ELEMENTS = 1 << 22;
+		constexpr int REPETITIONS = 5;
+
+		// Best of a few runs, in milliseconds.
+		template<typename Function>
+		double measure(Function&& function) {
+			double best = 0.0;
+			for (int i = 0; i < REPETITIONS; i++) {
+				auto start = std::chrono::steady_clock::now();
+				function();
+				double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				best = i == 0 ? milliseconds : std::min(best, milliseconds);
+			}
+			return best;
+		}
+
+		std::string format(const char* pattern, double a, double b, double c) {
+			char text[128];
+			std::snprintf(text, sizeof(text), pattern, a, b, c);
+			return text;
+		}
+
+		void report(std::string& summary, const std::string& line) {
+			Logger::DEBUG_INFO(line);
+			summary += line + "\n";
+		}
+	}
+
+	std::string JobBenchmark::run()
+	{
+		std::string summary;
+		report(summary, "Job benchmark on " + std::to_string(std::thread::hardware_concurrency()) + " hardware threads.");
+		measureSpawnOverhead(summary);
+		measureScaling(summary);
+		return summary;
+	}
+
+	void JobBenchmark::measureSpawnOverhead(std::string& summary)
+	{
+		for (size_t threads : THREAD_COUNTS) {
+			// The thread that waits is one of them.
+			JobSystem jobs(threads - 1);
+			double milliseconds = measure([&jobs] {
+				JobCounter counter;
+				for (size_t i = 0; i < SPAWNED_JOBS; i++) {
+					jobs.spawn("Empty", [] {}, &counter);
+				}
+				jobs.wait(counter);
+			});
+			report(summary, format("Spawn overhead, %.0f threads: %.1f ns per job (%.2f ms)", static_cast<double>(threads),
+				milliseconds * 1e6 / SPAWNED_JOBS, milliseconds));
+		}
+	}
+
+	void JobBenchmark::measureScaling(std::string& summary)
+	{
+		std::vector<float> values(FOR_ELEMENTS);
+		std::vector<uint32_t> unsorted(SORT_ELEMENTS);
+		std::mt19937 random(1);
+		for (auto& value : unsorted) {
+			value = random();
+		}
+		std::vector<uint32_t> sorted;
+
+		double forBaseline = 0.0;
+		double sortBaseline = 0.0;
+		for (size_t threads : THREAD_COUNTS) {
+			JobSystem jobs(threads - 1);
+			double forMilliseconds = measure([&] {
+				jobs.parallelFor("Scale", values.size(), FOR_GRAIN, [&values](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++) {
+						values[i] = std::sqrt(static_cast<float>(i)) * std::sin(static_cast<float>(i));
+					}
+				});
+			});
+			double sortMilliseconds = measure([&] {
+				sorted = unsorted;
+				jobs.parallelSort(sorted.begin(), sorted.end(), std::less<uint32_t>());
+			});
+			if (threads == 1) {
+				forBaseline = forMilliseconds;
+				sortBaseline = sortMilliseconds;
+			}
+
+			report(summary, format("parallelFor, %.0f threads: %.2f ms, %.2fx", static_cast<double>(threads), forMilliseconds, forBaseline / forMilliseconds));
+			report(summary, format("parallelSort, %.0f threads: %.2f ms, %.2fx", static_cast<double>(threads), sortMilliseconds, sortBaseline / sortMilliseconds));
+		}
+	}
+}
@@ -0,0 +1,294 @@
+#include <Utils/JobSystem.h>
+
+namespace ToyEngine {
+	namespace {
+		// Spins before a worker sleeps, since jobs tend to come in bursts.
+		constexpr int IDLE_SPINS = 64;
+
+		struct CurrentWorker {
+			const JobSystem* system = nullptr;
+			size_t worker = 0;
+		};
+
+		thread_local CurrentWorker sCurrentWorker;
+	}
+
+	JobSystem& JobSystem::getInstance()
+	{
+		static JobSystem instance([] {
+			size_t hardwareThreads = std::thread::hardware_concurrency();
+			return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+		}());
+		return instance;
+	}
+
+	JobSystem::JobSystem(size_t threadCount) :
+		mEpoch(std::chrono::steady_clock::now())
+	{
+		for (size_t i = 0; i < threadCount; i++) {
+			mQueues.push_back(std::make_unique<WorkStealingQueue>());
+		}
+		for (size_t i = 0; i <= threadCount; i++) {
+			mTraces.push_back(std::make_unique<TraceBuffer>());
+		}
+		for (size_t i = 0; i < threadCount; i++) {
+			mThreads.emplace_back([this, i] { workerLoop(i); });
+		}
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mSleepMutex);
+			mStop = true;
+		}
+		mWake.notify_all();
+		for (auto& thread : mThreads) {
+			thread.join();
+		}
+	}
+
+	void JobSystem::spawn(const char* name, std::function<void()> function, JobCounter* counter)
+	{
+		if (counter) {
+			counter->mCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		enqueue(new Job{ std::move(function), name, counter });
+	}
+
+	void JobSystem::spawnAfter(JobCounter& dependency, const char* name, std::function<void()> function, JobCounter* counter)
+	{
+		if (counter) {
+			counter->mCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		Job* job = new Job{ std::move(function), name, counter };
+		{
+			// The last job of the dependency takes the waiting jobs under the same lock.
+			std::lock_guard<std::mutex> lock(dependency.mMutex);
+			if (!dependency.isDone()) {
+				dependency.mWaiting.push_back(job);
+				return;
+			}
+		}
+		enqueue(job);
+	}
+
+	void JobSystem::wait(const JobCounter& counter)
+	{
+		const size_t worker = getCurrentWorker();
+		// Any job a worker could take may be a long one, like a model import, which the main thread must
+		// not pick up in the middle of a frame. Other threads only help with the jobs they wait for.
+		const bool isWorker = worker < mQueues.size();
+		while (!counter.isDone()) {
+			if (Job* job = isWorker ? findJob(worker) : findJobOf(counter)) {
+				execute(job, worker);
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+		std::lock_guard<std::mutex> lock(counter.mMutex);
+	}
+
+	void JobSystem::parallelFor(const char* name, size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body)
+	{
+		grain = std::max<size_t>(grain, 1);
+		const size_t rangeCount = (count + grain - 1) / grain;
+		if (rangeCount == 0) {
+			return;
+		}
+		if (rangeCount == 1 || mThreads.empty()) {
+			body(0, count);
+			return;
+		}
+
+		// Every helper takes ranges until none are left, so one slow range does not hold up the others.
+		std::atomic<size_t> next{ 0 };
+		auto takeRanges = [&next, &body, rangeCount, grain, count] {
+			for (size_t range = next.fetch_add(1); range < rangeCount; range = next.fetch_add(1)) {
+				const size_t begin = range * grain;
+				body(begin, std::min(begin + grain, count));
+			}
+		};
+
+		JobCounter counter;
+		const size_t helperCount = std::min(rangeCount - 1, mThreads.size());
+		for (size_t i = 0; i < helperCount; i++) {
+			spawn(name, takeRanges, &counter);
+		}
+		takeRanges();
+		wait(counter);
+	}
+
+	void JobSystem::runOnMainThread(std::function<void()> function)
+	{
+		std::lock_guard<std::mutex> lock(mMainThreadMutex);
+		mMainThreadJobs.push_back(std::move(function));
+	}
+
+	void JobSystem::processMainThreadJobs()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMainThreadMutex);
+			mRunningMainThreadJobs.swap(mMainThreadJobs);
+		}
+		// Jobs queued from here on run next frame.
+		for (auto& function : mRunningMainThreadJobs) {
+			function();
+		}
+		mRunningMainThreadJobs.clear();
+	}
+
+	std::vector<JobTrace> JobSystem::collectTraces()
+	{
+		std::vector<JobTrace> traces;
+		for (auto& buffer : mTraces) {
+			std::lock_guard<std::mutex> lock(buffer->mutex);
+			traces.insert(traces.end(), buffer->traces.begin(), buffer->traces.end());
+			buffer->traces.clear();
+		}
+		std::sort(traces.begin(), traces.end(), [](const JobTrace& a, const JobTrace& b) {
+			return a.start < b.start;
+		});
+		return traces;
+	}
+
+	void JobSystem::workerLoop(size_t worker)
+	{
+		sCurrentWorker.system = this;
+		sCurrentWorker.worker = worker;
+
+		int idleSpins = 0;
+		while (true) {
+			if (Job* job = findJob(worker)) {
+				execute(job, worker);
+				idleSpins = 0;
+				continue;
+			}
+			if (++idleSpins < IDLE_SPINS) {
+				std::this_thread::yield();
+				continue;
+			}
+			idleSpins = 0;
+
+			std::unique_lock<std::mutex> lock(mSleepMutex);
+			mSleeping.fetch_add(1);
+			mWake.wait(lock, [this] { return mStop || mQueuedJobs.load() > 0; });
+			mSleeping.fetch_sub(1);
+			if (mStop && mQueuedJobs.load() <= 0) {
+				return;
+			}
+		}
+	}
+
+	void JobSystem::enqueue(Job* job)
+	{
+		const size_t worker = getCurrentWorker();
+		// Nobody else would ever run it.
+		if (mThreads.empty()) {
+			execute(job, worker);
+			return;
+		}
+		if (worker >= mQueues.size() || !mQueues[worker]->push(job)) {
+			std::lock_guard<std::mutex> lock(mSharedMutex);
+			mShared.push_back(job);
+		}
+		mQueuedJobs.fetch_add(1);
+
+		// A worker checks the count under the lock before it sleeps, so it cannot miss this.
+		if (mSleeping.load() > 0) {
+			std::lock_guard<std::mutex> lock(mSleepMutex);
+			mWake.notify_one();
+		}
+	}
+
+	Job* JobSystem::findJob(size_t worker)
+	{
+		Job* job = nullptr;
+		if (worker < mQueues.size()) {
+			job = mQueues[worker]->pop();
+		}
+		if (!job) {
+			std::lock_guard<std::mutex> lock(mSharedMutex);
+			if (!mShared.empty()) {
+				job = mShared.front();
+				mShared.pop_front();
+			}
+		}
+		// Start after the own deque, so that thieves spread over the victims.
+		for (size_t i = 1; !job && i <= mQueues.size(); i++) {
+			job = mQueues[(worker + i) % mQueues.size()]->steal();
+		}
+
+		if (job) {
+			mQueuedJobs.fetch_sub(1);
+		}
+		return job;
+	}
+
+	Job* JobSystem::findJobOf(const JobCounter& counter)
+	{
+		Job* job = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mSharedMutex);
+			auto found = std::find_if(mShared.begin(), mShared.end(), [&counter](const Job* queued) {
+				return queued->counter == &counter;
+			});
+			if (found != mShared.end()) {
+				job = *found;
+				mShared.erase(found);
+			}
+		}
+		if (job) {
+			mQueuedJobs.fetch_sub(1);
+		}
+		return job;
+	}
+
+	void JobSystem::execute(Job* job, size_t worker)
+	{
+		const bool tracing = mTracing;
+		const auto start = tracing ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+		job->function();
+		if (tracing) {
+			const auto end = std::chrono::steady_clock::now();
+			TraceBuffer& buffer = *mTraces[std::min(worker, mQueues.size())];
+			std::lock_guard<std::mutex> lock(buffer.mutex);
+			buffer.traces.push_back({ job->name, worker < mQueues.size() ? static_cast<uint32_t>(worker + 1) : 0,
+				std::chrono::duration<float, std::milli>(start - mEpoch).count(), std::chrono::duration<float, std::milli>(end - mEpoch).count() });
+		}
+
+		if (JobCounter* counter = job->counter) {
+			finish(*counter);
+		}
+		delete job;
+	}
+
+	void JobSystem::finish(JobCounter& counter)
+	{
+		uint32_t count = counter.mCount.load(std::memory_order_relaxed);
+		while (count > 1 && !counter.mCount.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel)) {
+		}
+		if (count > 1) {
+			return;
+		}
+
+		// Reaching zero happens under the lock, and wait() takes the lock before it returns, so the counter
+		// is not destroyed while this still uses it.
+		std::vector<Job*> waiting;
+		{
+			std::lock_guard<std::mutex> lock(counter.mMutex);
+			if (counter.mCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				waiting.swap(counter.mWaiting);
+			}
+		}
+		for (Job* job : waiting) {
+			enqueue(job);
+		}
+	}
+
+	size_t JobSystem::getCurrentWorker() const
+	{
+		return sCurrentWorker.system == this ? sCurrentWorker.worker : mQueues.size();
+	}
+}
@@ -0,0 +1,148 @@
+#include <Utils/Lz4.h>
+#include <cstring>
+
+namespace ToyEngine {
+	namespace {
+		constexpr size_t MIN_MATCH = 4;
+		// The format wants the last 5 bytes as literals and no match starting in the last 12.
+		constexpr size_t LAST_LITERALS = 5;
+		constexpr size_t MATCH_FIND_LIMIT = 12;
+		constexpr size_t MAX_OFFSET = 65535;
+		constexpr int HASH_BITS = 16;
+
+		uint32_t read32(const uint8_t* data) {
+			uint32_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return value;
+		}
+
+		uint32_t hash(uint32_t sequence) {
+			return (sequence * 2654435761u) >> (32 - HASH_BITS);
+		}
+
+		// The part of a length that does not fit into the token's 4 bits.
+		void appendLength(std::vector<uint8_t>& out, size_t length) {
+			for (; length >= 255; length -= 255) {
+				out.push_back(255);
+			}
+			out.push_back(static_cast<uint8_t>(length));
+		}
+
+		bool readLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+			uint8_t byte;
+			do {
+				if (in == end) {
+					return false;
+				}
+				byte = *in++;
+				length += byte;
+			} while (byte == 255);
+			return true;
+		}
+
+		// Literals, then a match unless matchLength is 0, which only the last sequence has.
+		void appendSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength) {
+			const size_t matchCode = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+			out.push_back(static_cast<uint8_t>(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+			if (literalLength >= 15) {
+				appendLength(out, literalLength - 15);
+			}
+			out.insert(out.end(), literals, literals + literalLength);
+			if (matchLength == 0) {
+				return;
+			}
+			out.push_back(static_cast<uint8_t>(offset & 0xFF));
+			out.push_back(static_cast<uint8_t>(offset >> 8));
+			if (matchCode >= 15) {
+				appendLength(out, matchCode - 15);
+			}
+		}
+	}
+
+	std::vector<uint8_t> Lz4::compress(const uint8_t* data, size_t size)
+	{
+		std::vector<uint8_t> out;
+		out.reserve(getMaxCompressedSize(size));
+		size_t anchor = 0;
+		if (size > MATCH_FIND_LIMIT) {
+			// Positions plus one, 0 is empty.
+			std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+			const size_t matchEnd = size - LAST_LITERALS;
+			size_t position = 0;
+			while (position + MATCH_FIND_LIMIT < size) {
+				const uint32_t sequence = read32(data + position);
+				uint32_t& slot = table[hash(sequence)];
+				const size_t candidate = slot;
+				slot = static_cast<uint32_t>(position + 1);
+				if (candidate == 0 || position + 1 - candidate > MAX_OFFSET || read32(data + candidate - 1) != sequence) {
+					// Skip faster through data that does not compress.
+					position += 1 + ((position - anchor) >> 6);
+					continue;
+				}
+				const size_t match = candidate - 1;
+				size_t length = MIN_MATCH;
+				while (position + length < matchEnd && data[match + length] == data[position + length]) {
+					length++;
+				}
+				appendSequence(out, data + anchor, position - anchor, position - match, length);
+				position += length;
+				anchor = position;
+			}
+		}
+		appendSequence(out, data + anchor, size - anchor, 0, 0);
+		return out;
+	}
+
+	bool Lz4::decompress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t size)
+	{
+		const uint8_t* in = source;
+		const uint8_t* const inEnd = source + sourceSize;
+		uint8_t* out = destination;
+		uint8_t* const outEnd = destination + size;
+		while (in < inEnd) {
+			const uint8_t token = *in++;
+			size_t literalLength = token >> 4;
+			if (literalLength == 15 && !readLength(in, inEnd, literalLength)) {
+				return false;
+			}
+			if (literalLength > static_cast<size_t>(inEnd - in) || literalLength > static_cast<size_t>(outEnd - out)) {
+				return false;
+			}
+			if (literalLength > 0) {
+				std::memcpy(out, in, literalLength);
+			}
+			in += literalLength;
+			out += literalLength;
+			// The last sequence has no match.
+			if (in == inEnd) {
+				break;
+			}
+
+			if (inEnd - in < 2) {
+				return false;
+			}
+			const size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+			in += 2;
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !readLength(in, inEnd, matchLength)) {
+				return false;
+			}
+			matchLength += MIN_MATCH;
+			if (offset == 0 || offset > static_cast<size_t>(out - destination) || matchLength > static_cast<size_t>(outEnd - out)) {
+				return false;
+			}
+			const uint8_t* match = out - offset;
+			if (offset >= matchLength) {
+				std::memcpy(out, match, matchLength);
+				out += matchLength;
+			}
+			else {
+				// Overlapping, repeats the last offset bytes.
+				for (size_t i = 0; i < matchLength; i++) {
+					*out++ = match[i];
+				}
+			}
+		}
+		return in == inEnd && out == outEnd;
+	}
+}
@@ -0,0 +1,81 @@
+#include <Utils/MappedFile.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ToyEngine {
+	std::shared_ptr<MappedFile> MappedFile::open(const std::string& path, bool sequential)
+	{
+		std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+		const DWORD flags = FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : 0);
+		HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+		if (handle == INVALID_HANDLE_VALUE) {
+			return nullptr;
+		}
+		file->mFile = handle;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+			return nullptr;
+		}
+		file->mMapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!file->mMapping) {
+			return nullptr;
+		}
+		file->mData = static_cast<const uint8_t*>(MapViewOfFile(file->mMapping, FILE_MAP_READ, 0, 0, 0));
+		if (!file->mData) {
+			return nullptr;
+		}
+		file->mSize = static_cast<size_t>(size.QuadPart);
+#else
+		const int descriptor = ::open(path.c_str(), O_RDONLY);
+		if (descriptor < 0) {
+			return nullptr;
+		}
+		struct stat status;
+		if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+			::close(descriptor);
+			return nullptr;
+		}
+		// The mapping holds on to the file by itself.
+		void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+		::close(descriptor);
+		if (data == MAP_FAILED) {
+			return nullptr;
+		}
+		file->mData = static_cast<const uint8_t*>(data);
+		file->mSize = static_cast<size_t>(status.st_size);
+		if (sequential) {
+			posix_madvise(data, file->mSize, POSIX_MADV_SEQUENTIAL);
+		}
+#endif
+		return file;
+	}
+
+	MappedFile::~MappedFile()
+	{
+#ifdef _WIN32
+		if (mData) {
+			UnmapViewOfFile(mData);
+		}
+		if (mMapping) {
+			CloseHandle(mMapping);
+		}
+		if (mFile) {
+			CloseHandle(mFile);
+		}
+#else
+		if (mData) {
+			munmap(const_cast<uint8_t*>(mData), mSize);
+		}
+#endif
+	}
+}
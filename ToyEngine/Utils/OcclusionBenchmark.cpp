@@ -0,0 +1,115 @@
+#include <Utils/OcclusionBenchmark.h>
+#include <Renderer/OcclusionCuller.h>
+#include <Utils/JobSystem.h>
+#include <Utils/Logger.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace ToyEngine {
+	namespace {
+		constexpr size_t OCCLUDEES = 10000;
+		// 6 faces of 4x4 quads: 192 triangles per building, 15360 in all, within the default budget.
+		constexpr size_t BUILDINGS = 80;
+		constexpr int FACE_QUADS = 4;
+		constexpr int REPETITIONS = 20;
+
+		// Unit cube around the origin, counter clockwise seen from outside.
+		OccluderMesh buildCube() {
+			OccluderMesh mesh;
+			const glm::vec3 axes[6][3] = {
+				{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+				{ { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+				{ { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 0 } },
+				{ { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+				{ { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+				{ { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			};
+			for (const auto& [normal, u, v] : axes) {
+				const uint32_t first = static_cast<uint32_t>(mesh.positions.size());
+				for (int j = 0; j <= FACE_QUADS; j++) {
+					for (int i = 0; i <= FACE_QUADS; i++) {
+						mesh.positions.push_back(normal * 0.5f + u * (static_cast<float>(i) / FACE_QUADS - 0.5f) + v * (static_cast<float>(j) / FACE_QUADS - 0.5f));
+					}
+				}
+				for (int j = 0; j < FACE_QUADS; j++) {
+					for (int i = 0; i < FACE_QUADS; i++) {
+						const uint32_t corner = first + j * (FACE_QUADS + 1) + i;
+						const uint32_t quad[6] = { corner, corner + 1, corner + FACE_QUADS + 2, corner, corner + FACE_QUADS + 2, corner + FACE_QUADS + 1 };
+						mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+					}
+				}
+			}
+			mesh.exact = true;
+			return mesh;
+		}
+
+		std::string format(const char* pattern, double a, double b, double c) {
+			char text[160];
+			std::snprintf(text, sizeof(text), pattern, a, b, c);
+			return text;
+		}
+
+		void report(std::string& summary, const std::string& line) {
+			Logger::DEBUG_INFO(line);
+			summary += line + "\n";
+		}
+	}
+
+	std::string OcclusionBenchmark::run()
+	{
+		// Buildings along a street in front of the camera, small boxes scattered behind and between them.
+		const OccluderMesh cube = buildCube();
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::vector<glm::mat4> buildings;
+		for (size_t i = 0; i < BUILDINGS; i++) {
+			const float side = i % 2 == 0 ? -1.0f : 1.0f;
+			const glm::vec3 size(8.0f + 8.0f * unit(random), 10.0f + 30.0f * unit(random), 8.0f + 8.0f * unit(random));
+			const glm::vec3 center(side * (6.0f + size.x * 0.5f + 20.0f * unit(random)), size.y * 0.5f, -10.0f - 5.0f * static_cast<float>(i));
+			buildings.push_back(glm::scale(glm::translate(glm::mat4(1.0f), center), size));
+		}
+
+		OcclusionCuller culler;
+		const glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 500.0f)
+			* glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		auto fill = [&] {
+			culler.clear();
+			for (const glm::mat4& model : buildings) {
+				const size_t occludee = culler.addOccludee(glm::vec3(model * glm::vec4(-0.5f, -0.5f, -0.5f, 1.0f)), glm::vec3(model * glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)));
+				culler.addOccluder(occludee, cube, model, model[0][0] * model[1][1]);
+			}
+			std::mt19937 boxes(2);
+			while (culler.size() < OCCLUDEES) {
+				const glm::vec3 min(-60.0f + 120.0f * unit(boxes), 0.0f, -5.0f - 400.0f * unit(boxes));
+				culler.addOccludee(min, min + glm::vec3(1.0f + 2.0f * unit(boxes)));
+			}
+		};
+		fill();
+		const std::vector<uint8_t> frustumVisibility(culler.size(), 1);
+
+		std::string summary;
+		report(summary, "Occlusion benchmark, " + std::to_string(culler.size()) + " occludees and " + std::to_string(BUILDINGS) + " occluders on "
+			+ std::to_string(JobSystem::getInstance().getThreadCount() + 1) + " threads.");
+
+		// Best and average of the cull alone, refilled like the renderer does every frame.
+		double best = 0.0;
+		double total = 0.0;
+		for (int i = 0; i < REPETITIONS; i++) {
+			fill();
+			auto start = std::chrono::steady_clock::now();
+			culler.cull(viewProjection, frustumVisibility);
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best = i == 0 ? milliseconds : std::min(best, milliseconds);
+			total += milliseconds;
+		}
+		report(summary, format("Cull: %.3f ms best, %.3f ms average, %.0f occluder triangles", best, total / REPETITIONS,
+			static_cast<double>(culler.getRasterizedTriangleCount())));
+		report(summary, "Culled " + std::to_string(culler.getCulledCount()) + " of " + std::to_string(culler.size()) + " occludees.");
+		return summary;
+	}
+}
@@ -0,0 +1,261 @@
+#include <Utils/PackArchive.h>
+#include <Utils/Logger.h>
+#include <Utils/Lz4.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+namespace ToyEngine {
+	namespace {
+		// "TPAK"
+		constexpr uint32_t MAGIC = 0x4B415054;
+		constexpr uint32_t COMPRESSION_NONE = 0;
+		constexpr uint32_t COMPRESSION_LZ4 = 1;
+		// LZ4 cannot expand data further than this, a larger size means a damaged entry.
+		constexpr uint64_t MAX_LZ4_RATIO = 256;
+
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t entryCount;
+			uint64_t index;
+			uint64_t strings;
+			uint64_t stringsSize;
+		};
+
+		size_t alignUp(size_t value, size_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		bool isInside(const MappedFile& file, uint64_t offset, uint64_t size) {
+			return offset <= file.getSize() && size <= file.getSize() - offset;
+		}
+	}
+
+	struct PackArchive::Entry {
+		uint64_t hash;
+		uint64_t offset;
+		// in the archive, and once decompressed
+		uint64_t storedSize;
+		uint64_t size;
+		// of the packed file, see FileStatus
+		int64_t modifiedTime;
+		// in the string table
+		uint32_t pathOffset;
+		uint32_t pathLength;
+		uint32_t compression;
+		uint32_t padding;
+	};
+
+	std::shared_ptr<PackArchive> PackArchive::open(const std::string& archivePath)
+	{
+		// Most of the archive is read at startup, in the order it was packed in.
+		std::shared_ptr<MappedFile> file = MappedFile::open(archivePath, true);
+		if (!file || file->getSize() < sizeof(Header)) {
+			return nullptr;
+		}
+		Header header;
+		std::memcpy(&header, file->getData(), sizeof(header));
+		if (header.magic != MAGIC || header.version != VERSION || header.entryCount > file->getSize() / sizeof(Entry)
+			|| header.index % alignof(Entry) != 0 || !isInside(*file, header.index, header.entryCount * sizeof(Entry))
+			|| !isInside(*file, header.strings, header.stringsSize)) {
+			return nullptr;
+		}
+
+		const Entry* entries = reinterpret_cast<const Entry*>(file->getData() + header.index);
+		for (uint64_t i = 0; i < header.entryCount; i++) {
+			const Entry& entry = entries[i];
+			if (!isInside(*file, entry.offset, entry.storedSize) || static_cast<uint64_t>(entry.pathOffset) + entry.pathLength > header.stringsSize
+				|| (i > 0 && entries[i - 1].hash > entry.hash)) {
+				return nullptr;
+			}
+			const bool validSize = entry.compression == COMPRESSION_NONE ? entry.size == entry.storedSize
+				: entry.compression == COMPRESSION_LZ4 && entry.size <= entry.storedSize * MAX_LZ4_RATIO;
+			if (!validSize) {
+				return nullptr;
+			}
+		}
+
+		std::shared_ptr<PackArchive> archive(new PackArchive());
+		archive->mEntries = entries;
+		archive->mEntryCount = static_cast<size_t>(header.entryCount);
+		archive->mStrings = reinterpret_cast<const char*>(file->getData() + header.strings);
+		archive->mStringsSize = static_cast<size_t>(header.stringsSize);
+		archive->mFile = std::move(file);
+		return archive;
+	}
+
+	bool PackArchive::write(const std::string& archivePath, const std::vector<Source>& sources, Statistics* statistics)
+	{
+		std::vector<Entry> entries(sources.size());
+		std::string strings;
+		for (size_t i = 0; i < sources.size(); i++) {
+			entries[i] = {};
+			entries[i].hash = hashPath(sources[i].path);
+			entries[i].pathOffset = static_cast<uint32_t>(strings.size());
+			entries[i].pathLength = static_cast<uint32_t>(sources[i].path.size());
+			strings += sources[i].path;
+		}
+		Header header = {};
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.entryCount = entries.size();
+		header.index = alignUp(sizeof(Header), ALIGNMENT);
+		header.strings = header.index + entries.size() * sizeof(Entry);
+		header.stringsSize = strings.size();
+		uint64_t offset = alignUp(static_cast<size_t>(header.strings + header.stringsSize), ALIGNMENT);
+
+		Statistics written;
+		written.entryCount = entries.size();
+		const std::string temporaryPath = archivePath + ".tmp";
+		std::error_code error;
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			// The header and the index go in last, once the entries are known.
+			const std::vector<char> zeros(static_cast<size_t>(offset));
+			file.write(zeros.data(), static_cast<std::streamsize>(zeros.size()));
+
+			for (size_t i = 0; i < sources.size() && file; i++) {
+				const Source& source = sources[i];
+				std::shared_ptr<MappedFile> mapped = MappedFile::open(source.diskPath);
+				// Empty files cannot be mapped.
+				if (!mapped && !(std::filesystem::is_regular_file(source.diskPath, error) && std::filesystem::file_size(source.diskPath, error) == 0)) {
+					Logger::DEBUG_ERROR("Cannot read " + source.diskPath + " into the archive " + archivePath);
+					file.close();
+					std::filesystem::remove(temporaryPath, error);
+					return false;
+				}
+				const uint8_t* data = mapped ? mapped->getData() : nullptr;
+				const size_t size = mapped ? mapped->getSize() : 0;
+
+				Entry& entry = entries[i];
+				entry.offset = offset;
+				entry.modifiedTime = static_cast<int64_t>(std::filesystem::last_write_time(source.diskPath, error).time_since_epoch().count());
+				entry.size = size;
+				entry.storedSize = size;
+				std::vector<uint8_t> compressed;
+				if (source.compress && size > 0) {
+					compressed = Lz4::compress(data, size);
+					if (compressed.size() + size / 8 <= size) {
+						entry.compression = COMPRESSION_LZ4;
+						entry.storedSize = compressed.size();
+						data = compressed.data();
+						written.compressedCount++;
+					}
+				}
+				file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(entry.storedSize));
+				offset = alignUp(static_cast<size_t>(offset + entry.storedSize), ALIGNMENT);
+				file.write(zeros.data(), static_cast<std::streamsize>(offset - entry.offset - entry.storedSize));
+				written.fileBytes += size;
+			}
+
+			std::sort(entries.begin(), entries.end(), [&strings](const Entry& a, const Entry& b) {
+				if (a.hash != b.hash) {
+					return a.hash < b.hash;
+				}
+				return strings.compare(a.pathOffset, a.pathLength, strings, b.pathOffset, b.pathLength) < 0;
+			});
+			for (size_t i = 1; i < entries.size(); i++) {
+				const Entry& previous = entries[i - 1];
+				const Entry& entry = entries[i];
+				if (previous.hash == entry.hash && strings.compare(previous.pathOffset, previous.pathLength, strings, entry.pathOffset, entry.pathLength) == 0) {
+					Logger::DEBUG_ERROR("The archive " + archivePath + " would hold " + strings.substr(entry.pathOffset, entry.pathLength) + " twice.");
+					file.close();
+					std::filesystem::remove(temporaryPath, error);
+					return false;
+				}
+			}
+
+			file.seekp(static_cast<std::streamoff>(header.index));
+			file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(Entry)));
+			file.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+			file.seekp(0);
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			if (!file) {
+				file.close();
+				std::filesystem::remove(temporaryPath, error);
+				return false;
+			}
+		}
+		std::filesystem::rename(temporaryPath, archivePath, error);
+		if (error) {
+			Logger::DEBUG_ERROR("Cannot replace " + archivePath + ": " + error.message());
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+		written.archiveBytes = offset;
+		if (statistics) {
+			*statistics = written;
+		}
+		return true;
+	}
+
+	uint64_t PackArchive::hashPath(const std::string& path)
+	{
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ull;
+		for (char c : path) {
+			hash ^= static_cast<uint8_t>(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool PackArchive::contains(const std::string& path) const
+	{
+		return find(path) != nullptr;
+	}
+
+	FileStatus PackArchive::getStatus(const std::string& path) const
+	{
+		FileStatus status;
+		if (const Entry* entry = find(path)) {
+			status.exists = true;
+			status.size = entry->size;
+			status.modifiedTime = entry->modifiedTime;
+		}
+		return status;
+	}
+
+	FileData PackArchive::read(const std::string& path) const
+	{
+		const Entry* entry = find(path);
+		if (!entry) {
+			return FileData();
+		}
+		const uint8_t* stored = mFile->getData() + entry->offset;
+		FileData file;
+		if (entry->compression == COMPRESSION_NONE) {
+			file.data = stored;
+			file.size = static_cast<size_t>(entry->size);
+			file.owner = mFile;
+			return file;
+		}
+		auto bytes = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(entry->size));
+		if (!Lz4::decompress(stored, static_cast<size_t>(entry->storedSize), bytes->data(), bytes->size())) {
+			Logger::DEBUG_ERROR("The archived file " + path + " is damaged.");
+			return FileData();
+		}
+		file.data = bytes->data();
+		file.size = bytes->size();
+		file.owner = std::move(bytes);
+		return file;
+	}
+
+	const PackArchive::Entry* PackArchive::find(const std::string& path) const
+	{
+		const uint64_t hash = hashPath(path);
+		const Entry* end = mEntries + mEntryCount;
+		const Entry* entry = std::lower_bound(mEntries, end, hash, [](const Entry& entry, uint64_t hash) {
+			return entry.hash < hash;
+		});
+		for (; entry != end && entry->hash == hash; entry++) {
+			if (entry->pathLength == path.size() && std::memcmp(mStrings + entry->pathOffset, path.data(), path.size()) == 0) {
+				return entry;
+			}
+		}
+		return nullptr;
+	}
+}
@@ -0,0 +1,117 @@
+#include <Utils/TextureCompressionBenchmark.h>
+#include <Utils/JobSystem.h>
+#include <Utils/Logger.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace ToyEngine {
+	namespace {
+		constexpr int IMAGE_SIZE = 1024;
+		constexpr int REPETITIONS = 3;
+		const char* FORMAT_NAMES[] = { "BC1", "BC3", "BC5", "BC7" };
+		const char* QUALITY_NAMES[] = { "fast", "normal", "high" };
+
+		// Best of a few runs, in milliseconds.
+		template<typename Function>
+		double measure(Function&& function) {
+			double best = 0.0;
+			for (int i = 0; i < REPETITIONS; i++) {
+				auto start = std::chrono::steady_clock::now();
+				function();
+				double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				best = i == 0 ? milliseconds : std::min(best, milliseconds);
+			}
+			return best;
+		}
+
+		// Smooth gradients with edges and noise, roughly what a photographed texture has in its blocks.
+		std::vector<uint8_t> generateImage() {
+			std::vector<uint8_t> rgba(static_cast<size_t>(IMAGE_SIZE) * IMAGE_SIZE * 4);
+			std::mt19937 random(1);
+			std::uniform_int_distribution<int> noise(-12, 12);
+			for (int y = 0; y < IMAGE_SIZE; y++) {
+				for (int x = 0; x < IMAGE_SIZE; x++) {
+					const float wave = std::sin(x * 0.02f) * std::cos(y * 0.015f);
+					const int stripe = ((x / 37 + y / 53) % 3) * 40;
+					const int values[4] = {
+						static_cast<int>(128 + 100 * wave) + stripe,
+						x * 255 / IMAGE_SIZE,
+						y * 255 / IMAGE_SIZE - stripe,
+						static_cast<int>(200 + 55 * std::sin((x + y) * 0.01f))
+					};
+					uint8_t* texel = &rgba[(static_cast<size_t>(y) * IMAGE_SIZE + x) * 4];
+					for (int channel = 0; channel < 4; channel++) {
+						texel[channel] = static_cast<uint8_t>(std::min(std::max(values[channel] + noise(random), 0), 255));
+					}
+				}
+			}
+			return rgba;
+		}
+
+		// Over the channels the format keeps.
+		double computePsnr(const std::vector<uint8_t>& original, const std::vector<uint8_t>& decoded, BcFormat format) {
+			const int channels = format == BcFormat::BC1 ? 3 : format == BcFormat::BC5 ? 2 : 4;
+			double squaredError = 0.0;
+			for (size_t texel = 0; texel < original.size() / 4; texel++) {
+				for (int channel = 0; channel < channels; channel++) {
+					const double delta = static_cast<double>(original[texel * 4 + channel]) - decoded[texel * 4 + channel];
+					squaredError += delta * delta;
+				}
+			}
+			const double meanSquaredError = squaredError / (original.size() / 4 * channels);
+			return meanSquaredError == 0.0 ? INFINITY : 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+		}
+
+		std::string describe(const char* pattern, const char* a, const char* b, double c, double d, double e, double f) {
+			char text[160];
+			std::snprintf(text, sizeof(text), pattern, a, b, c, d, e, f);
+			return text;
+		}
+
+		void report(std::string& summary, const std::string& line) {
+			Logger::DEBUG_INFO(line);
+			summary += line + "\n";
+		}
+	}
+
+	std::string TextureCompressionBenchmark::run()
+	{
+		std::string summary;
+		report(summary, "Texture compression benchmark on a " + std::to_string(IMAGE_SIZE) + "x" + std::to_string(IMAGE_SIZE)
+			+ " image, " + std::to_string(std::thread::hardware_concurrency()) + " hardware threads.");
+		const std::vector<uint8_t> rgba = generateImage();
+		for (BcFormat format : { BcFormat::BC1, BcFormat::BC3, BcFormat::BC5, BcFormat::BC7 }) {
+			for (BcQuality quality : { BcQuality::Fast, BcQuality::Normal, BcQuality::High }) {
+				measureFormat(rgba, format, quality, summary);
+			}
+		}
+		return summary;
+	}
+
+	void TextureCompressionBenchmark::measureFormat(const std::vector<uint8_t>& rgba, BcFormat format, BcQuality quality, std::string& summary)
+	{
+		std::vector<uint8_t> blocks;
+		JobSystem serialJobs(0);
+		const double serialMilliseconds = measure([&] {
+			blocks = BcEncoder::encode(rgba.data(), IMAGE_SIZE, IMAGE_SIZE, format, quality, serialJobs);
+		});
+		// The waiting thread works too.
+		JobSystem parallelJobs(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+		const double parallelMilliseconds = measure([&] {
+			blocks = BcEncoder::encode(rgba.data(), IMAGE_SIZE, IMAGE_SIZE, format, quality, parallelJobs);
+		});
+
+		std::vector<uint8_t> decoded;
+		BcEncoder::decode(blocks.data(), IMAGE_SIZE, IMAGE_SIZE, format, decoded);
+		const double megapixels = static_cast<double>(IMAGE_SIZE) * IMAGE_SIZE / 1e6;
+		report(summary, describe("%s %s: %.1f MPix/s on 1 thread, %.1f MPix/s on %.0f threads, PSNR %.2f dB",
+			FORMAT_NAMES[static_cast<int>(format)], QUALITY_NAMES[static_cast<int>(quality)], megapixels * 1000.0 / serialMilliseconds,
+			megapixels * 1000.0 / parallelMilliseconds, static_cast<double>(std::max(std::thread::hardware_concurrency(), 1u)),
+			computePsnr(rgba, decoded, format)));
+	}
+}
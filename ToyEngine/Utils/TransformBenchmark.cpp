@@ -0,0 +1,111 @@
+#include <Utils/TransformBenchmark.h>
+#include <Engine/Component.h>
+#include <Engine/TransformSystem.h>
+#include <Utils/JobSystem.h>
+#include <Utils/Logger.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace ToyEngine {
+	namespace {
+		// 16 roots with 16 children each, five levels deep: 1118480 transforms.
+		constexpr size_t ROOTS = 16;
+		constexpr size_t CHILDREN = 16;
+		constexpr size_t LEVELS = 5;
+		constexpr int REPETITIONS = 5;
+
+		// Best of a few updates after prepare() in milliseconds, prepare is not timed.
+		template<typename Prepare>
+		double measure(entt::registry& registry, TransformSystem& transforms, Prepare&& prepare) {
+			double best = 0.0;
+			for (int i = 0; i < REPETITIONS; i++) {
+				prepare(i);
+				auto start = std::chrono::steady_clock::now();
+				transforms.update(registry, [](entt::entity) {});
+				double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				best = i == 0 ? milliseconds : std::min(best, milliseconds);
+			}
+			return best;
+		}
+
+		void move(entt::registry& registry, const std::vector<entt::entity>& entities, int repetition) {
+			const glm::vec3 offset(0.01f * (repetition + 1), 0.0f, 0.0f);
+			for (entt::entity entity : entities) {
+				registry.patch<TransformComponent>(entity, [&offset](TransformComponent& transform) {
+					transform.setLocalPosition(transform.localPos + offset);
+				});
+			}
+		}
+
+		std::string format(const char* pattern, double a, double b) {
+			char text[128];
+			std::snprintf(text, sizeof(text), pattern, a, b);
+			return text;
+		}
+
+		void report(std::string& summary, const std::string& line) {
+			Logger::DEBUG_INFO(line);
+			summary += line + "\n";
+		}
+	}
+
+	std::string TransformBenchmark::run()
+	{
+		entt::registry registry;
+		TransformSystem transforms;
+		transforms.init(registry);
+
+		std::vector<entt::entity> all;
+		std::vector<entt::entity> roots;
+		std::vector<entt::entity> level;
+		std::vector<entt::entity> nextLevel;
+		for (size_t i = 0; i < ROOTS; i++) {
+			entt::entity entity = registry.create();
+			registry.emplace<TransformComponent>(entity, glm::vec3(static_cast<float>(i), 0.0f, 0.0f), glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(1.0f));
+			roots.push_back(entity);
+		}
+		level = roots;
+		all = roots;
+		for (size_t depth = 1; depth < LEVELS; depth++) {
+			nextLevel.clear();
+			for (entt::entity parent : level) {
+				for (size_t i = 0; i < CHILDREN; i++) {
+					entt::entity entity = registry.create();
+					registry.emplace<TransformComponent>(entity, glm::vec3(0.0f, 1.0f, static_cast<float>(i)), glm::vec3(5.0f, 0.0f, 0.0f), glm::vec3(0.9f));
+					registry.emplace<RelationComponent>(entity, parent, std::list<entt::entity>());
+					nextLevel.push_back(entity);
+				}
+			}
+			all.insert(all.end(), nextLevel.begin(), nextLevel.end());
+			std::swap(level, nextLevel);
+		}
+
+		std::string summary;
+		report(summary, "Transform benchmark, " + std::to_string(all.size()) + " transforms in " + std::to_string(LEVELS) + " levels on "
+			+ std::to_string(JobSystem::getInstance().getThreadCount() + 1) + " threads.");
+
+		auto start = std::chrono::steady_clock::now();
+		transforms.update(registry, [](entt::entity) {});
+		report(summary, format("Sort and first update: %.2f ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), 0.0));
+
+		const double allMoved = measure(registry, transforms, [&](int repetition) {
+			move(registry, all, repetition);
+		});
+		report(summary, format("All moved: %.2f ms, %.1f ns per transform", allMoved, allMoved * 1e6 / all.size()));
+
+		// Everything below them changes too.
+		const double rootsMoved = measure(registry, transforms, [&](int repetition) {
+			move(registry, roots, repetition);
+		});
+		report(summary, format("Roots moved: %.2f ms, %.1f ns per transform", rootsMoved, rootsMoved * 1e6 / all.size()));
+
+		const double leavesMoved = measure(registry, transforms, [&](int repetition) {
+			move(registry, std::vector<entt::entity>(level.begin(), level.begin() + level.size() / 100), repetition);
+		});
+		report(summary, format("1%% of the leaves moved: %.2f ms (%.0f updated)", leavesMoved, static_cast<double>(transforms.getLastUpdateCount())));
+		return summary;
+	}
+}
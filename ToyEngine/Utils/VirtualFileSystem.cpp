@@ -0,0 +1,130 @@
+#include <Utils/VirtualFileSystem.h>
+#include <Utils/Logger.h>
+#include <Utils/MappedFile.h>
+#include <filesystem>
+#include <system_error>
+
+namespace ToyEngine {
+	VirtualFileSystem& VirtualFileSystem::getInstance()
+	{
+		static VirtualFileSystem instance;
+		return instance;
+	}
+
+	bool VirtualFileSystem::mount(const std::string& archivePath)
+	{
+		std::error_code error;
+		if (!std::filesystem::exists(archivePath, error)) {
+			return false;
+		}
+		std::shared_ptr<PackArchive> archive = PackArchive::open(archivePath);
+		if (!archive) {
+			Logger::DEBUG_WARNING(archivePath + " is not a valid pack archive.");
+			return false;
+		}
+		Logger::DEBUG_INFO("Mounted " + archivePath + " with " + std::to_string(archive->getEntryCount()) + " files.");
+		mArchives.insert(mArchives.begin(), std::move(archive));
+		return true;
+	}
+
+	FileData VirtualFileSystem::read(const std::string& path) const
+	{
+		const PackedFile packed = findPacked(path);
+		if (packed.archive) {
+			return packed.archive->read(packed.name);
+		}
+		return mLooseFilesEnabled ? readLooseFile(path) : FileData();
+	}
+
+	bool VirtualFileSystem::exists(const std::string& path) const
+	{
+		return getStatus(path).exists;
+	}
+
+	FileStatus VirtualFileSystem::getStatus(const std::string& path) const
+	{
+		const PackedFile packed = findPacked(path);
+		if (packed.archive) {
+			return packed.status;
+		}
+		return mLooseFilesEnabled ? getLooseStatus(path) : FileStatus();
+	}
+
+	bool VirtualFileSystem::isPacked(const std::string& path) const
+	{
+		return findPacked(path).archive != nullptr;
+	}
+
+	std::string VirtualFileSystem::normalize(const std::string& path)
+	{
+		// Backslashes are only separators on Windows, packed names always use forward slashes.
+		std::string name = path;
+		for (char& c : name) {
+			if (c == '\\') {
+				c = '/';
+			}
+		}
+		std::filesystem::path normalized = std::filesystem::path(name).lexically_normal();
+		if (normalized.is_absolute()) {
+			std::error_code error;
+			const std::filesystem::path relative = normalized.lexically_relative(std::filesystem::current_path(error));
+			if (!error && !relative.empty() && *relative.begin() != "..") {
+				normalized = relative;
+			}
+		}
+		return normalized.generic_string();
+	}
+
+	VirtualFileSystem::PackedFile VirtualFileSystem::findPacked(const std::string& path) const
+	{
+		PackedFile packed;
+		if (mArchives.empty()) {
+			return packed;
+		}
+		packed.name = normalize(path);
+		for (const auto& archive : mArchives) {
+			packed.status = archive->getStatus(packed.name);
+			if (packed.status.exists) {
+				// Only a stat, and shipped builds turn loose files off.
+				if (mLooseFilesEnabled) {
+					const FileStatus loose = getLooseStatus(path);
+					if (loose.exists && loose.modifiedTime > packed.status.modifiedTime) {
+						return PackedFile();
+					}
+				}
+				packed.archive = archive.get();
+				return packed;
+			}
+		}
+		return PackedFile();
+	}
+
+	FileStatus VirtualFileSystem::getLooseStatus(const std::string& path)
+	{
+		FileStatus status;
+		std::error_code error;
+		if (std::filesystem::is_regular_file(path, error)) {
+			status.size = std::filesystem::file_size(path, error);
+			status.modifiedTime = static_cast<int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+			status.exists = !error;
+		}
+		return status;
+	}
+
+	FileData VirtualFileSystem::readLooseFile(const std::string& path)
+	{
+		FileData file;
+		if (std::shared_ptr<MappedFile> mapped = MappedFile::open(path)) {
+			file.data = mapped->getData();
+			file.size = mapped->getSize();
+			file.owner = std::move(mapped);
+			return file;
+		}
+		// Empty files cannot be mapped, but they exist.
+		std::error_code error;
+		if (std::filesystem::is_regular_file(path, error)) {
+			file.owner = std::make_shared<std::vector<uint8_t>>();
+		}
+		return file;
+	}
+}
@@ -3,158 +3,309 @@
 #include <string>
 #include <vector>
 #include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glad/glad.h>
 #include <entt/entity/registry.hpp>
 #include <stdexcept>
 #include <Resource/Texture.h>
 #include <Renderer/Shader.h>
+#include <Renderer/GLStateCache.h>
+#include <Renderer/Vertex.h>
+#include <Renderer/GeometryPool.h>
+#include <Renderer/MeshSimplifier.h>
 #include <Utils/Logger.h>
 #include <list>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 namespace ToyEngine {
-    #define MAX_BONE_INFLUENCE 4
-
-    struct Vertex {
-        glm::vec3 Position;
-        glm::vec3 Normal;
-        glm::vec2 TexCoords;
-        glm::vec3 Tangent;
-        // bitangent
-        glm::vec3 Bitangent;
-        //bone indexes which will influence this vertex
-        int mBoneIDs[MAX_BONE_INFLUENCE];
-        //weights from each bone
-        float mWeights[MAX_BONE_INFLUENCE];
+    struct OccluderMesh;
+
+    // Local space bounds of a mesh, computed once from its vertices at import.
+    struct BoundsComponent {
+        glm::vec3 min = glm::vec3(0.0f);
+        glm::vec3 max = glm::vec3(0.0f);
+        // sphere around the box center, tighter than the box's half diagonal
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+
+        BoundsComponent() = default;
+
+        BoundsComponent(const std::vector<Vertex>& vertices) {
+            if (vertices.empty()) {
+                return;
+            }
+            min = max = vertices[0].Position;
+            for (const auto& vertex : vertices) {
+                min = glm::min(min, vertex.Position);
+                max = glm::max(max, vertex.Position);
+            }
+            center = (min + max) * 0.5f;
+            float radiusSquared = 0.0f;
+            for (const auto& vertex : vertices) {
+                glm::vec3 offset = vertex.Position - center;
+                radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+            }
+            radius = std::sqrt(radiusSquared);
+        }
     };
 
-    struct MeshComponent {
-        GLuint VBOIndex;
-        GLuint VAOIndex;
-        GLuint EBOIndex;
+    // Everything a MeshGeometry needs that does not touch GL, so that it can be prepared on a worker thread.
+    // The constructor only encodes the vertices. The levels of detail and the occluder are import steps of
+    // their own, see ModelLoader::convertMesh.
+    struct MeshGeometryData {
+        const VertexLayout* layout = nullptr;
+        GLenum indexType = GL_UNSIGNED_INT;
+        // encoded with layout
+        std::vector<uint8_t> vertexData;
+        std::vector<unsigned int> indices;
+        // levels 1 and up
+        std::vector<LodIndices> lods;
+        size_t vertexCount = 0;
+        BoundsComponent bounds;
+        glm::vec4 dequantization = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        std::shared_ptr<const OccluderMesh> occluder;
+        // Index count of every level when the data was loaded cooked, see ModelCooker. The vertices and
+        // indices then only exist packed in the cooked file, and vertexData and the index vectors are empty.
+        std::vector<size_t> packedIndexCounts;
+
+        MeshGeometryData() = default;
+
+        MeshGeometryData(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indicesInput,
+            PositionFormat positionFormat = PositionFormat::Snorm16, bool skinned = false) :
+            layout(&VertexLayout::select(positionFormat, skinned, vertices)), indexType(GeometryPool::selectIndexType(vertices.size())),
+            indices(indicesInput), vertexCount(vertices.size()), bounds(vertices) {
+            dequantization = layout->computeDequantization(bounds.min, bounds.max);
+            vertexData = layout->encode(vertices, dequantization);
+        }
 
-        std::shared_ptr<Shader> shader;
+        // Level 0 is indices, the others are lods.
+        size_t getIndexCount(size_t level) const {
+            if (!packedIndexCounts.empty()) {
+                return packedIndexCounts[level];
+            }
+            return level == 0 ? indices.size() : lods[level - 1].indices.size();
+        }
+
+        size_t getVertexBytes() const {
+            return vertexCount * layout->getStride();
+        }
+
+        // The vertices followed by the indices of every level in indexType, for GeometryPool::allocateFrom.
+        std::vector<uint8_t> pack() const {
+            const size_t indexSize = GeometryPool::getIndexSize(indexType);
+            size_t indexCount = indices.size();
+            for (const auto& lod : lods) {
+                indexCount += lod.indices.size();
+            }
+            std::vector<uint8_t> packed(vertexData.size() + indexCount * indexSize);
+            std::copy(vertexData.begin(), vertexData.end(), packed.begin());
+            uint8_t* out = packed.data() + vertexData.size();
+            auto append = [&](const std::vector<unsigned int>& levelIndices) {
+                if (indexSize == sizeof(uint16_t)) {
+                    for (unsigned int index : levelIndices) {
+                        const uint16_t shortIndex = static_cast<uint16_t>(index);
+                        std::memcpy(out, &shortIndex, sizeof(shortIndex));
+                        out += sizeof(shortIndex);
+                    }
+                }
+                else {
+                    std::memcpy(out, levelIndices.data(), levelIndices.size() * sizeof(unsigned int));
+                    out += levelIndices.size() * sizeof(unsigned int);
+                }
+            };
+            append(indices);
+            for (const auto& lod : lods) {
+                append(lod.indices);
+            }
+            return packed;
+        }
+    };
+
+    // GPU side of a mesh: its range in the geometry pool. Shared between every entity that places
+    // the same mesh, so that they can be drawn with one instanced call.
+    struct MeshGeometry {
+        GLuint VAOIndex = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+        GeometryPool* pool = nullptr;
+        GeometryRange range;
+        // Finest first. lods[0] is range itself.
+        std::vector<MeshLod> lods;
 
         size_t vertexSize = 0;
+        GLsizei indexCount = 0;
+
+        BoundsComponent bounds;
+        // xyz offset and w scale from the stored positions to mesh space, see VertexLayout.
+        glm::vec4 dequantization = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+        // Simplified copy kept on the CPU for occlusion culling.
+        std::shared_ptr<const OccluderMesh> occluder;
+
+        MeshGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+            PositionFormat positionFormat = PositionFormat::Snorm16, bool skinned = false) :
+            MeshGeometry(MeshGeometryData(vertices, indices, positionFormat, skinned)) {
+        }
+
+        // Only the upload, which has to happen on the thread owning the GL context. With packed, a buffer
+        // holding data.pack(), the pool copies from it on the GPU instead. Cooked data always needs packed.
+        explicit MeshGeometry(const MeshGeometryData& data, GLuint packed = 0) :
+            bounds(data.bounds), dequantization(data.dequantization), occluder(data.occluder) {
+            pool = &GeometryPool::getInstance(*data.layout, data.indexType);
+            const size_t indexSize = GeometryPool::getIndexSize(data.indexType);
+            size_t indexOffset = data.getVertexBytes();
+            if (packed != 0) {
+                range = pool->allocateFrom(packed, 0, data.vertexCount, indexOffset, data.getIndexCount(0));
+            }
+            else {
+                range = pool->allocate(data.vertexData, data.indices);
+            }
+            indexOffset += data.getIndexCount(0) * indexSize;
+            if (!range.isValid()) {
+                Logger::DEBUG_ERROR("Something went wrong when creating Mesh Geometry!!!");
+            }
+            VAOIndex = pool->getVAOIndex();
+            indexType = pool->getIndexType();
+            vertexSize = data.vertexCount;
+            indexCount = range.indexCount;
+
+            lods.push_back({ range, 0.0f });
+            if (range.isValid()) {
+                for (size_t level = 1; level <= data.lods.size(); level++) {
+                    const LodIndices& lod = data.lods[level - 1];
+                    const size_t lodIndexCount = data.getIndexCount(level);
+                    GeometryRange lodRange = packed != 0 ? pool->allocateIndicesFrom(range, packed, indexOffset, lodIndexCount)
+                        : pool->allocateIndices(range, lod.indices);
+                    lods.push_back({ lodRange, lod.error });
+                    indexOffset += lodIndexCount * indexSize;
+                }
+            }
+        }
+
+        MeshGeometry(const MeshGeometry&) = delete;
+        MeshGeometry& operator=(const MeshGeometry&) = delete;
+
+        ~MeshGeometry() {
+            for (size_t i = 1; i < lods.size(); i++) {
+                pool->releaseIndices(lods[i].range);
+            }
+            pool->release(range);
+        }
+
+        // The coarsest level whose error stays below maxError, which is in mesh units.
+        size_t selectLod(float maxError) const {
+            size_t level = 0;
+            while (level + 1 < lods.size() && lods[level + 1].error <= maxError) {
+                level++;
+            }
+            return level;
+        }
+    };
+
+    struct MeshComponent {
+        std::shared_ptr<MeshGeometry> geometry;
+
+        std::shared_ptr<Shader> shader;
 
         bool hasNormal = false;
         bool hasTexture = false;
 
+        // Always rasterized for occlusion culling when on screen, even with a simplified occluder, so only
+        // meant for solid meshes. Other meshes only occlude when they are large on screen and small enough
+        // to be rasterized as they are.
+        bool occluder = false;
+
         // Vertex data includes coordinate, normal and 
-        MeshComponent(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, std::shared_ptr<Shader> shaderInput, bool hasNormal = true, bool hasTexture = true) :shader(shaderInput), hasNormal(hasNormal), hasTexture(hasTexture) {
-            try {
-                //if (!hasNormal || !hasTexture) {
-               //    throw std::invalid_argument("vertex data without texture or normal is not support currrently");
-               //}
-
-                vertexSize = vertices.size();
-
-                // generate 1 Vertex Array Object
-                // Used to remember subsequent vertex attribute calls.
-                // Stores:
-                // 1. Calls to glEnableVertexAttribArray or glDisableVertexAttribArray.
-                // 2. Vertex attribute configurations via glVertexAttribPointer.
-                // 3. Vertex buffer objects associated with vertex attributes by calls to glVertexAttribPointer.
-                // 4. The last EBO that gets bound while a VAO is bound.
-                glGenVertexArrays(1, &VAOIndex);
-
-                // generate 1 Vertex Buffer Object
-                // VBO stores a large number of vertices in the GPU's memory.
-                glGenBuffers(1, &VBOIndex);
-
-                // EBO stores indices that OpenGL uses to decide what vertices to draw.
-                glGenBuffers(1, &EBOIndex);
-
-                // Any subsequent vertex attribute calls from this on will be stored inside the VAO
-                glBindVertexArray(VAOIndex);
-
-                glBindBuffer(GL_ARRAY_BUFFER, VBOIndex);
-                glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
-
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBOIndex);
-                glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), &indices[0], GL_STATIC_DRAW);
-
-                // Vertex position
-                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
-                glEnableVertexAttribArray(0);
-                //Vertex normal
-                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-                glEnableVertexAttribArray(1);
-                //vertex texture coords
-                glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-                glEnableVertexAttribArray(2);
-                //vertex tangent
-                glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-                glEnableVertexAttribArray(3);
-                //vertex bitangent
-                glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-                glEnableVertexAttribArray(4);
-                // ids
-                glEnableVertexAttribArray(5);
-                glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, mBoneIDs));
-
-                // weights
-                glEnableVertexAttribArray(6);
-                glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, mWeights));
-                glBindVertexArray(0);
-
-                glBindBuffer(GL_ARRAY_BUFFER, 0);
-            }
-            catch (...) {
-                Logger::DEBUG_ERROR("Something went wrong when creating Mesh Component!!!");
-            }
+        MeshComponent(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, std::shared_ptr<Shader> shaderInput, bool hasNormal = true, bool hasTexture = true) :
+            MeshComponent(std::make_shared<MeshGeometry>(vertices, indices), shaderInput, hasNormal, hasTexture)
+        {
+        }
 
+        MeshComponent(std::shared_ptr<MeshGeometry> geometryInput, std::shared_ptr<Shader> shaderInput, bool hasNormal = true, bool hasTexture = true) :
+            geometry(geometryInput), shader(shaderInput), hasNormal(hasNormal), hasTexture(hasTexture)
+        {
         }
     };
 
+    // Slots of the transforms changed since the last TransformSystem update, owned by the TransformSystem.
+    using TransformQueue = std::vector<uint32_t>;
+
+    // Translation, rotation and scale relative to the parent in RelationComponent. The world matrix lives in
+    // the TransformSystem and is only recomputed by its update. The setters queue the transform for its next update, members
+    // assigned directly only count inside registry.patch. Either has to happen on the thread that runs it.
     struct TransformComponent {
         glm::vec3 localPos = glm::vec3(0.0f, 0.0f, 0.0f);
-        glm::vec3 rotation_eular = glm::vec3(0.0f, 0.0f, 0.0f);
+        glm::quat localRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
         glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
-
-        // Reference is to avoid expensive update operations on parent transforms
-        bool isReference = false;
-        const TransformComponent* referencedTransform = nullptr;
+        // Euler angles in degrees, applied x then y then z. Kept as set so that editing them does not jump
+        // between equivalent angles, localRotation is what gets used.
+        glm::vec3 rotation_eular = glm::vec3(0.0f, 0.0f, 0.0f);
 
         TransformComponent() = default;
         TransformComponent(glm::vec3 pos, glm::vec3 rotation, glm::vec3 scaleInput) :
-            localPos(pos), rotation_eular(rotation), scale(scaleInput)
+            localPos(pos), scale(scaleInput)
         {
+            setLocalRotation(rotation);
         };
 
-        // TODO: This may be error prone. Think about how to adjust this.
-        void addParentTransform(const TransformComponent& other) {
-            isReference = true;
-            referencedTransform = &other;
-        };
+        void setLocalPosition(const glm::vec3& position) {
+            localPos = position;
+            markDirty();
+        }
 
-        glm::vec3 getWorldPos() const {
-            const TransformComponent* current = this;
-            glm::vec3 worldPos = localPos;
-            while (current->isReference) {
-                current = current->referencedTransform;
-                worldPos += current->localPos;
-            }
-            return worldPos;
+        void setLocalRotation(const glm::vec3& eulerDegrees) {
+            rotation_eular = eulerDegrees;
+            localRotation = glm::angleAxis(glm::radians(eulerDegrees.x), glm::vec3(1.0f, 0.0f, 0.0f))
+                * glm::angleAxis(glm::radians(eulerDegrees.y), glm::vec3(0.0f, 1.0f, 0.0f))
+                * glm::angleAxis(glm::radians(eulerDegrees.z), glm::vec3(0.0f, 0.0f, 1.0f));
+            markDirty();
         }
 
-        glm::vec3 getWorldRotation() const {
-            const TransformComponent* current = this;
-            glm::vec3 worldRot = rotation_eular;
-            while (current->isReference) {
-                current = current->referencedTransform;
-                worldRot += current->rotation_eular;
-            }
-            return worldRot;
+        void setLocalScale(const glm::vec3& localScale) {
+            scale = localScale;
+            markDirty();
         }
 
-        glm::vec3 getWorldScale() const {
-            const TransformComponent* current = this;
-            glm::vec3 worldScale = scale;
-            while (current->isReference) {
-                current = current->referencedTransform;
-                worldScale *= current->scale;
+        // translate * rotate * scale
+        glm::mat4 getLocalMatrix() const {
+            glm::mat4 matrix = glm::mat4_cast(localRotation);
+            matrix[0] *= scale.x;
+            matrix[1] *= scale.y;
+            matrix[2] *= scale.z;
+            matrix[3] = glm::vec4(localPos, 1.0f);
+            return matrix;
+        }
+
+        // Parent world matrix times the local matrix, as of the last TransformSystem update. Identity until
+        // the first update after the transform was added.
+        const glm::mat4& getWorldMatrix() const {
+            return *world;
+        }
+
+        // Inverse transpose of the upper 3x3 of the world matrix, which is its cofactor matrix over the
+        // determinant.
+        glm::mat3 getNormalMatrix() const {
+            const glm::vec3 x((*world)[0]);
+            const glm::vec3 y((*world)[1]);
+            const glm::vec3 z((*world)[2]);
+            const glm::vec3 yz = glm::cross(y, z);
+            const float determinant = glm::dot(x, yz);
+            // A zero scale, which lights use, has no inverse. Its normals do not matter.
+            if (determinant == 0.0f) {
+                return glm::mat3(1.0f);
             }
-            return worldScale;
+            const float invDeterminant = 1.0f / determinant;
+            return glm::mat3(yz * invDeterminant, glm::cross(z, x) * invDeterminant, glm::cross(x, y) * invDeterminant);
+        }
+
+        glm::vec3 getWorldPos() const {
+            return glm::vec3((*world)[3]);
+        }
+
+        bool isDirty() const {
+            return dirty;
         }
 
         glm::vec3 front() {
@@ -178,6 +329,28 @@ namespace ToyEngine {
         glm::vec3 up() {
             return glm::vec3(0.0f, 1.0f, 0.0f);
         }
+
+    private:
+        friend class TransformSystem;
+
+        // Queued once until the update took it.
+        void markDirty() {
+            if (!dirty) {
+                dirty = true;
+                if (queue) {
+                    queue->push_back(slot);
+                }
+            }
+        }
+
+        // Until the hierarchy is sorted again, which takes every transform, it is not queued.
+        bool dirty = true;
+        // position in the TransformSystem arrays, assigned when the hierarchy is sorted
+        uint32_t slot = 0;
+        TransformQueue* queue = nullptr;
+        inline static const glm::mat4 IDENTITY = glm::mat4(1.0f);
+        // the slot's world matrix in the TransformSystem
+        const glm::mat4* world = &IDENTITY;
     };
 
     struct MaterialComponent {
@@ -197,6 +370,8 @@ namespace ToyEngine {
         // ambient texture
         Texture ambientTexture;
         glm::vec4 ambientColor = { 1, 1, 1, 1 };
+        // index into the renderer's MaterialBuffer, set up together with the textures. 0 uses the missing textures.
+        uint32_t materialIndex = 0;
     };
 
     struct RelationComponent {
@@ -303,10 +478,10 @@ namespace ToyEngine {
 
             // configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
             glGenVertexArrays(1, &VAO);
-            glBindVertexArray(VAO);
+            GLStateCache::getInstance().bindVertexArray(VAO);
             glGenBuffers(1, &VBO);
 
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, VBO);
             glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
 
             // update the lamp's position attribute's stride to reflect the updated buffer data
@@ -315,7 +490,7 @@ namespace ToyEngine {
         }
 
         void draw() {
-            glBindVertexArray(VAO);
+            GLStateCache::getInstance().bindVertexArray(VAO);
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }
     };
@@ -0,0 +1,206 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <glm/glm.hpp>
+#include <Renderer/FrustumCuller.h>
+
+namespace ToyEngine {
+	struct AABB {
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+
+		float surfaceArea() const {
+			glm::vec3 extent = max - min;
+			return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+		}
+
+		bool contains(const AABB& other) const {
+			return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+		}
+
+		bool overlaps(const AABB& other) const {
+			return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::greaterThanEqual(max, other.min));
+		}
+
+		static AABB merge(const AABB& a, const AABB& b) {
+			return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+		}
+
+		// Box around the local box after the transform (Arvo's method).
+		static AABB transform(const glm::vec3& localMin, const glm::vec3& localMax, const glm::mat4& model);
+	};
+
+	enum class FrustumTestResult { Outside, Intersects, Inside };
+
+	FrustumTestResult testFrustum(const Frustum& frustum, const AABB& box);
+
+	// Entry distance of the ray into the box, or a negative value when it misses within maxDistance.
+	// invDirection is 1 / direction per axis.
+	float intersectRay(const AABB& box, const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance);
+
+	// Incremental bounding volume hierarchy over AABB proxies.
+	// Leaves are inserted next to the sibling chosen by the surface area heuristic, and the tree is kept
+	// balanced with AVL rotations on the way up. Moving a proxy only refits its ancestors.
+	class DynamicAABBTree
+	{
+	public:
+		static constexpr int32_t NULL_NODE = -1;
+		// Leaves are enlarged by this so that small movements don't touch the tree at all.
+		static constexpr float AABB_MARGIN = 0.05f;
+
+		int32_t createProxy(const AABB& box, uint32_t userData);
+		void destroyProxy(int32_t proxyId);
+
+		// Returns true when the tree had to be changed.
+		bool moveProxy(int32_t proxyId, const AABB& box);
+
+		uint32_t getUserData(int32_t proxyId) const {
+			return mNodes[proxyId].userData;
+		}
+
+		const AABB& getFatAABB(int32_t proxyId) const {
+			return mNodes[proxyId].box;
+		}
+
+		size_t getProxyCount() const {
+			return mProxyCount;
+		}
+
+		int32_t getHeight() const {
+			return mRoot == NULL_NODE ? 0 : mNodes[mRoot].height;
+		}
+
+		// callback(uint32_t userData) for every leaf overlapping the box.
+		template<typename Callback>
+		void query(const AABB& box, Callback&& callback) const;
+
+		// callback(uint32_t userData) for every leaf that is not outside the frustum.
+		// Subtrees entirely inside the frustum are reported without testing their leaves.
+		template<typename Callback>
+		void query(const Frustum& frustum, Callback&& callback) const;
+
+		// callback(uint32_t userData, float entryDistance) returns the new max distance, so returning
+		// entryDistance keeps only closer hits and returning a negative value stops the cast.
+		template<typename Callback>
+		void rayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Callback&& callback) const;
+
+	private:
+		struct TreeNode {
+			AABB box;
+			int32_t parent = NULL_NODE;
+			int32_t child1 = NULL_NODE;
+			int32_t child2 = NULL_NODE;
+			// leaf = 0, free node = -1
+			int32_t height = -1;
+			uint32_t userData = 0;
+
+			bool isLeaf() const {
+				return child1 == NULL_NODE;
+			}
+		};
+
+		int32_t allocateNode();
+		void freeNode(int32_t nodeId);
+
+		int32_t findBestSibling(const AABB& box) const;
+		void insertLeaf(int32_t leaf);
+		void removeLeaf(int32_t leaf);
+		// Recompute boxes and heights from nodeId to the root, rebalancing on the way.
+		void refit(int32_t nodeId);
+		int32_t balance(int32_t nodeId);
+
+		std::vector<TreeNode> mNodes;
+		int32_t mRoot = NULL_NODE;
+		// free nodes are chained through parent
+		int32_t mFreeList = NULL_NODE;
+		size_t mProxyCount = 0;
+	};
+
+	template<typename Callback>
+	void DynamicAABBTree::query(const AABB& box, Callback&& callback) const
+	{
+		if (mRoot == NULL_NODE) {
+			return;
+		}
+		std::vector<int32_t> stack;
+		stack.reserve(64);
+		stack.push_back(mRoot);
+		while (!stack.empty()) {
+			const TreeNode& node = mNodes[stack.back()];
+			stack.pop_back();
+			if (!node.box.overlaps(box)) {
+				continue;
+			}
+			if (node.isLeaf()) {
+				callback(node.userData);
+			}
+			else {
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+	}
+
+	template<typename Callback>
+	void DynamicAABBTree::query(const Frustum& frustum, Callback&& callback) const
+	{
+		if (mRoot == NULL_NODE) {
+			return;
+		}
+		// (node, already known to be inside)
+		std::vector<std::pair<int32_t, bool>> stack;
+		stack.reserve(64);
+		stack.emplace_back(mRoot, false);
+		while (!stack.empty()) {
+			auto [nodeId, inside] = stack.back();
+			stack.pop_back();
+			const TreeNode& node = mNodes[nodeId];
+			if (!inside) {
+				FrustumTestResult result = testFrustum(frustum, node.box);
+				if (result == FrustumTestResult::Outside) {
+					continue;
+				}
+				inside = result == FrustumTestResult::Inside;
+			}
+			if (node.isLeaf()) {
+				callback(node.userData);
+			}
+			else {
+				stack.emplace_back(node.child1, inside);
+				stack.emplace_back(node.child2, inside);
+			}
+		}
+	}
+
+	template<typename Callback>
+	void DynamicAABBTree::rayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Callback&& callback) const
+	{
+		if (mRoot == NULL_NODE) {
+			return;
+		}
+		const glm::vec3 invDirection = 1.0f / direction;
+		std::vector<int32_t> stack;
+		stack.reserve(64);
+		stack.push_back(mRoot);
+		while (!stack.empty()) {
+			const TreeNode& node = mNodes[stack.back()];
+			stack.pop_back();
+			float entry = intersectRay(node.box, origin, invDirection, maxDistance);
+			if (entry < 0.0f) {
+				continue;
+			}
+			if (node.isLeaf()) {
+				maxDistance = callback(node.userData, entry);
+				if (maxDistance < 0.0f) {
+					return;
+				}
+			}
+			else {
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+	}
+}
@@ -23,7 +23,8 @@ namespace ToyEngine {
 	public:
 		MyEngine(WindowPtr& window) :mWindow(window){};
 		void tick();
-		void init();
+		// looseFiles keeps reading loose files once an archive is mounted, which debug builds always do.
+		void init(bool looseFiles);
 
 		std::shared_ptr<Camera> getMainCamera () const {
 			return mMainCameraPtr;
@@ -6,7 +6,10 @@
 #include <Renderer/Camera.h>
 #include <tuple>
 #include <Engine/Component.h>
+#include <Engine/DynamicAABBTree.h>
+#include <Engine/TransformSystem.h>
 #include <entt/entt.hpp>
+#include <unordered_map>
 
 
 namespace ToyEngine {
@@ -14,6 +17,7 @@ namespace ToyEngine {
 		public:
 			void init();
 
+			// Bring the world transforms up to date, then draw.
 			void update();
 			void processRendering();
 			Scene() = default;
@@ -33,7 +37,34 @@ namespace ToyEngine {
 			void addDirectionalLight(glm::vec3 direction, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, float constant, float linear, float quadratic);
 
 			void addModel(std::string path, std::string modelName, entt::entity parent);
+
+			// Mesh and light entities overlapping the box.
+			std::vector<entt::entity> queryRange(const AABB& box) const;
+			// Closest mesh or light entity whose bounds the ray hits, entt::null if none.
+			entt::entity raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* hitDistance = nullptr) const;
+
+			const DynamicAABBTree& getSpatialIndex() const {
+				return mSpatialIndex;
+			}
+
+			const TransformSystem& getTransformSystem() const {
+				return mTransformSystem;
+			}
 		private:
+			// Spatial index maintenance, connected to the registry in init().
+			void onSpatialComponentConstruct(entt::registry& registry, entt::entity entity);
+			void onSpatialComponentDestroy(entt::registry& registry, entt::entity entity);
+			// Refit the entity's proxy and move its resident mesh. Called by the transform system for every
+			// recomputed world transform, which includes the descendants of a moved entity.
+			void onWorldTransformChanged(entt::entity entity);
+			AABB computeWorldBounds(entt::entity entity) const;
+			const BoundsComponent& getLocalBounds(entt::entity entity) const;
+
+			// GPU resident copies of the drawable meshes, kept in sync the same way.
+			void onResidentMeshConstruct(entt::registry& registry, entt::entity entity);
+			void onResidentMeshDestroy(entt::registry& registry, entt::entity entity);
+			void onResidentMeshUpdate(entt::registry& registry, entt::entity entity);
+
 			entt::registry mRegistry;
 
 			std::vector<entt::entity> mEntityList;
@@ -41,5 +72,13 @@ namespace ToyEngine {
 			std::shared_ptr<Camera> mCamera;
 
 			entt::entity mRootEntity;
+
+			TransformSystem mTransformSystem;
+
+			// Every mesh and positioned light. Culling, picking and range queries go through it instead of a view.
+			DynamicAABBTree mSpatialIndex;
+			std::unordered_map<entt::entity, int32_t> mSpatialProxies;
+			size_t mSpatialMeshCount = 0;
+			std::unordered_map<entt::entity, uint32_t> mResidentMeshes;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <entt/entity/registry.hpp>
+#include <Engine/Component.h>
+
+namespace ToyEngine {
+	// Keeps the world matrices of TransformComponent up to date. The local and world matrices live in arrays
+	// sorted by hierarchy depth, one level after the other, with the children of a parent next to each other,
+	// and every component points at its world matrix. Every level only depends on the one before it, so it is
+	// split across the worker threads. Only the queued components are read, the levels only touch the arrays.
+	// The order is only rebuilt when transforms are added or removed or a parent changes, not when they move.
+	// When only a few transforms changed, their subtrees are walked instead of all levels, unless they turn
+	// out to be large.
+	class TransformSystem
+	{
+	public:
+		// Levels with fewer transforms are done on the calling thread.
+		static constexpr size_t SLOTS_PER_TASK = 4096;
+		// With less than one change per this many transforms, the changed subtrees are walked instead, as long
+		// as they have fewer transforms than that as well.
+		static constexpr size_t SPARSE_UPDATE_RATIO = 64;
+
+		// Connect to the registry so that patched transforms get queued and reparenting resorts. Transforms
+		// changed through their setters queue themselves.
+		void init(entt::registry& registry);
+
+		// Recompute the changed transforms and all of their descendants. onChanged(entity) is called once
+		// for every entity whose world matrix was recomputed, after its parent.
+		template<typename Callback>
+		void update(entt::registry& registry, Callback&& onChanged);
+
+		// Transforms recomputed by the last update.
+		size_t getLastUpdateCount() const {
+			return mChangedSlots.size();
+		}
+
+		size_t getLevelCount() const {
+			return mLevels.empty() ? 0 : mLevels.size() - 1;
+		}
+
+		float getLastUpdateMilliseconds() const {
+			return mLastUpdateMilliseconds;
+		}
+
+	private:
+		void onTransformChanged(entt::registry& registry, entt::entity entity);
+		void onTopologyChanged(entt::registry& registry, entt::entity entity);
+
+		// Sort every transform by depth, load all local matrices and mark them as changed.
+		void rebuild(entt::registry& registry);
+		// Bring the world matrices up to date and fill mChangedSlots.
+		void propagate(entt::registry& registry);
+		// Compute the marked slots and their descendants level by level and collect them.
+		void updateLevels();
+		// False when it gave up because the subtrees are too large. updateLevels finishes what it started.
+		bool updateSubtrees();
+		// Take the local matrix of the slot's component and mark the slot.
+		void loadLocal(uint32_t slot);
+		void loadQueued();
+		// World matrix of the slot from its parent's and its local matrix.
+		void computeWorld(uint32_t slot);
+		// function(begin, end) over all slots, split across the worker threads when there are many.
+		template<typename Function>
+		void forEachSlotRange(size_t begin, size_t end, Function&& function);
+
+		TransformQueue mQueue;
+		bool mTopologyDirty = true;
+
+		// Everything below is indexed by slot.
+		std::vector<entt::entity> mEntities;
+		// Adding or removing a transform moves others in the registry, but it also causes a rebuild before
+		// these are used again.
+		std::vector<TransformComponent*> mComponents;
+		// -1 for roots
+		std::vector<int32_t> mParents;
+		// the children of a slot are [mChildBegin, mChildEnd) in the next level
+		std::vector<uint32_t> mChildBegin;
+		std::vector<uint32_t> mChildEnd;
+		std::vector<glm::mat4> mLocal;
+		// Resized only by a rebuild, which points the components at it again.
+		std::vector<glm::mat4> mWorld;
+		// cleared again by the end of every update
+		std::vector<uint8_t> mChanged;
+		// first slot of every level, followed by the slot count
+		std::vector<size_t> mLevels;
+
+		std::vector<uint32_t> mChangedSlots;
+		// where each block of SLOTS_PER_TASK slots starts in mChangedSlots
+		std::vector<size_t> mBlockOffsets;
+		std::vector<uint32_t> mQueuedSlots;
+		std::vector<uint32_t> mStack;
+		float mLastUpdateMilliseconds = 0.0f;
+	};
+
+	template<typename Callback>
+	void TransformSystem::update(entt::registry& registry, Callback&& onChanged)
+	{
+		propagate(registry);
+		for (uint32_t slot : mChangedSlots) {
+			onChanged(mEntities[slot]);
+		}
+	}
+}
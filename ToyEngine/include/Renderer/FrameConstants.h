@@ -0,0 +1,17 @@
+#pragma once
+#include <glm/glm.hpp>
+
+namespace ToyEngine {
+	// std140 mirror of the FrameConstants block. Computed once per frame by RenderSystem.
+	struct FrameConstants {
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::mat4 viewProjection;
+		// w is unused
+		glm::vec4 cameraPosition;
+		// x: seconds since start, y: seconds since the last frame
+		glm::vec4 time;
+	};
+
+	static_assert(sizeof(FrameConstants) == 3 * 64 + 2 * 16, "FrameConstants does not match the std140 layout.");
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace ToyEngine {
+	// Six planes as (normal, distance) with normals pointing inside. A point p is inside a plane when dot(n, p) + d >= 0.
+	struct Frustum {
+		enum Plane { Left = 0, Right, Bottom, Top, Near, Far, Count };
+		glm::vec4 planes[Count];
+
+		// Gribb-Hartmann extraction from a view projection matrix.
+		static Frustum fromMatrix(const glm::mat4& viewProjection);
+	};
+
+	// Bounding spheres in world space kept as structure of arrays, so that the plane tests
+	// run over 8 (AVX2) or 4 (SSE) spheres at a time. The instruction set is picked at runtime.
+	class FrustumCuller
+	{
+	public:
+		// Remove the spheres. The culled count of the last cull is kept for statistics.
+		void clear();
+
+		// Returns the index of the sphere, which is the index into the visibility result.
+		size_t add(const glm::vec3& center, float radius);
+
+		// Spheres that are entirely outside any of the planes are marked 0, the rest 1.
+		void cull(const Frustum& frustum);
+
+		const std::vector<uint8_t>& getVisibility() const {
+			return mVisible;
+		}
+
+		size_t size() const {
+			return mCenterX.size();
+		}
+
+		size_t getCulledCount() const {
+			return mCulledCount;
+		}
+
+	private:
+		void cullScalar(const Frustum& frustum, size_t begin, size_t end);
+		size_t cullSSE(const Frustum& frustum);
+		size_t cullAVX2(const Frustum& frustum);
+
+		std::vector<float> mCenterX;
+		std::vector<float> mCenterY;
+		std::vector<float> mCenterZ;
+		std::vector<float> mRadius;
+
+		std::vector<uint8_t> mVisible;
+		size_t mCulledCount = 0;
+	};
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+namespace ToyEngine {
+	// Shadow copy of the GL binding and fixed function state the renderer touches. Every setter compares
+	// with the shadow first and only calls into the driver when the value actually changes.
+	// It only stays correct if all code changes this state through it, including the deletes that
+	// implicitly unbind objects. ImGui's backend restores whatever it changes, so it can stay outside.
+	class GLStateCache
+	{
+	public:
+		static constexpr GLuint MAX_TEXTURE_UNITS = 16;
+
+		struct Counters {
+			size_t issued = 0;
+			size_t elided = 0;
+		};
+
+		static GLStateCache& getInstance();
+
+		void useProgram(GLuint program);
+		// Returns whether the binding changed.
+		bool bindVertexArray(GLuint vertexArray);
+
+		// GL_ELEMENT_ARRAY_BUFFER is part of the VAO and always passed through.
+		void bindBuffer(GLenum target, GLuint buffer);
+		// Binds the generic target as well, like GL does.
+		void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+		// Switches the active unit only when a bind needs it.
+		void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+		void setDepthTest(bool enabled);
+		void setDepthFunc(GLenum func);
+		void setDepthMask(bool enabled);
+		void setBlend(bool enabled);
+		void setBlendFunc(GLenum source, GLenum destination);
+
+		// Deleting a bound object unbinds it, so deletes have to go through here too.
+		void deleteBuffer(GLuint buffer);
+		void deleteVertexArray(GLuint vertexArray);
+		void deleteTexture(GLuint texture);
+		void deleteProgram(GLuint program);
+
+		// Forget everything, the next call of every setter goes to the driver.
+		void invalidate();
+
+		// Start counting a new frame.
+		void beginFrame();
+
+		const Counters& getLastFrameCounters() const {
+			return mLastFrameCounters;
+		}
+
+	private:
+		static constexpr GLuint UNKNOWN = UINT32_MAX;
+
+		enum BufferSlot : size_t {
+			ARRAY_BUFFER_SLOT,
+			COPY_READ_BUFFER_SLOT,
+			COPY_WRITE_BUFFER_SLOT,
+			DRAW_INDIRECT_BUFFER_SLOT,
+			UNIFORM_BUFFER_SLOT,
+			SHADER_STORAGE_BUFFER_SLOT,
+			PIXEL_PACK_BUFFER_SLOT,
+			PIXEL_UNPACK_BUFFER_SLOT,
+			TEXTURE_BUFFER_BUFFER_SLOT,
+			BUFFER_SLOT_COUNT,
+			UNTRACKED_BUFFER_SLOT = BUFFER_SLOT_COUNT,
+		};
+
+		enum TextureSlot : size_t {
+			TEXTURE_2D_SLOT,
+			TEXTURE_2D_ARRAY_SLOT,
+			TEXTURE_CUBE_MAP_SLOT,
+			TEXTURE_BUFFER_SLOT,
+			TEXTURE_SLOT_COUNT,
+			UNTRACKED_TEXTURE_SLOT = TEXTURE_SLOT_COUNT,
+		};
+
+		GLStateCache();
+
+		static BufferSlot getBufferSlot(GLenum target);
+		static TextureSlot getTextureSlot(GLenum target);
+
+		// Counts the call and returns whether it has to be issued.
+		bool changes(GLuint& shadow, GLuint value);
+		void setCapability(GLenum capability, GLuint& shadow, bool enabled);
+		void activateUnit(GLuint unit);
+
+		GLuint mProgram;
+		GLuint mVertexArray;
+		std::array<GLuint, BUFFER_SLOT_COUNT> mBuffers;
+		GLuint mActiveUnit;
+		std::array<std::array<GLuint, TEXTURE_SLOT_COUNT>, MAX_TEXTURE_UNITS> mTextures;
+		GLuint mDepthTest;
+		GLuint mDepthFunc;
+		GLuint mDepthMask;
+		GLuint mBlend;
+		GLuint mBlendSource;
+		GLuint mBlendDestination;
+
+		Counters mCounters;
+		Counters mLastFrameCounters;
+	};
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+#include <Renderer/VertexLayout.h>
+
+namespace ToyEngine {
+	// Where a mesh lives inside the pool's buffers. Indices are relative to baseVertex.
+	struct GeometryRange {
+		GLuint firstIndex = 0;
+		GLsizei indexCount = 0;
+		GLint baseVertex = 0;
+		GLsizei vertexCount = 0;
+		// Small id used to group draws of the same mesh in the sort key, unique across pools.
+		uint32_t id = 0;
+
+		bool isValid() const {
+			return indexCount > 0;
+		}
+	};
+
+	// One level of detail of a mesh. All levels share the vertices of level 0 and only have their own indices.
+	struct MeshLod {
+		GeometryRange range;
+		// How far the level's surface is from the full mesh, in mesh units.
+		float error = 0.0f;
+	};
+
+	// First fit allocator over [0, capacity) with coalescing of released ranges.
+	class RangeAllocator
+	{
+	public:
+		static constexpr size_t INVALID_OFFSET = SIZE_MAX;
+
+		size_t allocate(size_t size);
+		void release(size_t offset, size_t size);
+		// Make [oldCapacity, newCapacity) available.
+		void grow(size_t newCapacity);
+
+		size_t getCapacity() const {
+			return mCapacity;
+		}
+
+	private:
+		// offset -> size of every free block
+		std::map<size_t, size_t> mFreeBlocks;
+		size_t mCapacity = 0;
+	};
+
+	// All static mesh vertices of one layout suballocated from one vertex buffer, and their indices of one
+	// type from one index buffer, with one VAO. Binding the VAO once is enough for every mesh in the pool,
+	// which is what allows the meshes to be submitted with multi draw indirect.
+	class GeometryPool
+	{
+	public:
+		// The pool for vertices in layout with indices of indexType, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+		static GeometryPool& getInstance(const VertexLayout& layout, GLenum indexType);
+
+		// 16 bit indices whenever all of them fit, indices are relative to the mesh's base vertex.
+		static GLenum selectIndexType(size_t vertexCount) {
+			return vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		}
+
+		static size_t getIndexSize(GLenum indexType) {
+			return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+		}
+
+		// vertexData holds vertices already encoded with the pool's layout.
+		GeometryRange allocate(const std::vector<uint8_t>& vertexData, const std::vector<unsigned int>& indices);
+		void release(const GeometryRange& range);
+
+		// Another index range over the vertices of base, e.g. a level of detail. The result has its own id
+		// and has to be released with releaseIndices before base is released.
+		GeometryRange allocateIndices(const GeometryRange& base, const std::vector<unsigned int>& indices);
+		void releaseIndices(const GeometryRange& range);
+
+		// The same from a GL buffer that already holds the data, like one from the transfer queue, copied on the
+		// GPU. Offsets are in bytes, the vertices have to be encoded with the layout and the indices of indexType.
+		GeometryRange allocateFrom(GLuint source, size_t vertexOffset, size_t vertexCount, size_t indexOffset, size_t indexCount);
+		GeometryRange allocateIndicesFrom(const GeometryRange& base, GLuint source, size_t indexOffset, size_t indexCount);
+
+		GLuint getVAOIndex() {
+			init();
+			return mVAOIndex;
+		}
+
+		GLuint getVertexBufferIndex() const {
+			return mVBOIndex;
+		}
+
+		GLuint getIndexBufferIndex() const {
+			return mEBOIndex;
+		}
+
+		const VertexLayout& getLayout() const {
+			return mLayout;
+		}
+
+		GLenum getIndexType() const {
+			return mIndexType;
+		}
+
+		// Bytes of buffer storage currently allocated, used or not.
+		size_t getAllocatedBytes() const {
+			return mVertexRanges.getCapacity() * mLayout.getStride() + mIndexRanges.getCapacity() * getIndexSize(mIndexType);
+		}
+
+		// Sum over all pools.
+		static size_t getTotalAllocatedBytes();
+
+	private:
+		GeometryPool(const VertexLayout& layout, GLenum indexType);
+
+		static std::map<std::pair<const VertexLayout*, GLenum>, std::unique_ptr<GeometryPool>>& getPools();
+
+		void init();
+		// Offsets in elements, growing the buffers when needed.
+		size_t allocateVertexRange(size_t vertexCount);
+		size_t allocateIndexRange(size_t indexCount);
+		// Returns the offset of the indices in the index buffer.
+		size_t uploadIndices(const std::vector<unsigned int>& indices);
+		// Reallocate a buffer with room for at least the requested element count, keeping its content.
+		void growBuffer(GLuint& buffer, RangeAllocator& allocator, size_t elementSize, size_t minCapacity);
+		void setupVertexAttributes();
+
+		const VertexLayout& mLayout;
+		GLenum mIndexType;
+
+		GLuint mVAOIndex = 0;
+		GLuint mVBOIndex = 0;
+		GLuint mEBOIndex = 0;
+
+		RangeAllocator mVertexRanges;
+		RangeAllocator mIndexRanges;
+	};
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <Renderer/GeometryPool.h>
+#include <Renderer/IndirectBuffer.h>
+#include <Renderer/RenderQueue.h>
+
+namespace ToyEngine {
+	class Shader;
+
+	// GPU driven culling of resident meshes. Instances are uploaded once and only touched again when they
+	// move. Every frame a compute pass tests all of them against the frustum and against a depth pyramid
+	// of the previous frame, picks a level of detail and counts them into the draw command of that level.
+	// A second pass turns the counts into instance ranges and a third writes the visible instances there.
+	// The CPU cost per frame only depends on the number of distinct meshes and materials, and the number of
+	// draw calls only on the number of distinct VAOs and texture pages.
+	class GpuCuller
+	{
+	public:
+		static constexpr uint32_t INVALID_INSTANCE = UINT32_MAX;
+		static constexpr GLuint WORKGROUP_SIZE = 64;
+
+		// Consecutive commands that can be drawn with one glMultiDrawElementsIndirect.
+		struct DrawRun {
+			DrawPacket state;
+			size_t firstCommand = 0;
+			size_t commandCount = 0;
+		};
+
+		// Compute shaders, storage buffers and image load/store, plus everything multi draw indirect needs.
+		static bool isSupported();
+
+		void init();
+
+		// The packet provides shader, texture pages, material and the position dequantization, its model and geometry are ignored. The geometry
+		// comes from lods, finest first. The bounds are in mesh space. Returns a handle that stays valid until removeInstance.
+		uint32_t addInstance(const DrawPacket& state, const std::vector<MeshLod>& lods, const glm::mat4& model,
+			const glm::vec3& localMin, const glm::vec3& localMax);
+		void updateInstance(uint32_t instance, const glm::mat4& model);
+		void removeInstance(uint32_t instance);
+
+		size_t getInstanceCount() const {
+			return mRecords.size();
+		}
+
+		// Upload what changed since the last frame, reset the commands and dispatch the culling passes.
+		// A level is used when its error times the mesh scale times lodErrorScale, over the view depth, is at most 1.
+		// Leaves the command buffer bound to GL_DRAW_INDIRECT_BUFFER.
+		void cull(const glm::mat4& viewProjection, float lodErrorScale);
+
+		const std::vector<DrawRun>& getDrawRuns() const {
+			return mDrawRuns;
+		}
+
+		// Tightly packed InstanceData of the visible instances, written by cull.
+		GLuint getVisibleInstanceBuffer() const {
+			return mVisibleBuffer;
+		}
+
+		// Reduce the depth buffer of the frame just drawn with viewProjection. The next cull tests against it,
+		// so an object that comes into view from behind an occluder may show up one frame late.
+		void buildDepthPyramid(int width, int height, const glm::mat4& viewProjection);
+
+		bool hasDepthPyramid() const {
+			return mDepthPyramidValid;
+		}
+
+	private:
+		// Matches the storage buffer read by the culling shader.
+		struct InstanceRecord {
+			glm::mat4 model;
+			// w of boundsMin holds the batch of the finest level, w of boundsMax the level count, as uint bits
+			glm::vec4 boundsMin;
+			glm::vec4 boundsMax;
+		};
+
+		// All instances of one level of detail of a mesh with one material. The levels of a mesh are
+		// consecutive batches, and each of them has room for every instance of the mesh.
+		struct Batch {
+			DrawPacket state;
+			float lodError = 0.0f;
+			// on the finest level's batch only
+			uint32_t lodCount = 1;
+			size_t instanceCount = 0;
+		};
+
+		// Matches the storage buffer read by the culling shader.
+		struct BatchInfo {
+			// folded into the model matrix of the visible instances
+			glm::vec4 positionDequantization;
+			uint32_t command;
+			float lodError;
+			// written with the visible instances
+			uint32_t materialIndex;
+			uint32_t padding;
+		};
+
+		// shader, VAO, first index, base vertex, index count, diffuse page, specular page, material
+		using BatchKey = std::tuple<const Shader*, GLuint, GLuint, GLint, GLsizei, uint32_t, uint32_t, uint32_t>;
+
+		// Returns the batch of the finest level.
+		uint32_t findOrAddBatch(const DrawPacket& state, const std::vector<MeshLod>& lods);
+		void markDirty(size_t record);
+		void rebuildCommands();
+		void uploadInstances();
+		void resizeDepthPyramid(int width, int height);
+
+		std::vector<InstanceRecord> mRecords;
+		std::vector<uint32_t> mRecordBatch;
+		std::vector<uint32_t> mRecordHandle;
+		std::vector<uint32_t> mHandleRecord;
+		std::vector<uint32_t> mFreeHandles;
+		size_t mDirtyBegin = SIZE_MAX;
+		size_t mDirtyEnd = 0;
+
+		std::vector<Batch> mBatches;
+		std::map<BatchKey, uint32_t> mBatchIds;
+		bool mCommandsDirty = false;
+		std::vector<DrawRun> mDrawRuns;
+		// in batch order
+		std::vector<BatchInfo> mBatchInfos;
+		std::vector<DrawElementsIndirectCommand> mCommandTemplate;
+
+		std::shared_ptr<Shader> mCullShader;
+		std::shared_ptr<Shader> mAllocateShader;
+		std::shared_ptr<Shader> mWriteShader;
+		std::shared_ptr<Shader> mCopyDepthShader;
+		std::shared_ptr<Shader> mReduceDepthShader;
+
+		GLuint mInstanceBuffer = 0;
+		size_t mInstanceCapacity = 0;
+		GLuint mBatchInfoBuffer = 0;
+		// instance counts of zero, copied over the command buffer before every cull
+		GLuint mCommandTemplateBuffer = 0;
+		size_t mCommandTemplateCapacity = 0;
+		GLuint mCommandBuffer = 0;
+		size_t mCommandCapacity = 0;
+		GLuint mVisibleBuffer = 0;
+		size_t mVisibleCapacity = 0;
+		// command and slot picked for every instance by the culling pass
+		GLuint mInstanceSlotBuffer = 0;
+		size_t mInstanceSlotCapacity = 0;
+
+		GLuint mDepthFramebuffer = 0;
+		GLuint mDepthTexture = 0;
+		GLuint mDepthPyramid = 0;
+		int mDepthWidth = 0;
+		int mDepthHeight = 0;
+		int mDepthPyramidLevels = 0;
+		glm::mat4 mDepthPyramidViewProjection = glm::mat4(1.0f);
+		bool mDepthPyramidValid = false;
+	};
+}
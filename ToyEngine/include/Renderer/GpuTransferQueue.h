@@ -0,0 +1,171 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glad/glad.h>
+#include <Resource/BcEncoder.h>
+#include <Resource/ImageData.h>
+
+struct GLFWwindow;
+
+namespace ToyEngine {
+	// A texture or buffer created by the transfer thread. Everything but done is only written before done is
+	// set, and the GPU has finished the upload by then, so any thread may use the handle afterwards.
+	struct GpuTransfer {
+		std::atomic<bool> done{ false };
+		// 0 when the upload failed
+		GLuint handle = 0;
+		// of the texture
+		int width = 0;
+		int height = 0;
+		// internal format, block compressed or as many channels as the image had
+		GLenum format = GL_NONE;
+		// of the buffer
+		size_t size = 0;
+		bool isTexture = false;
+
+		// Keep the handle, it is deleted with the transfer otherwise, on the main thread.
+		GLuint take() {
+			GLuint taken = handle;
+			handle = 0;
+			return taken;
+		}
+
+		~GpuTransfer();
+	};
+
+	// Uploads textures and buffers on a thread of its own with a second GL context that shares objects with the
+	// main one, so that streaming in assets does not stall the frame. The data goes through a ring of pixel
+	// buffer objects guarded by fences, a request is done once the fence after its last command signalled.
+	// Only the bytes per frame budget is staged per frame, so that large assets do not starve the frame of
+	// bandwidth. The main thread takes the finished handles over, any GL state of its own, like framebuffers,
+	// vertex arrays or the geometry pools, stays on the main thread.
+	class GpuTransferQueue
+	{
+	public:
+		static constexpr size_t STAGING_SLOT_BYTES = 4 * 1024 * 1024;
+		static constexpr size_t STAGING_SLOT_COUNT = 4;
+		static constexpr size_t DEFAULT_FRAME_BUDGET_BYTES = 16 * 1024 * 1024;
+
+		static GpuTransferQueue& getInstance();
+
+		// Create the shared context and start the thread. Main thread, with the main context current.
+		// Returns false when there is no second context, the requests then return null.
+		bool init(GLFWwindow* mainWindow);
+		// Finish the queued requests and destroy the context. Main thread.
+		void shutdown();
+
+		bool isRunning() const {
+			return mRunning;
+		}
+
+		// A mipmapped GL_TEXTURE_2D with the image. Any thread.
+		std::shared_ptr<GpuTransfer> uploadTexture(ImageData image);
+		// A GL_TEXTURE_2D with the block compressed levels as they are, no mips are generated. Any thread.
+		std::shared_ptr<GpuTransfer> uploadCompressedTexture(CompressedImage image);
+		// A GL buffer with the data, to be copied to its destination with glCopyBufferSubData. Any thread.
+		std::shared_ptr<GpuTransfer> uploadBuffer(std::vector<uint8_t> data);
+		// The same straight from memory that stays valid while owner is held, like a mapped file. Any thread.
+		std::shared_ptr<GpuTransfer> uploadBuffer(const uint8_t* data, size_t size, std::shared_ptr<const void> owner);
+
+		// Block until the transfer is done, regardless of the budget. Sleeps until the transfer thread retires it.
+		void wait(const GpuTransfer& transfer);
+
+		// Start the budget of a new frame. Main thread, once per frame.
+		void beginFrame();
+
+		size_t getFrameBudget() const {
+			return mFrameBudget;
+		}
+
+		void setFrameBudget(size_t bytes) {
+			mFrameBudget = bytes;
+		}
+
+		// Bytes staged during the last frame.
+		size_t getLastFrameBytes() const {
+			return mLastFrameBytes;
+		}
+
+		// Requests not done yet.
+		size_t getPendingCount() const {
+			return mPendingCount;
+		}
+
+	private:
+		struct Request {
+			std::shared_ptr<GpuTransfer> transfer;
+			ImageData image;
+			CompressedImage compressed;
+			std::vector<uint8_t> data;
+			// instead of data
+			const uint8_t* source = nullptr;
+			size_t sourceSize = 0;
+			std::shared_ptr<const void> owner;
+		};
+
+		struct StagingSlot {
+			GLuint buffer = 0;
+			size_t capacity = 0;
+			// set after the last command reading the slot
+			GLsync fence = nullptr;
+		};
+
+		// A request whose commands are submitted, waiting for its fence.
+		struct InFlight {
+			std::shared_ptr<GpuTransfer> transfer;
+			GLsync fence = nullptr;
+		};
+
+		GpuTransferQueue() = default;
+
+		// Queue the request with a new transfer. Null when the thread is not running.
+		std::shared_ptr<GpuTransfer> submit(Request request, bool isTexture);
+		void threadLoop();
+		void process(Request& request);
+		void stageTexture(Request& request);
+		void stageCompressedTexture(Request& request);
+		void stageBuffer(Request& request);
+		// The next slot of the ring once the GPU is done with it, mapped for writing and bound to target.
+		void* mapSlot(GLenum target, size_t bytes);
+		// Unmap the slot mapSlot returned. Call fenceSlot after the commands reading it.
+		void unmapSlot(GLenum target);
+		void fenceSlot();
+		// Wait for the budget of the next frame unless someone waits for a request.
+		void consumeBudget(size_t bytes);
+		// Publish the requests whose fence signalled. Blocks for the first one with block.
+		void retire(bool block);
+
+		friend struct GpuTransfer;
+		// Delete the object of a dropped transfer on the main thread. Any thread.
+		void release(GLuint handle, bool isTexture);
+
+		GLFWwindow* mWindow = nullptr;
+		std::thread mThread;
+		std::atomic<bool> mRunning{ false };
+		bool mStop = false;
+
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		// notified when requests retire while someone waits
+		std::condition_variable mDone;
+		std::deque<Request> mRequests;
+		std::atomic<size_t> mPendingCount{ 0 };
+		std::atomic<int> mWaiters{ 0 };
+
+		std::atomic<size_t> mFrameBudget{ DEFAULT_FRAME_BUDGET_BYTES };
+		size_t mFrameBytes = 0;
+		std::atomic<size_t> mLastFrameBytes{ 0 };
+
+		// Only touched by the transfer thread.
+		StagingSlot mSlots[STAGING_SLOT_COUNT];
+		size_t mNextSlot = 0;
+		std::deque<InFlight> mInFlight;
+	};
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+
+namespace ToyEngine {
+	// Layout fixed by glMultiDrawElementsIndirect.
+	struct DrawElementsIndirectCommand {
+		GLuint count = 0;
+		GLuint instanceCount = 0;
+		GLuint firstIndex = 0;
+		GLint baseVertex = 0;
+		GLuint baseInstance = 0;
+	};
+
+	// Per-frame stream of indirect draw commands.
+	class IndirectBuffer
+	{
+	public:
+		// Multi draw indirect needs base instance as well, so that every command reads its own instances.
+		static bool isSupported() {
+			return GLAD_GL_ARB_draw_indirect && GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance;
+		}
+
+		void init();
+
+		// Uploads the commands and leaves the buffer bound to GL_DRAW_INDIRECT_BUFFER.
+		void upload(const std::vector<DrawElementsIndirectCommand>& commands);
+
+	private:
+		GLuint mBufferIndex = 0;
+		size_t mCapacity = 0;
+	};
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+namespace ToyEngine {
+	// Attribute locations of the per-instance data, after the per-vertex attributes 0 - 6.
+	// A mat4 takes four consecutive locations and a mat3 three.
+	enum InstanceAttributeLocation : GLuint {
+		INSTANCE_MODEL_LOCATION = 7,
+		INSTANCE_NORMAL_MATRIX_LOCATION = 11,
+		INSTANCE_MATERIAL_LOCATION = 14,
+	};
+
+	struct InstanceData {
+		glm::mat4 model;
+		glm::mat3 normalMatrix;
+		// index into the MaterialBuffer, read as an integer
+		uint32_t materialIndex;
+	};
+
+	// Per-frame stream of instance transforms. All instances of a frame are uploaded at once,
+	// then each batch points the instance attributes of its VAO at its own range.
+	class InstanceBuffer
+	{
+	public:
+		// Enable the instance attributes on the currently bound VAO. Only needs to happen once per VAO.
+		static void enableAttributes();
+
+		void init();
+
+		void upload(const std::vector<InstanceData>& instances);
+
+		// Point the instance attributes of the currently bound VAO at instances starting from firstInstance.
+		void bindAttributes(size_t firstInstance) const {
+			bindAttributes(mBufferIndex, firstInstance);
+		}
+
+		// Same for any buffer holding tightly packed InstanceData, e.g. one written by a compute shader.
+		static void bindAttributes(GLuint buffer, size_t firstInstance);
+
+	private:
+		GLuint mBufferIndex = 0;
+		size_t mCapacity = 0;
+	};
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <entt/entity/registry.hpp>
+#include <Renderer/UniformBuffer.h>
+
+namespace ToyEngine {
+	// Must match MAX_NR_*_LIGHTS in the shaders that declare the Lights block.
+	constexpr int MAX_LIGHTS_PER_TYPE = 32;
+
+	// std140 mirrors of the structs in the Lights block. Every vec3 is followed by a float so that
+	// each pair fills exactly one 16 byte slot.
+	struct GpuDirLight {
+		glm::vec3 direction;
+		float padding0;
+		glm::vec3 ambient;
+		float padding1;
+		glm::vec3 diffuse;
+		float padding2;
+		glm::vec3 specular;
+		float padding3;
+	};
+
+	struct GpuPointLight {
+		glm::vec3 position;
+		float constant;
+		glm::vec3 ambient;
+		float linear;
+		glm::vec3 diffuse;
+		float quadratic;
+		glm::vec3 specular;
+		float padding0;
+	};
+
+	struct GpuSpotLight {
+		glm::vec3 position;
+		float constant;
+		glm::vec3 direction;
+		float linear;
+		glm::vec3 ambient;
+		float quadratic;
+		glm::vec3 diffuse;
+		float cutOff;
+		glm::vec3 specular;
+		float outerCutOff;
+	};
+
+	struct LightBlock {
+		// x: directional, y: point, z: spot
+		glm::ivec4 lightCounts;
+		GpuDirLight dirLights[MAX_LIGHTS_PER_TYPE];
+		GpuPointLight pointLights[MAX_LIGHTS_PER_TYPE];
+		GpuSpotLight spotLights[MAX_LIGHTS_PER_TYPE];
+	};
+
+	static_assert(sizeof(GpuDirLight) == 64, "GpuDirLight does not match the std140 layout.");
+	static_assert(sizeof(GpuPointLight) == 64, "GpuPointLight does not match the std140 layout.");
+	static_assert(sizeof(GpuSpotLight) == 80, "GpuSpotLight does not match the std140 layout.");
+
+	// Owns the Lights uniform block. Lights are packed once per frame, and only when a light changed or
+	// markDirty was called since the last upload. Positions and directions come from the world matrices, so
+	// the scene calls markDirty when the TransformSystem moved a light.
+	class LightBuffer
+	{
+	public:
+		void init(entt::registry& registry);
+
+		void update(entt::registry& registry);
+
+		void markDirty() {
+			mIsDirty = true;
+		}
+
+	private:
+		void onLightChanged(entt::registry& registry, entt::entity entity);
+
+		void pack(entt::registry& registry);
+
+		UniformBuffer mBuffer;
+		LightBlock mBlock{};
+		bool mIsDirty = true;
+	};
+}
@@ -6,6 +6,7 @@
 #include <vector>
 #include "GLFW/glfw3.h"
 #include <glad/glad.h>
+#include <Renderer/GLStateCache.h>
 
 using glm::vec3;
 using glm::mat4;
@@ -19,6 +20,8 @@ class Line {
     vec3 endPoint;
     mat4 MVP;
     vec3 lineColor;
+    GLint mvpLocation;
+    GLint colorLocation;
 public:
     Line(vec3 start, vec3 end) {
 
@@ -61,6 +64,9 @@ public:
         glLinkProgram(shaderProgram);
         // check for linking errors
 
+        mvpLocation = glGetUniformLocation(shaderProgram, "MVP");
+        colorLocation = glGetUniformLocation(shaderProgram, "color");
+
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
 
@@ -72,16 +78,16 @@ public:
 
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
+        ToyEngine::GLStateCache::getInstance().bindVertexArray(VAO);
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        ToyEngine::GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices.data(), GL_STATIC_DRAW);
 
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(0);
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        ToyEngine::GLStateCache::getInstance().bindBuffer(GL_ARRAY_BUFFER, 0);
+        ToyEngine::GLStateCache::getInstance().bindVertexArray(0);
 
     }
 
@@ -96,19 +102,19 @@ public:
     }
 
     int draw() {
-        glUseProgram(shaderProgram);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "MVP"), 1, GL_FALSE, &MVP[0][0]);
-        glUniform3fv(glGetUniformLocation(shaderProgram, "color"  ), 1, &lineColor[0]);
+        ToyEngine::GLStateCache::getInstance().useProgram(shaderProgram);
+        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &MVP[0][0]);
+        glUniform3fv(colorLocation, 1, &lineColor[0]);
 
-        glBindVertexArray(VAO);
+        ToyEngine::GLStateCache::getInstance().bindVertexArray(VAO);
         glDrawArrays(GL_LINES, 0, 2);
         return 1;
     }
 
     ~Line() {
 
-        glDeleteVertexArrays(1, &VAO);
-        glDeleteBuffers(1, &VBO);
-        glDeleteProgram(shaderProgram);
+        ToyEngine::GLStateCache::getInstance().deleteVertexArray(VAO);
+        ToyEngine::GLStateCache::getInstance().deleteBuffer(VBO);
+        ToyEngine::GLStateCache::getInstance().deleteProgram(shaderProgram);
     }
 };
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <glad/glad.h>
+#include <Renderer/TextureArrayPool.h>
+
+namespace ToyEngine {
+	// One texel of the materials buffer texture, read as a uvec4 by the mesh shaders.
+	struct GpuMaterial {
+		uint32_t diffuseLayer;
+		uint32_t specularLayer;
+		float shininess;
+		uint32_t padding;
+	};
+
+	static_assert(sizeof(GpuMaterial) == 16, "GpuMaterial does not match one GL_RGBA32UI texel.");
+
+	// Texture pages a material samples from. They are draw state, the layers are not.
+	struct MaterialPages {
+		uint32_t diffusePage;
+		uint32_t specularPage;
+	};
+
+	// All materials in one buffer texture, indexed per instance. Materials are never removed, and adding one
+	// that already exists returns the existing index. The buffer is only written when materials were added.
+	class MaterialBuffer
+	{
+	public:
+		// The first material added, meant for the missing textures.
+		static constexpr uint32_t DEFAULT_MATERIAL = 0;
+
+		void init();
+
+		uint32_t add(const TextureLayer& diffuse, const TextureLayer& specular, float shininess);
+
+		// Upload the materials added since the last call and bind the buffer texture to unit.
+		void bind(GLuint unit);
+
+		const MaterialPages& getPages(uint32_t material) const {
+			return mPages[material < mPages.size() ? material : DEFAULT_MATERIAL];
+		}
+
+		size_t size() const {
+			return mMaterials.size();
+		}
+
+	private:
+		// diffuse page, diffuse layer, specular page, specular layer, shininess
+		using MaterialKey = std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, float>;
+
+		std::vector<GpuMaterial> mMaterials;
+		std::vector<MaterialPages> mPages;
+		std::map<MaterialKey, uint32_t> mIndices;
+
+		GLuint mBuffer = 0;
+		GLuint mTexture = 0;
+		size_t mCapacity = 0;
+		size_t mUploadedCount = 0;
+	};
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <Renderer/Vertex.h>
+
+namespace ToyEngine {
+	// How well an index buffer uses a FIFO post-transform cache of a given size.
+	struct VertexCacheStatistics {
+		// vertex shader invocations per triangle, 0.5 is the best possible and 3 the worst
+		float acmr = 0.0f;
+		// vertex shader invocations per vertex, 1 is the best possible
+		float atvr = 0.0f;
+	};
+
+	// Cache statistics before and after one stage of MeshOptimizer::optimize.
+	struct MeshOptimizationStep {
+		std::string name;
+		VertexCacheStatistics before;
+		VertexCacheStatistics after;
+	};
+
+	// Import time reordering of triangle lists. Everything here works on plain vectors, so it can be run
+	// and timed on any mesh outside the renderer.
+	class MeshOptimizer
+	{
+	public:
+		// Small enough to be a conservative estimate for current hardware.
+		static constexpr size_t DEFAULT_CACHE_SIZE = 16;
+		// How much worse than the Tipsify order the overdraw order may make the vertex cache.
+		static constexpr float DEFAULT_OVERDRAW_THRESHOLD = 1.05f;
+
+		// Simulate a FIFO cache over the triangles.
+		static VertexCacheStatistics analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount,
+			size_t cacheSize = DEFAULT_CACHE_SIZE);
+
+		// Merge vertices whose attributes are bitwise equal and drop unreferenced ones. Returns the new vertex count.
+		static size_t deduplicateVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+		// Tipsify (Sander et al.), fans triangles around vertices that are still in the cache. When clusters
+		// is given it receives the first triangle of every run that had to restart after a dead end.
+		static void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+			size_t cacheSize = DEFAULT_CACHE_SIZE, std::vector<size_t>* clusters = nullptr);
+
+		// Split a Tipsify ordered list into clusters and draw the ones facing away from the mesh center first,
+		// so the outside of a convex-ish mesh occludes its inside. Clusters are only split where the vertex
+		// cache stays within threshold of its current efficiency.
+		static void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+			const std::vector<size_t>& clusters, size_t cacheSize = DEFAULT_CACHE_SIZE,
+			float threshold = DEFAULT_OVERDRAW_THRESHOLD);
+
+		// Store vertices in the order the indices first reference them, so vertex fetch walks memory linearly.
+		static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+		// All of the above in order. Returns the statistics of every stage.
+		static std::vector<MeshOptimizationStep> optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
+			size_t cacheSize = DEFAULT_CACHE_SIZE);
+	};
+}
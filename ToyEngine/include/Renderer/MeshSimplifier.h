@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <Renderer/Vertex.h>
+
+namespace ToyEngine {
+	// One level of detail: indices into the original vertices and how far its surface is from the original one.
+	struct LodIndices {
+		std::vector<unsigned int> indices;
+		// Largest distance of an original vertex from the level's surface, in mesh units. Screen space error
+		// selection takes it as the most the level deviates.
+		float error = 0.0f;
+	};
+
+	// Quadric error edge collapse (Garland and Heckbert). A vertex is only ever collapsed onto another
+	// existing vertex, so every level indexes the original vertex buffer and only needs its own indices.
+	// Vertices sharing a position are collapsed together, which keeps UV and normal seams closed.
+	class MeshSimplifier
+	{
+	public:
+		static constexpr size_t MAX_LOD_LEVELS = 4;
+
+		// Collapse edges, cheapest first, until at most targetIndexCount indices are left or the next
+		// collapse would cost more than maxError. The cost is the root mean square distance to the planes
+		// collapsed into a vertex, which stays below the largest distance of any one vertex. error receives that
+		// largest distance, measured on the result, see LodIndices::error.
+		static std::vector<unsigned int> simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+			size_t targetIndexCount, float maxError, float* error = nullptr);
+
+		// Levels 1 and up for a mesh, each with roughly half the triangles of the one before and the last
+		// one with about a tenth of the original. Stops early when a level would not be much smaller.
+		static std::vector<LodIndices> buildLods(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+			size_t maxLevels = MAX_LOD_LEVELS);
+	};
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <Renderer/ModelLoader.h>
+
+namespace ToyEngine {
+	// Imported models cooked into .tmesh files in ModelCache, so that loading one again skips Assimp and the
+	// mesh conversion. A cooked file holds the nodes, materials and texture references as fixed size records,
+	// followed by every mesh's geometry packed like MeshGeometryData::pack() and 64 byte aligned, so that it
+	// goes from the mapped file to the GPU as it is. Files are named after a hash of the source path and the
+	// import settings. They list every file Assimp read or looked for with a hash of its contents, and a
+	// .stamps file next to them has the size and time of those, so that only files that were touched since
+	// are hashed again. A changed file, like an edited .mtl of an OBJ, cooks the model again.
+	class ModelCooker
+	{
+	public:
+		static constexpr uint32_t VERSION = 7;
+
+		// Of the path and the settings only, the file is not read. Never 0.
+		static uint64_t computeKey(const std::string& sourcePath, unsigned int importFlags, PositionFormat positionFormat);
+		// For ImportedSource::hash.
+		static uint64_t hashSource(const FileData& file);
+		static std::string getCookedPath(uint64_t key);
+
+		// Every mesh needs its data, import.sources are what it was imported from. Goes through a temporary
+		// file, so that no reader sees half of one.
+		static bool write(const std::string& cookedPath, uint64_t key, const ModelImport& import);
+		// Fill the nodes, meshes, materials and textures of import from a cooked file, read through the
+		// VirtualFileSystem as import.cookedFile. Loose and uncompressed packed files are mapped, not copied.
+		// The meshes' data only has what MeshGeometry needs besides the packed geometry, which stays in the
+		// mapping. Meshes in import.cachedGeometry get no data. False without a valid cooked file for key, or
+		// when one of its sources changed.
+		static bool read(const std::string& cookedPath, uint64_t key, ModelImport& import);
+	};
+}
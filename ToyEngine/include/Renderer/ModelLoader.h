@@ -0,0 +1,210 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <entt/entity/registry.hpp>
+#include <Engine/Component.h>
+#include <Renderer/GpuTransferQueue.h>
+#include <Resource/ResourceManager.h>
+#include <Resource/Texture.h>
+#include <Utils/FileData.h>
+
+struct aiScene;
+struct aiNode;
+struct aiMesh;
+
+namespace ToyEngine {
+	struct MeshOptimizationStep;
+
+	enum class ImportState {
+		Queued,
+		// reading and converting on a worker thread
+		Importing,
+		// waiting for or in the middle of the upload on the main thread
+		Uploading,
+		Done,
+		Failed,
+		Cancelled
+	};
+
+	// A texture a material refers to, decoded on a worker and uploaded during the upload.
+	struct ImportedTexture {
+		// file path, or the name of an embedded texture
+		std::string path;
+		TextureType type = TextureType::UNKNOWN;
+		bool isEmbedded = false;
+		// the compressed image of an embedded texture, copied since the Assimp scene is gone by the upload
+		std::vector<unsigned char> embeddedData;
+		// not requested when the file was already loaded
+		TextureRequest request;
+		Texture texture;
+	};
+
+	// Texture members index ModelImport::textures, -1 when the material has none.
+	struct ImportedMaterial {
+		bool isEmbedded = false;
+		float shininess = 20.0f;
+		glm::vec4 ambientColor = { 1, 1, 1, 1 };
+		glm::vec4 diffuseColor = { 1, 1, 1, 1 };
+		glm::vec4 specularColor = { 1, 1, 1, 1 };
+		std::vector<int32_t> diffuseTextures;
+		int32_t specularTexture = -1;
+		int32_t heightTexture = -1;
+		int32_t normalTexture = -1;
+		int32_t ambientTexture = -1;
+	};
+
+	struct ImportedMesh {
+		std::string name;
+		uint32_t material = 0;
+		// for MeshComponent
+		bool hasNormals = false;
+		bool hasTexCoords = false;
+		// null when the geometry was already on the GPU
+		std::unique_ptr<MeshGeometryData> data;
+		// data.pack() on its way to the GPU, null without the transfer queue
+		std::shared_ptr<GpuTransfer> transfer;
+		// data.pack() in ModelImport::cookedFile, when the model was loaded cooked
+		const uint8_t* packed = nullptr;
+		size_t packedSize = 0;
+		std::shared_ptr<MeshGeometry> geometry;
+	};
+
+	// A file Assimp read or looked for, so that the cooked file can tell when it is out of date.
+	struct ImportedSource {
+		std::string path;
+		// before it was read, not existing when Assimp did not find it
+		FileStatus status;
+		// of the contents
+		uint64_t hash = 0;
+	};
+
+	struct ImportedNode {
+		std::string name;
+		std::vector<uint32_t> meshes;
+		std::vector<uint32_t> children;
+	};
+
+	// One model on its way into the scene. The import job owns everything but the atomics until it
+	// switches the state to Uploading, from then on the main thread does.
+	struct ModelImport {
+		std::string path;
+		std::string name;
+		// the entity returned to the caller, the model's nodes end up below it
+		entt::entity placeholder = entt::null;
+		PositionFormat positionFormat = PositionFormat::Snorm16;
+		// Meshes of the same file already on the GPU, by mesh index. Held so that they stay until the upload.
+		std::unordered_map<uint32_t, std::shared_ptr<MeshGeometry>> cachedGeometry;
+		// the .tmesh file the model was loaded from, see ModelCooker
+		FileData cookedFile;
+
+		std::atomic<ImportState> state{ ImportState::Queued };
+		// 0 to 1
+		std::atomic<float> progress{ 0.0f };
+		std::atomic<bool> cancelled{ false };
+		std::string error;
+
+		// root first
+		std::vector<ImportedNode> nodes;
+		std::vector<ImportedMesh> meshes;
+		std::vector<ImportedMaterial> materials;
+		std::vector<ImportedTexture> textures;
+		// the model file first, then the files it refers to, like the .mtl of an OBJ
+		std::vector<ImportedSource> sources;
+
+		size_t requestedTextures = 0;
+		size_t uploadedTextures = 0;
+		size_t uploadedMeshes = 0;
+
+		// The entities are built one per upload step as well, in node order. By node index, null until built.
+		std::vector<entt::entity> nodeEntities;
+		// what each node goes below, set once the parent node is built
+		std::vector<entt::entity> nodeParents;
+		size_t builtNodes = 0;
+		// of the node builtNodes
+		size_t builtNodeMeshes = 0;
+	};
+
+	// Loads models without blocking the frame. load() returns an empty placeholder entity right away. Assimp
+	// reads the file and the meshes are optimized and simplified on worker threads, or all of that comes
+	// from the model's cooked file when it was loaded before, see ModelCooker. Then the images are
+	// decoded on them. The data goes to the GPU through the transfer queue, and the main thread takes the
+	// textures and meshes into its pools one at a time, within a time budget per frame. Finally it builds
+	// the entities below the placeholder, also one at a time.
+	class ModelLoader
+	{
+	public:
+		// Imports read and converted but not uploaded yet hold all of their meshes in memory, so only this
+		// many run at a time and the others wait in the queue.
+		static constexpr size_t MAX_IMPORTS_IN_FLIGHT = 2;
+		static constexpr float DEFAULT_UPLOAD_BUDGET_MS = 4.0f;
+		// Images decoded but not uploaded yet, per import. Enough to keep every worker busy, decoding all
+		// textures of a large model at once would hold gigabytes of pixels.
+		static constexpr size_t MAX_TEXTURES_DECODED_AHEAD = 32;
+
+		entt::entity load(const std::string& path, const std::string& name, entt::registry& registry, entt::entity parent, PositionFormat positionFormat);
+
+		// The placeholder is removed once the import stops, which takes until the next ReadFile progress
+		// update or the next mesh when it is on a worker.
+		void cancel(entt::entity placeholder);
+
+		// Start queued imports and upload finished ones until the budget is used. Once per frame on the main thread.
+		void update(entt::registry& registry);
+
+		// Imports not done yet, in the order they were requested.
+		const std::vector<std::shared_ptr<ModelImport>>& getImports() const {
+			return mImports;
+		}
+
+		float getUploadBudget() const {
+			return mUploadBudget;
+		}
+
+		void setUploadBudget(float milliseconds) {
+			mUploadBudget = milliseconds;
+		}
+
+	private:
+		// Read the file and convert everything that does not need GL. Runs on a worker.
+		static void import(ModelImport& import);
+		static void importMaterial(ModelImport& import, const aiScene* scene, uint32_t materialIndex, std::unordered_map<std::string, int32_t>& textureIndices);
+		static uint32_t importNode(ModelImport& import, const aiNode* node);
+		// steps receives the statistics of MeshOptimizer::optimize, they are logged for the whole model.
+		static std::unique_ptr<MeshGeometryData> convertMesh(const aiMesh* mesh, PositionFormat positionFormat, std::vector<MeshOptimizationStep>& steps);
+
+		enum class UploadStep {
+			Progressed,
+			// the next texture and the next mesh are still being decoded or transferred
+			Waiting,
+			Finished
+		};
+
+		// Upload one texture or mesh, or build one entity once everything is up.
+		UploadStep uploadStep(ModelImport& import, entt::registry& registry);
+		// Build the next node or mesh entity. A subtree whose entity was deleted in the meantime is dropped.
+		void buildStep(ModelImport& import, entt::registry& registry);
+		// Start decoding the textures up to MAX_TEXTURES_DECODED_AHEAD past the last uploaded one.
+		void requestTextures(ModelImport& import);
+		void uploadTexture(ImportedTexture& texture);
+		void uploadMesh(ModelImport& import, uint32_t meshIndex);
+		entt::entity buildNode(const ModelImport& import, uint32_t nodeIndex, entt::registry& registry, entt::entity parent);
+		entt::entity buildMesh(ModelImport& import, uint32_t meshIndex, entt::registry& registry, entt::entity parent);
+		// Take the placeholder of a failed or cancelled import out of the scene, with whatever was built below it.
+		static void removePlaceholder(const ModelImport& import, entt::registry& registry);
+
+		static std::string getGeometryKey(const std::string& path, uint32_t meshIndex, PositionFormat positionFormat);
+
+		std::vector<std::shared_ptr<ModelImport>> mImports;
+		float mUploadBudget = DEFAULT_UPLOAD_BUDGET_MS;
+
+		// Textures loaded from files, by path.
+		ResourceManager mTextures;
+		// Meshes already on the GPU, by model path and mesh index. Placing a model again reuses them.
+		std::unordered_map<std::string, std::weak_ptr<MeshGeometry>> mGeometryCache;
+	};
+}
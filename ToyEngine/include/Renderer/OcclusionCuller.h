@@ -0,0 +1,148 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <Renderer/Vertex.h>
+
+namespace ToyEngine {
+	// Low polygon stand-in for a mesh, only rasterized into the occlusion depth buffer.
+	struct OccluderMesh {
+		static constexpr size_t DEFAULT_MAX_TRIANGLES = 256;
+
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		// The mesh's own triangles, which never cover a pixel the mesh does not. A simplified proxy may,
+		// for example where clustering closed a hole, so it only occludes for meshes flagged as occluders.
+		bool exact = true;
+
+		size_t getTriangleCount() const {
+			return indices.size() / 3;
+		}
+
+		// Small meshes are used as they are. Larger ones are simplified by vertex clustering on a grid
+		// that gets coarser until at most maxTriangles are left, then shrunk along the vertex normals by a
+		// cell diagonal, so that the clustered surface lies within the mesh. Returns nullptr for meshes
+		// without triangles.
+		static std::shared_ptr<const OccluderMesh> build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+			size_t maxTriangles = DEFAULT_MAX_TRIANGLES);
+	};
+
+	// Occluder triangle in screen space, set up once per cull and then rasterized into every tile row it touches.
+	// Edge functions are e = a * x + b * y + c, positive inside. Depth is interpolated the same way.
+	struct OccluderTriangle {
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		// pixel bounds, clamped to the depth buffer
+		int xMin;
+		int xMax;
+		int yMin;
+		int yMax;
+	};
+
+	// Software occlusion culling. Occluders are rasterized on the CPU into a low resolution depth buffer,
+	// 8 pixels at a time with AVX2 when the CPU has it. Occludees are then tested with their
+	// screen space bounds against a depth hierarchy: 32x32 pixel blocks, 8x8 pixel tiles, then pixels.
+	// Both stages are split across worker threads. Nothing is read back from the GPU, so the result
+	// only depends on what was submitted.
+	class OcclusionCuller
+	{
+	public:
+		static constexpr int WIDTH = 256;
+		static constexpr int HEIGHT = 128;
+		static constexpr int TILE_SIZE = 8;
+		static constexpr int BLOCK_SIZE = 32;
+		static constexpr size_t DEFAULT_TRIANGLE_BUDGET = 16384;
+
+		OcclusionCuller();
+		~OcclusionCuller();
+
+		OcclusionCuller(const OcclusionCuller&) = delete;
+		OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+		// Remove occluders and occludees. Statistics of the last cull are kept.
+		void clear();
+
+		// World space box. Returns the index of the occludee, which is the index into the visibility result.
+		// Boxes that are not finite are never culled.
+		size_t addOccludee(const glm::vec3& worldMin, const glm::vec3& worldMax);
+
+		// The occluder is skipped when its occludee is outside the frustum. Occluders with a higher
+		// priority are rasterized first, until the triangle budget is used up. The mesh has to stay alive until cull.
+		void addOccluder(size_t occludee, const OccluderMesh& mesh, const glm::mat4& model, float priority);
+
+		// Occludees marked 0 in frustumVisibility are neither rasterized nor tested, and stay 0.
+		void cull(const glm::mat4& viewProjection, const std::vector<uint8_t>& frustumVisibility);
+
+		const std::vector<uint8_t>& getVisibility() const {
+			return mVisible;
+		}
+
+		size_t size() const {
+			return mOccludeeMin.size();
+		}
+
+		// Occludees inside the frustum that were hidden by the last cull.
+		size_t getCulledCount() const {
+			return mCulledCount;
+		}
+
+		float getLastCullMilliseconds() const {
+			return mLastCullMilliseconds;
+		}
+
+		size_t getRasterizedTriangleCount() const {
+			return mRasterizedTriangleCount;
+		}
+
+		void setTriangleBudget(size_t budget) {
+			mTriangleBudget = budget;
+		}
+
+		// Depth in [0, 1], row major with the first row at the bottom of the screen.
+		const std::vector<float>& getDepthBuffer() const {
+			return mDepth;
+		}
+
+	private:
+		struct Occluder {
+			size_t occludee;
+			const OccluderMesh* mesh;
+			glm::mat4 model;
+			float priority;
+		};
+
+		void setupOccluders(size_t begin, size_t end, std::vector<OccluderTriangle>& triangles) const;
+		void binTriangles();
+		void rasterizeTileRow(int tileRow);
+		void buildBlocks();
+		bool isOccludeeVisible(size_t occludee) const;
+
+		std::vector<glm::vec3> mOccludeeMin;
+		std::vector<glm::vec3> mOccludeeMax;
+		std::vector<Occluder> mOccluders;
+
+		// per cull
+		glm::mat4 mViewProjection = glm::mat4(1.0f);
+		std::vector<const Occluder*> mSelectedOccluders;
+		std::vector<std::vector<OccluderTriangle>> mTriangleChunks;
+		// triangle indices per tile row, as (chunk, index) pairs
+		std::vector<std::vector<std::pair<uint32_t, uint32_t>>> mTileRowBins;
+
+		std::vector<float> mDepth;
+		// farthest depth per tile and per block
+		std::vector<float> mTileMaxDepth;
+		std::vector<float> mBlockMaxDepth;
+
+		std::vector<uint8_t> mVisible;
+		size_t mCulledCount = 0;
+		size_t mRasterizedTriangleCount = 0;
+		size_t mTriangleBudget = DEFAULT_TRIANGLE_BUDGET;
+		float mLastCullMilliseconds = 0.0f;
+	};
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+namespace ToyEngine {
+	class Shader;
+
+	// Passes are submitted in enum order.
+	enum class RenderPass : uint8_t {
+		Opaque = 0,
+		Transparent = 1,
+		Overlay = 2,
+	};
+
+	// Everything needed to issue one draw call. Produced during extraction so that
+	// submission never has to go back to the registry.
+	struct DrawPacket {
+		uint64_t sortKey = 0;
+		const Shader* shader = nullptr;
+		GLuint VAOIndex = 0;
+		// range of the mesh inside its VAO's buffers
+		uint32_t geometryId = 0;
+		GLsizei indexCount = 0;
+		GLuint firstIndex = 0;
+		GLint baseVertex = 0;
+		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, fixed per VAO
+		GLenum indexType = GL_UNSIGNED_INT;
+		// maps the stored positions to mesh space, folded into the instance's model matrix
+		glm::vec4 positionDequantization = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		// texture array pages, see TextureArrayPool
+		uint32_t diffusePage = 0;
+		uint32_t specularPage = 0;
+		// index into the MaterialBuffer, per instance and therefore not draw state
+		uint32_t materialIndex = 0;
+		glm::mat4 model = glm::mat4(1.0f);
+		glm::mat3 normalMatrix = glm::mat3(1.0f);
+
+		// Packets that can be drawn without changing any state in between. Materials whose textures share
+		// pages only differ in the layers they sample, so they do not split draws.
+		bool sharesDrawState(const DrawPacket& other) const {
+			return shader == other.shader && VAOIndex == other.VAOIndex && diffusePage == other.diffusePage
+				&& specularPage == other.specularPage;
+		}
+	};
+
+	class RenderQueue
+	{
+	public:
+		// Key layout, from the most significant bit:
+		// | pass 2 | shader 10 | material 16 | geometry 16 | depth 20 |
+		// Sorting by the key groups packets by the most expensive state change first.
+		// Pooled meshes share one VAO, so the geometry field keeps copies of a mesh together for instancing.
+		static uint64_t makeSortKey(RenderPass pass, GLuint program, uint32_t materialId, uint32_t geometryId, float viewDepth, float farPlane);
+
+		// Returns a small stable id for the texture pages of a material so that it fits into the key.
+		uint32_t getMaterialId(uint32_t diffusePage, uint32_t specularPage);
+
+		void push(const DrawPacket& packet) {
+			mPackets.push_back(packet);
+		}
+
+		// Drop the packets whose flag is 0, keeping the submission order. keep is indexed by submission order.
+		void filter(const std::vector<uint8_t>& keep);
+
+		// LSD radix sort of the keys. Packets are not moved, only the order is.
+		void sort();
+
+		void clear();
+
+		size_t size() const {
+			return mPackets.size();
+		}
+
+		bool empty() const {
+			return mPackets.empty();
+		}
+
+		// Access in sorted order. Only valid after sort().
+		const DrawPacket& getSorted(size_t i) const {
+			return mPackets[mOrder[i]];
+		}
+
+	private:
+		std::vector<DrawPacket> mPackets;
+
+		std::vector<uint64_t> mKeys;
+		std::vector<uint64_t> mKeysScratch;
+		std::vector<uint32_t> mOrder;
+		std::vector<uint32_t> mOrderScratch;
+
+		std::unordered_map<uint64_t, uint32_t> mMaterialIds;
+	};
+}
@@ -3,11 +3,13 @@
 #include "GLFW/glfw3.h"
 #include "Renderer/Camera.h"
 #include <string>
+#include <algorithm>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "Resource/Texture.h"
 #include "Renderer/Shader.h"
+#include <Renderer/ShaderLibrary.h>
 #include "UI/View/ImGuiManager.h"
 #include "../../submodule/FileExplorer/imfilebrowser.h"
 #include "Engine/Component.h"
@@ -15,6 +17,16 @@
 #include "../Engine/Scene.h"
 #include <Resource/ResourceManager.h>
 #include <Renderer/SkyBox.h>
+#include <Renderer/RenderQueue.h>
+#include <Renderer/InstanceBuffer.h>
+#include <Renderer/IndirectBuffer.h>
+#include <Renderer/FrustumCuller.h>
+#include <Renderer/OcclusionCuller.h>
+#include <Renderer/GpuCuller.h>
+#include <Renderer/LightBuffer.h>
+#include <Renderer/MaterialBuffer.h>
+#include <Renderer/FrameConstants.h>
+#include <Renderer/ModelLoader.h>
 
 
 namespace ToyEngine{
@@ -23,10 +35,73 @@ namespace ToyEngine{
 		public:
 			//void tick();
 			void afterDraw();
+			// Clears the frame and uploads the per-frame uniform blocks.
 			void preDraw();
+			void onFramebufferResize(int width, int height);
 			void drawGridLine();
 			void drawCoordinateIndicator(glm::vec3 position);
-			void drawMesh(const TransformComponent& transform, const MeshComponent& mesh, MaterialComponent textures);
+			// Extract a draw packet for the mesh. Nothing is drawn until drawRenderQueue.
+			// Meshes without bounds are never culled.
+			void submitMesh(const TransformComponent& transform, const MeshComponent& mesh, const MaterialComponent& material, const BoundsComponent* bounds);
+			// Sort the queued packets and draw them, only changing state between packets when needed.
+			void drawRenderQueue();
+			// Mesh draw calls issued by the last drawRenderQueue. A multi draw counts as one.
+			size_t getDrawCallCount() const {
+				return mDrawCallCount;
+			}
+			// Meshes rejected by frustum culling in the last frame, by the scene's spatial index and by the sphere test.
+			size_t getCulledCount() const {
+				return mBroadphaseCulledCount + mFrustumCuller.getCulledCount();
+			}
+			void setBroadphaseCulledCount(size_t count) {
+				mBroadphaseCulledCount = count;
+			}
+			const OcclusionCuller& getOcclusionCuller() const {
+				return mOcclusionCuller;
+			}
+			bool isOcclusionCullingEnabled() const {
+				return mOcclusionCullingEnabled;
+			}
+			void setOcclusionCullingEnabled(bool enabled) {
+				mOcclusionCullingEnabled = enabled;
+			}
+			// Resident meshes stay on the GPU between frames and are culled there. Returns the instance handle.
+			uint32_t addResidentMesh(const TransformComponent& transform, const MeshComponent& mesh, const MaterialComponent& material, const BoundsComponent& bounds);
+			void updateResidentMesh(uint32_t instance, const TransformComponent& transform);
+			void removeResidentMesh(uint32_t instance);
+			// After the world matrix of a light changed.
+			void markLightsDirty() {
+				mLightBuffer.markDirty();
+			}
+			// Cull the resident meshes with a compute pass and draw the visible ones, instead of submitMesh and drawRenderQueue.
+			void drawResidentMeshes();
+			const GpuCuller& getGpuCuller() const {
+				return mGpuCuller;
+			}
+			bool isGpuCullingEnabled() const {
+				return mGpuCullingEnabled;
+			}
+			void setGpuCullingEnabled(bool enabled) {
+				mGpuCullingEnabled = enabled && GpuCuller::isSupported();
+			}
+			// Screen space error in pixels up to which a coarser level of detail is used.
+			float getLodPixelError() const {
+				return mLodPixelError;
+			}
+			void setLodPixelError(float pixels) {
+				mLodPixelError = std::max(pixels, 0.01f);
+			}
+			// How positions of meshes imported from now on are stored on the GPU.
+			PositionFormat getPositionFormat() const {
+				return mPositionFormat;
+			}
+			void setPositionFormat(PositionFormat format) {
+				mPositionFormat = format;
+			}
+			// Frustum of the current frame's camera. Valid after preDraw.
+			Frustum getViewFrustum() const {
+				return Frustum::fromMatrix(mFrameConstants.viewProjection);
+			}
 			void drawImGuiManager();
 			void drawPointLight();
 			void initGrid();
@@ -34,11 +109,13 @@ namespace ToyEngine{
 			void setupImGUI();
 			entt::entity loadModel(std::string path, std::string modelName, entt::registry& registry, entt::entity parent);
 
-			void setupTextureOfType(entt::entity entity, aiTextureType type, aiMaterial* const& pMaterial, const std::string& directory, const aiScene* scene);
-
-			void getTexturesOfType(aiTextureType type, aiMaterial* const& pMaterial, std::vector<Texture>& vecToAdd);
+			// Models load in the background, the entity returned is a placeholder they end up under.
+			ModelLoader& getModelLoader() {
+				return mModelLoader;
+			}
 
-			void applyLighting(Shader* shader);
+			// Add the material's texture layers and shininess to the material buffer, with the missing textures as fallback.
+			uint32_t registerMaterial(const MaterialComponent& material);
 
 			static RenderSystem instance;
 
@@ -55,10 +132,22 @@ namespace ToyEngine{
 			float lastFrameTime = 0.0f; 
 			std::vector<float> mGridPoints;
 			void bindSiblings(entt::registry& registry, entt::entity curr, entt::entity& prev);
-			entt::entity processNode(aiNode* node, const aiScene* scene, entt::registry& registry, entt::entity parent, std::vector<Texture>& textures, const string& directory);
-			entt::entity processMesh(aiMesh* mesh, const aiScene* scene, entt::registry& registry, entt::entity parent, std::vector<Texture>& textures, const string& directory);
+			void updateFrameConstants();
+
+			glm::mat4 computeModelMatrix(const TransformComponent& transform) const;
+
+			// Everything but the model matrix and the sort key.
+			DrawPacket makeDrawPacket(const MeshComponent& mesh, const MaterialComponent& material, size_t lod = 0) const;
+			// Pixels per unit at a view depth of 1, over the allowed LOD error in pixels.
+			float getLodErrorScale() const;
 
-			aiColor4D getColorFromMaterialOfType(const aiTextureType type, const aiMaterial* const pMaterial);
+			// State bound by the previous mesh draw, so that only what changes gets set.
+			struct BoundDrawState {
+				const Shader* shader = nullptr;
+				GLuint VAOIndex = 0;
+			};
+			// Returns true when the VAO changed, so that the caller can point its instance attributes.
+			bool applyDrawState(const DrawPacket& packet, BoundDrawState& bound);
 
 			GLuint mGridVBOIndex;
 			GLuint mGridVAOIndex;
@@ -70,12 +159,37 @@ namespace ToyEngine{
 
 			glm::vec3 mGridLineColor = glm::vec3(255, 0, 0);
 			
-			ResourceManager rm;
-
 			Texture mMissingTextureDiffuse;
 			Texture mMissingTextureSpecular;
 
 			SkyBox mSkyBox;
+
+			RenderQueue mRenderQueue;
+			FrustumCuller mFrustumCuller;
+			size_t mBroadphaseCulledCount = 0;
+			OcclusionCuller mOcclusionCuller;
+			bool mOcclusionCullingEnabled = true;
+			GpuCuller mGpuCuller;
+			bool mGpuCullingEnabled = false;
+			float mLodPixelError = 1.0f;
+			PositionFormat mPositionFormat = PositionFormat::Snorm16;
+			InstanceBuffer mInstanceBuffer;
+			std::vector<InstanceData> mInstances;
+			// (first sorted packet, instance count)
+			std::vector<std::pair<size_t, size_t>> mInstanceBatches;
+			IndirectBuffer mIndirectBuffer;
+			std::vector<DrawElementsIndirectCommand> mIndirectCommands;
+			size_t mDrawCallCount = 0;
+
+			ModelLoader mModelLoader;
+
+			LightBuffer mLightBuffer;
+			MaterialBuffer mMaterialBuffer;
+
+			FrameConstants mFrameConstants{};
+			UniformBuffer mFrameConstantsBuffer;
+			int mViewportWidth = 1920;
+			int mViewportHeight = 1080;
 	};
 }
 
@@ -1,17 +1,59 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <Renderer/GLStateCache.h>
 
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstdint>
+#include <unordered_map>
 #include "glm/glm.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 
 namespace ToyEngine {
+    // FNV-1a. constexpr so that uniform names used on hot paths are hashed at compile time.
+    constexpr uint32_t hashUniformName(std::string_view name)
+    {
+        uint32_t hash = 2166136261u;
+        for (char c : name) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // "model"_uniform
+    constexpr uint32_t operator""_uniform(const char* name, size_t length)
+    {
+        return hashUniformName(std::string_view(name, length));
+    }
+
+    struct UniformInfo {
+        GLint location = -1;
+        GLenum type = GL_NONE;
+        GLint arraySize = 1;
+    };
+
+    struct UniformBlockInfo {
+        GLuint index = GL_INVALID_INDEX;
+        GLint dataSize = 0;
+    };
+
+    // A uniform location resolved once, typed so that the matching glUniform call is picked at compile time.
+    template<typename T>
+    struct UniformHandle {
+        GLint location = -1;
+
+        bool isValid() const {
+            return location >= 0;
+        }
+    };
+
     class Shader
     {
     public:
@@ -19,39 +61,138 @@ namespace ToyEngine {
         Shader() = default;
         // constructor generates the shader on the fly
         Shader(const char* vertexPath, const char* fragmentPath);
+        // Takes ownership of an already linked program, e.g. one restored from a program binary.
+        explicit Shader(GLuint linkedProgram);
+
+        static std::string readSource(const char* path);
+        // Compile and link a program. Set retrievable when the binary will be read back with glGetProgramBinary.
+        static GLuint compileProgram(const std::string& vertexCode, const std::string& fragmentCode, bool retrievable);
+        static GLuint compileComputeProgram(const std::string& computeCode, bool retrievable);
 
         // activate the shader
         void use()
         {
-            glUseProgram(ID);
+            GLStateCache::getInstance().useProgram(ID);
+        }
+
+        // Location of an active uniform, -1 if the program does not use it.
+        GLint getUniformLocation(uint32_t nameHash) const
+        {
+            auto iter = mUniforms.find(nameHash);
+            return iter != mUniforms.end() ? iter->second.location : -1;
+        }
+
+        const UniformInfo* getUniformInfo(std::string_view name) const
+        {
+            auto iter = mUniforms.find(hashUniformName(name));
+            return iter != mUniforms.end() ? &iter->second : nullptr;
+        }
+
+        const UniformBlockInfo* getUniformBlockInfo(std::string_view name) const
+        {
+            auto iter = mUniformBlocks.find(hashUniformName(name));
+            return iter != mUniformBlocks.end() ? &iter->second : nullptr;
+        }
+
+        template<typename T>
+        UniformHandle<T> getUniformHandle(uint32_t nameHash) const
+        {
+            UniformHandle<T> handle;
+            auto iter = mUniforms.find(nameHash);
+            if (iter != mUniforms.end()) {
+                if (!isCompatibleUniformType<T>(iter->second.type)) {
+                    std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH for program " << ID << std::endl;
+                    return handle;
+                }
+                handle.location = iter->second.location;
+            }
+            return handle;
         }
 
-        // utility uniform functions
-        void setUniform(const std::string& name, bool value) const
+        template<typename T>
+        UniformHandle<T> getUniformHandle(std::string_view name) const
         {
-            glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+            return getUniformHandle<T>(hashUniformName(name));
         }
 
-        void setUniform(const std::string& name, int value) const
+        // typed uniform functions, no lookup at all
+        void setUniform(UniformHandle<bool> handle, bool value) const
         {
-            glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+            glUniform1i(handle.location, (int)value);
         }
-        void setUniform(const std::string& name, float value) const
+
+        void setUniform(UniformHandle<int> handle, int value) const
+        {
+            glUniform1i(handle.location, value);
+        }
+
+        void setUniform(UniformHandle<float> handle, float value) const
+        {
+            glUniform1f(handle.location, value);
+        }
+
+        void setUniform(UniformHandle<glm::mat4> handle, const glm::mat4& value) const
+        {
+            glUniformMatrix4fv(handle.location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+
+        void setUniform(UniformHandle<glm::vec3> handle, const glm::vec3& vec) const
+        {
+            glUniform3f(handle.location, vec.x, vec.y, vec.z);
+        }
+
+        void setUniform(UniformHandle<glm::ivec2> handle, const glm::ivec2& vec) const
         {
-            glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+            glUniform2i(handle.location, vec.x, vec.y);
         }
 
-        void setUniform(const std::string& name, glm::mat4 value)const 
+        // utility uniform functions, resolved through the reflection table instead of the driver
+        void setUniform(std::string_view name, bool value) const
         {
-            glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+            glUniform1i(getUniformLocation(hashUniformName(name)), (int)value);
         }
 
-        void setUniform(const std::string& name, glm::vec3 vec) const
+        void setUniform(std::string_view name, int value) const
         {
-            glUniform3f(glGetUniformLocation(ID, name.c_str()), vec.x, vec.y, vec.z);
+            glUniform1i(getUniformLocation(hashUniformName(name)), value);
+        }
+        void setUniform(std::string_view name, float value) const
+        {
+            glUniform1f(getUniformLocation(hashUniformName(name)), value);
+        }
+
+        void setUniform(std::string_view name, glm::mat4 value)const
+        {
+            glUniformMatrix4fv(getUniformLocation(hashUniformName(name)), 1, GL_FALSE, glm::value_ptr(value));
+        }
+
+        void setUniform(std::string_view name, glm::vec3 vec) const
+        {
+            glUniform3f(getUniformLocation(hashUniformName(name)), vec.x, vec.y, vec.z);
         }
     private:
         // utility function for checking shader compilation/linking errors.
-        void checkCompileErrors(unsigned int shader, std::string type);
+        static void checkCompileErrors(unsigned int shader, std::string type);
+
+        // Enumerate active uniforms and uniform blocks after linking.
+        void reflect();
+        void addUniform(const std::string& name, const UniformInfo& info);
+
+        template<typename T>
+        static bool isCompatibleUniformType(GLenum type);
+
+        std::unordered_map<uint32_t, UniformInfo> mUniforms;
+        std::unordered_map<uint32_t, UniformBlockInfo> mUniformBlocks;
     };
+
+    template<> inline bool Shader::isCompatibleUniformType<bool>(GLenum type) { return type == GL_BOOL || type == GL_INT; }
+    template<> inline bool Shader::isCompatibleUniformType<float>(GLenum type) { return type == GL_FLOAT; }
+    template<> inline bool Shader::isCompatibleUniformType<glm::vec3>(GLenum type) { return type == GL_FLOAT_VEC3; }
+    template<> inline bool Shader::isCompatibleUniformType<glm::ivec2>(GLenum type) { return type == GL_INT_VEC2; }
+    template<> inline bool Shader::isCompatibleUniformType<glm::mat4>(GLenum type) { return type == GL_FLOAT_MAT4; }
+    // samplers are set through integer texture units
+    template<> inline bool Shader::isCompatibleUniformType<int>(GLenum type)
+    {
+        return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE || type == GL_SAMPLER_2D_ARRAY;
+    }
 }
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <Renderer/Shader.h>
+
+namespace ToyEngine {
+	// Owns every linked program. A program is identified by its source paths and defines,
+	// so that meshes sharing a material share the same Shader instead of compiling their own.
+	// Linked binaries are kept on disk and reused across runs when the driver supports it.
+	class ShaderLibrary
+	{
+	public:
+		static ShaderLibrary& getInstance();
+
+		// Defines are injected right after the #version line as "#define <define>".
+		std::shared_ptr<Shader> get(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& defines = {});
+		// Compute programs need GL 4.3 or ARB_compute_shader.
+		std::shared_ptr<Shader> getCompute(const std::string& computePath, const std::vector<std::string>& defines = {});
+
+		void setCacheDirectory(const std::filesystem::path& directory) {
+			mCacheDirectory = directory;
+		}
+
+		// Drop the library's references. Programs still in use stay alive through their owners.
+		void clear() {
+			mPrograms.clear();
+		}
+
+		size_t size() const {
+			return mPrograms.size();
+		}
+
+	private:
+		ShaderLibrary() = default;
+
+		static std::string injectDefines(const std::string& source, const std::vector<std::string>& defines);
+
+		// compile(retrievable) builds the program from the sources when there is no usable binary.
+		GLuint compileCached(const std::vector<std::string>& sources, const std::function<GLuint(bool)>& compile);
+		GLuint loadBinary(const std::filesystem::path& cachePath);
+		void saveBinary(const std::filesystem::path& cachePath, GLuint program);
+
+		bool isBinaryCacheSupported();
+
+		std::unordered_map<std::string, std::shared_ptr<Shader>> mPrograms;
+
+		std::filesystem::path mCacheDirectory = "ShaderCache";
+		// Vendor, renderer and version. A driver update invalidates every cached binary.
+		std::string mDriverId;
+		int mBinaryCacheSupported = -1;
+	};
+}
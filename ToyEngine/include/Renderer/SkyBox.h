@@ -1,18 +1,18 @@
 #pragma once
 #include <imgui.h>
 #include <vector>
+#include <memory>
 #include <string>
 #include <glad/glad.h>
 #include <Resource/StbImageLoader.h>
 #include "Shader.h"
 
 namespace ToyEngine {
-    class Camera;
     class SkyBox
     {
     public:
         SkyBox() = default;
-        SkyBox(const std::vector<std::string>& faces, std::shared_ptr<Camera> camera);
+        SkyBox(const std::vector<std::string>& faces);
 
         void render();
     private:
@@ -22,8 +22,7 @@ namespace ToyEngine {
         GLuint mTextureId;
         GLuint mCubeVBO;
         GLuint mCubeVAO;
-        Shader mShader;
-        std::shared_ptr<Camera> mCamera;
+        std::shared_ptr<Shader> mShader;
     };
 }
 
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <glad/glad.h>
+
+namespace ToyEngine {
+	// Where a texture lives inside the pool. A page keeps its id when it grows, but not its GL name.
+	struct TextureLayer {
+		static constexpr uint32_t INVALID_PAGE = UINT32_MAX;
+
+		uint32_t page = INVALID_PAGE;
+		uint32_t layer = 0;
+
+		bool isValid() const {
+			return page != INVALID_PAGE;
+		}
+	};
+
+	// Textures of the same size and format share GL_TEXTURE_2D_ARRAY pages, so that draws sampling different
+	// textures only differ in a layer index and can be merged. A full page doubles its layer count up to the
+	// GL limit, after that a new page of the same kind is started. Block compressed textures keep their
+	// format in pages of their own.
+	class TextureArrayPool
+	{
+	public:
+		// Every 8 bit source format fits, blitting expands RED and RGB the same way sampling them does.
+		static constexpr GLenum DEFAULT_FORMAT = GL_RGBA8;
+
+		static TextureArrayPool& getInstance();
+
+		static bool isCompressed(GLenum format);
+
+		// Copy all mip levels of a mipmap complete GL_TEXTURE_2D into a free layer of a matching page.
+		TextureLayer add(GLuint texture, int width, int height, GLenum format = DEFAULT_FORMAT);
+
+		GLuint getTexture(uint32_t page) const {
+			return page < mPages.size() ? mPages[page].texture : 0;
+		}
+
+		size_t getPageCount() const {
+			return mPages.size();
+		}
+
+		size_t getLayerCount() const;
+
+		size_t getTotalAllocatedBytes() const;
+
+	private:
+		struct Page {
+			GLuint texture = 0;
+			int width = 0;
+			int height = 0;
+			GLenum format = DEFAULT_FORMAT;
+			int levels = 1;
+			uint32_t layerCount = 0;
+			uint32_t capacity = 0;
+		};
+
+		// width, height, format
+		using PageKey = std::tuple<int, int, GLenum>;
+
+		TextureArrayPool() = default;
+
+		static int getLevelCount(int width, int height);
+		static size_t getPageBytes(const Page& page);
+
+		// Reallocate the page with room for capacity layers and copy the used layers over.
+		void grow(Page& page, uint32_t capacity);
+		// A source layer below 0 reads a GL_TEXTURE_2D instead of an array layer.
+		void copyLayer(GLuint source, GLint sourceLayer, GLuint destination, GLint destinationLayer, int width, int height, int levels);
+		// Compressed textures cannot be blitted, their blocks go through a pixel buffer instead. Copies all
+		// layers of a page when the source is one.
+		void copyCompressed(GLenum sourceTarget, GLuint source, GLuint destination, GLint destinationLayer, const Page& page,
+			GLsizei layerCount);
+
+		std::vector<Page> mPages;
+		// the page that currently takes new layers of each kind
+		std::map<PageKey, uint32_t> mOpenPages;
+		GLuint mReadFramebuffer = 0;
+		GLuint mDrawFramebuffer = 0;
+		GLuint mCopyBuffer = 0;
+		size_t mCopyBufferBytes = 0;
+		GLint mMaxLayers = 0;
+	};
+}
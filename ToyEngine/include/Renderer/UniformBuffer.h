@@ -0,0 +1,39 @@
+#pragma once
+#include <glad/glad.h>
+#include <string_view>
+
+namespace ToyEngine {
+	// Fixed binding points shared by every program. Shader binds blocks with these names when it is linked.
+	enum UniformBlockBinding : GLuint {
+		LIGHTS_BLOCK_BINDING = 0,
+		FRAME_CONSTANTS_BLOCK_BINDING = 1,
+	};
+
+	// Returns GL_INVALID_INDEX for blocks that are not shared engine blocks.
+	GLuint getUniformBlockBinding(std::string_view blockName);
+
+	class UniformBuffer
+	{
+	public:
+		UniformBuffer() = default;
+
+		// Allocate the buffer and attach it to the binding point.
+		void init(GLsizeiptr size, GLuint bindingPoint);
+
+		// Replace the whole content. The old storage is orphaned so the upload does not wait on draws still reading it.
+		void upload(const void* data, GLsizeiptr size);
+
+		GLuint getBufferIndex() const {
+			return mBufferIndex;
+		}
+
+		GLuint getBindingPoint() const {
+			return mBindingPoint;
+		}
+
+	private:
+		GLuint mBufferIndex = 0;
+		GLuint mBindingPoint = 0;
+		GLsizeiptr mSize = 0;
+	};
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "glm/glm.hpp"
+
+namespace ToyEngine {
+    #define MAX_BONE_INFLUENCE 4
+
+    struct Vertex {
+        glm::vec3 Position;
+        glm::vec3 Normal;
+        glm::vec2 TexCoords;
+        glm::vec3 Tangent;
+        // bitangent
+        glm::vec3 Bitangent;
+        //bone indexes which will influence this vertex
+        int mBoneIDs[MAX_BONE_INFLUENCE];
+        //weights from each bone
+        float mWeights[MAX_BONE_INFLUENCE];
+    };
+}
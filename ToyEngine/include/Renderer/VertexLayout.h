@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <Renderer/Vertex.h>
+
+namespace ToyEngine {
+	// How positions are stored on the GPU. The quantized formats store positions relative to the mesh bounds,
+	// and a per-mesh dequantization transform gets folded into the model matrix when drawing.
+	enum class PositionFormat : uint8_t {
+		Float32 = 0,
+		Half = 1,
+		Snorm16 = 2,
+	};
+
+	struct VertexAttribute {
+		GLuint location;
+		GLint components;
+		GLenum type;
+		GLboolean normalized;
+		// read as an integer vector in the shader
+		bool integer;
+		size_t offset;
+	};
+
+	// GPU vertex format of pooled meshes. Every layout feeds the same shader inputs:
+	// 0 position with the bitangent sign in w, 1 and 3 octahedral normal and tangent, 2 texture coordinates,
+	// and for skinned layouts 5 bone ids and 6 bone weights. The bitangent is rebuilt in the shader.
+	// Texture coordinates are half precision with quantized positions, unless a mesh's do not fit.
+	class VertexLayout
+	{
+	public:
+		// Highest attribute location a layout can use, plus one.
+		static constexpr GLuint MAX_VERTEX_ATTRIBUTES = 7;
+
+		// Largest texture coordinate magnitude half precision stores exactly to 1/2048 of a texture.
+		static constexpr float MAX_HALF_TEXCOORD = 1.0f;
+
+		// Layouts are immutable and shared, so they can be compared by address. Float32 positions always
+		// come with float texture coordinates.
+		static const VertexLayout& get(PositionFormat position, bool skinned, bool halfTexCoords);
+		// The layout for these vertices, with half texture coordinates only when all of them fit.
+		static const VertexLayout& select(PositionFormat position, bool skinned, const std::vector<Vertex>& vertices);
+
+		// xyz offset and w scale that map the stored positions of a mesh with these bounds back to mesh space.
+		glm::vec4 computeDequantization(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+		static glm::mat4 getDequantizationMatrix(const glm::vec4& dequantization);
+
+		// Tightly packed vertices in this layout, positions mapped through the inverse of dequantization.
+		std::vector<uint8_t> encode(const std::vector<Vertex>& vertices, const glm::vec4& dequantization) const;
+
+		// Point the attributes of the bound VAO at buffer and disable the per-vertex locations the layout does not use.
+		void setupAttributes(GLuint buffer) const;
+
+		PositionFormat getPositionFormat() const {
+			return mPositionFormat;
+		}
+
+		bool isSkinned() const {
+			return mSkinned;
+		}
+
+		bool hasHalfTexCoords() const {
+			return mHalfTexCoords;
+		}
+
+		size_t getStride() const {
+			return mStride;
+		}
+
+		const std::vector<VertexAttribute>& getAttributes() const {
+			return mAttributes;
+		}
+
+	private:
+		VertexLayout(PositionFormat position, bool skinned, bool halfTexCoords);
+
+		PositionFormat mPositionFormat;
+		bool mSkinned;
+		bool mHalfTexCoords;
+		size_t mStride = 0;
+		std::vector<VertexAttribute> mAttributes;
+	};
+}
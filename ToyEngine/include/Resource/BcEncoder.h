@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <Resource/ImageData.h>
+
+// glad is generated for core 3.3 without extensions, so the S3TC and BPTC formats are defined here and their
+// support is checked by TextureCooker. The values are the ones of the extension specifications.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM_ARB
+#define GL_COMPRESSED_RGBA_BPTC_UNORM_ARB 0x8E8C
+#endif
+
+namespace ToyEngine {
+	class JobSystem;
+
+	// Block compressed formats, 4x4 texels per block.
+	enum class BcFormat {
+		// RGB, 8 bytes per block
+		BC1,
+		// RGB with interpolated alpha, 16 bytes per block
+		BC3,
+		// two channels, for normal maps with z reconstructed in the shader, 16 bytes per block
+		BC5,
+		// RGBA at higher quality, 16 bytes per block
+		BC7
+	};
+
+	enum class BcQuality {
+		// bounding box endpoints
+		Fast,
+		// endpoints along the principal axis, refitted once
+		Normal,
+		// refitted until it stops improving, and every p-bit combination for BC7
+		High
+	};
+
+	// A full mip chain of block compressed levels, base level first.
+	struct CompressedImage {
+		BcFormat format = BcFormat::BC1;
+		int width = 0;
+		int height = 0;
+		std::vector<std::vector<uint8_t>> levels;
+		std::string error;
+
+		bool isValid() const {
+			return !levels.empty();
+		}
+	};
+
+	// CPU encoder and decoder of the BC formats. The BC1, BC3 and BC5 index selection uses SSE where
+	// available. BC7 is encoded with mode 6 only, a single subset of RGBA endpoints, which is what the
+	// decoder understands as well.
+	class BcEncoder
+	{
+	public:
+		static size_t getBlockBytes(BcFormat format) {
+			return format == BcFormat::BC1 ? 8 : 16;
+		}
+
+		static size_t getLevelBytes(BcFormat format, int width, int height) {
+			return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+		}
+
+		static GLenum getGLFormat(BcFormat format);
+
+		// Compress one level of RGBA8 texels, rows of blocks are split over the job system.
+		static std::vector<uint8_t> encode(const uint8_t* rgba, int width, int height, BcFormat format, BcQuality quality);
+		static std::vector<uint8_t> encode(const uint8_t* rgba, int width, int height, BcFormat format, BcQuality quality, JobSystem& jobs);
+		// Expand to RGBA8 and compress the whole mip chain, down to 1x1.
+		static CompressedImage compress(const ImageData& image, BcFormat format, BcQuality quality);
+
+		// Back to RGBA8. BC5 gets the z of the unit normal as blue. Fails on BC7 modes other than 6.
+		static bool decode(const uint8_t* blocks, int width, int height, BcFormat format, std::vector<uint8_t>& rgba);
+		// The base level as an image, for drivers without the format.
+		static ImageData decompress(const CompressedImage& image);
+
+	private:
+		static void encodeBlock(const uint8_t* texels, BcFormat format, BcQuality quality, uint8_t* block);
+		static void decodeBlock(const uint8_t* block, BcFormat format, uint8_t* texels, bool& supported);
+	};
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <string>
+#include <utility>
+#include "Resource/stb_image.h"
+
+namespace ToyEngine {
+	// Pixels decoded by stb_image, freed with the object. Move only.
+	class ImageData
+	{
+	public:
+		ImageData() = default;
+
+		ImageData(stbi_uc* pixels, int width, int height, int channels)
+			: mPixels(pixels), mWidth(width), mHeight(height), mChannels(channels) {}
+
+		// A failed decode, with the reason.
+		explicit ImageData(std::string error) : mError(std::move(error)) {}
+
+		ImageData(ImageData&& other) noexcept {
+			*this = std::move(other);
+		}
+
+		ImageData& operator=(ImageData&& other) noexcept {
+			if (this != &other) {
+				reset();
+				std::swap(mPixels, other.mPixels);
+				std::swap(mWidth, other.mWidth);
+				std::swap(mHeight, other.mHeight);
+				std::swap(mChannels, other.mChannels);
+				std::swap(mError, other.mError);
+			}
+			return *this;
+		}
+
+		ImageData(const ImageData&) = delete;
+		ImageData& operator=(const ImageData&) = delete;
+
+		~ImageData() {
+			reset();
+		}
+
+		void reset() {
+			if (mPixels) {
+				stbi_image_free(mPixels);
+				mPixels = nullptr;
+			}
+			mWidth = mHeight = mChannels = 0;
+		}
+
+		const stbi_uc* getPixels() const {
+			return mPixels;
+		}
+
+		int getWidth() const {
+			return mWidth;
+		}
+
+		int getHeight() const {
+			return mHeight;
+		}
+
+		int getChannels() const {
+			return mChannels;
+		}
+
+		const std::string& getError() const {
+			return mError;
+		}
+
+		bool isValid() const {
+			return mPixels != nullptr;
+		}
+
+	private:
+		stbi_uc* mPixels = nullptr;
+		int mWidth = 0;
+		int mHeight = 0;
+		int mChannels = 0;
+		std::string mError;
+	};
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <Resource/BcEncoder.h>
+
+namespace ToyEngine {
+	// KTX 2.0 container of block compressed 2D textures with their mip chain. Only what the encoder writes
+	// is read back: one layer, one face, no supercompression.
+	class Ktx2
+	{
+	public:
+		// Through a temporary file, so that no reader sees half of one.
+		static bool write(const std::string& path, const CompressedImage& image);
+
+		// The error of the image says what went wrong.
+		static CompressedImage read(const std::string& path);
+		static CompressedImage read(const uint8_t* data, size_t size);
+	};
+}
@@ -1,14 +1,16 @@
 #pragma once
 #include "ImageLoader.h"
+#include "ImageData.h"
 #include "stb_image.h"
 
 namespace ToyEngine {
+    // Safe to call from several threads at once, the flip only applies to the calling thread.
     class StbImageLoader :public ImageLoader
     {
     public:
-        static unsigned char*  getImageFrom (std::string path, int* width, int* height, int* channelNum, bool shouldFlip);
-        static unsigned char* getImageFrom (stbi_uc const* buffer, int len, bool shouldFlip, int& width, int& height, int& channels);
+        // An invalid ImageData with the reason when the image cannot be decoded.
+        static ImageData getImageFrom(const std::string& path, bool shouldFlip);
+        static ImageData getImageFrom(stbi_uc const* buffer, int len, bool shouldFlip);
     };
 
 }
-
@@ -3,6 +3,9 @@
 #include<vector>
 #include"Resource/stb_image.h"
 #include "glad/glad.h"
+#include <Resource/BcEncoder.h>
+#include <Resource/ImageData.h>
+#include <Renderer/TextureArrayPool.h>
 #include <string>
 #include <memory>
 namespace ToyEngine {
@@ -28,14 +31,31 @@ namespace ToyEngine {
 	public:
 		Texture() = default;
 
-		Texture(std::string path, TextureType type, bool flip) :mPath(path), mTextureType(type) {
+		// keepTexture2D keeps the GL_TEXTURE_2D for drawing it directly, like ImGui does. Otherwise only the
+		// copy in the texture arrays is left.
+		Texture(std::string path, TextureType type, bool flip, bool keepTexture2D = false) :mKeepTexture2D(keepTexture2D), mTextureType(type), mPath(path) {
 			loadFromPath(flip);
 		}
 
-		Texture(std::string path, TextureType type, stbi_uc const* buffer, int len, bool flip):mPath(path),mTextureType(type) {
+		Texture(std::string path, TextureType type, stbi_uc const* buffer, int len, bool flip):mTextureType(type), mPath(path) {
 			loadFromBuf(buffer, len, flip);
 		}
 
+		// Upload an image decoded beforehand, see TextureRequest.
+		Texture(std::string path, TextureType type, const ImageData& image) :mTextureType(type), mPath(path) {
+			upload(image);
+		}
+
+		// Upload the levels of a cooked texture as they are.
+		Texture(std::string path, TextureType type, const CompressedImage& image) :mTextureType(type), mPath(path) {
+			upload(image);
+		}
+
+		// Take over a mipmapped GL_TEXTURE_2D created elsewhere, like by the transfer queue.
+		Texture(std::string path, TextureType type, GLuint texture, int width, int height, GLenum format) :mTextureType(type), mPath(path) {
+			adopt(texture, width, height, format);
+		}
+
 		Texture(const Texture& other);
 		Texture& operator=(const Texture other);
 
@@ -47,9 +67,14 @@ namespace ToyEngine {
 			return mPath;
 		}
 
+		// The GL_TEXTURE_2D, 0 when only the copy in the texture arrays is kept.
 		GLuint getTextureIndex() const {
 			return mTextureIndex;
 		}
+		// Copy of the texture inside the shared texture arrays, what the mesh shaders sample.
+		const TextureLayer& getArrayLayer() const {
+			return mArrayLayer;
+		}
 		unsigned int getWidth() const {
 			return mWidth;
 		}
@@ -78,6 +103,11 @@ namespace ToyEngine {
 
 		void loadFromPath(bool flip);
 		void loadFromBuf(stbi_uc const* buffer, int len, bool shouldFlip);
+		void upload(const ImageData& image);
+		void upload(const CompressedImage& image);
+		void adopt(GLuint texture, int width, int height, GLenum format);
+		// Copy the texture into the texture arrays and free it, unless it is kept.
+		void addToArrayPool(GLenum format);
 
 		int mWidth=-1;
 		int mHeight=-1;
@@ -93,10 +123,45 @@ namespace ToyEngine {
 
 		GLuint mTextureIndex=INVALID_ID;
 
+		TextureLayer mArrayLayer;
+
+		bool mKeepTexture2D = false;
+
 		TextureType mTextureType;
 
 		std::string mPath;
 	};
+
+	// A texture whose image is decoded on a worker thread. Requesting the textures of a model one after the
+	// other decodes all of them at once. The transfer queue uploads each one once it is decoded, or the GL
+	// thread does when the queue is not running. Image files with a cooked texture load that instead.
+	class TextureRequest
+	{
+	public:
+		TextureRequest() = default;
+
+		// Any thread.
+		TextureRequest(std::string path, TextureType type, bool flip);
+		// Decode an image file in memory, like the embedded textures of a model.
+		TextureRequest(std::string path, TextureType type, std::vector<unsigned char> encoded, bool flip);
+
+		bool isRequested() const {
+			return mDecode != nullptr;
+		}
+
+		bool isReady() const;
+
+		// Create the texture, waiting for the decode and transfer if they are not done yet. The pixels are
+		// freed right after, so it can only be done once. GL thread only.
+		Texture upload();
+
+	private:
+		struct Decode;
+
+		std::shared_ptr<Decode> mDecode;
+		std::string mPath;
+		TextureType mTextureType = TextureType::UNKNOWN;
+	};
 }
 
 
@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <Resource/BcEncoder.h>
+#include <Resource/Texture.h>
+
+namespace ToyEngine {
+	// Block compressed copies of image files, stored as a .ktx2 file next to the source with the whole mip
+	// chain, so that textures load without decoding the image or building mips on the driver. Cooking is
+	// either done ahead of time for a directory or on demand the first time a texture is loaded.
+	class TextureCooker
+	{
+	public:
+		static TextureCooker& getInstance();
+
+		// Which formats the driver samples. Main thread, with the GL context current.
+		void init();
+
+		bool isSupported(BcFormat format) const {
+			return mSupported[static_cast<int>(format)];
+		}
+
+		// Two channel BC5 for normal maps, BC1 for opaque and BC3 for transparent images, or BC7 for both at
+		// high quality or without S3TC. BC7 only when the driver samples it, since a texture in a format it
+		// does not is decoded from the source image instead.
+		BcFormat selectFormat(TextureType type, bool hasAlpha, BcQuality quality) const;
+
+		static bool isCooked(const std::string& path);
+		static std::string getCookedPath(const std::string& path);
+
+		// Compress an image file next to it. Any thread.
+		bool cook(const std::string& path, TextureType type);
+		// Cook the images below the directory that have no up to date cooked file, returns how many.
+		size_t cookDirectory(const std::string& directory);
+
+		// The cooked texture of an image file if it is up to date, or cooked right away when cooking on
+		// demand. .ktx2 files are read as they are. Invalid when the source image has to be loaded instead.
+		// Any thread.
+		CompressedImage load(const std::string& path, TextureType type);
+
+		bool isCookingOnDemand() const {
+			return mCookingOnDemand;
+		}
+
+		void setCookingOnDemand(bool cookingOnDemand) {
+			mCookingOnDemand = cookingOnDemand;
+		}
+
+		BcQuality getQuality() const {
+			return mQuality;
+		}
+
+		void setQuality(BcQuality quality) {
+			mQuality = quality;
+		}
+
+	private:
+		// A cook other threads may wait for.
+		struct PendingCook {
+			bool done = false;
+			CompressedImage image;
+		};
+
+		TextureCooker() = default;
+
+		// Decode, compress and write the cooked file. A path being cooked already is waited for instead, since
+		// two images of a model often share one.
+		CompressedImage compress(const std::string& path, TextureType type);
+		CompressedImage cookImage(const std::string& path, TextureType type);
+
+		bool mSupported[4] = {};
+		std::atomic<bool> mCookingOnDemand{ false };
+		std::atomic<BcQuality> mQuality{ BcQuality::Normal };
+
+		std::mutex mPendingMutex;
+		std::condition_variable mCookFinished;
+		std::unordered_map<std::string, std::shared_ptr<PendingCook>> mPendingCooks;
+	};
+}
@@ -38,17 +38,17 @@ namespace ui {
 
 		void setPosition(glm::vec3 position) {
 			if (mSelectedEntity != entt::null) {
-				mRegistry.patch<ToyEngine::TransformComponent>(mSelectedEntity, [position](ToyEngine::TransformComponent& transform) {transform.localPos = position; });
+				mRegistry.patch<ToyEngine::TransformComponent>(mSelectedEntity, [position](ToyEngine::TransformComponent& transform) {transform.setLocalPosition(position); });
 			}
 		}
 		void setRotation(glm::vec3 rotation) {
 			if (mSelectedEntity != entt::null) {
-				mRegistry.patch<ToyEngine::TransformComponent>(mSelectedEntity, [rotation](ToyEngine::TransformComponent& transform) {transform.rotation_eular = rotation; });
+				mRegistry.patch<ToyEngine::TransformComponent>(mSelectedEntity, [rotation](ToyEngine::TransformComponent& transform) {transform.setLocalRotation(rotation); });
 			}
 		}
 		void setScale(glm::vec3 scale) {
 			if (mSelectedEntity != entt::null) {
-				mRegistry.patch<ToyEngine::TransformComponent>(mSelectedEntity, [scale](ToyEngine::TransformComponent& transform) {transform.scale = scale; });
+				mRegistry.patch<ToyEngine::TransformComponent>(mSelectedEntity, [scale](ToyEngine::TransformComponent& transform) {transform.setLocalScale(scale); });
 			}
 		}
 
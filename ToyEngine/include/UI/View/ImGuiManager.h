@@ -2,6 +2,7 @@
 #include "glm/glm.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <functional>
 #include <memory>
 #include <string>
 #include "../../../submodule/FileExplorer/imfilebrowser.h"
@@ -74,8 +75,20 @@ namespace ui
 		ImGuiManager(ImGuiManager const&) = delete;
 		void operator=(ImGuiManager const&) = delete;
 	private:
+		// Work started from a button, run as a job so that the UI keeps drawing meanwhile.
+		struct BackgroundTask {
+			bool running = false;
+			// of the last run
+			std::string result;
+		};
+
 		ImGuiManager();
 
+		// The button, or that the task is running, then the result of its last run. True when pressed.
+		bool renderTaskButton(const BackgroundTask& task, const char* label);
+		// The result is shown once the function returned.
+		void startTask(BackgroundTask& task, const char* name, std::function<std::string()> function);
+
 		std::shared_ptr<InspectorPanelController> mInspectorPanelController;
 		std::shared_ptr<SceneHierarchyController> mHierarchyContorller;
 		std::shared_ptr<FileExplorerController> mFileExplorerController;
@@ -88,6 +101,13 @@ namespace ui
 		ImGuiContext mContext;
 		std::shared_ptr<ToyEngine::Scene> mScene;
 		std::vector<std::shared_ptr<Controller>> mScreenControllers;
+
+		BackgroundTask mJobBenchmark;
+		BackgroundTask mTransformBenchmark;
+		BackgroundTask mOcclusionBenchmark;
+		BackgroundTask mTextureCooking;
+		BackgroundTask mCompressionBenchmark;
+		BackgroundTask mAssetPacking;
 	};
 
 }
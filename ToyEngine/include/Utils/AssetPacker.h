@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace ToyEngine {
+	// Packs directories of loose files into an archive for the VirtualFileSystem, run with --pack or from the
+	// UI. The files go directory by directory in the order given and sorted by path within, so the ones
+	// loaded first at startup should be listed first.
+	class AssetPacker
+	{
+	public:
+		// Shaders, then Resources, then the cooked models.
+		static const std::vector<std::string>& getDefaultDirectories();
+
+		// Compressed unless they are read in place, like cooked models and textures.
+		static bool pack(const std::vector<std::string>& directories, const std::string& archivePath, bool compress = true);
+
+		// Where to pack to while archivePath is mounted, a mapped file cannot be replaced on Windows.
+		static std::string getPendingPath(const std::string& archivePath);
+		// Replaces archivePath with its pending archive, if there is one. Call before mounting it.
+		static void installPending(const std::string& archivePath);
+	};
+}
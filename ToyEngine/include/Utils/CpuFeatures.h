@@ -0,0 +1,23 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TOY_X86_SIMD 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+// MSVC accepts AVX2 intrinsics without /arch:AVX2, so only the caller needs to check the CPU.
+#define TOY_TARGET_AVX2
+#else
+#define TOY_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#else
+#define TOY_X86_SIMD 0
+#endif
+
+namespace ToyEngine {
+	class CpuFeatures
+	{
+	public:
+		// AVX2 and FMA, with the OS saving the YMM registers. Detected once.
+		static bool hasAVX2();
+	};
+}
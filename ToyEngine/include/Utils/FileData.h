@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ToyEngine {
+	// The bytes of a file read through the VirtualFileSystem. They stay valid while owner is held.
+	struct FileData {
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+		// what data points into: a mapped loose file, a mapped archive or a decompressed copy. Null when the
+		// file was not found.
+		std::shared_ptr<const void> owner;
+
+		bool isValid() const {
+			return owner != nullptr;
+		}
+
+		std::string toString() const {
+			return size > 0 ? std::string(reinterpret_cast<const char*>(data), size) : std::string();
+		}
+	};
+
+	// Enough to tell whether a file changed without reading it.
+	struct FileStatus {
+		bool exists = false;
+		uint64_t size = 0;
+		// file_time_type ticks, for packed files those of the file that was packed
+		int64_t modifiedTime = 0;
+	};
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+
+namespace ToyEngine {
+	// Microbenchmarks of the job system, with their results logged. Every measurement uses its own
+	// JobSystem, so they can run as a job of the engine's, but they take a few seconds.
+	class JobBenchmark
+	{
+	public:
+		// The results, one per line.
+		static std::string run();
+
+	private:
+		// Time to spawn, run and wait for one empty job, with every thread count.
+		static void measureSpawnOverhead(std::string& summary);
+		// parallelFor and parallelSort from 1 to 64 threads, against 1 thread.
+		static void measureScaling(std::string& summary);
+	};
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Utils/WorkStealingQueue.h>
+
+namespace ToyEngine {
+	class JobCounter;
+
+	struct Job {
+		std::function<void()> function;
+		// a string literal, for tracing
+		const char* name;
+		JobCounter* counter;
+	};
+
+	// Number of unfinished jobs spawned with it. Jobs spawned after a counter only start once it reaches
+	// zero. A counter must outlive its jobs, so it is only destroyed after JobSystem::wait returned.
+	class JobCounter
+	{
+	public:
+		bool isDone() const {
+			return mCount.load(std::memory_order_acquire) == 0;
+		}
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<uint32_t> mCount{ 0 };
+		mutable std::mutex mMutex;
+		std::vector<Job*> mWaiting;
+	};
+
+	// A finished job, in milliseconds since the job system started.
+	struct JobTrace {
+		const char* name;
+		// 0 for threads outside the job system, workers count from 1
+		uint32_t thread;
+		float start;
+		float end;
+	};
+
+	// Worker threads with a work stealing deque each. Jobs spawned by a worker go to its own deque, jobs
+	// spawned by any other thread go to a shared queue. Idle workers steal from the others, and workers that
+	// wait for a counter run jobs in the meantime, so jobs may wait for other jobs without blocking a thread.
+	// Other threads that wait only run the counter's own jobs from the shared queue, so that a frame never
+	// picks up a long job. Work that touches the GL context goes through the main thread queue instead.
+	class JobSystem
+	{
+	public:
+		// Sorts with less elements per thread are not split.
+		static constexpr size_t MIN_SORT_RUN = 4096;
+
+		// One worker less than the hardware has threads, since the main thread works while it waits.
+		static JobSystem& getInstance();
+
+		// Workers, not counting the threads that spawn and wait.
+		explicit JobSystem(size_t threadCount);
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		void spawn(const char* name, std::function<void()> function, JobCounter* counter = nullptr);
+		// Spawn once dependency is done.
+		void spawnAfter(JobCounter& dependency, const char* name, std::function<void()> function, JobCounter* counter = nullptr);
+
+		// Run jobs until the counter is done. Outside the workers only the counter's jobs still in the shared
+		// queue are run, and the thread yields otherwise.
+		void wait(const JobCounter& counter);
+
+		// Calls body(begin, end) for ranges of at most grain indices covering [0, count) and returns when all
+		// of them finished. The calling thread takes ranges as well.
+		void parallelFor(const char* name, size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body);
+
+		// Sorts one run per thread, then merges them pairwise. Not stable.
+		template<typename Iterator, typename Compare>
+		void parallelSort(Iterator begin, Iterator end, Compare compare);
+
+		// Queue work for the thread owning the GL context. Any thread may call this.
+		void runOnMainThread(std::function<void()> function);
+		// Called by the main thread once per frame to run what was queued for it.
+		void processMainThreadJobs();
+
+		size_t getThreadCount() const {
+			return mThreads.size();
+		}
+
+		void setTracing(bool enabled) {
+			mTracing = enabled;
+		}
+
+		bool isTracing() const {
+			return mTracing;
+		}
+
+		// Jobs that finished since the last call while tracing was on.
+		std::vector<JobTrace> collectTraces();
+
+	private:
+		struct TraceBuffer {
+			std::mutex mutex;
+			std::vector<JobTrace> traces;
+		};
+
+		void workerLoop(size_t worker);
+		void enqueue(Job* job);
+		// Own deque first, then the shared queue, then the other deques.
+		Job* findJob(size_t worker);
+		// A job of the counter from the shared queue.
+		Job* findJobOf(const JobCounter& counter);
+		void execute(Job* job, size_t worker);
+		// Count a job of the counter as done and release the jobs waiting for it.
+		void finish(JobCounter& counter);
+		// The deque of the calling thread, or getThreadCount() outside the job system.
+		size_t getCurrentWorker() const;
+
+		std::vector<std::unique_ptr<WorkStealingQueue>> mQueues;
+		std::vector<std::thread> mThreads;
+
+		std::mutex mSharedMutex;
+		std::deque<Job*> mShared;
+
+		// Jobs queued and not yet taken. It may briefly go below zero, since jobs are counted after they were pushed.
+		std::atomic<int64_t> mQueuedJobs{ 0 };
+		std::atomic<int> mSleeping{ 0 };
+		std::mutex mSleepMutex;
+		std::condition_variable mWake;
+		std::atomic<bool> mStop{ false };
+
+		std::mutex mMainThreadMutex;
+		std::vector<std::function<void()>> mMainThreadJobs;
+		std::vector<std::function<void()>> mRunningMainThreadJobs;
+
+		std::atomic<bool> mTracing{ false };
+		// one per worker, then one for every other thread
+		std::vector<std::unique_ptr<TraceBuffer>> mTraces;
+		std::chrono::steady_clock::time_point mEpoch;
+	};
+
+	template<typename Iterator, typename Compare>
+	void JobSystem::parallelSort(Iterator begin, Iterator end, Compare compare)
+	{
+		const size_t count = static_cast<size_t>(std::distance(begin, end));
+		const size_t maxRuns = std::min(getThreadCount() + 1, count / MIN_SORT_RUN);
+		if (maxRuns <= 1) {
+			std::sort(begin, end, compare);
+			return;
+		}
+
+		// A power of two, so that the runs merge pairwise.
+		size_t runCount = 1;
+		while (runCount * 2 <= maxRuns) {
+			runCount *= 2;
+		}
+		const size_t runSize = (count + runCount - 1) / runCount;
+		auto runBegin = [begin, count, runSize](size_t run) {
+			return std::next(begin, static_cast<std::ptrdiff_t>(std::min(run * runSize, count)));
+		};
+
+		parallelFor("Sort runs", runCount, 1, [&](size_t first, size_t last) {
+			for (size_t run = first; run < last; run++) {
+				std::sort(runBegin(run), runBegin(run + 1), compare);
+			}
+		});
+		for (size_t width = 1; width < runCount; width *= 2) {
+			parallelFor("Merge runs", runCount / (width * 2), 1, [&](size_t first, size_t last) {
+				for (size_t pair = first; pair < last; pair++) {
+					const size_t run = pair * width * 2;
+					std::inplace_merge(runBegin(run), runBegin(run + width), runBegin(run + width * 2), compare);
+				}
+			});
+		}
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ToyEngine {
+	// The LZ4 block format, without the frame around it, so the sizes have to be stored by the caller.
+	// Compression is greedy with a single hash table, decompression is bounds checked.
+	class Lz4
+	{
+	public:
+		static size_t getMaxCompressedSize(size_t size) {
+			return size + size / 255 + 16;
+		}
+
+		static std::vector<uint8_t> compress(const uint8_t* data, size_t size);
+		// False unless source is a valid block of exactly size bytes once decompressed.
+		static bool decompress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t size);
+	};
+}
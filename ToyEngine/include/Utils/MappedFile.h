@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ToyEngine {
+	// A whole file mapped read only. The pages come straight from the OS file cache and are only read
+	// from disk once touched. Shared, so that data pointing into the mapping can keep it alive.
+	class MappedFile
+	{
+	public:
+		// Null when the file cannot be opened or is empty. With sequential, the OS is told that the file is
+		// read front to back, so that it reads ahead further.
+		static std::shared_ptr<MappedFile> open(const std::string& path, bool sequential = false);
+
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const uint8_t* getData() const {
+			return mData;
+		}
+
+		size_t getSize() const {
+			return mSize;
+		}
+
+	private:
+		MappedFile() = default;
+
+		const uint8_t* mData = nullptr;
+		size_t mSize = 0;
+#ifdef _WIN32
+		void* mFile = nullptr;
+		void* mMapping = nullptr;
+#endif
+	};
+}
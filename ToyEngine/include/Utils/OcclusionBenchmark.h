@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+
+namespace ToyEngine {
+	// Cull times of an OcclusionCuller with 10000 occludees behind a few dozen buildings, with the results
+	// logged. Needs no GL context and uses the engine's job system, so it can run as one of its jobs.
+	class OcclusionBenchmark
+	{
+	public:
+		// The results, one per line.
+		static std::string run();
+	};
+}
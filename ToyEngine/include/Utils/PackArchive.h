@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <Utils/FileData.h>
+#include <Utils/MappedFile.h>
+
+namespace ToyEngine {
+	// A read only archive of many files in one, mapped as a whole. A header and the index come first, the
+	// entries sorted by the hash of their path so that a lookup is a binary search, then the path strings
+	// and the file data, every entry 64 byte aligned. Entries are stored either as they are, and then read
+	// in place from the mapping, or LZ4 compressed.
+	class PackArchive
+	{
+	public:
+		static constexpr uint32_t VERSION = 2;
+		static constexpr size_t ALIGNMENT = 64;
+
+		// A file to pack. path is its name in the archive, as VirtualFileSystem::normalize returns it.
+		struct Source {
+			std::string path;
+			std::string diskPath;
+			bool compress = false;
+		};
+
+		// What write did.
+		struct Statistics {
+			size_t entryCount = 0;
+			size_t compressedCount = 0;
+			uint64_t fileBytes = 0;
+			uint64_t archiveBytes = 0;
+		};
+
+		// Null when it is not a valid archive.
+		static std::shared_ptr<PackArchive> open(const std::string& archivePath);
+
+		// The data goes in the order of sources, which should be the order the files are loaded in, so that
+		// startup reads the archive front to back. Compressed entries are only kept when they are at least an
+		// eighth smaller. Goes through a temporary file, false when a source cannot be read or a path repeats.
+		static bool write(const std::string& archivePath, const std::vector<Source>& sources, Statistics* statistics = nullptr);
+
+		static uint64_t hashPath(const std::string& path);
+
+		bool contains(const std::string& path) const;
+		// With the modification time the file had when it was packed.
+		FileStatus getStatus(const std::string& path) const;
+		// Invalid when the path is not in the archive or its data is damaged.
+		FileData read(const std::string& path) const;
+
+		size_t getEntryCount() const {
+			return mEntryCount;
+		}
+
+	private:
+		struct Entry;
+
+		PackArchive() = default;
+
+		const Entry* find(const std::string& path) const;
+
+		std::shared_ptr<MappedFile> mFile;
+		const Entry* mEntries = nullptr;
+		size_t mEntryCount = 0;
+		const char* mStrings = nullptr;
+		size_t mStringsSize = 0;
+	};
+}
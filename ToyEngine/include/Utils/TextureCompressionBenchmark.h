@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <Resource/BcEncoder.h>
+
+namespace ToyEngine {
+	// Throughput of the block compression encoder in megapixels per second, with the PSNR of the result, for
+	// every format and quality. Runs on a generated image with its own job systems, so it can run as a job
+	// of the engine's, and takes a few seconds.
+	class TextureCompressionBenchmark
+	{
+	public:
+		// The results, one per line.
+		static std::string run();
+
+	private:
+		// One thread against all of them.
+		static void measureFormat(const std::vector<uint8_t>& rgba, BcFormat format, BcQuality quality, std::string& summary);
+	};
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+
+namespace ToyEngine {
+	// Update times of a TransformSystem with a million transforms, with the results logged. Builds its own
+	// registry and uses the engine's job system, so it can run as one of its jobs, and takes a few seconds.
+	class TransformBenchmark
+	{
+	public:
+		// The results, one per line.
+		static std::string run();
+	};
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <Utils/FileData.h>
+#include <Utils/PackArchive.h>
+
+namespace ToyEngine {
+	// Where assets are read from: the mounted pack archives, newest first, then loose files on disk unless
+	// those are turned off as in a shipped build. Without an archive, as during development, everything is
+	// read from loose files. With both, a loose file changed after it was packed wins over the packed one. Paths are relative to the working directory, like the loose files always were,
+	// with either separator. Mount before loading anything, reading is safe from any thread.
+	class VirtualFileSystem
+	{
+	public:
+		static constexpr const char* DEFAULT_ARCHIVE = "Assets.pak";
+
+		static VirtualFileSystem& getInstance();
+
+		// False when the archive does not exist or is not valid.
+		bool mount(const std::string& archivePath);
+
+		// Invalid when the file is neither packed nor on disk.
+		FileData read(const std::string& path) const;
+		bool exists(const std::string& path) const;
+		// Of the file read would return.
+		FileStatus getStatus(const std::string& path) const;
+		// In a mounted archive and read from there.
+		bool isPacked(const std::string& path) const;
+
+		bool isLooseFilesEnabled() const {
+			return mLooseFilesEnabled;
+		}
+
+		void setLooseFilesEnabled(bool enabled) {
+			mLooseFilesEnabled = enabled;
+		}
+
+		// The name of a file in an archive: relative to the working directory when below it, with forward
+		// slashes and without "." and "..".
+		static std::string normalize(const std::string& path);
+
+	private:
+		// archive is null when the file is not read from an archive.
+		struct PackedFile {
+			const PackArchive* archive = nullptr;
+			std::string name;
+			FileStatus status;
+		};
+
+		VirtualFileSystem() = default;
+
+		PackedFile findPacked(const std::string& path) const;
+
+		static FileStatus getLooseStatus(const std::string& path);
+		static FileData readLooseFile(const std::string& path);
+
+		std::vector<std::shared_ptr<PackArchive>> mArchives;
+		bool mLooseFilesEnabled = true;
+	};
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ToyEngine {
+	struct Job;
+
+	// Chase-Lev deque of a fixed size. Only the owning thread pushes and pops, at the bottom, so its most
+	// recent jobs stay hot in its cache. Other threads steal the oldest jobs from the top.
+	class WorkStealingQueue
+	{
+	public:
+		static constexpr size_t CAPACITY = 4096;
+
+		// Returns false when the queue is full.
+		bool push(Job* job)
+		{
+			const int64_t bottom = mBottom.load(std::memory_order_relaxed);
+			const int64_t top = mTop.load(std::memory_order_acquire);
+			if (bottom - top >= static_cast<int64_t>(CAPACITY)) {
+				return false;
+			}
+			mJobs[bottom & MASK].store(job, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			mBottom.store(bottom + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		Job* pop()
+		{
+			const int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+			mBottom.store(bottom, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t top = mTop.load(std::memory_order_relaxed);
+			if (top > bottom) {
+				mBottom.store(bottom + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			Job* job = mJobs[bottom & MASK].load(std::memory_order_relaxed);
+			if (top == bottom) {
+				// The last job, which a thief may be taking at the same time.
+				if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					job = nullptr;
+				}
+				mBottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		Job* steal()
+		{
+			int64_t top = mTop.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t bottom = mBottom.load(std::memory_order_acquire);
+			if (top >= bottom) {
+				return nullptr;
+			}
+			Job* job = mJobs[top & MASK].load(std::memory_order_relaxed);
+			if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				return nullptr;
+			}
+			return job;
+		}
+
+	private:
+		static constexpr int64_t MASK = CAPACITY - 1;
+		static_assert((CAPACITY & (CAPACITY - 1)) == 0, "The capacity must be a power of two.");
+
+		// On separate cache lines, since the owner writes one and thieves the other.
+		alignas(64) std::atomic<int64_t> mTop{ 0 };
+		alignas(64) std::atomic<int64_t> mBottom{ 0 };
+		std::array<std::atomic<Job*>, CAPACITY> mJobs;
+	};
+}
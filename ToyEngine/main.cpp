@@ -11,6 +11,9 @@
 #include <sstream>
 #include "Resource/StbImageLoader.h"
 #include "Resource/Texture.h"
+#include "Renderer/GpuTransferQueue.h"
+#include "Utils/AssetPacker.h"
+#include "Utils/VirtualFileSystem.h"
 
 using std::unique_ptr;
 using ToyEngine::WindowPtr;
@@ -28,8 +31,16 @@ bool isOver = false;
 
 std::shared_ptr<ToyEngine::MyEngine> engine_globalPtr;
 
-int main(char* argc, char** argv)
+int main(int argc, char** argv)
 {
+    // ToyEngine --pack [archive] builds the asset archive from the loose files and exits.
+    if (argc > 1 && std::string(argv[1]) == "--pack") {
+        const std::string archivePath = argc > 2 ? argv[2] : ToyEngine::VirtualFileSystem::DEFAULT_ARCHIVE;
+        return ToyEngine::AssetPacker::pack(ToyEngine::AssetPacker::getDefaultDirectories(), archivePath) ? 0 : 1;
+    }
+    // ToyEngine --loose-files keeps reading loose files next to the archive in a release build.
+    const bool looseFiles = argc > 1 && std::string(argv[1]) == "--loose-files";
+
     // glfw: initialize and configure
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -45,11 +56,12 @@ int main(char* argc, char** argv)
 
     auto engine = std::make_shared<ToyEngine::MyEngine>(window);
     engine_globalPtr = engine;
-    engine->init();
+    engine->init(looseFiles);
   
     while (!glfwWindowShouldClose(window.get())) {
         engine->tick();
     }
+    ToyEngine::GpuTransferQueue::getInstance().shutdown();
     glfwTerminate();
     return 0;
 }
@@ -96,6 +108,6 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    ToyEngine::RenderSystem::instance.onFramebufferResize(width, height);
 
 }
\ No newline at end of file